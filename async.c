@@ -0,0 +1,837 @@
+#include "async.h"
+#include "netlink.h"
+#include "inventory.h"
+
+/* A netlink request is processed by the kernel within sendto(), so the
+ * win here is to never wait for an answer : requests of all the pending
+ * operations are stacked and sent with a single sendto() per flush, the
+ * answers are read when the socket is readable and dispatched on their
+ * sequence number. Only one dump can run on a socket at a time, dumps
+ * are queued and chained as they complete.
+ */
+
+#include <linux/if_link.h>
+#include <linux/fib_rules.h>
+#include <netinet/ether.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#define ASYNC_SENDLEN   (32*1024)
+
+enum
+{
+    OP_INVENTORY,
+    OP_QUERY,
+    OP_LINK,
+    OP_ADDR,
+    OP_GATEWAY,
+};
+
+enum
+{
+    STEP_GETLINK,
+    STEP_GETMASTER,
+    STEP_DUMP_LINK,
+    STEP_DUMP_ADDR,
+    STEP_DUMP_ROUTE,
+    STEP_DUMP_RULE,
+    STEP_APPLY,
+};
+
+typedef struct async_op
+{
+    int                     type;
+    int                     step;
+    char                    name[IFNAMSIZ];
+    int                     ifindex;
+    int                     up;
+    int                     prefixlen;
+    struct in_addr          addr;
+    struct ether_addr       mac;
+    inventory_t             inv;
+    async_info_callback_t   info;
+    async_done_callback_t   done;
+    void                    *user;
+    struct async_op         *next;
+} async_op_t;
+
+typedef struct async_slot
+{
+    uint32_t                seq;
+    async_op_t              *op;
+} async_slot_t;
+
+struct netconfig_async
+{
+    netlink_t               nl;
+    netlink_req_t           out;
+    async_slot_t            *slots;
+    size_t                  nbSlots;
+    size_t                  pending;
+    async_op_t              *dumpHead;
+    async_op_t              *dumpTail;
+    async_op_t              *dumping;
+};
+
+netconfig_async_t *asyncOpen(void)
+{
+    netconfig_async_t   *async;
+
+    if ( (async = calloc(1, sizeof(*async))) == NULL )
+        return NULL;
+
+    if ( netlinkOpen(&async->nl, NETLINK_ROUTE, 0) )
+    {
+        free(async);
+        return NULL;
+    }
+
+    if ( fcntl(async->nl.fd, F_SETFL, O_NONBLOCK) < 0 )
+    {
+        perror("fcntl");
+        asyncClose(async);
+        return NULL;
+    }
+
+    /* Let the kernel filter the dumps on an interface
+     */
+    netlinkStrict(&async->nl);
+
+    async->nbSlots = 64;
+    if ( (async->slots = calloc(async->nbSlots, sizeof(async_slot_t))) == NULL )
+    {
+        asyncClose(async);
+        return NULL;
+    }
+
+    return async;
+}
+
+static void freeOp(async_op_t *op)
+{
+    inventoryFree(&op->inv);
+    free(op);
+}
+
+static void finishOp(netconfig_async_t *async, async_op_t *op, int error)
+{
+    async->pending--;
+
+    if ( error && op->info )
+        op->info(error, NULL, op->user);
+    else if ( op->done )
+        op->done(error, op->user);
+
+    freeOp(op);
+}
+
+void asyncClose(netconfig_async_t *async)
+{
+    async_op_t  *op;
+    size_t      i;
+
+    if ( async == NULL )
+        return;
+
+    /* Operations still running are dropped silently
+     */
+    for ( i = 0 ; async->slots && i < async->nbSlots ; i++ )
+    {
+        if ( async->slots[i].op && async->slots[i].op != async->dumping )
+            freeOp(async->slots[i].op);
+    }
+
+    if ( async->dumping )
+        freeOp(async->dumping);
+
+    while ( (op = async->dumpHead) )
+    {
+        async->dumpHead = op->next;
+        freeOp(op);
+    }
+
+    free(async->slots);
+    netlinkReqFree(&async->out);
+    netlinkClose(&async->nl);
+    free(async);
+}
+
+int asyncFd(const netconfig_async_t *async)
+{
+    return async ? async->nl.fd : -1;
+}
+
+size_t asyncPending(const netconfig_async_t *async)
+{
+    return async ? async->pending : 0;
+}
+
+static int setSlot(netconfig_async_t *async, uint32_t seq, async_op_t *op)
+{
+    async_slot_t    *slots,
+                    *slot;
+    size_t          i,
+                    nb;
+
+    /* Sequence numbers are consecutive, a collision means that the ring
+     * is too small for the number of requests in flight
+     */
+    while ( async->slots[seq & (async->nbSlots - 1)].op )
+    {
+        nb = async->nbSlots * 2;
+        if ( (slots = calloc(nb, sizeof(*slots))) == NULL )
+            return -1;
+
+        for ( i = 0 ; i < async->nbSlots ; i++ )
+        {
+            if ( async->slots[i].op )
+                slots[async->slots[i].seq & (nb - 1)] = async->slots[i];
+        }
+
+        free(async->slots);
+        async->slots = slots;
+        async->nbSlots = nb;
+    }
+
+    slot = &async->slots[seq & (async->nbSlots - 1)];
+    slot->seq = seq;
+    slot->op = op;
+
+    return 0;
+}
+
+static async_slot_t *getSlot(netconfig_async_t *async, uint32_t seq)
+{
+    async_slot_t    *slot = &async->slots[seq & (async->nbSlots - 1)];
+
+    return slot->op && slot->seq == seq ? slot : NULL;
+}
+
+/* Stack a message for the next flush, the family header is returned
+ */
+static void *queueMessage(netconfig_async_t *async, async_op_t *op,
+        uint16_t type, uint16_t flags, size_t hdrlen)
+{
+    struct nlmsghdr *nlh;
+    void            *hdr;
+
+    if ( (hdr = netlinkReqAdd(&async->out, type, flags, hdrlen)) == NULL )
+        return NULL;
+
+    nlh = (struct nlmsghdr *) (async->out.buff + async->out.last);
+    nlh->nlmsg_seq = async->nl.seq++;
+
+    if ( setSlot(async, nlh->nlmsg_seq, op) )
+        return NULL;
+
+    return hdr;
+}
+
+static int queueGetLink(netconfig_async_t *async, async_op_t *op)
+{
+    struct ifinfomsg    *ifi;
+
+    op->step = STEP_GETLINK;
+    if ( (ifi = queueMessage(async, op, RTM_GETLINK, 0, sizeof(*ifi))) == NULL )
+        return -1;
+
+    ifi->ifi_family = AF_UNSPEC;
+
+    /* The attributes last, they may move the buffer
+     */
+    return netlinkReqAttrStr(&async->out, IFLA_IFNAME, op->name) ||
+        netlinkReqAttrU32(&async->out, IFLA_EXT_MASK, RTEXT_FILTER_SKIP_STATS) ?
+        -1 : 0;
+}
+
+/* The VRF master of a queried interface gives the table of its gateway
+ */
+static int queueGetMaster(netconfig_async_t *async, async_op_t *op)
+{
+    struct ifinfomsg    *ifi;
+
+    op->step = STEP_GETMASTER;
+    if ( (ifi = queueMessage(async, op, RTM_GETLINK, 0, sizeof(*ifi))) == NULL )
+        return -1;
+
+    ifi->ifi_family = AF_UNSPEC;
+    ifi->ifi_index = op->inv.links[0].master;
+
+    return netlinkReqAttrU32(&async->out, IFLA_EXT_MASK, RTEXT_FILTER_SKIP_STATS);
+}
+
+static void queueDump(netconfig_async_t *async, async_op_t *op, int step)
+{
+    op->step = step;
+    op->next = NULL;
+
+    if ( async->dumpTail )
+        async->dumpTail->next = op;
+    else
+        async->dumpHead = op;
+
+    async->dumpTail = op;
+}
+
+static int sendMessages(netconfig_async_t *async, const char *buff, size_t len)
+{
+    struct sockaddr_nl  kernel = { .nl_family = AF_NETLINK };
+
+    if ( sendto(async->nl.fd, buff, len, 0,
+                (struct sockaddr *) &kernel, sizeof(kernel)) < 0 )
+    {
+        perror("sendto");
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Dumps of a single interface query are filtered by the kernel
+ */
+static int startDump(netconfig_async_t *async)
+{
+    netlink_req_t       req = { 0 };
+    struct nlmsghdr     *nlh;
+    struct ifinfomsg    *ifi;
+    struct ifaddrmsg    *ifa;
+    struct rtmsg        *rtm;
+    struct fib_rule_hdr *frh;
+    async_op_t          *op;
+    int                 ret = -1;
+
+    if ( async->dumping || (op = async->dumpHead) == NULL )
+        return 0;
+
+    if ( (async->dumpHead = op->next) == NULL )
+        async->dumpTail = NULL;
+
+    switch ( op->step )
+    {
+        case STEP_DUMP_LINK:
+        if ( (ifi = netlinkReqAdd(&req, RTM_GETLINK, NLM_F_DUMP, sizeof(*ifi))) == NULL ||
+                netlinkReqAttrU32(&req, IFLA_EXT_MASK, RTEXT_FILTER_SKIP_STATS) )
+            goto out;
+        break;
+
+        case STEP_DUMP_ADDR:
+        if ( (ifa = netlinkReqAdd(&req, RTM_GETADDR, NLM_F_DUMP, sizeof(*ifa))) == NULL )
+            goto out;
+        ifa->ifa_family = AF_INET;
+        ifa->ifa_index = op->ifindex;
+        break;
+
+        case STEP_DUMP_ROUTE:
+        if ( (rtm = netlinkReqAdd(&req, RTM_GETROUTE, NLM_F_DUMP, sizeof(*rtm))) == NULL )
+            goto out;
+        rtm->rtm_family = AF_INET;
+        if ( op->ifindex && netlinkReqAttrU32(&req, RTA_OIF, op->ifindex) )
+            goto out;
+        break;
+
+        default:
+        if ( (frh = netlinkReqAdd(&req, RTM_GETRULE, NLM_F_DUMP, sizeof(*frh))) == NULL )
+            goto out;
+        frh->family = AF_INET;
+        break;
+    }
+
+    nlh = (struct nlmsghdr *) req.buff;
+    nlh->nlmsg_seq = async->nl.seq++;
+
+    if ( setSlot(async, nlh->nlmsg_seq, op) )
+        goto out;
+
+    if ( sendMessages(async, req.buff, req.len) )
+    {
+        getSlot(async, nlh->nlmsg_seq)->op = NULL;
+        goto out;
+    }
+
+    async->dumping = op;
+    ret = 0;
+
+out:
+    netlinkReqFree(&req);
+
+    if ( ret )
+        finishOp(async, op, -EIO);
+
+    return ret;
+}
+
+/* Send everything queued since the last flush
+ */
+int asyncFlush(netconfig_async_t *async)
+{
+    const struct nlmsghdr   *nlh;
+    size_t                  start,
+                            off;
+    int                     ret = 0;
+
+    if ( async == NULL )
+        return -1;
+
+    for ( start = off = 0 ; ret == 0 && start < async->out.len ; start = off )
+    {
+        while ( off < async->out.len && (off == start || off - start < ASYNC_SENDLEN) )
+        {
+            nlh = (const struct nlmsghdr *) (async->out.buff + off);
+            off += NLMSG_ALIGN(nlh->nlmsg_len);
+        }
+
+        ret = sendMessages(async, async->out.buff + start, off - start);
+    }
+
+    netlinkReqReset(&async->out);
+
+    return startDump(async) || ret ? -1 : 0;
+}
+
+static void completeInventory(netconfig_async_t *async, async_op_t *op)
+{
+    interface_info_t    info;
+    inventory_link_t    *link = NULL;
+    char                ns[INET6_ADDRSTRLEN] = "";
+    size_t              i;
+
+    /* A query may hold the VRF master of the interface too
+     */
+    if ( op->type == OP_QUERY &&
+            (link = inventoryFind(&op->inv, op->ifindex)) == NULL )
+    {
+        finishOp(async, op, -ENODEV);
+        return;
+    }
+
+    inventoryResolve(&op->inv);
+    getDomainNameServer(ns, sizeof(ns));
+
+    for ( i = 0 ; i < op->inv.nb ; i++ )
+    {
+        if ( link && &op->inv.links[i] != link )
+            continue;
+
+        inventoryInfo(&op->inv.links[i], ns, &info);
+        op->info(0, &info, op->user);
+    }
+
+    /* A full inventory ends with a NULL record
+     */
+    if ( op->type == OP_INVENTORY )
+        op->info(0, NULL, op->user);
+
+    op->info = NULL;
+    finishOp(async, op, 0);
+}
+
+static int queueApply(netconfig_async_t *async, async_op_t *op)
+{
+    struct ifaddrmsg    *ifa;
+    struct rtmsg        *rtm;
+    struct in_addr      bcast;
+
+    op->step = STEP_APPLY;
+
+    if ( op->type == OP_ADDR )
+    {
+        if ( (ifa = queueMessage(async, op, RTM_NEWADDR,
+                        NLM_F_CREATE | NLM_F_REPLACE, sizeof(*ifa))) == NULL )
+            return -1;
+
+        ifa->ifa_family = AF_INET;
+        ifa->ifa_prefixlen = op->prefixlen;
+        ifa->ifa_index = op->ifindex;
+
+        bcast.s_addr = op->addr.s_addr |
+            (op->prefixlen ? htonl(~(~0u << (32 - op->prefixlen))) : INADDR_NONE);
+
+        if ( netlinkReqAttr(&async->out, IFA_LOCAL, &op->addr, sizeof(op->addr)) ||
+                netlinkReqAttr(&async->out, IFA_ADDRESS, &op->addr, sizeof(op->addr)) ||
+                (op->prefixlen < 31 &&
+                 netlinkReqAttr(&async->out, IFA_BROADCAST, &bcast, sizeof(bcast))) )
+            return -1;
+
+        return 0;
+    }
+
+    if ( (rtm = queueMessage(async, op, RTM_NEWROUTE,
+                    NLM_F_CREATE | NLM_F_EXCL, sizeof(*rtm))) == NULL )
+        return -1;
+
+    rtm->rtm_family = AF_INET;
+    rtm->rtm_table = RT_TABLE_MAIN;
+    rtm->rtm_protocol = RTPROT_BOOT;
+    rtm->rtm_scope = RT_SCOPE_UNIVERSE;
+    rtm->rtm_type = RTN_UNICAST;
+
+    if ( netlinkReqAttr(&async->out, RTA_GATEWAY, &op->addr, sizeof(op->addr)) ||
+            netlinkReqAttrU32(&async->out, RTA_OIF, op->ifindex) )
+        return -1;
+
+    return 0;
+}
+
+/* Move an operation to its next step once an answer is complete
+ */
+static void advanceOp(netconfig_async_t *async, async_op_t *op)
+{
+    int ret = 0;
+
+    switch ( op->step )
+    {
+        case STEP_GETLINK:
+        if ( op->ifindex == 0 )
+        {
+            finishOp(async, op, -ENODEV);
+            return;
+        }
+
+        if ( op->type == OP_QUERY && op->inv.nb && op->inv.links[0].master )
+            ret = queueGetMaster(async, op);
+        else if ( op->type == OP_QUERY )
+            queueDump(async, op, STEP_DUMP_ADDR);
+        else
+            ret = queueApply(async, op);
+        break;
+
+        case STEP_GETMASTER:
+        inventorySort(&op->inv);
+        queueDump(async, op, STEP_DUMP_ADDR);
+        break;
+
+        case STEP_DUMP_LINK:
+        inventorySort(&op->inv);
+        queueDump(async, op, STEP_DUMP_ADDR);
+        break;
+
+        case STEP_DUMP_ADDR:
+        queueDump(async, op, STEP_DUMP_ROUTE);
+        break;
+
+        case STEP_DUMP_ROUTE:
+        queueDump(async, op, STEP_DUMP_RULE);
+        break;
+
+        case STEP_DUMP_RULE:
+        completeInventory(async, op);
+        return;
+
+        default:
+        finishOp(async, op, 0);
+        return;
+    }
+
+    if ( ret )
+        finishOp(async, op, -ENOMEM);
+}
+
+static void failAll(netconfig_async_t *async, int error)
+{
+    async_op_t  *op;
+    size_t      i;
+
+    for ( i = 0 ; i < async->nbSlots ; i++ )
+    {
+        if ( (op = async->slots[i].op) == NULL )
+            continue;
+
+        async->slots[i].op = NULL;
+        if ( op == async->dumping )
+            async->dumping = NULL;
+
+        finishOp(async, op, error);
+    }
+}
+
+static int asyncReply(const struct nlmsghdr *nlh, void *user)
+{
+    netconfig_async_t       *async = user;
+    async_slot_t            *slot;
+    async_op_t              *op;
+    const struct ifinfomsg  *ifi;
+    int                     error;
+
+    if ( (slot = getSlot(async, nlh->nlmsg_seq)) == NULL )
+        return 0;
+
+    op = slot->op;
+
+    switch ( nlh->nlmsg_type )
+    {
+        case NLMSG_ERROR:
+        case NLMSG_DONE:
+        slot->op = NULL;
+        if ( op == async->dumping )
+            async->dumping = NULL;
+
+        error = *(const int *) NLMSG_DATA(nlh);
+        if ( error )
+            finishOp(async, op, error < 0 ? error : -error);
+        else
+            advanceOp(async, op);
+        break;
+
+        case RTM_NEWLINK:
+        if ( op->step == STEP_GETLINK )
+        {
+            ifi = NLMSG_DATA(nlh);
+            op->ifindex = ifi->ifi_index;
+        }
+        /* fall through */
+
+        default:
+        if ( op->type == OP_INVENTORY || op->type == OP_QUERY )
+            inventoryParse(&op->inv, nlh);
+        break;
+    }
+
+    return 0;
+}
+
+/* Read and dispatch all the answers available, then send the requests
+ * of the next steps. Returns the number of operations still pending.
+ */
+int asyncProcess(netconfig_async_t *async)
+{
+    int ret;
+
+    if ( async == NULL )
+        return -1;
+
+    while ( (ret = netlinkRecv(&async->nl, &asyncReply, async)) > 0 )
+        ;
+
+    /* Answers were lost, nothing can tell which operations completed
+     */
+    if ( ret < 0 && errno == ENOBUFS )
+        failAll(async, -ENOBUFS);
+    else if ( ret < 0 )
+        return -1;
+
+    if ( asyncFlush(async) )
+        return -1;
+
+    return async->pending;
+}
+
+static async_op_t *newOp(netconfig_async_t *async, int type, const char *ifname)
+{
+    async_op_t  *op;
+
+    if ( async == NULL ||
+            (ifname && strlen(ifname) >= IFNAMSIZ) ||
+            (op = calloc(1, sizeof(*op))) == NULL )
+        return NULL;
+
+    op->type = type;
+    if ( ifname )
+        strcpy(op->name, ifname);
+
+    async->pending++;
+
+    return op;
+}
+
+typedef struct async_mark
+{
+    size_t      len;
+    unsigned    count;
+    uint32_t    seq;
+} async_mark_t;
+
+static async_mark_t markQueue(const netconfig_async_t *async)
+{
+    async_mark_t    mark = { async->out.len, async->out.count, async->nl.seq };
+
+    return mark;
+}
+
+/* A failed submission drops the messages it already queued
+ */
+static int submitOp(netconfig_async_t *async, async_op_t *op,
+        async_mark_t mark, int ret)
+{
+    async_slot_t    *slot;
+
+    if ( ret == 0 )
+        return 0;
+
+    memset(async->out.buff + mark.len, 0, async->out.len - mark.len);
+    async->out.len = async->out.last = mark.len;
+    async->out.count = mark.count;
+
+    for ( ; mark.seq != async->nl.seq ; mark.seq++ )
+    {
+        if ( (slot = getSlot(async, mark.seq)) )
+            slot->op = NULL;
+    }
+
+    async->pending--;
+    freeOp(op);
+
+    return -1;
+}
+
+int asyncGetInterfaces(netconfig_async_t *async, async_info_callback_t cb,
+        void *user)
+{
+    async_op_t  *op;
+
+    if ( cb == NULL || (op = newOp(async, OP_INVENTORY, NULL)) == NULL )
+        return -1;
+
+    op->info = cb;
+    op->user = user;
+    queueDump(async, op, STEP_DUMP_LINK);
+
+    return 0;
+}
+
+int asyncGetInterface(netconfig_async_t *async, const char *ifname,
+        async_info_callback_t cb, void *user)
+{
+    async_op_t      *op;
+    async_mark_t    mark;
+
+    if ( cb == NULL || ifname == NULL ||
+            (op = newOp(async, OP_QUERY, ifname)) == NULL )
+        return -1;
+
+    op->info = cb;
+    op->user = user;
+
+    mark = markQueue(async);
+
+    return submitOp(async, op, mark, queueGetLink(async, op));
+}
+
+static int queueSetLink(netconfig_async_t *async, async_op_t *op)
+{
+    struct ifinfomsg    *ifi;
+
+    op->step = STEP_APPLY;
+    if ( (ifi = queueMessage(async, op, RTM_NEWLINK, 0, sizeof(*ifi))) == NULL )
+        return -1;
+
+    ifi->ifi_family = AF_UNSPEC;
+
+    if ( op->up >= 0 )
+    {
+        ifi->ifi_flags = op->up ? IFF_UP : 0;
+        ifi->ifi_change = IFF_UP;
+    }
+
+    /* The attributes last, they may move the buffer
+     */
+    if ( netlinkReqAttrStr(&async->out, IFLA_IFNAME, op->name) )
+        return -1;
+
+    return op->up >= 0 ? 0 :
+        netlinkReqAttr(&async->out, IFLA_ADDRESS, &op->mac, sizeof(op->mac));
+}
+
+int asyncSetInterfaceUp(netconfig_async_t *async, const char *ifname, int up,
+        async_done_callback_t cb, void *user)
+{
+    async_op_t      *op;
+    async_mark_t    mark;
+
+    if ( ifname == NULL || (op = newOp(async, OP_LINK, ifname)) == NULL )
+        return -1;
+
+    op->up = up ? 1 : 0;
+    op->done = cb;
+    op->user = user;
+
+    mark = markQueue(async);
+
+    return submitOp(async, op, mark, queueSetLink(async, op));
+}
+
+int asyncSetMacAddress(netconfig_async_t *async, const char *ifname,
+        const char *mac, async_done_callback_t cb, void *user)
+{
+    struct ether_addr   eth;
+    async_op_t          *op;
+    async_mark_t        mark;
+
+    if ( ifname == NULL || mac == NULL || ether_aton_r(mac, &eth) == NULL ||
+            (op = newOp(async, OP_LINK, ifname)) == NULL )
+        return -1;
+
+    op->up = -1;
+    op->mac = eth;
+    op->done = cb;
+    op->user = user;
+
+    mark = markQueue(async);
+
+    return submitOp(async, op, mark, queueSetLink(async, op));
+}
+
+/* The mask defaults to a host address
+ */
+int asyncSetIpAddress(netconfig_async_t *async, const char *ifname,
+        const char *ip, const char *mask, async_done_callback_t cb, void *user)
+{
+    struct in_addr  in,
+                    msk;
+    async_op_t      *op;
+    int             prefixlen = 32;
+    async_mark_t    mark;
+
+    if ( ifname == NULL || ip == NULL || inet_aton(ip, &in) == 0 )
+        return -1;
+
+    if ( mask )
+    {
+        if ( inet_aton(mask, &msk) == 0 )
+            return -1;
+
+        /* Only contiguous masks
+         */
+        for ( prefixlen = 0 ; prefixlen < 32 &&
+                (ntohl(msk.s_addr) & (1u << (31 - prefixlen))) ; prefixlen++ )
+            ;
+
+        if ( prefixlen < 32 && (ntohl(msk.s_addr) << prefixlen) )
+            return -1;
+    }
+
+    if ( (op = newOp(async, OP_ADDR, ifname)) == NULL )
+        return -1;
+
+    op->addr = in;
+    op->prefixlen = prefixlen;
+    op->done = cb;
+    op->user = user;
+
+    mark = markQueue(async);
+
+    return submitOp(async, op, mark, queueGetLink(async, op));
+}
+
+int asyncSetIpGateway(netconfig_async_t *async, const char *ifname,
+        const char *gw, async_done_callback_t cb, void *user)
+{
+    struct in_addr  in;
+    async_op_t      *op;
+    async_mark_t    mark;
+
+    if ( ifname == NULL || gw == NULL || inet_aton(gw, &in) == 0 ||
+            (op = newOp(async, OP_GATEWAY, ifname)) == NULL )
+        return -1;
+
+    op->addr = in;
+    op->done = cb;
+    op->user = user;
+
+    mark = markQueue(async);
+
+    return submitOp(async, op, mark, queueGetLink(async, op));
+}
@@ -0,0 +1,70 @@
+#ifndef __ASYNC_H__
+#define __ASYNC_H__
+
+#include "netconfig.h"
+#include "network.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/* Non-blocking flavour of the query and apply API for event loops.
+ * Requests are queued, then sent together by asyncFlush(); asyncFd() is
+ * to be watched for reading and asyncProcess() called when readable, it
+ * runs the callbacks of the completed requests.
+ * Callbacks receive 0 or a negative errno.
+ */
+typedef struct netconfig_async netconfig_async_t;
+
+typedef void (*async_info_callback_t)(int error, const interface_info_t *info,
+        void *user);
+
+typedef void (*async_done_callback_t)(int error, void *user);
+
+NETCONFIG_API
+netconfig_async_t *asyncOpen(void);
+
+NETCONFIG_API
+void asyncClose(netconfig_async_t *async);
+
+NETCONFIG_API
+int asyncFd(const netconfig_async_t *async);
+
+NETCONFIG_API
+size_t asyncPending(const netconfig_async_t *async);
+
+NETCONFIG_API
+int asyncFlush(netconfig_async_t *async);
+
+NETCONFIG_API
+int asyncProcess(netconfig_async_t *async);
+
+NETCONFIG_API
+int asyncGetInterfaces(netconfig_async_t *async, async_info_callback_t cb,
+        void *user);
+
+NETCONFIG_API
+int asyncGetInterface(netconfig_async_t *async, const char *ifname,
+        async_info_callback_t cb, void *user);
+
+NETCONFIG_API
+int asyncSetInterfaceUp(netconfig_async_t *async, const char *ifname, int up,
+        async_done_callback_t cb, void *user);
+
+NETCONFIG_API
+int asyncSetMacAddress(netconfig_async_t *async, const char *ifname,
+        const char *mac, async_done_callback_t cb, void *user);
+
+NETCONFIG_API
+int asyncSetIpAddress(netconfig_async_t *async, const char *ifname,
+        const char *ip, const char *mask, async_done_callback_t cb, void *user);
+
+NETCONFIG_API
+int asyncSetIpGateway(netconfig_async_t *async, const char *ifname,
+        const char *gw, async_done_callback_t cb, void *user);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __ASYNC_H__ */
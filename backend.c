@@ -0,0 +1,105 @@
+#include "kernel.h"
+#include "trace.h"
+
+#include <stdio.h>
+#include <errno.h>
+#include <net/if.h>
+#include <sys/ioctl.h>
+
+static int linuxIoctl(void *ctx, int fd, unsigned long request, void *arg)
+{
+    return ioctl(fd, request, arg);
+}
+
+static FILE *linuxOpen(void *ctx, const char *path, const char *mode)
+{
+    return fopen(path, mode);
+}
+
+static int linuxRename(void *ctx, const char *from, const char *to)
+{
+    return rename(from, to);
+}
+
+static unsigned linuxNameToIndex(void *ctx, const char *ifname)
+{
+    return if_nametoindex(ifname);
+}
+
+static char *linuxIndexToName(void *ctx, unsigned ifindex, char *ifname)
+{
+    return if_indextoname(ifindex, ifname);
+}
+
+static const netconfig_backend_t    linuxBackend =
+{
+    .name = "linux",
+    .ioctl = &linuxIoctl,
+    .transact = NULL,
+    .open = &linuxOpen,
+    .rename = &linuxRename,
+    .nameToIndex = &linuxNameToIndex,
+    .indexToName = &linuxIndexToName,
+};
+
+static const netconfig_backend_t    *backend = &linuxBackend;
+
+void netconfigSetBackend(const netconfig_backend_t *b)
+{
+    backend = b ? b : &linuxBackend;
+}
+
+const netconfig_backend_t *netconfigGetBackend(void)
+{
+    return backend;
+}
+
+/* Every ioctl of the library goes through here, hence the probes
+ */
+int kernelIoctl(int fd, unsigned long request, void *arg)
+{
+    int ret;
+
+    TRACE_PROBE2(ioctl_start, request, arg);
+    ret = backend->ioctl(backend->ctx, fd, request, arg);
+    TRACE_PROBE3(ioctl_done, request, arg, ret);
+
+    return ret;
+}
+
+int kernelSimulated(void)
+{
+    return backend->transact != NULL;
+}
+
+int kernelTransact(const void *msgs, size_t len, backend_reply_t reply,
+        void *user)
+{
+    if ( backend->transact == NULL )
+    {
+        errno = EOPNOTSUPP;
+        return -1;
+    }
+
+    return backend->transact(backend->ctx, msgs, len, reply, user);
+}
+
+FILE *kernelOpen(const char *path, const char *mode)
+{
+    return backend->open(backend->ctx, path, mode);
+}
+
+int kernelRename(const char *from, const char *to)
+{
+    return backend->rename(backend->ctx, from, to);
+}
+
+unsigned kernelNameToIndex(const char *ifname)
+{
+    return backend->nameToIndex(backend->ctx, ifname);
+}
+
+char *kernelIndexToName(unsigned ifindex, char *ifname)
+{
+    return backend->indexToName(backend->ctx, ifindex, ifname);
+}
@@ -0,0 +1,52 @@
+#ifndef __BACKEND_H__
+#define __BACKEND_H__
+
+#include "netconfig.h"
+
+#include <stdio.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+struct nlmsghdr;
+
+typedef int (*backend_reply_t)(const struct nlmsghdr *nlh, void *user);
+
+/* Everything the library asks the kernel goes through a backend : the
+ * netdevice ioctls, the rtnetlink requests, the interface name <-> index
+ * translations and the configuration files.
+ * transact gets a whole batch of rtnetlink messages and hands every
+ * answer to reply, as the kernel would send them back (NLM_F_MULTI
+ * messages, NLMSG_DONE, NLMSG_ERROR ACKs). Left NULL, the requests go to
+ * a real netlink socket.
+ */
+typedef struct netconfig_backend
+{
+    const char  *name;
+    void        *ctx;
+
+    int         (*ioctl)(void *ctx, int fd, unsigned long request, void *arg);
+    int         (*transact)(void *ctx, const void *msgs, size_t len,
+                        backend_reply_t reply, void *user);
+    FILE        *(*open)(void *ctx, const char *path, const char *mode);
+    int         (*rename)(void *ctx, const char *from, const char *to);
+    unsigned    (*nameToIndex)(void *ctx, const char *ifname);
+    char        *(*indexToName)(void *ctx, unsigned ifindex, char *ifname);
+} netconfig_backend_t;
+
+/* The backend is global, it must be set before networkInit() and the
+ * sockets opened by the library. NULL restores the Linux one.
+ */
+NETCONFIG_API
+void netconfigSetBackend(const netconfig_backend_t *backend);
+
+NETCONFIG_API
+const netconfig_backend_t *netconfigGetBackend(void);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __BACKEND_H__ */
@@ -0,0 +1,440 @@
+#include "baseline.h"
+#include "kernel.h"
+
+/* A baseline file is a header, the entries then the text of the header
+ * and of the rows, one after the other without separator. An entry holds
+ * the hashes of the key and of the whole row, so that an unchanged row
+ * costs one lookup and one comparison of hashes.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#define BASELINE_MAGIC      0x4e43424c
+#define BASELINE_VERSION    1
+
+#define HASH_INIT           0xcbf29ce484222325ULL
+
+typedef struct baseline_header
+{
+    uint32_t    magic;
+    uint32_t    version;
+    uint32_t    count;
+    uint32_t    columns;
+    uint64_t    text;
+} baseline_header_t;
+
+typedef struct baseline_entry
+{
+    uint64_t    key;
+    uint64_t    row;
+    uint32_t    offset;
+    uint32_t    len;
+} baseline_entry_t;
+
+struct baseline
+{
+    baseline_entry_t    *entries;
+    size_t              nb;
+    size_t              size;
+    char                *text;
+    size_t              len;
+    size_t              textSize;
+    size_t              columns;
+};
+
+static uint64_t hash(const char *p, size_t len)
+{
+    uint64_t    h = HASH_INIT;
+
+    /* FNV-1a
+     */
+    while ( len-- )
+    {
+        h ^= (unsigned char) *p++;
+        h *= 0x100000001b3ULL;
+    }
+
+    return h;
+}
+
+static size_t keyLength(const char *row, size_t len)
+{
+    const char  *comma = memchr(row, ',', len);
+
+    return comma ? (size_t) (comma - row) : len;
+}
+
+static int appendText(baseline_t *baseline, const char *data, size_t len)
+{
+    char    *text;
+    size_t  size;
+
+    if ( baseline->len + len > baseline->textSize )
+    {
+        for ( size = baseline->textSize ? baseline->textSize : 4096 ;
+                size < baseline->len + len ; size *= 2 )
+            ;
+
+        if ( (text = realloc(baseline->text, size)) == NULL )
+            return -1;
+
+        baseline->text = text;
+        baseline->textSize = size;
+    }
+
+    memcpy(baseline->text + baseline->len, data, len);
+    baseline->len += len;
+
+    return 0;
+}
+
+baseline_t *baselineNew(const char *columns)
+{
+    baseline_t  *baseline;
+
+    if ( columns == NULL || (baseline = calloc(1, sizeof(*baseline))) == NULL )
+        return NULL;
+
+    baseline->columns = strcspn(columns, "\n");
+    if ( appendText(baseline, columns, baseline->columns) )
+    {
+        baselineFree(baseline);
+        return NULL;
+    }
+
+    return baseline;
+}
+
+int baselineAdd(baseline_t *baseline, const char *row, size_t len)
+{
+    baseline_entry_t    *entry;
+
+    if ( baseline == NULL || row == NULL )
+        return -1;
+
+    while ( len && (row[len - 1] == '\n' || row[len - 1] == '\r') )
+        len--;
+
+    if ( len > UINT32_MAX || baseline->len + len > UINT32_MAX )
+        return -1;
+
+    if ( baseline->nb == baseline->size )
+    {
+        size_t  size = baseline->size ? baseline->size * 2 : 64;
+
+        if ( (entry = realloc(baseline->entries, size * sizeof(*entry))) == NULL )
+            return -1;
+
+        baseline->entries = entry;
+        baseline->size = size;
+    }
+
+    entry = &baseline->entries[baseline->nb];
+    entry->key = hash(row, keyLength(row, len));
+    entry->row = hash(row, len);
+    entry->offset = baseline->len;
+    entry->len = len;
+
+    if ( appendText(baseline, row, len) )
+        return -1;
+
+    baseline->nb++;
+
+    return 0;
+}
+
+/* The file is read through the backend, the simulated kernel has it too
+ */
+baseline_t *baselineLoad(const char *path)
+{
+    baseline_header_t   hdr;
+    baseline_t          *baseline;
+    size_t              i;
+    FILE                *file;
+
+    if ( path == NULL || (file = kernelOpen(path, "r")) == NULL )
+        return NULL;
+
+    if ( fread(&hdr, sizeof(hdr), 1, file) != 1 ||
+            hdr.magic != BASELINE_MAGIC || hdr.version != BASELINE_VERSION ||
+            hdr.columns > hdr.text || hdr.text > UINT32_MAX ||
+            hdr.count > SIZE_MAX / sizeof(baseline_entry_t) ||
+            (baseline = calloc(1, sizeof(*baseline))) == NULL )
+    {
+        fclose(file);
+        return NULL;
+    }
+
+    baseline->nb = baseline->size = hdr.count;
+    baseline->len = baseline->textSize = hdr.text;
+    baseline->columns = hdr.columns;
+
+    if ( (hdr.count &&
+             (baseline->entries = malloc(hdr.count * sizeof(baseline_entry_t))) == NULL) ||
+            (baseline->text = malloc(hdr.text ? hdr.text : 1)) == NULL ||
+            fread(baseline->entries, sizeof(baseline_entry_t), hdr.count, file) != hdr.count ||
+            fread(baseline->text, 1, hdr.text, file) != hdr.text ||
+            fgetc(file) != EOF )
+    {
+        fclose(file);
+        baselineFree(baseline);
+        return NULL;
+    }
+
+    fclose(file);
+
+    for ( i = 0 ; i < baseline->nb ; i++ )
+    {
+        if ( (uint64_t) baseline->entries[i].offset + baseline->entries[i].len >
+                baseline->len )
+        {
+            baselineFree(baseline);
+            return NULL;
+        }
+    }
+
+    return baseline;
+}
+
+int baselineSave(const baseline_t *baseline, const char *path)
+{
+    baseline_header_t   hdr;
+    char                tmp[PATH_MAX];
+    FILE                *file;
+    int                 ret = -1;
+
+    if ( baseline == NULL || path == NULL )
+        return -1;
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = BASELINE_MAGIC;
+    hdr.version = BASELINE_VERSION;
+    hdr.count = baseline->nb;
+    hdr.columns = baseline->columns;
+    hdr.text = baseline->len;
+
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    if ( (file = kernelOpen(tmp, "w")) == NULL )
+    {
+        perror(tmp);
+        return -1;
+    }
+
+    if ( fwrite(&hdr, sizeof(hdr), 1, file) == 1 &&
+            fwrite(baseline->entries, sizeof(*baseline->entries), baseline->nb,
+                file) == baseline->nb &&
+            fwrite(baseline->text, 1, baseline->len, file) == baseline->len )
+        ret = 0;
+
+    if ( fclose(file) )
+        ret = -1;
+
+    if ( ret == 0 && (ret = kernelRename(tmp, path)) )
+        perror("rename");
+
+    return ret;
+}
+
+/* End of the field starting at p, a quoted field may hold commas
+ */
+static const char *fieldEnd(const char *p, const char *end)
+{
+    int quoted = 0;
+
+    for ( ; p < end ; p++ )
+    {
+        if ( *p == '"' )
+            quoted = !quoted;
+        else if ( *p == ',' && !quoted )
+            break;
+    }
+
+    return p;
+}
+
+static const char *nextField(const char *p, const char *end)
+{
+    return p < end ? p + 1 : p;
+}
+
+/* Only the fields that differ, as named by the columns
+ */
+static int diffFields(const baseline_t *cur, const baseline_entry_t *o,
+        const char *oldText, const baseline_entry_t *n,
+        baseline_callback_t cb, void *user)
+{
+    baseline_change_t   change;
+    const char          *c = cur->text,
+                        *cLast = c + cur->columns,
+                        *op = oldText + o->offset,
+                        *oLast = op + o->len,
+                        *np = cur->text + n->offset,
+                        *nLast = np + n->len,
+                        *cEnd,
+                        *oEnd,
+                        *nEnd;
+    int                 ret;
+
+    memset(&change, 0, sizeof(change));
+    change.op = '~';
+    change.key = np;
+    change.keyLen = keyLength(np, n->len);
+
+    for ( ;; )
+    {
+        cEnd = fieldEnd(c, cLast);
+        oEnd = fieldEnd(op, oLast);
+        nEnd = fieldEnd(np, nLast);
+
+        if ( oEnd - op != nEnd - np || memcmp(op, np, nEnd - np) )
+        {
+            change.column = c;
+            change.columnLen = cEnd - c;
+            change.value = np;
+            change.valueLen = nEnd - np;
+
+            if ( (ret = cb(&change, user)) )
+                return ret;
+        }
+
+        if ( oEnd == oLast && nEnd == nLast )
+            return 0;
+
+        c = nextField(cEnd, cLast);
+        op = nextField(oEnd, oLast);
+        np = nextField(nEnd, nLast);
+    }
+}
+
+static int report(const baseline_t *baseline, const baseline_entry_t *entry,
+        char op, baseline_callback_t cb, void *user)
+{
+    baseline_change_t   change;
+
+    memset(&change, 0, sizeof(change));
+    change.op = op;
+
+    if ( entry == NULL )
+    {
+        change.value = baseline->text;
+        change.valueLen = baseline->columns;
+    }
+    else
+    {
+        change.key = baseline->text + entry->offset;
+        change.keyLen = keyLength(change.key, entry->len);
+
+        if ( op == '+' )
+        {
+            change.value = change.key;
+            change.valueLen = entry->len;
+        }
+    }
+
+    return cb(&change, user);
+}
+
+int baselineDiff(const baseline_t *old, const baseline_t *cur,
+        baseline_callback_t cb, void *user)
+{
+    const baseline_entry_t  *o,
+                            *n;
+    uint32_t                *slots = NULL;
+    unsigned char           *seen = NULL;
+    size_t                  size,
+                            mask,
+                            i,
+                            j;
+    int                     ret = 0;
+
+    if ( cur == NULL || cb == NULL )
+        return -1;
+
+    /* Without a usable baseline everything is new
+     */
+    if ( old == NULL || old->columns != cur->columns ||
+            memcmp(old->text, cur->text, cur->columns) )
+    {
+        if ( (ret = report(cur, NULL, '#', cb, user)) )
+            return ret;
+
+        for ( i = 0 ; i < cur->nb ; i++ )
+        {
+            if ( (ret = report(cur, &cur->entries[i], '+', cb, user)) )
+                return ret;
+        }
+
+        return 0;
+    }
+
+    /* Open addressing on the key hashes, at most half full
+     */
+    for ( size = 16 ; size < old->nb * 2 ; size *= 2 )
+        ;
+    mask = size - 1;
+
+    if ( (slots = calloc(size, sizeof(*slots))) == NULL ||
+            (seen = calloc(old->nb + 1, 1)) == NULL )
+    {
+        free(slots);
+        return -1;
+    }
+
+    for ( i = 0 ; i < old->nb ; i++ )
+    {
+        for ( j = old->entries[i].key & mask ; slots[j] ; j = (j + 1) & mask )
+            ;
+        slots[j] = i + 1;
+    }
+
+    for ( i = 0 ; ret == 0 && i < cur->nb ; i++ )
+    {
+        n = &cur->entries[i];
+        o = NULL;
+
+        for ( j = n->key & mask ; slots[j] ; j = (j + 1) & mask )
+        {
+            const baseline_entry_t  *e = &old->entries[slots[j] - 1];
+            size_t                  len = keyLength(cur->text + n->offset, n->len);
+
+            if ( e->key == n->key && !seen[slots[j] - 1] &&
+                    keyLength(old->text + e->offset, e->len) == len &&
+                    memcmp(old->text + e->offset, cur->text + n->offset, len) == 0 )
+            {
+                o = e;
+                seen[slots[j] - 1] = 1;
+                break;
+            }
+        }
+
+        if ( o == NULL )
+            ret = report(cur, n, '+', cb, user);
+        else if ( o->row != n->row || o->len != n->len )
+            ret = diffFields(cur, o, old->text, n, cb, user);
+    }
+
+    for ( i = 0 ; ret == 0 && i < old->nb ; i++ )
+    {
+        if ( !seen[i] )
+            ret = report(old, &old->entries[i], '-', cb, user);
+    }
+
+    free(slots);
+    free(seen);
+
+    return ret;
+}
+
+void baselineFree(baseline_t *baseline)
+{
+    if ( baseline == NULL )
+        return;
+
+    free(baseline->entries);
+    free(baseline->text);
+    free(baseline);
+}
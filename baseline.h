@@ -0,0 +1,71 @@
+#ifndef __BASELINE_H__
+#define __BASELINE_H__
+
+#include "netconfig.h"
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/* The CSV records of a display, kept in a binary file so that the next
+ * display only reports what changed. A row is keyed by its first field,
+ * the interface name, and compared with the stored one through a hash :
+ * only the rows that differ are split into fields.
+ */
+typedef struct baseline baseline_t;
+
+/* One change, the strings are not NUL terminated :
+ *  '#'     the columns are new, value is the header, every row follows
+ *  '+'     a row was added, value is the whole row
+ *  '-'     a row was removed, only key is set
+ *  '~'     a field changed, column is its name and value the new one
+ */
+typedef struct baseline_change
+{
+    char        op;
+    const char  *key;
+    size_t      keyLen;
+    const char  *column;
+    size_t      columnLen;
+    const char  *value;
+    size_t      valueLen;
+} baseline_change_t;
+
+typedef int (*baseline_callback_t)(const baseline_change_t *change,
+        void *user);
+
+/* columns is the CSV header of the rows
+ */
+NETCONFIG_API
+baseline_t *baselineNew(const char *columns);
+
+/* A trailing new line is dropped
+ */
+NETCONFIG_API
+int baselineAdd(baseline_t *baseline, const char *row, size_t len);
+
+/* NULL when the file is missing or not a baseline
+ */
+NETCONFIG_API
+baseline_t *baselineLoad(const char *path);
+
+NETCONFIG_API
+int baselineSave(const baseline_t *baseline, const char *path);
+
+/* Calls cb for every change from old to cur in linear time, old may be
+ * NULL. A non-zero return of cb stops the walk and is returned.
+ */
+NETCONFIG_API
+int baselineDiff(const baseline_t *old, const baseline_t *cur,
+        baseline_callback_t cb, void *user);
+
+NETCONFIG_API
+void baselineFree(baseline_t *baseline);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __BASELINE_H__ */
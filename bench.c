@@ -0,0 +1,533 @@
+#define _GNU_SOURCE
+
+#include "network.h"
+#include "iflink.h"
+#include "backend.h"
+
+/* Convergence of the write paths : the time from a setter call until the
+ * kernel announces the change on rtnetlink, or until a reader sees it for
+ * the name server, which is only a file. Every size runs on fresh links
+ * in a private network namespace, and the files go to a temporary
+ * directory through a backend : the host is not touched. Needs root.
+ *
+ *  netbench [<interfaces>...]      default 1 10 100 1000 10000
+ */
+
+#include <sched.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <net/route.h>
+#include <poll.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <limits.h>
+#include <sys/stat.h>
+
+#define NOTIFY_TIMEOUT  1000
+#define EVENTS_BUFFLEN  (4*1024*1024)
+
+typedef struct bench_files
+{
+    const netconfig_backend_t   *kernel;
+    char                        root[PATH_MAX];
+} bench_files_t;
+
+typedef struct bench_stats
+{
+    const char  *name;
+    double      *us;
+    size_t      nb;
+    size_t      missed;
+} bench_stats_t;
+
+static bench_files_t    files;
+
+static double now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+/* The files of /proc and /sys are the real ones, the others go under
+ * the temporary root
+ */
+static const char *bench_path(const char *path, char *buff, size_t len)
+{
+    if ( strncmp(path, "/proc/", 6) == 0 || strncmp(path, "/sys/", 5) == 0 )
+        return path;
+
+    snprintf(buff, len, "%s%s", files.root, path);
+
+    return buff;
+}
+
+static FILE *bench_open(void *ctx, const char *path, const char *mode)
+{
+    char    buff[PATH_MAX];
+
+    return files.kernel->open(files.kernel->ctx,
+            bench_path(path, buff, sizeof(buff)), mode);
+}
+
+static int bench_rename(void *ctx, const char *from, const char *to)
+{
+    char    buffFrom[PATH_MAX],
+            buffTo[PATH_MAX];
+
+    return files.kernel->rename(files.kernel->ctx,
+            bench_path(from, buffFrom, sizeof(buffFrom)),
+            bench_path(to, buffTo, sizeof(buffTo)));
+}
+
+static int make_dir(const char *sub)
+{
+    char    path[PATH_MAX];
+    char    *p;
+
+    snprintf(path, sizeof(path), "%s%s", files.root, sub);
+    for ( p = path + strlen(files.root) + 1 ; (p = strchr(p, '/')) ; p++ )
+    {
+        *p = '\0';
+        if ( mkdir(path, 0755) < 0 && errno != EEXIST )
+        {
+            perror(path);
+            return -1;
+        }
+        *p = '/';
+    }
+
+    return 0;
+}
+
+static int events_open(void)
+{
+    struct sockaddr_nl  addr;
+    int                 fd,
+                        opt = EVENTS_BUFFLEN;
+
+    if ( (fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE)) < 0 )
+    {
+        perror("socket");
+        return -1;
+    }
+
+    if ( setsockopt(fd, SOL_SOCKET, SO_RCVBUFFORCE, &opt, sizeof(opt)) < 0 )
+        setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &opt, sizeof(opt));
+
+    memset(&addr, 0, sizeof(addr));
+    addr.nl_family = AF_NETLINK;
+    addr.nl_groups = RTMGRP_IPV4_IFADDR | RTMGRP_IPV4_ROUTE;
+
+    if ( bind(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0 )
+    {
+        perror("bind");
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+static int is_address(const struct nlmsghdr *nlh, int ifindex,
+        struct in_addr addr)
+{
+    const struct ifaddrmsg  *ifa = NLMSG_DATA(nlh);
+    const struct rtattr     *rta = IFA_RTA(ifa);
+    int                     len = IFA_PAYLOAD(nlh);
+
+    if ( nlh->nlmsg_type != RTM_NEWADDR || ifa->ifa_index != ifindex )
+        return 0;
+
+    for ( ; RTA_OK(rta, len) ; rta = RTA_NEXT(rta, len) )
+    {
+        if ( rta->rta_type == IFA_LOCAL )
+            return !memcmp(RTA_DATA(rta), &addr, sizeof(addr));
+    }
+
+    return 0;
+}
+
+static int is_default(const struct nlmsghdr *nlh, int ifindex,
+        struct in_addr gw)
+{
+    const struct rtmsg  *rtm = NLMSG_DATA(nlh);
+    const struct rtattr *rta = RTM_RTA(rtm);
+    int                 len = RTM_PAYLOAD(nlh),
+                        oif = 0,
+                        via = 0;
+
+    if ( nlh->nlmsg_type != RTM_NEWROUTE || rtm->rtm_dst_len )
+        return 0;
+
+    for ( ; RTA_OK(rta, len) ; rta = RTA_NEXT(rta, len) )
+    {
+        if ( rta->rta_type == RTA_OIF )
+            oif = *(const int *) RTA_DATA(rta) == ifindex;
+        else if ( rta->rta_type == RTA_GATEWAY )
+            via = !memcmp(RTA_DATA(rta), &gw, sizeof(gw));
+    }
+
+    return oif && via;
+}
+
+/* Reads the notifications until the expected one, the others are the
+ * side effects of the change (old address removed, prefix route...)
+ */
+static int events_wait(int fd, int type, int ifindex, struct in_addr addr)
+{
+    static char         buff[64*1024];
+    struct pollfd       pfd = { .fd = fd, .events = POLLIN };
+    const struct nlmsghdr *nlh;
+    ssize_t             len;
+
+    for ( ;; )
+    {
+        if ( poll(&pfd, 1, NOTIFY_TIMEOUT) <= 0 )
+            return -1;
+
+        /* An overrun loses events, maybe the one expected
+         */
+        if ( (len = recv(fd, buff, sizeof(buff), 0)) < 0 )
+        {
+            if ( errno == EINTR || errno == ENOBUFS )
+                continue;
+
+            perror("recv");
+            return -1;
+        }
+
+        for ( nlh = (const struct nlmsghdr *) buff ; NLMSG_OK(nlh, len) ;
+                nlh = NLMSG_NEXT(nlh, len) )
+        {
+            if ( type == RTM_NEWADDR ? is_address(nlh, ifindex, addr) :
+                    is_default(nlh, ifindex, addr) )
+                return 0;
+        }
+    }
+}
+
+static void bench_name(char *name, const char *prefix, size_t i)
+{
+    snprintf(name, IFNAMSIZ, "%s%zu", prefix, i);
+}
+
+static void bench_ip(char *ip, size_t len, size_t i, int host)
+{
+    snprintf(ip, len, "10.%zu.%zu.%d", (i >> 8) & 0xff, i & 0xff, host);
+}
+
+/* Dummy links, or veth pairs on the kernels without the dummy driver
+ */
+static const char *links_create(size_t nb)
+{
+    link_batch_t    batch;
+    char            name[IFNAMSIZ],
+                    peer[IFNAMSIZ];
+    size_t          i;
+    int             ret;
+
+    /* The first one alone tells whether the driver is there
+     */
+    memset(&batch, 0, sizeof(batch));
+    for ( i = 0, ret = 0 ; ret == 0 && i < nb ; i++ )
+    {
+        bench_name(name, "bench", i);
+        if ( (ret = linkAddDummy(&batch, name)) == 0 && (i == 0 || i == nb - 1) )
+        {
+            ret = linkBatchCommit(&batch);
+            linkBatchFree(&batch);
+        }
+    }
+
+    linkBatchFree(&batch);
+    if ( ret == 0 )
+        return "dummy";
+
+    memset(&batch, 0, sizeof(batch));
+    for ( i = 0, ret = 0 ; ret == 0 && i < nb ; i++ )
+    {
+        bench_name(name, "bench", i);
+        bench_name(peer, "bpeer", i);
+        ret = linkAddVeth(&batch, name, peer, LINK_NETNS_NONE);
+    }
+
+    ret = ret ? ret : linkBatchCommit(&batch);
+    linkBatchFree(&batch);
+
+    return ret ? NULL : "veth";
+}
+
+static int links_up(size_t nb, int peers)
+{
+    char    (*names)[IFNAMSIZ];
+    char    **list;
+    size_t  count = peers ? nb * 2 : nb,
+            i;
+    int     ret = -1;
+
+    names = calloc(count, IFNAMSIZ);
+    list = calloc(count, sizeof(*list));
+
+    if ( names && list )
+    {
+        for ( i = 0 ; i < count ; i++ )
+        {
+            bench_name(names[i], i < nb ? "bench" : "bpeer", i % nb);
+            list[i] = names[i];
+        }
+
+        ret = bringInterfacesUp((const char * const *) list, count, 0, NULL) < 0 ?
+            -1 : 0;
+    }
+
+    free(names);
+    free(list);
+
+    return ret;
+}
+
+/* The setters change what is there, the first address and its mask are
+ * given by hand
+ */
+static int address_seed(const struct ifreq *ifr, size_t i)
+{
+    struct ifreq        req;
+    struct sockaddr_in  *sin = (struct sockaddr_in *) &req.ifr_addr;
+    char                ip[INET_ADDRSTRLEN];
+    int                 fd,
+                        ret = -1;
+
+    if ( (fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0)) < 0 )
+        return -1;
+
+    bench_ip(ip, sizeof(ip), i, 1);
+    memset(&req, 0, sizeof(req));
+    memcpy(req.ifr_name, ifr->ifr_name, IFNAMSIZ);
+    sin->sin_family = AF_INET;
+    inet_aton(ip, &sin->sin_addr);
+
+    if ( ioctl(fd, SIOCSIFADDR, &req) == 0 )
+    {
+        inet_aton("255.255.255.0", &sin->sin_addr);
+        if ( ioctl(fd, SIOCSIFNETMASK, &req) == 0 )
+            ret = 0;
+    }
+
+    if ( ret )
+        perror(ifr->ifr_name);
+
+    close(fd);
+
+    return ret;
+}
+
+static int compare_us(const void *a, const void *b)
+{
+    double  x = *(const double *) a,
+            y = *(const double *) b;
+
+    return x < y ? -1 : x > y;
+}
+
+static double percentile(const bench_stats_t *stats, int p)
+{
+    size_t  i = (stats->nb * p + 99) / 100;
+
+    return stats->nb ? stats->us[i ? i - 1 : 0] : 0;
+}
+
+static void stats_print(bench_stats_t *stats)
+{
+    qsort(stats->us, stats->nb, sizeof(double), &compare_us);
+
+    printf("  %-24s %6zu %9.1f %9.1f %9.1f %9.1f", stats->name, stats->nb,
+            percentile(stats, 50), percentile(stats, 90), percentile(stats, 99),
+            stats->nb ? stats->us[stats->nb - 1] : 0);
+
+    if ( stats->missed )
+        printf("  (%zu without notification)", stats->missed);
+
+    printf("\n");
+}
+
+static void stats_add(bench_stats_t *stats, double start, int ret)
+{
+    if ( ret )
+        stats->missed++;
+    else
+        stats->us[stats->nb++] = now_us() - start;
+}
+
+static int run(size_t nb)
+{
+    const struct ifreq  **ifrs = NULL;
+    bench_stats_t       stats[3];
+    const char          *kind;
+    char                name[IFNAMSIZ],
+                        ip[INET_ADDRSTRLEN],
+                        ns[INET_ADDRSTRLEN];
+    struct in_addr      in;
+    double              start;
+    size_t              i;
+    int                 events = -1,
+                        ret = -1;
+
+    memset(stats, 0, sizeof(stats));
+    stats[0].name = "setInterfaceIpAddress";
+    stats[1].name = "setInterfaceIpGateway";
+    stats[2].name = "setDomainNameServer";
+
+    if ( unshare(CLONE_NEWNET) < 0 )
+    {
+        perror("unshare");
+        return -1;
+    }
+
+    networkClean();
+
+    if ( (kind = links_create(nb)) == NULL )
+    {
+        fprintf(stderr, "%zu links: cannot create them\n", nb);
+        return -1;
+    }
+
+    if ( links_up(nb, strcmp(kind, "veth") == 0) || networkInit() ||
+            (ifrs = calloc(nb, sizeof(*ifrs))) == NULL )
+        goto out;
+
+    for ( i = 0 ; i < 3 ; i++ )
+    {
+        if ( (stats[i].us = calloc(nb, sizeof(double))) == NULL )
+            goto out;
+    }
+
+    for ( i = 0 ; i < nb ; i++ )
+    {
+        bench_name(name, "bench", i);
+        if ( (ifrs[i] = getInterfaceByNameIpv4(name)) == NULL ||
+                address_seed(ifrs[i], i) )
+            goto out;
+    }
+
+    /* Subscribed once the links are ready, not to get their own events
+     */
+    if ( (events = events_open()) < 0 )
+        goto out;
+
+    for ( i = 0 ; i < nb ; i++ )
+    {
+        bench_ip(ip, sizeof(ip), i, 2);
+        inet_aton(ip, &in);
+
+        start = now_us();
+        if ( setInterfaceIpAddress(ifrs[i], ip) == 0 )
+            stats_add(&stats[0], start, events_wait(events, RTM_NEWADDR,
+                        if_nametoindex(ifrs[i]->ifr_name), in));
+        else
+            stats[0].missed++;
+    }
+
+    for ( i = 0 ; i < nb ; i++ )
+    {
+        bench_ip(ip, sizeof(ip), i, 254);
+        inet_aton(ip, &in);
+
+        start = now_us();
+        if ( setInterfaceIpGateway(ifrs[i], ip) == 0 )
+            stats_add(&stats[1], start, events_wait(events, RTM_NEWROUTE,
+                        if_nametoindex(ifrs[i]->ifr_name), in));
+        else
+            stats[1].missed++;
+    }
+
+    /* Visible once a reader gets it back from the file
+     */
+    for ( i = 0 ; i < nb ; i++ )
+    {
+        bench_ip(ip, sizeof(ip), i, 53);
+
+        start = now_us();
+        stats_add(&stats[2], start, setDomainNameServer(ip) ||
+                getDomainNameServer(ns, sizeof(ns)) || strcmp(ns, ip));
+    }
+
+    printf("%zu %s interfaces, latency in us\n", nb, kind);
+    printf("  %-24s %6s %9s %9s %9s %9s\n", "", "n", "p50", "p90", "p99", "max");
+    for ( i = 0 ; i < 3 ; i++ )
+        stats_print(&stats[i]);
+
+    /* The whole file is rewritten for each interface
+     */
+    start = now_us();
+    for ( i = 0, ret = 0 ; ret == 0 && i < nb ; i++ )
+        ret = saveInterfaceIpConfig(ifrs[i], MANUAL);
+
+    printf("  %-24s %6zu calls in %.1f ms%s\n", "saveInterfaceIpConfig", i,
+            (now_us() - start) / 1e3, ret ? " (failed)" : "");
+
+out:
+    for ( i = 0 ; i < 3 ; i++ )
+        free(stats[i].us);
+
+    free(ifrs);
+    if ( events >= 0 )
+        close(events);
+
+    return ret;
+}
+
+int main(int argc, char *argv[])
+{
+    static const size_t     sizes[] = { 1, 10, 100, 1000, 10000 };
+    netconfig_backend_t     backend;
+    char                    cmd[PATH_MAX + 16];
+    size_t                  nb;
+    int                     i,
+                            ret = 0;
+
+    files.kernel = netconfigGetBackend();
+    backend = *files.kernel;
+    backend.name = "bench";
+    backend.open = &bench_open;
+    backend.rename = &bench_rename;
+
+    snprintf(files.root, sizeof(files.root), "/tmp/netbench.XXXXXX");
+    if ( mkdtemp(files.root) == NULL )
+    {
+        perror("mkdtemp");
+        return 1;
+    }
+
+    if ( make_dir("/etc/") || make_dir("/mnt/boot/conf/") )
+        return 1;
+
+    netconfigSetBackend(&backend);
+
+    for ( i = 1 ; ret == 0 && i < (argc > 1 ? argc : 6) ; i++ )
+    {
+        nb = argc > 1 ? strtoul(argv[i], NULL, 0) : sizes[i - 1];
+        if ( nb == 0 || nb > 0xffff )
+        {
+            fprintf(stderr, "%s: between 1 and 65535 interfaces\n", argv[i]);
+            ret = -1;
+            break;
+        }
+
+        ret = run(nb);
+    }
+
+    networkClean();
+    netconfigSetBackend(NULL);
+
+    snprintf(cmd, sizeof(cmd), "rm -rf %s", files.root);
+    if ( system(cmd) )
+        fprintf(stderr, "%s: not removed\n", files.root);
+
+    return ret ? 1 : 0;
+}
@@ -0,0 +1,908 @@
+#include "checkpoint.h"
+#include "netlink.h"
+#include "kernel.h"
+#include "network.h"
+
+/* A checkpoint file is a header, the links sorted by name, the addresses
+ * and the routes, which refer to the links by their rank, then the text of
+ * resolv.conf. Interface indexes change from one boot to the next, names
+ * do not : they are looked up once, in a single link dump, at restore.
+ */
+
+#include <linux/if_addr.h>
+#include <net/if.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CHECKPOINT_MAGIC    0x4e43434b
+#define CHECKPOINT_VERSION  1
+#define CHECKPOINT_TMP      CHECKPOINT ".tmp"
+
+#define INTERFACES          "/mnt/boot/conf/interfaces"
+#define RESOLV_TMP          RESOLV_CONF ".tmp"
+
+/* Far above what a resolv.conf holds
+ */
+#define RESOLV_MAX          (64*1024)
+
+#define HASH_INIT           0xcbf29ce484222325ULL
+
+#define LIFE_FOREVER        0xffffffffU
+
+/* Address flags that are asked for, the others are the kernel's
+ */
+#define ADDR_FLAGS          (IFA_F_NODAD | IFA_F_HOMEADDRESS | \
+                             IFA_F_MANAGETEMPADDR | IFA_F_NOPREFIXROUTE)
+
+typedef struct checkpoint_header
+{
+    uint32_t    magic;
+    uint32_t    version;
+    uint32_t    links;
+    uint32_t    addrs;
+    uint32_t    routes;
+    uint32_t    resolv;
+    uint64_t    stamp;
+} checkpoint_header_t;
+
+/* addrs is set for the static and manual stanzas, seen when the link
+ * existed : the others are only named
+ */
+typedef struct checkpoint_link
+{
+    char        name[IFNAMSIZ];
+    uint32_t    flags;
+    uint32_t    mtu;
+    uint8_t     addrs;
+    uint8_t     seen;
+    uint8_t     pad[2];
+} checkpoint_link_t;
+
+typedef struct checkpoint_addr
+{
+    uint32_t    link;
+    uint32_t    flags;
+    uint8_t     family;
+    uint8_t     prefix;
+    uint8_t     scope;
+    uint8_t     pad;
+    uint8_t     local[16];
+    uint8_t     peer[16];
+    uint8_t     broadcast[4];
+} checkpoint_addr_t;
+
+typedef struct checkpoint_route
+{
+    uint32_t    link;
+    uint32_t    table;
+    uint32_t    priority;
+    uint8_t     family;
+    uint8_t     dstLen;
+    uint8_t     protocol;
+    uint8_t     scope;
+    uint8_t     dst[16];
+    uint8_t     gateway[16];
+} checkpoint_route_t;
+
+typedef struct checkpoint
+{
+    checkpoint_header_t hdr;
+    checkpoint_link_t   *links;
+    size_t              linksSize;
+    checkpoint_addr_t   *addrs;
+    size_t              addrsSize;
+    checkpoint_route_t  *routes;
+    size_t              routesSize;
+    char                *resolv;
+    unsigned            *ranks;
+    size_t              ranksSize;
+} checkpoint_t;
+
+/* The state of a link found at restore
+ */
+typedef struct restore_link
+{
+    int         ifindex;
+    uint32_t    flags;
+    uint32_t    mtu;
+} restore_link_t;
+
+typedef struct restore
+{
+    const checkpoint_t  *ckpt;
+    restore_link_t      *found;
+    uint32_t            *owners;
+    uint32_t            seq;
+} restore_t;
+
+static uint64_t hash(uint64_t h, const void *data, size_t len)
+{
+    const unsigned char *p = data;
+
+    /* FNV-1a
+     */
+    while ( len-- )
+    {
+        h ^= *p++;
+        h *= 0x100000001b3ULL;
+    }
+
+    return h;
+}
+
+/* The array with room for the element nb, zeroed, NULL when out of
+ * memory and the array is left as it was
+ */
+static void *grow(void *array, size_t *size, size_t nb, size_t elem)
+{
+    char    *tmp;
+    size_t  n;
+
+    if ( nb < *size )
+        return array;
+
+    for ( n = *size ? *size : 64 ; n <= nb ; n *= 2 )
+        ;
+
+    if ( (tmp = realloc(array, n * elem)) == NULL )
+        return NULL;
+
+    memset(tmp + *size * elem, 0, (n - *size) * elem);
+    *size = n;
+
+    return tmp;
+}
+
+static int compareLink(const void *a, const void *b)
+{
+    return strcmp(((const checkpoint_link_t *) a)->name,
+            ((const checkpoint_link_t *) b)->name);
+}
+
+static checkpoint_link_t *findLink(const checkpoint_t *ckpt, const char *name)
+{
+    checkpoint_link_t   key;
+
+    if ( strlen(name) >= sizeof(key.name) )
+        return NULL;
+
+    strcpy(key.name, name);
+
+    return bsearch(&key, ckpt->links, ckpt->hdr.links, sizeof(key), &compareLink);
+}
+
+static int addStanza(checkpoint_t *ckpt, const char *name, const char *method)
+{
+    checkpoint_link_t   *link;
+
+    if ( (link = grow(ckpt->links, &ckpt->linksSize, ckpt->hdr.links,
+                    sizeof(*link))) == NULL )
+        return -1;
+
+    ckpt->links = link;
+    link = &ckpt->links[ckpt->hdr.links++];
+    snprintf(link->name, sizeof(link->name), "%s", name);
+    link->addrs = !strcmp(method, "static") || !strcmp(method, "manual");
+
+    return 0;
+}
+
+/* The stamp is a hash of the whole interfaces file, the links are those
+ * of its iface stanzas when ckpt is not NULL. No file, no stanza.
+ */
+static int readInterfaces(uint64_t *stamp, checkpoint_t *ckpt)
+{
+#define BUFFLEN     1024
+    char                buff[BUFFLEN],
+                        word[16],
+                        name[IFNAMSIZ],
+                        family[16],
+                        method[16];
+    checkpoint_link_t   *link;
+    FILE                *file;
+    uint32_t            i;
+
+    *stamp = HASH_INIT;
+
+    if ( (file = kernelOpen(INTERFACES, "r")) == NULL )
+        return errno == ENOENT ? 0 : -1;
+
+    while ( fgets(buff, sizeof(buff), file) )
+    {
+        *stamp = hash(*stamp, buff, strlen(buff));
+
+        if ( ckpt && sscanf(buff, " %15s %15s %15s %15s", word, name, family,
+                    method) == 4 && !strcmp(word, "iface") &&
+                addStanza(ckpt, name, method) )
+        {
+            fclose(file);
+            return -1;
+        }
+    }
+
+    fclose(file);
+
+    if ( ckpt == NULL || ckpt->hdr.links == 0 )
+        return 0;
+
+    /* An interface may have an inet and an inet6 stanza
+     */
+    qsort(ckpt->links, ckpt->hdr.links, sizeof(*ckpt->links), &compareLink);
+
+    for ( i = 1, link = ckpt->links ; i < ckpt->hdr.links ; i++ )
+    {
+        if ( strcmp(link->name, ckpt->links[i].name) )
+            *++link = ckpt->links[i];
+        else
+            link->addrs |= ckpt->links[i].addrs;
+    }
+    ckpt->hdr.links = link - ckpt->links + 1;
+
+    return 0;
+#undef BUFFLEN
+}
+
+/* The rank of the link of ifindex when its addresses are kept
+ */
+static const checkpoint_link_t *linkOf(const checkpoint_t *ckpt, int ifindex,
+        uint32_t *rank)
+{
+    if ( ifindex <= 0 || (size_t) ifindex >= ckpt->ranksSize ||
+            ckpt->ranks[ifindex] == 0 )
+        return NULL;
+
+    *rank = ckpt->ranks[ifindex] - 1;
+
+    return ckpt->links[*rank].addrs ? &ckpt->links[*rank] : NULL;
+}
+
+static int saveLink(checkpoint_t *ckpt, const struct nlmsghdr *nlh)
+{
+    const struct ifinfomsg  *ifi = NLMSG_DATA(nlh);
+    const struct rtattr     *tb[IFLA_MAX + 1];
+    checkpoint_link_t       *link;
+    unsigned                *ranks;
+
+    netlinkParseAttr(IFLA_RTA(ifi), IFLA_PAYLOAD(nlh), tb, IFLA_MAX);
+
+    if ( tb[IFLA_IFNAME] == NULL || ifi->ifi_index <= 0 ||
+            (link = findLink(ckpt, RTA_DATA(tb[IFLA_IFNAME]))) == NULL )
+        return 0;
+
+    link->seen = 1;
+    link->flags = ifi->ifi_flags & IFF_UP;
+    link->mtu = tb[IFLA_MTU] ? netlinkAttrU32(tb[IFLA_MTU]) : 0;
+
+    if ( (ranks = grow(ckpt->ranks, &ckpt->ranksSize, ifi->ifi_index,
+                    sizeof(*ranks))) == NULL )
+        return -1;
+
+    ckpt->ranks = ranks;
+    ckpt->ranks[ifi->ifi_index] = link - ckpt->links + 1;
+
+    return 0;
+}
+
+/* Only what was asked for : neither the IPv6 link-local addresses nor the
+ * ones with a lifetime, from DHCP or autoconfiguration
+ */
+static int saveAddr(checkpoint_t *ckpt, const struct nlmsghdr *nlh)
+{
+    const struct ifaddrmsg      *ifa = NLMSG_DATA(nlh);
+    const struct rtattr         *tb[IFA_MAX + 1],
+                                *local;
+    const struct ifa_cacheinfo  *ci;
+    checkpoint_addr_t           *addr;
+    size_t                      len;
+    uint32_t                    rank,
+                                flags;
+
+    if ( (ifa->ifa_family != AF_INET && ifa->ifa_family != AF_INET6) ||
+            linkOf(ckpt, ifa->ifa_index, &rank) == NULL )
+        return 0;
+
+    netlinkParseAttr(IFA_RTA(ifa), IFA_PAYLOAD(nlh), tb, IFA_MAX);
+
+    flags = tb[IFA_FLAGS] ? netlinkAttrU32(tb[IFA_FLAGS]) : ifa->ifa_flags;
+    ci = tb[IFA_CACHEINFO] ? RTA_DATA(tb[IFA_CACHEINFO]) : NULL;
+    local = tb[IFA_LOCAL] ? tb[IFA_LOCAL] : tb[IFA_ADDRESS];
+    len = ifa->ifa_family == AF_INET ? 4 : 16;
+
+    if ( local == NULL || RTA_PAYLOAD(local) != len ||
+            (tb[IFA_ADDRESS] && RTA_PAYLOAD(tb[IFA_ADDRESS]) != len) ||
+            (ifa->ifa_family == AF_INET6 && ifa->ifa_scope == RT_SCOPE_LINK) ||
+            (flags & IFA_F_TEMPORARY) || (ci && ci->ifa_valid != LIFE_FOREVER) )
+        return 0;
+
+    if ( (addr = grow(ckpt->addrs, &ckpt->addrsSize, ckpt->hdr.addrs,
+                    sizeof(*addr))) == NULL )
+        return -1;
+
+    ckpt->addrs = addr;
+    addr = &ckpt->addrs[ckpt->hdr.addrs++];
+    addr->link = rank;
+    addr->flags = flags & ADDR_FLAGS;
+    addr->family = ifa->ifa_family;
+    addr->prefix = ifa->ifa_prefixlen;
+    addr->scope = ifa->ifa_scope;
+    memcpy(addr->local, RTA_DATA(local), len);
+    memcpy(addr->peer, RTA_DATA(tb[IFA_ADDRESS] ? tb[IFA_ADDRESS] : local), len);
+
+    if ( tb[IFA_BROADCAST] && RTA_PAYLOAD(tb[IFA_BROADCAST]) == 4 )
+        memcpy(addr->broadcast, RTA_DATA(tb[IFA_BROADCAST]), 4);
+
+    return 0;
+}
+
+/* The unicast routes through one interface, not those the kernel adds
+ * for the addresses nor those of DHCP, autoconfiguration or redirects
+ */
+static int saveRoute(checkpoint_t *ckpt, const struct nlmsghdr *nlh)
+{
+    const struct rtmsg  *rtm = NLMSG_DATA(nlh);
+    const struct rtattr *tb[RTA_MAX + 1];
+    checkpoint_route_t  *route;
+    size_t              len;
+    uint32_t            rank;
+
+    if ( (rtm->rtm_family != AF_INET && rtm->rtm_family != AF_INET6) ||
+            rtm->rtm_type != RTN_UNICAST || (rtm->rtm_flags & RTM_F_CLONED) ||
+            rtm->rtm_protocol == RTPROT_KERNEL || rtm->rtm_protocol == RTPROT_REDIRECT ||
+            rtm->rtm_protocol == RTPROT_RA || rtm->rtm_protocol == RTPROT_DHCP )
+        return 0;
+
+    netlinkParseAttr(RTM_RTA(rtm), RTM_PAYLOAD(nlh), tb, RTA_MAX);
+    len = rtm->rtm_family == AF_INET ? 4 : 16;
+
+    if ( tb[RTA_OIF] == NULL || tb[RTA_MULTIPATH] ||
+            (tb[RTA_DST] && RTA_PAYLOAD(tb[RTA_DST]) != len) ||
+            (tb[RTA_GATEWAY] && RTA_PAYLOAD(tb[RTA_GATEWAY]) != len) ||
+            linkOf(ckpt, netlinkAttrU32(tb[RTA_OIF]), &rank) == NULL )
+        return 0;
+
+    if ( (route = grow(ckpt->routes, &ckpt->routesSize, ckpt->hdr.routes,
+                    sizeof(*route))) == NULL )
+        return -1;
+
+    ckpt->routes = route;
+    route = &ckpt->routes[ckpt->hdr.routes++];
+    route->link = rank;
+    route->table = tb[RTA_TABLE] ? netlinkAttrU32(tb[RTA_TABLE]) : rtm->rtm_table;
+    route->priority = tb[RTA_PRIORITY] ? netlinkAttrU32(tb[RTA_PRIORITY]) : 0;
+    route->family = rtm->rtm_family;
+    route->dstLen = rtm->rtm_dst_len;
+    route->protocol = rtm->rtm_protocol;
+    route->scope = rtm->rtm_scope;
+
+    if ( tb[RTA_DST] )
+        memcpy(route->dst, RTA_DATA(tb[RTA_DST]), len);
+    if ( tb[RTA_GATEWAY] )
+        memcpy(route->gateway, RTA_DATA(tb[RTA_GATEWAY]), len);
+
+    return 0;
+}
+
+static int saveReply(const struct nlmsghdr *nlh, void *user)
+{
+    checkpoint_t    *ckpt = user;
+
+    switch ( nlh->nlmsg_type )
+    {
+        case RTM_NEWLINK:
+        return saveLink(ckpt, nlh);
+
+        case RTM_NEWADDR:
+        return saveAddr(ckpt, nlh);
+
+        case RTM_NEWROUTE:
+        return saveRoute(ckpt, nlh);
+
+        default:
+        return 0;
+    }
+}
+
+/* The links first, so that the addresses and routes find their rank
+ */
+static int dumpState(checkpoint_t *ckpt)
+{
+    netlink_t           nl;
+    netlink_req_t       req = { 0 };
+    struct ifinfomsg    *ifi;
+    struct ifaddrmsg    *ifa;
+    struct rtmsg        *rtm;
+    int                 ret = -1;
+
+    if ( netlinkOpen(&nl, NETLINK_ROUTE, 0) )
+        return -1;
+
+    if ( (ifi = netlinkReqAdd(&req, RTM_GETLINK, NLM_F_DUMP, sizeof(*ifi))) != NULL &&
+            netlinkReqAttrU32(&req, IFLA_EXT_MASK, RTEXT_FILTER_SKIP_STATS) == 0 &&
+            (ifa = netlinkReqAdd(&req, RTM_GETADDR, NLM_F_DUMP, sizeof(*ifa))) != NULL &&
+            (rtm = netlinkReqAdd(&req, RTM_GETROUTE, NLM_F_DUMP, sizeof(*rtm))) != NULL )
+        ret = netlinkTransact(&nl, &req, &saveReply, ckpt);
+
+    netlinkReqFree(&req);
+    netlinkClose(&nl);
+
+    return ret;
+}
+
+static int readResolv(checkpoint_t *ckpt)
+{
+    FILE    *file;
+    size_t  len;
+
+    if ( (file = kernelOpen(RESOLV_CONF, "r")) == NULL )
+        return errno == ENOENT ? 0 : -1;
+
+    if ( (ckpt->resolv = malloc(RESOLV_MAX)) == NULL )
+    {
+        fclose(file);
+        return -1;
+    }
+
+    len = fread(ckpt->resolv, 1, RESOLV_MAX, file);
+    if ( ferror(file) || !feof(file) )
+    {
+        fprintf(stderr, "%s: unreadable or too large\n", RESOLV_CONF);
+        fclose(file);
+        return -1;
+    }
+
+    ckpt->hdr.resolv = len;
+    fclose(file);
+
+    return 0;
+}
+
+static void checkpointFree(checkpoint_t *ckpt)
+{
+    free(ckpt->links);
+    free(ckpt->addrs);
+    free(ckpt->routes);
+    free(ckpt->resolv);
+    free(ckpt->ranks);
+}
+
+int saveCheckpoint(void)
+{
+    checkpoint_t    ckpt;
+    FILE            *file;
+    int             ret = -1;
+
+    memset(&ckpt, 0, sizeof(ckpt));
+    ckpt.hdr.magic = CHECKPOINT_MAGIC;
+    ckpt.hdr.version = CHECKPOINT_VERSION;
+
+    if ( readInterfaces(&ckpt.hdr.stamp, &ckpt) ||
+            (ckpt.hdr.links && dumpState(&ckpt)) || readResolv(&ckpt) )
+    {
+        checkpointFree(&ckpt);
+        return -1;
+    }
+
+    if ( (file = kernelOpen(CHECKPOINT_TMP, "w")) == NULL )
+    {
+        perror(CHECKPOINT_TMP);
+        checkpointFree(&ckpt);
+        return -1;
+    }
+
+    if ( fwrite(&ckpt.hdr, sizeof(ckpt.hdr), 1, file) == 1 &&
+            fwrite(ckpt.links, sizeof(*ckpt.links), ckpt.hdr.links, file) == ckpt.hdr.links &&
+            fwrite(ckpt.addrs, sizeof(*ckpt.addrs), ckpt.hdr.addrs, file) == ckpt.hdr.addrs &&
+            fwrite(ckpt.routes, sizeof(*ckpt.routes), ckpt.hdr.routes, file) == ckpt.hdr.routes &&
+            fwrite(ckpt.resolv, 1, ckpt.hdr.resolv, file) == ckpt.hdr.resolv )
+        ret = 0;
+
+    if ( fclose(file) || ret )
+    {
+        perror(CHECKPOINT_TMP);
+        ret = -1;
+    }
+    else if ( (ret = kernelRename(CHECKPOINT_TMP, CHECKPOINT)) )
+        perror("rename");
+
+    checkpointFree(&ckpt);
+
+    return ret;
+}
+
+/* NULL for an empty array as well as on error, see ok
+ */
+static void *readArray(FILE *file, size_t nb, size_t elem, int *ok)
+{
+    void    *array = NULL;
+
+    if ( !*ok || nb == 0 )
+        return NULL;
+
+    if ( nb > SIZE_MAX / elem || (array = malloc(nb * elem)) == NULL ||
+            fread(array, elem, nb, file) != nb )
+        *ok = 0;
+
+    return array;
+}
+
+static int loadCheckpoint(checkpoint_t *ckpt)
+{
+    FILE        *file;
+    uint64_t    stamp;
+    uint32_t    i;
+    int         ok;
+
+    if ( (file = kernelOpen(CHECKPOINT, "r")) == NULL )
+    {
+        perror(CHECKPOINT);
+        return -1;
+    }
+
+    ok = fread(&ckpt->hdr, sizeof(ckpt->hdr), 1, file) == 1 &&
+        ckpt->hdr.magic == CHECKPOINT_MAGIC &&
+        ckpt->hdr.version == CHECKPOINT_VERSION &&
+        ckpt->hdr.resolv <= RESOLV_MAX;
+
+    ckpt->links = readArray(file, ckpt->hdr.links, sizeof(*ckpt->links), &ok);
+    ckpt->addrs = readArray(file, ckpt->hdr.addrs, sizeof(*ckpt->addrs), &ok);
+    ckpt->routes = readArray(file, ckpt->hdr.routes, sizeof(*ckpt->routes), &ok);
+    ckpt->resolv = readArray(file, ckpt->hdr.resolv, 1, &ok);
+
+    if ( ok && fgetc(file) != EOF )
+        ok = 0;
+
+    fclose(file);
+
+    /* The ranks index the links, none may point past them
+     */
+    for ( i = 0 ; ok && i < ckpt->hdr.addrs ; i++ )
+        ok = ckpt->addrs[i].link < ckpt->hdr.links;
+    for ( i = 0 ; ok && i < ckpt->hdr.routes ; i++ )
+        ok = ckpt->routes[i].link < ckpt->hdr.links;
+
+    if ( !ok )
+    {
+        fprintf(stderr, "%s: not a checkpoint of version %d\n", CHECKPOINT,
+                CHECKPOINT_VERSION);
+        return -1;
+    }
+
+    if ( readInterfaces(&stamp, NULL) || stamp != ckpt->hdr.stamp )
+    {
+        fprintf(stderr, "%s: made from another %s\n", CHECKPOINT, INTERFACES);
+        return -1;
+    }
+
+    return 0;
+}
+
+static int restoreLink(const struct nlmsghdr *nlh, void *user)
+{
+    restore_t               *restore = user;
+    const struct ifinfomsg  *ifi = NLMSG_DATA(nlh);
+    const struct rtattr     *tb[IFLA_MAX + 1];
+    const checkpoint_link_t *link;
+    restore_link_t          *found;
+
+    if ( nlh->nlmsg_type != RTM_NEWLINK )
+        return 0;
+
+    netlinkParseAttr(IFLA_RTA(ifi), IFLA_PAYLOAD(nlh), tb, IFLA_MAX);
+
+    if ( tb[IFLA_IFNAME] == NULL ||
+            (link = findLink(restore->ckpt, RTA_DATA(tb[IFLA_IFNAME]))) == NULL )
+        return 0;
+
+    found = &restore->found[link - restore->ckpt->links];
+    found->ifindex = ifi->ifi_index;
+    found->flags = ifi->ifi_flags;
+    found->mtu = tb[IFLA_MTU] ? netlinkAttrU32(tb[IFLA_MTU]) : 0;
+
+    return 0;
+}
+
+static int findLinks(netlink_t *nl, restore_t *restore)
+{
+    netlink_req_t       req = { 0 };
+    struct ifinfomsg    *ifi;
+    int                 ret = -1;
+
+    if ( (ifi = netlinkReqAdd(&req, RTM_GETLINK, NLM_F_DUMP, sizeof(*ifi))) != NULL &&
+            netlinkReqAttrU32(&req, IFLA_EXT_MASK, RTEXT_FILTER_SKIP_STATS) == 0 )
+        ret = netlinkTransact(nl, &req, &restoreLink, restore);
+
+    netlinkReqFree(&req);
+
+    return ret;
+}
+
+/* Only the failures are answered with more than an ACK
+ */
+static int restoreReply(const struct nlmsghdr *nlh, void *user)
+{
+    const restore_t         *restore = user;
+    const struct nlmsgerr   *err = NLMSG_DATA(nlh);
+    const char              *what;
+
+    if ( nlh->nlmsg_type != NLMSG_ERROR || err->error == 0 )
+        return 0;
+
+    switch ( err->msg.nlmsg_type )
+    {
+        case RTM_NEWLINK:
+        what = "link";
+        break;
+
+        case RTM_NEWADDR:
+        what = "address";
+        break;
+
+        default:
+        what = "route";
+        break;
+    }
+
+    fprintf(stderr, "%s: %s: %s\n",
+            restore->ckpt->links[restore->owners[err->msg.nlmsg_seq - restore->seq]].name,
+            what, strerror(-err->error));
+
+    return 0;
+}
+
+static int addLinkMsg(netlink_req_t *req, const checkpoint_link_t *link,
+        const restore_link_t *found)
+{
+    struct ifinfomsg    *ifi;
+    int                 mtu = link->mtu && link->mtu != found->mtu;
+
+    if ( !((link->flags ^ found->flags) & IFF_UP) && !mtu )
+        return 0;
+
+    if ( (ifi = netlinkReqAdd(req, RTM_NEWLINK, 0, sizeof(*ifi))) == NULL )
+        return -1;
+
+    ifi->ifi_family = AF_UNSPEC;
+    ifi->ifi_index = found->ifindex;
+    ifi->ifi_flags = link->flags & IFF_UP;
+    ifi->ifi_change = (link->flags ^ found->flags) & IFF_UP;
+
+    return mtu ? netlinkReqAttrU32(req, IFLA_MTU, link->mtu) : 0;
+}
+
+static int addAddrMsg(netlink_req_t *req, const checkpoint_addr_t *addr,
+        int ifindex)
+{
+    struct ifaddrmsg    *ifa;
+    size_t              len = addr->family == AF_INET ? 4 : 16;
+    uint32_t            any = 0;
+
+    if ( (ifa = netlinkReqAdd(req, RTM_NEWADDR, NLM_F_CREATE | NLM_F_REPLACE,
+                    sizeof(*ifa))) == NULL )
+        return -1;
+
+    ifa->ifa_family = addr->family;
+    ifa->ifa_prefixlen = addr->prefix;
+    ifa->ifa_scope = addr->scope;
+    ifa->ifa_index = ifindex;
+
+    return netlinkReqAttr(req, IFA_LOCAL, addr->local, len) ||
+        netlinkReqAttr(req, IFA_ADDRESS, addr->peer, len) ||
+        (addr->family == AF_INET && memcmp(addr->broadcast, &any, 4) &&
+         netlinkReqAttr(req, IFA_BROADCAST, addr->broadcast, 4)) ||
+        (addr->flags && netlinkReqAttrU32(req, IFA_FLAGS, addr->flags)) ? -1 : 0;
+}
+
+static int addRouteMsg(netlink_req_t *req, const checkpoint_route_t *route,
+        int ifindex)
+{
+    static const uint8_t    any[16];
+    struct rtmsg            *rtm;
+    size_t                  len = route->family == AF_INET ? 4 : 16;
+
+    if ( (rtm = netlinkReqAdd(req, RTM_NEWROUTE, NLM_F_CREATE | NLM_F_REPLACE,
+                    sizeof(*rtm))) == NULL )
+        return -1;
+
+    rtm->rtm_family = route->family;
+    rtm->rtm_dst_len = route->dstLen;
+    rtm->rtm_table = route->table < 256 ? route->table : RT_TABLE_UNSPEC;
+    rtm->rtm_protocol = route->protocol;
+    rtm->rtm_scope = route->scope;
+    rtm->rtm_type = RTN_UNICAST;
+
+    return netlinkReqAttrU32(req, RTA_TABLE, route->table) ||
+        netlinkReqAttrU32(req, RTA_OIF, ifindex) ||
+        (route->dstLen && netlinkReqAttr(req, RTA_DST, route->dst, len)) ||
+        (memcmp(route->gateway, any, len) &&
+         netlinkReqAttr(req, RTA_GATEWAY, route->gateway, len)) ||
+        (route->priority && netlinkReqAttrU32(req, RTA_PRIORITY, route->priority)) ?
+        -1 : 0;
+}
+
+/* The rank of the link of each message, to name it when it fails
+ */
+static int addOwner(restore_t *restore, size_t *size, unsigned count,
+        uint32_t rank)
+{
+    uint32_t    *owners;
+
+    if ( count == 0 )
+        return 0;
+
+    if ( (owners = grow(restore->owners, size, count - 1,
+                    sizeof(*owners))) == NULL )
+        return -1;
+
+    restore->owners = owners;
+    restore->owners[count - 1] = rank;
+
+    return 0;
+}
+
+/* The links come up before their addresses are added, and the addresses
+ * before the routes through them : the kernel handles the messages of a
+ * batch in order.
+ */
+static int buildBatch(netlink_req_t *req, restore_t *restore,
+        checkpoint_stats_t *stats)
+{
+    const checkpoint_t  *ckpt = restore->ckpt;
+    const restore_link_t *found;
+    size_t              size = 0;
+    uint32_t            i;
+    unsigned            count;
+    int                 failed = 0;
+
+    for ( i = 0 ; i < ckpt->hdr.links ; i++ )
+    {
+        found = &restore->found[i];
+
+        if ( found->ifindex == 0 )
+        {
+            if ( ckpt->links[i].seen )
+            {
+                fprintf(stderr, "%s: no such interface\n", ckpt->links[i].name);
+                failed++;
+            }
+            continue;
+        }
+
+        if ( !ckpt->links[i].seen )
+            continue;
+
+        /* A link already as saved has no message, and no owner
+         */
+        count = req->count;
+        if ( addLinkMsg(req, &ckpt->links[i], found) ||
+                (req->count > count && addOwner(restore, &size, req->count, i)) )
+            return -1;
+    }
+
+    stats->links = req->count;
+
+    for ( i = 0 ; i < ckpt->hdr.addrs ; i++ )
+    {
+        if ( (found = &restore->found[ckpt->addrs[i].link])->ifindex == 0 )
+            continue;
+
+        if ( addAddrMsg(req, &ckpt->addrs[i], found->ifindex) ||
+                addOwner(restore, &size, req->count, ckpt->addrs[i].link) )
+            return -1;
+
+        stats->addrs++;
+    }
+
+    for ( i = 0 ; i < ckpt->hdr.routes ; i++ )
+    {
+        if ( (found = &restore->found[ckpt->routes[i].link])->ifindex == 0 )
+            continue;
+
+        if ( addRouteMsg(req, &ckpt->routes[i], found->ifindex) ||
+                addOwner(restore, &size, req->count, ckpt->routes[i].link) )
+            return -1;
+
+        stats->routes++;
+    }
+
+    return failed;
+}
+
+static int writeResolv(const checkpoint_t *ckpt)
+{
+    FILE    *file;
+    int     ret = 0;
+
+    if ( ckpt->hdr.resolv == 0 )
+        return 0;
+
+    if ( (file = kernelOpen(RESOLV_TMP, "w")) == NULL )
+    {
+        perror(RESOLV_TMP);
+        return -1;
+    }
+
+    if ( fwrite(ckpt->resolv, 1, ckpt->hdr.resolv, file) != ckpt->hdr.resolv )
+        ret = -1;
+
+    if ( fclose(file) || ret )
+    {
+        perror(RESOLV_TMP);
+        return -1;
+    }
+
+    if ( kernelRename(RESOLV_TMP, RESOLV_CONF) )
+    {
+        perror("rename");
+        return -1;
+    }
+
+    return 0;
+}
+
+int restoreCheckpoint(checkpoint_stats_t *stats)
+{
+    checkpoint_t        ckpt;
+    checkpoint_stats_t  none;
+    restore_t           restore;
+    netlink_req_t       req = { 0 };
+    netlink_t           nl;
+    int                 failed,
+                        ret = -1;
+
+    if ( stats == NULL )
+        stats = &none;
+
+    memset(stats, 0, sizeof(*stats));
+    memset(&ckpt, 0, sizeof(ckpt));
+    memset(&restore, 0, sizeof(restore));
+    restore.ckpt = &ckpt;
+
+    if ( loadCheckpoint(&ckpt) )
+    {
+        checkpointFree(&ckpt);
+        return -1;
+    }
+
+    if ( ckpt.hdr.links &&
+            (restore.found = calloc(ckpt.hdr.links, sizeof(*restore.found))) == NULL )
+    {
+        checkpointFree(&ckpt);
+        return -1;
+    }
+
+    if ( netlinkOpen(&nl, NETLINK_ROUTE, 0) )
+        goto out;
+
+    if ( findLinks(&nl, &restore) || (failed = buildBatch(&req, &restore, stats)) < 0 )
+        goto close;
+
+    if ( req.count )
+    {
+        /* The sequence numbers are those given by netlinkTransact()
+         */
+        restore.seq = nl.seq;
+        if ( (ret = netlinkTransact(&nl, &req, &restoreReply, &restore)) < 0 )
+            goto close;
+        failed += ret;
+    }
+
+    if ( writeResolv(&ckpt) )
+        failed++;
+
+    stats->failed = failed;
+    ret = failed;
+
+close:
+    netlinkReqFree(&req);
+    netlinkClose(&nl);
+
+out:
+    free(restore.owners);
+    free(restore.found);
+    checkpointFree(&ckpt);
+
+    return ret;
+}
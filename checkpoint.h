@@ -0,0 +1,46 @@
+#ifndef __CHECKPOINT_H__
+#define __CHECKPOINT_H__
+
+#include "netconfig.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/* Binary image of the state applied from the interfaces file, kept next
+ * to it : the links of its stanzas, the permanent addresses and the routes
+ * of the static and manual ones, and resolv.conf. The interfaces file
+ * stays the reference, a checkpoint made from another version of it is
+ * refused.
+ */
+#define CHECKPOINT      "/mnt/boot/conf/interfaces.ckpt"
+
+typedef struct checkpoint_stats
+{
+    unsigned    links;
+    unsigned    addrs;
+    unsigned    routes;
+    unsigned    failed;
+} checkpoint_stats_t;
+
+/* Rebuilds CHECKPOINT from the interfaces file and one batch of dumps.
+ * setDomainNameServer() calls it. saveInterfaceIpConfig() and
+ * setInterfaceOption() leave it to their caller, once after a run of
+ * them : until then the checkpoint is refused.
+ */
+NETCONFIG_API
+int saveCheckpoint(void);
+
+/* Replays CHECKPOINT : one link dump to find the interfaces, then a single
+ * batch of the links that differ, the addresses and the routes, and
+ * resolv.conf. Returns the number of messages refused or -1 on error,
+ * stats may be NULL.
+ */
+NETCONFIG_API
+int restoreCheckpoint(checkpoint_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __CHECKPOINT_H__ */
@@ -1,4 +1,6 @@
 #include "dhcp.h"
+#include "kernel.h"
+#include "trace.h"
 
 #include <stdio.h>
 #include <string.h>
@@ -17,9 +19,11 @@ int isInterfaceDynamic(const char *ifname)
     FILE    *f;
     int     ret = 0;
 
+    TRACE_ENTRY(ifname);
+
     if ( ifname == NULL ||
-            (f = fopen(LEASES, "r")) == NULL )
-        return 0;
+            (f = kernelOpen(LEASES, "r")) == NULL )
+        return TRACE_RETURN(0);
 
     while ( fgets(buff, sizeof(buff), f) )
     {
@@ -32,7 +36,7 @@ int isInterfaceDynamic(const char *ifname)
 
     fclose(f);
 
-    return ret;
+    return TRACE_RETURN(ret);
 #undef BUFFLEN
 }
 
@@ -42,13 +46,15 @@ int getDhcpLease(const char *ifname)
     pid_t       pid;
     const char  *arg [] = {DHCLIENT, ifname, NULL};
 
+    TRACE_ENTRY(ifname);
+
     if ( ifname == NULL )
-        return 0;
+        return TRACE_RETURN(0);
 
     if ( (pid = fork()) == -1 )
     {
         perror("fork");
-        return -1;
+        return TRACE_RETURN(-1);
     }
     if ( pid == 0 )
     {
@@ -69,5 +75,5 @@ int getDhcpLease(const char *ifname)
             ret = -1;
     }
 
-    return ret;
+    return TRACE_RETURN(ret);
 }
@@ -1,12 +1,16 @@
 #ifndef __DHCP_H__
 #define __DHCP_H__
 
+#include "netconfig.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif /* __cplusplus */
 
+NETCONFIG_API
 int isInterfaceDynamic(const char *ifname);
 
+NETCONFIG_API
 int getDhcpLease(const char *ifname);
 
 #ifdef __cplusplus
@@ -0,0 +1,666 @@
+#include "exporter.h"
+#include "inventory.h"
+#include "dhcp.h"
+#include "lease.h"
+
+/* Each interface keeps its sample lines already rendered, one per metric
+ * family. A scrape costs one link dump, which brings the counters, and
+ * only the lines whose value changed are rendered again. Addresses and
+ * routes, with the rules, are dumped again only when the kernel notified
+ * a change of them, the name server and the DHCP leases when their file
+ * changed.
+ */
+
+#include <linux/fib_rules.h>
+
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#define LINELEN         384
+#define CLIENT_TIMEOUT  2
+
+#define CONTENT_TYPE    "application/openmetrics-text; version=1.0.0; charset=utf-8"
+
+enum
+{
+    METRIC_INFO,
+    METRIC_PLUGGED,
+    METRIC_DYNAMIC,
+    METRIC_COUNTERS,
+    METRIC_RX_BYTES = METRIC_COUNTERS,
+    METRIC_RX_PACKETS,
+    METRIC_RX_ERRORS,
+    METRIC_RX_DROPPED,
+    METRIC_TX_BYTES,
+    METRIC_TX_PACKETS,
+    METRIC_TX_ERRORS,
+    METRIC_TX_DROPPED,
+    NBMETRIC,
+};
+
+typedef struct metric_family
+{
+    const char  *name;
+    const char  *type;
+    const char  *help;
+    size_t      stat;
+} metric_family_t;
+
+#define STAT(field)     offsetof(struct rtnl_link_stats64, field)
+
+static const metric_family_t    families [NBMETRIC] =
+{
+    {"netconfig_interface", "info", "Interface configuration", 0},
+    {"netconfig_interface_plugged", "gauge", "Interface is UP and RUNNING", 0},
+    {"netconfig_interface_dynamic", "gauge", "Interface got a DHCP lease", 0},
+    {"netconfig_receive_bytes", "counter", "Bytes received", STAT(rx_bytes)},
+    {"netconfig_receive_packets", "counter", "Packets received", STAT(rx_packets)},
+    {"netconfig_receive_errors", "counter", "Receive errors", STAT(rx_errors)},
+    {"netconfig_receive_dropped", "counter", "Received packets dropped", STAT(rx_dropped)},
+    {"netconfig_transmit_bytes", "counter", "Bytes transmitted", STAT(tx_bytes)},
+    {"netconfig_transmit_packets", "counter", "Packets transmitted", STAT(tx_packets)},
+    {"netconfig_transmit_errors", "counter", "Transmit errors", STAT(tx_errors)},
+    {"netconfig_transmit_dropped", "counter", "Transmitted packets dropped", STAT(tx_dropped)},
+};
+
+#undef STAT
+
+typedef struct exporter_iface
+{
+    inventory_link_t    link;
+    char                label[4 * IFNAMSIZ + 16];
+    unsigned short      len[NBMETRIC];
+    char                lines[NBMETRIC][LINELEN];
+} exporter_iface_t;
+
+typedef struct exporter
+{
+    netlink_t           nl;
+    netlink_t           events;
+    exporter_iface_t    **ifaces;
+    size_t              nb;
+    int                 addrDirty;
+    struct timespec     resolv;
+    struct timespec     leases;
+    char                ns[INET6_ADDRSTRLEN];
+    char                *out;
+    size_t              outLen;
+    size_t              outSize;
+} exporter_t;
+
+static uint64_t statValue(const inventory_link_t *link, int metric)
+{
+    return *(const uint64_t *) ((const char *) &link->stats +
+            families[metric].stat);
+}
+
+/* Label values escape backslashes, quotes and new lines
+ */
+static void renderLabel(exporter_iface_t *iface)
+{
+    const char  *s;
+    char        *p = iface->label;
+
+    p += sprintf(p, "interface=\"");
+    for ( s = iface->link.name ; *s ; s++ )
+    {
+        if ( *s == '\\' || *s == '"' )
+            *p++ = '\\';
+
+        if ( *s == '\n' )
+        {
+            *p++ = '\\';
+            *p++ = 'n';
+        }
+        else
+            *p++ = *s;
+    }
+
+    *p++ = '"';
+    *p = '\0';
+}
+
+static void renderLine(exporter_iface_t *iface, int metric, const char *fmt, ...)
+{
+    va_list ap;
+    int     len;
+
+    va_start(ap, fmt);
+    len = vsnprintf(iface->lines[metric], LINELEN, fmt, ap);
+    va_end(ap);
+
+    iface->len[metric] = len < 0 ? 0 : len >= LINELEN ? LINELEN - 1 : len;
+}
+
+static void renderState(exporter_t *exp, exporter_iface_t *iface)
+{
+    interface_info_t    info;
+
+    inventoryInfo(&iface->link, exp->ns, &info);
+    renderLabel(iface);
+
+    renderLine(iface, METRIC_INFO,
+            "netconfig_interface_info{%s,mac=\"%s\",ip=\"%s\",mask=\"%s\","
+            "bcast=\"%s\",gw=\"%s\",ns=\"%s\"} 1\n", iface->label,
+            info.mac, info.ip, info.mask, info.bcast, info.gw, info.ns);
+    renderLine(iface, METRIC_PLUGGED, "%s{%s} %d\n",
+            families[METRIC_PLUGGED].name, iface->label, info.plugged);
+    renderLine(iface, METRIC_DYNAMIC, "%s{%s} %d\n",
+            families[METRIC_DYNAMIC].name, iface->label, info.dynamic);
+}
+
+static void renderCounter(exporter_iface_t *iface, int metric)
+{
+    if ( !iface->link.hasStats )
+    {
+        iface->len[metric] = 0;
+        return;
+    }
+
+    renderLine(iface, metric, "%s_total{%s} %llu\n", families[metric].name,
+            iface->label, (unsigned long long) statValue(&iface->link, metric));
+}
+
+/* Update an interface from a new link record, the lines of the changed
+ * values only are rendered again
+ */
+static void updateIface(exporter_t *exp, exporter_iface_t *iface,
+        const inventory_link_t *link, int force)
+{
+    inventory_link_t    old = iface->link;
+    int                 metric,
+                        state;
+
+    state = force || memcmp(&old, link, offsetof(inventory_link_t, stats));
+
+    iface->link = *link;
+    if ( state )
+        renderState(exp, iface);
+
+    for ( metric = METRIC_COUNTERS ; metric < NBMETRIC ; metric++ )
+    {
+        if ( state || link->hasStats != old.hasStats ||
+                statValue(link, metric) != statValue(&old, metric) )
+            renderCounter(iface, metric);
+    }
+}
+
+static int compareIface(const void *a, const void *b)
+{
+    const exporter_iface_t  *ia = *(exporter_iface_t * const *) a,
+                            *ib = *(exporter_iface_t * const *) b;
+
+    return (ia->link.ifindex > ib->link.ifindex) -
+        (ia->link.ifindex < ib->link.ifindex);
+}
+
+static exporter_iface_t *findIface(const exporter_t *exp, int ifindex)
+{
+    exporter_iface_t    key,
+                        *pkey = &key,
+                        **found;
+
+    key.link.ifindex = ifindex;
+    found = bsearch(&pkey, exp->ifaces, exp->nb, sizeof(*exp->ifaces),
+            &compareIface);
+
+    return found ? *found : NULL;
+}
+
+static int fileChanged(const char *path, struct timespec *stamp)
+{
+    struct stat st;
+
+    if ( stat(path, &st) < 0 )
+        memset(&st.st_mtim, 0, sizeof(st.st_mtim));
+
+    if ( st.st_mtim.tv_sec == stamp->tv_sec &&
+            st.st_mtim.tv_nsec == stamp->tv_nsec )
+        return 0;
+
+    *stamp = st.st_mtim;
+
+    return 1;
+}
+
+static int inventoryReply(const struct nlmsghdr *nlh, void *user)
+{
+    return inventoryParse(user, nlh);
+}
+
+/* Any address, route or rule notification, or a lost one, means that the
+ * next scrape dumps them again
+ */
+static void drainEvents(exporter_t *exp)
+{
+    int got;
+
+    while ( (got = netlinkRecv(&exp->events, NULL, NULL)) > 0 )
+        exp->addrDirty = 1;
+
+    if ( got < 0 )
+        exp->addrDirty = 1;
+}
+
+static int refresh(exporter_t *exp)
+{
+    netlink_req_t       req = { 0 };
+    inventory_t         inv = { 0 };
+    exporter_iface_t    **ifaces = NULL,
+                        *iface;
+    inventory_link_t    *link;
+    struct ifaddrmsg    *ifa;
+    struct rtmsg        *rtm;
+    struct fib_rule_hdr *frh;
+    size_t              i;
+    int                 force = 0,
+                        addr,
+                        ret = -1;
+
+    drainEvents(exp);
+    addr = exp->addrDirty;
+    exp->addrDirty = 0;
+
+    /* No RTEXT_FILTER_SKIP_STATS here, the counters are wanted
+     */
+    if ( netlinkReqAdd(&req, RTM_GETLINK, NLM_F_DUMP, sizeof(struct ifinfomsg)) == NULL ||
+            netlinkTransact(&exp->nl, &req, &inventoryReply, &inv) )
+        goto out;
+
+    inventorySort(&inv);
+
+    if ( addr )
+    {
+        netlinkReqReset(&req);
+        if ( (ifa = netlinkReqAdd(&req, RTM_GETADDR, NLM_F_DUMP, sizeof(*ifa))) == NULL )
+            goto out;
+        ifa->ifa_family = AF_INET;
+
+        if ( (rtm = netlinkReqAdd(&req, RTM_GETROUTE, NLM_F_DUMP, sizeof(*rtm))) == NULL )
+            goto out;
+        rtm->rtm_family = AF_INET;
+
+        if ( (frh = netlinkReqAdd(&req, RTM_GETRULE, NLM_F_DUMP, sizeof(*frh))) == NULL )
+            goto out;
+        frh->family = AF_INET;
+
+        if ( netlinkTransact(&exp->nl, &req, &inventoryReply, &inv) )
+            goto out;
+
+        inventoryResolve(&inv);
+    }
+
+    if ( fileChanged(RESOLV_CONF, &exp->resolv) )
+    {
+        exp->ns[0] = '\0';
+        getDomainNameServer(exp->ns, sizeof(exp->ns));
+        force = 1;
+    }
+
+    if ( fileChanged(DHCLIENT_LEASES, &exp->leases) )
+        force = 1;
+
+    if ( inv.nb && (ifaces = calloc(inv.nb, sizeof(*ifaces))) == NULL )
+        goto out;
+
+    for ( i = 0 ; i < inv.nb ; i++ )
+    {
+        link = &inv.links[i];
+
+        if ( (iface = findIface(exp, link->ifindex)) )
+        {
+            if ( !addr )
+            {
+                link->addr = iface->link.addr;
+                link->bcast = iface->link.bcast;
+                link->prefixlen = iface->link.prefixlen;
+                link->hasAddr = iface->link.hasAddr;
+                link->gateway = iface->link.gateway;
+                link->hasGateway = iface->link.hasGateway;
+                link->table = iface->link.table;
+            }
+
+            updateIface(exp, iface, link, force);
+        }
+        else
+        {
+            if ( (iface = calloc(1, sizeof(*iface))) == NULL )
+                goto out;
+
+            updateIface(exp, iface, link, 1);
+        }
+
+        ifaces[i] = iface;
+    }
+
+    ret = 0;
+
+out:
+    if ( ret == 0 )
+    {
+        /* Interfaces gone from the dump are released
+         */
+        for ( i = 0 ; i < exp->nb ; i++ )
+        {
+            if ( inventoryFind(&inv, exp->ifaces[i]->link.ifindex) == NULL )
+                free(exp->ifaces[i]);
+        }
+
+        free(exp->ifaces);
+        exp->ifaces = ifaces;
+        exp->nb = inv.nb;
+    }
+    else
+    {
+        /* Keep the previous state, addresses are to be dumped again
+         */
+        for ( i = 0 ; ifaces && i < inv.nb ; i++ )
+        {
+            if ( ifaces[i] && findIface(exp, ifaces[i]->link.ifindex) != ifaces[i] )
+                free(ifaces[i]);
+        }
+
+        free(ifaces);
+        exp->addrDirty = 1;
+    }
+
+    inventoryFree(&inv);
+    netlinkReqFree(&req);
+
+    return ret;
+}
+
+static int appendOut(exporter_t *exp, const char *data, size_t len)
+{
+    char    *out;
+    size_t  size;
+
+    if ( exp->outLen + len > exp->outSize )
+    {
+        for ( size = exp->outSize ? exp->outSize : 64 * 1024 ;
+                size < exp->outLen + len ; size *= 2 )
+            ;
+
+        if ( (out = realloc(exp->out, size)) == NULL )
+            return -1;
+
+        exp->out = out;
+        exp->outSize = size;
+    }
+
+    memcpy(exp->out + exp->outLen, data, len);
+    exp->outLen += len;
+
+    return 0;
+}
+
+/* The samples of a family must be contiguous, the pre-rendered lines are
+ * gathered family by family
+ */
+static int renderMetrics(exporter_t *exp)
+{
+#define BUFFLEN     256
+    char    buff[BUFFLEN];
+    size_t  i;
+    int     metric,
+            len;
+
+    exp->outLen = 0;
+
+    for ( metric = 0 ; metric < NBMETRIC ; metric++ )
+    {
+        len = snprintf(buff, sizeof(buff), "# TYPE %s %s\n# HELP %s %s\n",
+                families[metric].name, families[metric].type,
+                families[metric].name, families[metric].help);
+
+        if ( appendOut(exp, buff, len) )
+            return -1;
+
+        for ( i = 0 ; i < exp->nb ; i++ )
+        {
+            if ( appendOut(exp, exp->ifaces[i]->lines[metric],
+                        exp->ifaces[i]->len[metric]) )
+                return -1;
+        }
+    }
+
+    return appendOut(exp, "# EOF\n", 6);
+#undef BUFFLEN
+}
+
+static int sendAll(int fd, const char *data, size_t len)
+{
+    ssize_t sent;
+
+    while ( len )
+    {
+        if ( (sent = send(fd, data, len, MSG_NOSIGNAL)) < 0 )
+        {
+            if ( errno == EINTR )
+                continue;
+
+            return -1;
+        }
+
+        data += sent;
+        len -= sent;
+    }
+
+    return 0;
+}
+
+/* One HTTP/1.0 exchange per connection : the request is read up to the
+ * end of its headers, any GET gets the metrics
+ */
+static void serveClient(exporter_t *exp, int fd)
+{
+#define BUFFLEN     4096
+    char            buff[BUFFLEN];
+    struct timeval  tv = { CLIENT_TIMEOUT, 0 };
+    size_t          len = 0;
+    ssize_t         got;
+    int             hdr;
+
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+    while ( len < sizeof(buff) - 1 )
+    {
+        if ( (got = recv(fd, buff + len, sizeof(buff) - 1 - len, 0)) <= 0 )
+            break;
+
+        len += got;
+        buff[len] = '\0';
+        if ( strstr(buff, "\r\n\r\n") || strstr(buff, "\n\n") )
+            break;
+    }
+
+    if ( len < 4 || strncmp(buff, "GET ", 4) )
+    {
+        hdr = snprintf(buff, sizeof(buff), "HTTP/1.0 405 Method Not Allowed\r\n"
+                "Allow: GET\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+        sendAll(fd, buff, hdr);
+        return;
+    }
+
+    if ( refresh(exp) || renderMetrics(exp) )
+    {
+        hdr = snprintf(buff, sizeof(buff), "HTTP/1.0 500 Internal Server Error\r\n"
+                "Content-Length: 0\r\nConnection: close\r\n\r\n");
+        sendAll(fd, buff, hdr);
+        return;
+    }
+
+    hdr = snprintf(buff, sizeof(buff), "HTTP/1.0 200 OK\r\n"
+            "Content-Type: " CONTENT_TYPE "\r\n"
+            "Content-Length: %zu\r\nConnection: close\r\n\r\n", exp->outLen);
+
+    if ( sendAll(fd, buff, hdr) == 0 )
+        sendAll(fd, exp->out, exp->outLen);
+#undef BUFFLEN
+}
+
+static int listenUnix(const char *path)
+{
+    struct sockaddr_un  addr;
+    int                 fd;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if ( strlen(path) >= sizeof(addr.sun_path) )
+    {
+        fprintf(stderr, "%s: path too long\n", path);
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    if ( (fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0 )
+    {
+        perror("socket");
+        return -1;
+    }
+
+    unlink(path);
+    if ( bind(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0 ||
+            listen(fd, SOMAXCONN) < 0 )
+    {
+        perror(path);
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+static int listenInet(const char *listenAddr)
+{
+    struct addrinfo hints,
+                    *res,
+                    *ai;
+    char            host[NI_MAXHOST] = "";
+    const char      *port,
+                    *sep;
+    int             fd = -1,
+                    opt = 1,
+                    ret;
+
+    /* [host:]port, an IPv6 host goes between brackets
+     */
+    if ( (sep = strrchr(listenAddr, ':')) )
+    {
+        port = sep + 1;
+        if ( listenAddr[0] == '[' && sep > listenAddr && sep[-1] == ']' )
+            snprintf(host, sizeof(host), "%.*s", (int) (sep - listenAddr - 2),
+                    listenAddr + 1);
+        else
+            snprintf(host, sizeof(host), "%.*s", (int) (sep - listenAddr),
+                    listenAddr);
+    }
+    else
+        port = listenAddr;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+
+    if ( (ret = getaddrinfo(host[0] ? host : NULL, port, &hints, &res)) )
+    {
+        fprintf(stderr, "%s: %s\n", listenAddr, gai_strerror(ret));
+        return -1;
+    }
+
+    for ( ai = res ; ai ; ai = ai->ai_next )
+    {
+        if ( (fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC,
+                        ai->ai_protocol)) < 0 )
+            continue;
+
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+        if ( bind(fd, ai->ai_addr, ai->ai_addrlen) == 0 &&
+                listen(fd, SOMAXCONN) == 0 )
+            break;
+
+        close(fd);
+        fd = -1;
+    }
+
+    if ( fd < 0 )
+        perror(listenAddr);
+
+    freeaddrinfo(res);
+
+    return fd;
+}
+
+int serveMetrics(const char *listenAddr)
+{
+    exporter_t  exp;
+    size_t      i;
+    int         fd,
+                client,
+                ret = -1;
+
+    if ( listenAddr == NULL )
+        return -1;
+
+    memset(&exp, 0, sizeof(exp));
+    exp.addrDirty = 1;
+
+    /* Subscribe before the first dump so that no change is missed
+     */
+    if ( netlinkOpen(&exp.events, NETLINK_ROUTE,
+                RTMGRP_IPV4_IFADDR | RTMGRP_IPV4_ROUTE | RTMGRP_IPV4_RULE) )
+        return -1;
+
+    if ( fcntl(exp.events.fd, F_SETFL, O_NONBLOCK) < 0 )
+    {
+        perror("fcntl");
+        netlinkClose(&exp.events);
+        return -1;
+    }
+
+    if ( netlinkOpen(&exp.nl, NETLINK_ROUTE, 0) )
+    {
+        netlinkClose(&exp.events);
+        return -1;
+    }
+
+    fd = strchr(listenAddr, '/') ? listenUnix(listenAddr) : listenInet(listenAddr);
+
+    while ( fd >= 0 )
+    {
+        if ( (client = accept(fd, NULL, NULL)) < 0 )
+        {
+            if ( errno == EINTR || errno == ECONNABORTED )
+                continue;
+
+            perror("accept");
+            break;
+        }
+
+        serveClient(&exp, client);
+        close(client);
+    }
+
+    if ( fd >= 0 )
+        close(fd);
+
+    for ( i = 0 ; i < exp.nb ; i++ )
+        free(exp.ifaces[i]);
+
+    free(exp.ifaces);
+    free(exp.out);
+    netlinkClose(&exp.nl);
+    netlinkClose(&exp.events);
+
+    return ret;
+}
@@ -0,0 +1,21 @@
+#ifndef __EXPORTER_H__
+#define __EXPORTER_H__
+
+#include "netconfig.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/* Serve the interfaces state and counters as OpenMetrics text over HTTP.
+ * listen is either a unix socket path (anything with a '/') or
+ * [host:]port. Only returns on error.
+ */
+NETCONFIG_API
+int serveMetrics(const char *listen);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __EXPORTER_H__ */
@@ -0,0 +1,498 @@
+#include "failover.h"
+#include "netlink.h"
+
+/* One rtnetlink socket follows the link and neighbor groups, it is bound
+ * before the first dump so that no change is lost, another one sends the
+ * requests. The gateways are few, they are simply scanned.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+
+#define FAILOVER_INTERVAL   1000
+
+/* NUD_VALID of the kernel : a link layer address is known
+ */
+#define FAILOVER_VALID      (NUD_PERMANENT | NUD_NOARP | NUD_REACHABLE | \
+                             NUD_PROBE | NUD_STALE | NUD_DELAY)
+#define FAILOVER_CONFIRMED  (NUD_PERMANENT | NUD_NOARP | NUD_REACHABLE)
+
+typedef struct failover_gw
+{
+    char            name[IFNAMSIZ];
+    struct in_addr  addr;
+    int             ifindex;
+    uint16_t        state;
+    uint8_t         running;
+} failover_gw_t;
+
+struct gateway_failover
+{
+    netlink_t       events;
+    netlink_t       nl;
+    netlink_req_t   req;
+    failover_gw_t   *gws;
+    size_t          nb;
+    size_t          size;
+    int             active;
+    int             interval;
+    int             loaded;
+    long long       received;
+    long long       nextProbe;
+};
+
+static long long monotonicUs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (long long) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+gateway_failover_t *failoverOpen(int interval)
+{
+    gateway_failover_t  *fo;
+
+    if ( (fo = calloc(1, sizeof(*fo))) == NULL )
+        return NULL;
+
+    fo->active = -1;
+    fo->interval = interval > 0 ? interval : FAILOVER_INTERVAL;
+
+    if ( netlinkOpen(&fo->events, NETLINK_ROUTE, RTMGRP_LINK | RTMGRP_NEIGH) )
+    {
+        free(fo);
+        return NULL;
+    }
+
+    if ( fo->events.fd >= 0 && fcntl(fo->events.fd, F_SETFL, O_NONBLOCK) < 0 )
+    {
+        perror("fcntl");
+        netlinkClose(&fo->events);
+        free(fo);
+        return NULL;
+    }
+
+    if ( netlinkOpen(&fo->nl, NETLINK_ROUTE, 0) )
+    {
+        netlinkClose(&fo->events);
+        free(fo);
+        return NULL;
+    }
+
+    return fo;
+}
+
+void failoverClose(gateway_failover_t *fo)
+{
+    if ( fo == NULL )
+        return;
+
+    netlinkClose(&fo->events);
+    netlinkClose(&fo->nl);
+    netlinkReqFree(&fo->req);
+    free(fo->gws);
+    free(fo);
+}
+
+int failoverAddGateway(gateway_failover_t *fo, const char *ifname,
+        const char *gw)
+{
+    failover_gw_t   *gws,
+                    *new;
+    size_t          size;
+
+    if ( fo == NULL || ifname == NULL || gw == NULL ||
+            strlen(ifname) >= IFNAMSIZ )
+        return -1;
+
+    if ( fo->nb == fo->size )
+    {
+        size = fo->size ? fo->size * 2 : 4;
+        if ( (gws = realloc(fo->gws, size * sizeof(*gws))) == NULL )
+            return -1;
+
+        fo->gws = gws;
+        fo->size = size;
+    }
+
+    new = &fo->gws[fo->nb];
+    memset(new, 0, sizeof(*new));
+    strcpy(new->name, ifname);
+
+    if ( inet_pton(AF_INET, gw, &new->addr) != 1 )
+    {
+        fprintf(stderr, "Invalid gateway %s\n", gw);
+        return -1;
+    }
+
+    fo->nb++;
+    fo->loaded = 0;
+
+    return 0;
+}
+
+static failover_gw_t *findGateway(gateway_failover_t *fo, int ifindex,
+        const void *addr)
+{
+    size_t  i;
+
+    for ( i = 0 ; i < fo->nb ; i++ )
+    {
+        if ( fo->gws[i].ifindex == ifindex &&
+                memcmp(&fo->gws[i].addr, addr, sizeof(fo->gws[i].addr)) == 0 )
+            return &fo->gws[i];
+    }
+
+    return NULL;
+}
+
+/* A link seen for the first time, or again, is matched by name. Its
+ * neighbors went away with it.
+ */
+static void linkEvent(gateway_failover_t *fo, const struct nlmsghdr *nlh)
+{
+    const struct ifinfomsg  *ifi = NLMSG_DATA(nlh);
+    const struct rtattr     *tb[IFLA_MAX + 1];
+    const char              *name = NULL;
+    failover_gw_t           *gw;
+    size_t                  i;
+
+    netlinkParseAttr(IFLA_RTA(ifi), IFLA_PAYLOAD(nlh), tb, IFLA_MAX);
+    if ( tb[IFLA_IFNAME] )
+        name = RTA_DATA(tb[IFLA_IFNAME]);
+
+    for ( i = 0 ; i < fo->nb ; i++ )
+    {
+        gw = &fo->gws[i];
+
+        if ( nlh->nlmsg_type == RTM_DELLINK )
+        {
+            if ( gw->ifindex == ifi->ifi_index )
+            {
+                gw->ifindex = 0;
+                gw->running = 0;
+                gw->state = 0;
+            }
+            continue;
+        }
+
+        if ( gw->ifindex != ifi->ifi_index )
+        {
+            if ( gw->ifindex || name == NULL ||
+                    strncmp(gw->name, name, IFNAMSIZ) )
+                continue;
+
+            gw->ifindex = ifi->ifi_index;
+            gw->state = 0;
+        }
+
+        gw->running = (ifi->ifi_flags & (IFF_UP | IFF_RUNNING)) ==
+            (IFF_UP | IFF_RUNNING);
+    }
+}
+
+static void neighborEvent(gateway_failover_t *fo, const struct nlmsghdr *nlh)
+{
+    const struct ndmsg  *ndm = NLMSG_DATA(nlh);
+    const struct rtattr *tb[NDA_MAX + 1];
+    failover_gw_t       *gw;
+
+    if ( ndm->ndm_family != AF_INET )
+        return;
+
+    netlinkParseAttr((const struct rtattr *) ((const char *) ndm +
+                NLMSG_ALIGN(sizeof(*ndm))), NLMSG_PAYLOAD(nlh, sizeof(*ndm)),
+            tb, NDA_MAX);
+
+    if ( tb[NDA_DST] == NULL || RTA_PAYLOAD(tb[NDA_DST]) != sizeof(struct in_addr) ||
+            (gw = findGateway(fo, ndm->ndm_ifindex, RTA_DATA(tb[NDA_DST]))) == NULL )
+        return;
+
+    gw->state = nlh->nlmsg_type == RTM_NEWNEIGH ? ndm->ndm_state : 0;
+}
+
+/* Notifications and dump answers alike
+ */
+static int failoverEvent(const struct nlmsghdr *nlh, void *user)
+{
+    switch ( nlh->nlmsg_type )
+    {
+        case RTM_NEWLINK:
+        case RTM_DELLINK:
+        linkEvent(user, nlh);
+        break;
+
+        case RTM_NEWNEIGH:
+        case RTM_DELNEIGH:
+        neighborEvent(user, nlh);
+        break;
+
+        default:
+        break;
+    }
+
+    return 0;
+}
+
+/* The links are dumped before the neighbors so that the ifindexes are
+ * known when their entries come
+ */
+static int failoverLoad(gateway_failover_t *fo)
+{
+    struct ifinfomsg    *ifi;
+    struct ndmsg        *ndm;
+    size_t              i;
+    int                 ret;
+
+    for ( i = 0 ; i < fo->nb ; i++ )
+    {
+        fo->gws[i].ifindex = 0;
+        fo->gws[i].running = 0;
+        fo->gws[i].state = 0;
+    }
+
+    netlinkReqReset(&fo->req);
+    if ( (ifi = netlinkReqAdd(&fo->req, RTM_GETLINK, NLM_F_DUMP, sizeof(*ifi))) == NULL )
+        return -1;
+    ifi->ifi_family = AF_UNSPEC;
+
+    if ( (ndm = netlinkReqAdd(&fo->req, RTM_GETNEIGH, NLM_F_DUMP, sizeof(*ndm))) == NULL )
+        return -1;
+    ndm->ndm_family = AF_INET;
+
+    if ( (ret = netlinkTransact(&fo->nl, &fo->req, &failoverEvent, fo)) )
+        return -1;
+
+    fo->loaded = 1;
+
+    return 0;
+}
+
+/* Unknown neighbors are given a chance, the kernel resolves them as soon
+ * as the route uses them
+ */
+static int gatewayUp(const failover_gw_t *gw)
+{
+    return gw->ifindex && gw->running &&
+        (gw->state == 0 || (gw->state & FAILOVER_VALID));
+}
+
+static int swapError(const struct nlmsghdr *nlh, void *user)
+{
+    const failover_gw_t *gw = user;
+    char                str[INET_ADDRSTRLEN];
+
+    if ( nlh->nlmsg_type == NLMSG_ERROR )
+    {
+        inet_ntop(AF_INET, &gw->addr, str, sizeof(str));
+        fprintf(stderr, "%s: default route via %s: %s\n", gw->name, str,
+                strerror(-((const struct nlmsgerr *) NLMSG_DATA(nlh))->error));
+    }
+
+    return 0;
+}
+
+/* The replacement of the route is atomic : the packets go either to the
+ * old gateway or to the new one
+ */
+static int swapRoute(gateway_failover_t *fo, int to, const char *reason,
+        failover_callback_t cb, void *user)
+{
+    failover_gw_t       *gw = &fo->gws[to];
+    failover_event_t    ev;
+    struct rtmsg        *rtm;
+    int                 ret;
+
+    netlinkReqReset(&fo->req);
+    if ( (rtm = netlinkReqAdd(&fo->req, RTM_NEWROUTE, NLM_F_CREATE | NLM_F_REPLACE,
+                    sizeof(*rtm))) == NULL )
+        return -1;
+
+    rtm->rtm_family = AF_INET;
+    rtm->rtm_table = RT_TABLE_MAIN;
+    rtm->rtm_protocol = RTPROT_STATIC;
+    rtm->rtm_scope = RT_SCOPE_UNIVERSE;
+    rtm->rtm_type = RTN_UNICAST;
+
+    if ( netlinkReqAttr(&fo->req, RTA_GATEWAY, &gw->addr, sizeof(gw->addr)) ||
+            netlinkReqAttrU32(&fo->req, RTA_OIF, gw->ifindex) )
+        return -1;
+
+    if ( (ret = netlinkTransact(&fo->nl, &fo->req, &swapError, gw)) )
+        return ret < 0 ? -1 : 0;
+
+    memset(&ev, 0, sizeof(ev));
+    memcpy(ev.name, gw->name, IFNAMSIZ);
+    inet_ntop(AF_INET, &gw->addr, ev.gw, sizeof(ev.gw));
+    if ( fo->active >= 0 )
+    {
+        memcpy(ev.fromName, fo->gws[fo->active].name, IFNAMSIZ);
+        inet_ntop(AF_INET, &fo->gws[fo->active].addr, ev.from, sizeof(ev.from));
+    }
+    ev.reason = reason;
+    ev.elapsed = monotonicUs() - fo->received;
+
+    fo->active = to;
+
+    return cb ? (cb(&ev, user) ? -1 : 0) : 0;
+}
+
+static int failoverSelect(gateway_failover_t *fo, failover_callback_t cb,
+        void *user)
+{
+    const failover_gw_t *active;
+    size_t              best;
+
+    for ( best = 0 ; best < fo->nb && !gatewayUp(&fo->gws[best]) ; best++ )
+        ;
+
+    /* Keep the route when no gateway is left
+     */
+    if ( best == fo->nb || (int) best == fo->active )
+        return 0;
+
+    if ( fo->active < 0 )
+        return swapRoute(fo, best, "initial", cb, user);
+
+    active = &fo->gws[fo->active];
+    if ( !gatewayUp(active) )
+        return swapRoute(fo, best, !active->running ? "link down" : "failed",
+                cb, user);
+
+    /* Only a confirmed gateway takes the route back
+     */
+    if ( (int) best < fo->active && (fo->gws[best].state & FAILOVER_CONFIRMED) )
+        return swapRoute(fo, best, "recovered", cb, user);
+
+    return 0;
+}
+
+/* NTF_USE has the kernel resolve the entry as if a packet was sent, a
+ * stale one goes through DELAY and PROBE, a failed one is tried again
+ */
+static int failoverProbe(gateway_failover_t *fo)
+{
+    struct ndmsg    *ndm;
+    size_t          i;
+
+    netlinkReqReset(&fo->req);
+    for ( i = 0 ; i < fo->nb ; i++ )
+    {
+        if ( fo->gws[i].ifindex == 0 || !fo->gws[i].running )
+            continue;
+
+        if ( (ndm = netlinkReqAdd(&fo->req, RTM_NEWNEIGH, NLM_F_CREATE,
+                        sizeof(*ndm))) == NULL )
+            return -1;
+
+        ndm->ndm_family = AF_INET;
+        ndm->ndm_ifindex = fo->gws[i].ifindex;
+        ndm->ndm_flags = NTF_USE;
+
+        if ( netlinkReqAttr(&fo->req, NDA_DST, &fo->gws[i].addr,
+                    sizeof(fo->gws[i].addr)) )
+            return -1;
+    }
+
+    if ( fo->req.count == 0 )
+        return 0;
+
+    /* A refused probe only delays the detection
+     */
+    return netlinkTransact(&fo->nl, &fo->req, NULL, NULL) < 0 ? -1 : 0;
+}
+
+int failoverFd(const gateway_failover_t *fo)
+{
+    return fo ? fo->events.fd : -1;
+}
+
+int failoverTimeout(const gateway_failover_t *fo)
+{
+    long long   now;
+
+    if ( fo == NULL )
+        return -1;
+
+    if ( !fo->loaded )
+        return 0;
+
+    now = monotonicUs() / 1000;
+
+    return fo->nextProbe > now ? (int) (fo->nextProbe - now) : 0;
+}
+
+int failoverProcess(gateway_failover_t *fo, failover_callback_t cb,
+        void *user)
+{
+    long long   now;
+    int         ret = 0;
+
+    if ( fo == NULL )
+        return -1;
+
+    fo->received = monotonicUs();
+
+    while ( fo->events.fd >= 0 &&
+            (ret = netlinkRecv(&fo->events, &failoverEvent, fo)) > 0 )
+        ;
+
+    /* Lost notifications mean a full reload
+     */
+    if ( ret < 0 )
+    {
+        if ( errno != ENOBUFS )
+        {
+            perror("recv");
+            return -1;
+        }
+
+        fo->loaded = 0;
+    }
+
+    if ( !fo->loaded && failoverLoad(fo) )
+        return -1;
+
+    if ( failoverSelect(fo, cb, user) )
+        return -1;
+
+    now = monotonicUs() / 1000;
+    if ( now >= fo->nextProbe )
+    {
+        if ( failoverProbe(fo) )
+            return -1;
+
+        fo->nextProbe = now + fo->interval;
+    }
+
+    return 0;
+}
+
+int failoverRun(gateway_failover_t *fo, failover_callback_t cb, void *user)
+{
+    struct pollfd   pfd = { .events = POLLIN };
+
+    if ( fo == NULL )
+        return -1;
+
+    pfd.fd = fo->events.fd;
+
+    for ( ;; )
+    {
+        if ( failoverProcess(fo, cb, user) )
+            return -1;
+
+        if ( poll(&pfd, 1, failoverTimeout(fo)) < 0 && errno != EINTR )
+        {
+            perror("poll");
+            return -1;
+        }
+    }
+}
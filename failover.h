@@ -0,0 +1,76 @@
+#ifndef __FAILOVER_H__
+#define __FAILOVER_H__
+
+#include "netconfig.h"
+#include "network.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+typedef struct failover_event
+{
+    char        name[IFNAMSIZ];
+    char        gw[INET_ADDRSTRLEN];
+    char        fromName[IFNAMSIZ];
+    char        from[INET_ADDRSTRLEN];
+    const char  *reason;
+    long        elapsed;
+} failover_event_t;
+
+typedef int (*failover_callback_t)(const failover_event_t *ev, void *user);
+
+/* Keeps the default route on the first usable gateway of a list ordered
+ * by priority. The NUD state of the gateways and the carrier of their
+ * interfaces are followed from the rtnetlink notifications, every gateway
+ * being probed again each interval (ms) so that the standby ones are
+ * known alive. When the active one fails the route is swapped by a single
+ * NLM_F_REPLACE message, there is no instant without a default route. A
+ * gateway of higher priority confirmed reachable again takes the route
+ * back.
+ * The time to detect a dead gateway is the one of the NUD timers of its
+ * interface, see net.ipv4.neigh.<if>.* in man (7) arp.
+ */
+typedef struct gateway_failover gateway_failover_t;
+
+NETCONFIG_API
+gateway_failover_t *failoverOpen(int interval);
+
+NETCONFIG_API
+void failoverClose(gateway_failover_t *fo);
+
+/* Gateways are added by decreasing priority
+ */
+NETCONFIG_API
+int failoverAddGateway(gateway_failover_t *fo, const char *ifname,
+        const char *gw);
+
+/* The socket to poll for input and the delay (ms) before the next call
+ * to failoverProcess() is due
+ */
+NETCONFIG_API
+int failoverFd(const gateway_failover_t *fo);
+
+NETCONFIG_API
+int failoverTimeout(const gateway_failover_t *fo);
+
+/* Reads the pending notifications, moves the route when needed then
+ * probes the gateways when it is time. cb, when not NULL, sees every
+ * switchover : from is empty for the first route installed and elapsed
+ * is the time in microseconds between the reception of the notification
+ * and the kernel acknowledging the new route. Returns -1 on error.
+ */
+NETCONFIG_API
+int failoverProcess(gateway_failover_t *fo, failover_callback_t cb,
+        void *user);
+
+/* Event loop, only returns on error
+ */
+NETCONFIG_API
+int failoverRun(gateway_failover_t *fo, failover_callback_t cb, void *user);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __FAILOVER_H__ */
@@ -0,0 +1,1890 @@
+/* fopencookie() is a GNU extension
+ */
+#define _GNU_SOURCE
+
+#include "fakekernel.h"
+#include "netlink.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <net/if.h>
+#include <net/if_arp.h>
+#include <net/route.h>
+#include <netinet/in.h>
+#include <netinet/ether.h>
+#include <arpa/inet.h>
+#include <sys/ioctl.h>
+#include <linux/if_link.h>
+#include <linux/fib_rules.h>
+
+/* From linux/if.h, which conflicts with net/if.h
+ */
+#ifndef IFF_LOWER_UP
+#define IFF_LOWER_UP    0x10000
+#endif
+
+#ifndef IF_OPER_UP
+#define IF_OPER_DOWN    2
+#define IF_OPER_UP      6
+#endif
+
+#define FAKE_DEVICES    "/proc/net/dev"
+
+typedef struct fake_link
+{
+    char            name[IFNAMSIZ];
+    unsigned        flags;
+    int             carrier;
+    unsigned short  type;
+    unsigned char   mac[ETH_ALEN];
+    unsigned        mtu;
+    unsigned        txqlen;
+    int             hasAddr;
+    struct in_addr  addr;
+    struct in_addr  mask;
+    struct in_addr  bcast;
+    int             master;
+    uint32_t        vrfTable;
+} fake_link_t;
+
+typedef struct fake_route
+{
+    struct in_addr  dst;
+    uint8_t         dstLen;
+    struct in_addr  gw;
+    int             ifindex;
+    uint32_t        table;
+} fake_route_t;
+
+typedef struct fake_rule
+{
+    int             iif;
+    int             oif;
+    uint32_t        priority;
+    uint32_t        table;
+} fake_rule_t;
+
+typedef struct fake_file
+{
+    struct fake_file    *next;
+    char                *path;
+    char                *data;
+    size_t              len;
+    int                 written;
+} fake_file_t;
+
+/* Links are never removed, the ifindex of a link is its position + 1 and
+ * the names are indexed in an open addressing table of ifindexes.
+ */
+struct fake_kernel
+{
+    netconfig_backend_t backend;
+
+    fake_link_t         *links;
+    size_t              nbLinks;
+    size_t              sizeLinks;
+
+    int32_t             *names;
+    size_t              namesSize;
+
+    fake_route_t        *routes;
+    size_t              nbRoutes;
+    size_t              sizeRoutes;
+
+    int32_t             *routeSlots;
+    size_t              routeSlotsSize;
+    size_t              routeSlotsUsed;
+
+    fake_rule_t         *rules;
+    size_t              nbRules;
+    size_t              sizeRules;
+
+    fake_file_t         *files;
+
+    /* The answer being built
+     */
+    netlink_req_t       msg;
+};
+
+typedef struct fake_stream
+{
+    fake_kernel_t   *fk;
+    char            *path;
+    char            *buff;
+    size_t          len;
+    size_t          size;
+    size_t          pos;
+    int             writing;
+} fake_stream_t;
+
+static size_t hashName(const char *name)
+{
+    size_t  h = 2166136261u;
+    int     i;
+
+    for ( i = 0 ; i < IFNAMSIZ && name[i] ; i++ )
+        h = (h ^ (unsigned char) name[i]) * 16777619u;
+
+    return h;
+}
+
+static fake_link_t *linkByIndex(fake_kernel_t *fk, int ifindex)
+{
+    if ( ifindex <= 0 || (size_t) ifindex > fk->nbLinks )
+        return NULL;
+
+    return &fk->links[ifindex - 1];
+}
+
+static int linkIndex(const fake_kernel_t *fk, const char *name)
+{
+    size_t  i,
+            mask = fk->namesSize - 1;
+
+    if ( name == NULL || fk->namesSize == 0 )
+        return 0;
+
+    for ( i = hashName(name) & mask ; fk->names[i] ; i = (i + 1) & mask )
+    {
+        if ( strncmp(fk->links[fk->names[i] - 1].name, name, IFNAMSIZ) == 0 )
+            return fk->names[i];
+    }
+
+    return 0;
+}
+
+static fake_link_t *linkByName(fake_kernel_t *fk, const char *name)
+{
+    return linkByIndex(fk, linkIndex(fk, name));
+}
+
+static void indexName(fake_kernel_t *fk, int ifindex)
+{
+    size_t  i,
+            mask = fk->namesSize - 1;
+
+    for ( i = hashName(fk->links[ifindex - 1].name) & mask ; fk->names[i] ;
+            i = (i + 1) & mask )
+        ;
+
+    fk->names[i] = ifindex;
+}
+
+static unsigned linkFlags(const fake_link_t *link)
+{
+    unsigned    flags = link->flags & ~(IFF_RUNNING | IFF_LOWER_UP);
+
+    if ( (flags & IFF_UP) && link->carrier )
+        flags |= IFF_RUNNING | IFF_LOWER_UP;
+
+    return flags;
+}
+
+static void linkAddress(fake_link_t *link, struct in_addr addr, int prefixlen,
+        const struct in_addr *bcast)
+{
+    link->addr = addr;
+    link->mask.s_addr = prefixlen ? htonl(~0U << (32 - prefixlen)) : 0;
+    link->bcast.s_addr = bcast ? bcast->s_addr :
+        (prefixlen < 31 ? addr.s_addr | ~link->mask.s_addr : 0);
+    link->hasAddr = 1;
+}
+
+static int prefixLength(struct in_addr mask)
+{
+    uint32_t    m = ntohl(mask.s_addr);
+    int         len = 0;
+
+    while ( m & 0x80000000u )
+    {
+        len++;
+        m <<= 1;
+    }
+
+    return len;
+}
+
+fake_kernel_t *fakeKernelNew(void)
+{
+    fake_kernel_t   *fk;
+
+    if ( (fk = calloc(1, sizeof(*fk))) == NULL )
+        return NULL;
+
+    return fk;
+}
+
+void fakeKernelFree(fake_kernel_t *fk)
+{
+    fake_file_t *file,
+                *next;
+
+    if ( fk == NULL )
+        return;
+
+    for ( file = fk->files ; file ; file = next )
+    {
+        next = file->next;
+        free(file->path);
+        free(file->data);
+        free(file);
+    }
+
+    netlinkReqFree(&fk->msg);
+    free(fk->links);
+    free(fk->names);
+    free(fk->routes);
+    free(fk->routeSlots);
+    free(fk->rules);
+    free(fk);
+}
+
+int fakeKernelAddLink(fake_kernel_t *fk, const char *name, unsigned flags,
+        const char *mac)
+{
+    fake_link_t         *link;
+    struct ether_addr   eth;
+
+    if ( fk == NULL || name == NULL || *name == '\0' ||
+            strlen(name) >= IFNAMSIZ || linkIndex(fk, name) )
+        return -1;
+
+    if ( mac && ether_aton_r(mac, &eth) == NULL )
+        return -1;
+
+    if ( fk->nbLinks == fk->sizeLinks )
+    {
+        size_t  size = fk->sizeLinks ? fk->sizeLinks * 2 : 64;
+
+        if ( (link = realloc(fk->links, size * sizeof(*link))) == NULL )
+            return -1;
+
+        fk->links = link;
+        fk->sizeLinks = size;
+    }
+
+    /* Keep the names at most half full
+     */
+    if ( (fk->nbLinks + 1) * 2 > fk->namesSize )
+    {
+        size_t  size = fk->namesSize ? fk->namesSize * 2 : 128,
+                i;
+        int32_t *names;
+
+        if ( (names = calloc(size, sizeof(*names))) == NULL )
+            return -1;
+
+        free(fk->names);
+        fk->names = names;
+        fk->namesSize = size;
+        for ( i = 0 ; i < fk->nbLinks ; i++ )
+            indexName(fk, i + 1);
+    }
+
+    link = &fk->links[fk->nbLinks++];
+    memset(link, 0, sizeof(*link));
+    strncpy(link->name, name, IFNAMSIZ - 1);
+    link->carrier = (flags & IFF_RUNNING) != 0;
+    link->flags = flags & ~(IFF_RUNNING | IFF_LOWER_UP);
+    link->txqlen = 1000;
+
+    if ( flags & IFF_LOOPBACK )
+    {
+        link->type = ARPHRD_LOOPBACK;
+        link->mtu = 65536;
+    }
+    else
+    {
+        link->type = ARPHRD_ETHER;
+        link->mtu = 1500;
+        link->flags |= IFF_BROADCAST | IFF_MULTICAST;
+
+        /* A locally administered address made of the ifindex
+         */
+        if ( mac )
+            memcpy(link->mac, &eth, ETH_ALEN);
+        else
+        {
+            link->mac[0] = 0x02;
+            link->mac[2] = fk->nbLinks >> 24;
+            link->mac[3] = fk->nbLinks >> 16;
+            link->mac[4] = fk->nbLinks >> 8;
+            link->mac[5] = fk->nbLinks;
+        }
+    }
+
+    indexName(fk, fk->nbLinks);
+
+    return fk->nbLinks;
+}
+
+int fakeKernelSetAddress(fake_kernel_t *fk, const char *name, const char *ip,
+        int prefixlen, const char *bcast)
+{
+    fake_link_t     *link;
+    struct in_addr  addr,
+                    brd;
+
+    if ( fk == NULL || (link = linkByName(fk, name)) == NULL ||
+            ip == NULL || inet_pton(AF_INET, ip, &addr) != 1 ||
+            prefixlen < 0 || prefixlen > 32 ||
+            (bcast && inet_pton(AF_INET, bcast, &brd) != 1) )
+        return -1;
+
+    linkAddress(link, addr, prefixlen, bcast ? &brd : NULL);
+
+    return 0;
+}
+
+static size_t hashRoute(const fake_route_t *route)
+{
+    size_t  h = 2166136261u;
+
+    h = (h ^ route->dst.s_addr) * 16777619u;
+    h = (h ^ route->dstLen) * 16777619u;
+    h = (h ^ route->table) * 16777619u;
+    h = (h ^ (uint32_t) route->ifindex) * 16777619u;
+
+    return h;
+}
+
+/* A route matches the key on its prefix and table, then on its interface
+ * and gateway when the key has them. Keys with an interface are looked up
+ * in the hash table, the others need a scan.
+ */
+static int matchRoute(const fake_route_t *route, const fake_route_t *key)
+{
+    return route->dst.s_addr == key->dst.s_addr &&
+        route->dstLen == key->dstLen && route->table == key->table &&
+        (key->ifindex == 0 || route->ifindex == key->ifindex) &&
+        (key->gw.s_addr == INADDR_ANY || route->gw.s_addr == key->gw.s_addr);
+}
+
+static fake_route_t *findRoute(fake_kernel_t *fk, const fake_route_t *key)
+{
+    size_t  i,
+            mask = fk->routeSlotsSize - 1;
+
+    if ( key->ifindex == 0 )
+    {
+        for ( i = 0 ; i < fk->nbRoutes ; i++ )
+        {
+            if ( matchRoute(&fk->routes[i], key) )
+                return &fk->routes[i];
+        }
+
+        return NULL;
+    }
+
+    if ( fk->routeSlotsSize == 0 )
+        return NULL;
+
+    for ( i = hashRoute(key) & mask ; fk->routeSlots[i] ; i = (i + 1) & mask )
+    {
+        if ( fk->routeSlots[i] > 0 &&
+                matchRoute(&fk->routes[fk->routeSlots[i] - 1], key) )
+            return &fk->routes[fk->routeSlots[i] - 1];
+    }
+
+    return NULL;
+}
+
+static int32_t *routeSlot(fake_kernel_t *fk, size_t pos)
+{
+    size_t  i,
+            mask = fk->routeSlotsSize - 1;
+
+    for ( i = hashRoute(&fk->routes[pos]) & mask ;
+            fk->routeSlots[i] != (int32_t) pos + 1 ; i = (i + 1) & mask )
+        ;
+
+    return &fk->routeSlots[i];
+}
+
+static int indexRoute(fake_kernel_t *fk, size_t pos)
+{
+    size_t  i,
+            mask;
+
+    /* Keep the slots at most half full, removed ones included
+     */
+    if ( (fk->routeSlotsUsed + 1) * 2 > fk->routeSlotsSize )
+    {
+        size_t  size = fk->routeSlotsSize ? fk->routeSlotsSize : 128;
+        int32_t *slots;
+
+        if ( (fk->nbRoutes + 1) * 4 > size )
+            size *= 2;
+
+        if ( (slots = calloc(size, sizeof(*slots))) == NULL )
+            return -1;
+
+        free(fk->routeSlots);
+        fk->routeSlots = slots;
+        fk->routeSlotsSize = size;
+        fk->routeSlotsUsed = 0;
+        for ( i = 0 ; i < fk->nbRoutes ; i++ )
+        {
+            if ( i != pos )
+                indexRoute(fk, i);
+        }
+    }
+
+    mask = fk->routeSlotsSize - 1;
+    for ( i = hashRoute(&fk->routes[pos]) & mask ; fk->routeSlots[i] > 0 ;
+            i = (i + 1) & mask )
+        ;
+
+    if ( fk->routeSlots[i] == 0 )
+        fk->routeSlotsUsed++;
+
+    fk->routeSlots[i] = pos + 1;
+
+    return 0;
+}
+
+/* NLM_F_REPLACE takes the place of the first route to the prefix,
+ * NLM_F_EXCL refuses to add a route to a prefix already routed, and an
+ * identical route is never added twice
+ */
+static int addRoute(fake_kernel_t *fk, const fake_route_t *route,
+        unsigned flags)
+{
+    fake_route_t    key = *route,
+                    *r;
+
+    key.ifindex = 0;
+    key.gw.s_addr = INADDR_ANY;
+
+    if ( (flags & NLM_F_REPLACE) && (r = findRoute(fk, &key)) )
+    {
+        size_t  pos = r - fk->routes;
+
+        *routeSlot(fk, pos) = -1;
+        *r = *route;
+
+        return indexRoute(fk, pos) ? -ENOMEM : 0;
+    }
+
+    if ( findRoute(fk, route) ||
+            ((flags & NLM_F_EXCL) && findRoute(fk, &key)) )
+        return -EEXIST;
+
+    if ( fk->nbRoutes == fk->sizeRoutes )
+    {
+        size_t  size = fk->sizeRoutes ? fk->sizeRoutes * 2 : 64;
+
+        if ( (r = realloc(fk->routes, size * sizeof(*r))) == NULL )
+            return -ENOMEM;
+
+        fk->routes = r;
+        fk->sizeRoutes = size;
+    }
+
+    fk->routes[fk->nbRoutes] = *route;
+    if ( indexRoute(fk, fk->nbRoutes) )
+        return -ENOMEM;
+
+    fk->nbRoutes++;
+
+    return 0;
+}
+
+/* The last route takes the place of the removed one
+ */
+static int delRoute(fake_kernel_t *fk, const fake_route_t *key)
+{
+    fake_route_t    *r;
+    size_t          pos,
+                    last = fk->nbRoutes - 1;
+
+    if ( (r = findRoute(fk, key)) == NULL )
+        return -ESRCH;
+
+    pos = r - fk->routes;
+    *routeSlot(fk, pos) = -1;
+    if ( pos != last )
+    {
+        *routeSlot(fk, last) = pos + 1;
+        fk->routes[pos] = fk->routes[last];
+    }
+
+    fk->nbRoutes--;
+
+    return 0;
+}
+
+static int parsePrefix(const char *str, struct in_addr *addr, int *len)
+{
+#define BUFFLEN     INET_ADDRSTRLEN
+    char    buff[BUFFLEN];
+    char    *slash,
+            *end;
+
+    if ( strcmp(str, "default") == 0 )
+    {
+        addr->s_addr = INADDR_ANY;
+        *len = 0;
+        return 0;
+    }
+
+    snprintf(buff, sizeof(buff), "%s", str);
+    *len = 32;
+    if ( (slash = strchr(buff, '/')) )
+    {
+        *slash++ = '\0';
+        *len = strtol(slash, &end, 10);
+        if ( *slash == '\0' || *end || *len < 0 || *len > 32 )
+            return -1;
+    }
+
+    return inet_pton(AF_INET, buff, addr) == 1 ? 0 : -1;
+#undef BUFFLEN
+}
+
+static int addTableRoute(fake_kernel_t *fk, const char *dst, const char *gw,
+        const char *dev, uint32_t table)
+{
+    fake_route_t    route;
+    int             len;
+
+    if ( fk == NULL || dst == NULL )
+        return -1;
+
+    memset(&route, 0, sizeof(route));
+    route.table = table;
+
+    if ( parsePrefix(dst, &route.dst, &len) ||
+            (gw && inet_pton(AF_INET, gw, &route.gw) != 1) ||
+            (route.ifindex = linkIndex(fk, dev)) == 0 )
+        return -1;
+
+    route.dstLen = len;
+
+    return addRoute(fk, &route, 0) ? -1 : 0;
+}
+
+int fakeKernelAddRoute(fake_kernel_t *fk, const char *dst, const char *gw,
+        const char *dev)
+{
+    return addTableRoute(fk, dst, gw, dev, RT_TABLE_MAIN);
+}
+
+static fake_file_t *findFile(const fake_kernel_t *fk, const char *path)
+{
+    fake_file_t *file;
+
+    for ( file = fk->files ; file ; file = file->next )
+    {
+        if ( strcmp(file->path, path) == 0 )
+            return file;
+    }
+
+    return NULL;
+}
+
+/* The file takes data over
+ */
+static int storeFile(fake_kernel_t *fk, const char *path, char *data,
+        size_t len, int written)
+{
+    fake_file_t *file;
+
+    if ( (file = findFile(fk, path)) == NULL )
+    {
+        if ( (file = calloc(1, sizeof(*file))) == NULL ||
+                (file->path = strdup(path)) == NULL )
+        {
+            free(file);
+            return -1;
+        }
+
+        file->next = fk->files;
+        fk->files = file;
+    }
+
+    free(file->data);
+    file->data = data;
+    file->len = len;
+    file->written = written;
+
+    return 0;
+}
+
+int fakeKernelSetFile(fake_kernel_t *fk, const char *path, const char *data,
+        size_t len)
+{
+    char    *copy;
+
+    if ( fk == NULL || path == NULL || (data == NULL && len) ||
+            (copy = malloc(len + 1)) == NULL )
+        return -1;
+
+    if ( len )
+        memcpy(copy, data, len);
+    copy[len] = '\0';
+
+    if ( storeFile(fk, path, copy, len, 0) )
+    {
+        free(copy);
+        return -1;
+    }
+
+    return 0;
+}
+
+const char *fakeKernelGetFile(const fake_kernel_t *fk, const char *path,
+        size_t *len)
+{
+    const fake_file_t   *file;
+
+    if ( fk == NULL || path == NULL || (file = findFile(fk, path)) == NULL )
+        return NULL;
+
+    if ( len )
+        *len = file->len;
+
+    return file->data;
+}
+
+void fakeKernelDumpFiles(const fake_kernel_t *fk, FILE *out, int all)
+{
+    const fake_file_t   *file;
+
+    for ( file = fk ? fk->files : NULL ; file ; file = file->next )
+    {
+        if ( !all && !file->written )
+            continue;
+
+        fprintf(out, "==> %s <==\n", file->path);
+
+        /* A checkpoint for example
+         */
+        if ( memchr(file->data, '\0', file->len) )
+        {
+            fprintf(out, "(%zu bytes of binary data)\n", file->len);
+            continue;
+        }
+
+        fwrite(file->data, 1, file->len, out);
+        if ( file->len && file->data[file->len - 1] != '\n' )
+            fprintf(out, "\n");
+    }
+}
+
+/* Netdevice ioctls
+ */
+static int fakeIfconf(fake_kernel_t *fk, struct ifconf *ifc)
+{
+    struct sockaddr_in  *sin;
+    size_t              i,
+                        n = 0,
+                        max = ifc->ifc_len / sizeof(struct ifreq);
+
+    for ( i = 0 ; i < fk->nbLinks ; i++ )
+    {
+        if ( !fk->links[i].hasAddr )
+            continue;
+
+        if ( ifc->ifc_req && n < max )
+        {
+            memset(&ifc->ifc_req[n], 0, sizeof(struct ifreq));
+            memcpy(ifc->ifc_req[n].ifr_name, fk->links[i].name, IFNAMSIZ);
+            sin = (struct sockaddr_in *) &ifc->ifc_req[n].ifr_addr;
+            sin->sin_family = AF_INET;
+            sin->sin_addr = fk->links[i].addr;
+        }
+        else if ( ifc->ifc_req )
+            break;
+
+        n++;
+    }
+
+    ifc->ifc_len = n * sizeof(struct ifreq);
+
+    return 0;
+}
+
+static int fakeRoute(fake_kernel_t *fk, unsigned long request,
+        const struct rtentry *rt)
+{
+    const struct sockaddr_in    *dst = (const struct sockaddr_in *) &rt->rt_dst,
+                                *mask = (const struct sockaddr_in *) &rt->rt_genmask,
+                                *gw = (const struct sockaddr_in *) &rt->rt_gateway;
+    fake_route_t                route;
+    size_t                      i;
+    int                         ret;
+
+    memset(&route, 0, sizeof(route));
+    route.table = RT_TABLE_MAIN;
+    route.dstLen = prefixLength(mask->sin_addr);
+    route.dst.s_addr = dst->sin_addr.s_addr & mask->sin_addr.s_addr;
+    if ( rt->rt_flags & RTF_GATEWAY )
+        route.gw = gw->sin_addr;
+
+    if ( rt->rt_dev && (route.ifindex = linkIndex(fk, rt->rt_dev)) == 0 )
+        ret = -ENODEV;
+    else if ( request == SIOCDELRT )
+        ret = delRoute(fk, &route);
+    else if ( route.ifindex )
+        ret = addRoute(fk, &route, 0);
+    else
+    {
+        /* The gateway must be on the subnet of an interface
+         */
+        for ( i = 0 ; i < fk->nbLinks && route.ifindex == 0 ; i++ )
+        {
+            if ( fk->links[i].hasAddr && (linkFlags(&fk->links[i]) & IFF_UP) &&
+                    ((route.gw.s_addr ^ fk->links[i].addr.s_addr) &
+                     fk->links[i].mask.s_addr) == 0 )
+                route.ifindex = i + 1;
+        }
+
+        ret = route.ifindex ? addRoute(fk, &route, 0) : -ENETUNREACH;
+    }
+
+    if ( ret < 0 )
+    {
+        errno = -ret;
+        return -1;
+    }
+
+    return 0;
+}
+
+static int fakeIoctl(void *ctx, int fd, unsigned long request, void *arg)
+{
+    fake_kernel_t       *fk = ctx;
+    struct ifreq        *ifr = arg;
+    struct sockaddr_in  *sin = (struct sockaddr_in *) &ifr->ifr_addr;
+    fake_link_t         *link;
+    char                name[IFNAMSIZ];
+
+    switch ( request )
+    {
+        case SIOCGIFCONF:
+        return fakeIfconf(fk, arg);
+
+        case SIOCADDRT:
+        case SIOCDELRT:
+        return fakeRoute(fk, request, arg);
+
+        default:
+        break;
+    }
+
+    snprintf(name, sizeof(name), "%.*s", IFNAMSIZ - 1, ifr->ifr_name);
+    if ( (link = linkByName(fk, name)) == NULL )
+    {
+        errno = ENODEV;
+        return -1;
+    }
+
+    switch ( request )
+    {
+        case SIOCGIFFLAGS:
+        ifr->ifr_flags = linkFlags(link);
+        return 0;
+
+        case SIOCSIFFLAGS:
+        link->flags = (ifr->ifr_flags & 0xffff & ~IFF_RUNNING) |
+            (link->flags & IFF_LOOPBACK);
+        return 0;
+
+        case SIOCGIFHWADDR:
+        memset(&ifr->ifr_hwaddr, 0, sizeof(ifr->ifr_hwaddr));
+        ifr->ifr_hwaddr.sa_family = link->type;
+        memcpy(ifr->ifr_hwaddr.sa_data, link->mac, ETH_ALEN);
+        return 0;
+
+        case SIOCSIFHWADDR:
+        memcpy(link->mac, ifr->ifr_hwaddr.sa_data, ETH_ALEN);
+        return 0;
+
+        case SIOCSIFADDR:
+        {
+            /* A new address gets the mask of its class
+             */
+            uint32_t    a = ntohl(sin->sin_addr.s_addr);
+            int         len = IN_CLASSA(a) ? 8 : IN_CLASSB(a) ? 16 :
+                            IN_CLASSC(a) ? 24 : 32;
+
+            if ( link->hasAddr )
+                len = prefixLength(link->mask);
+
+            linkAddress(link, sin->sin_addr, len, NULL);
+            return 0;
+        }
+
+        default:
+        break;
+    }
+
+    if ( !link->hasAddr )
+    {
+        errno = EADDRNOTAVAIL;
+        return -1;
+    }
+
+    switch ( request )
+    {
+        case SIOCGIFADDR:
+        case SIOCGIFNETMASK:
+        case SIOCGIFBRDADDR:
+        memset(sin, 0, sizeof(*sin));
+        sin->sin_family = AF_INET;
+        sin->sin_addr = request == SIOCGIFADDR ? link->addr :
+            request == SIOCGIFNETMASK ? link->mask : link->bcast;
+        return 0;
+
+        case SIOCSIFNETMASK:
+        linkAddress(link, link->addr, prefixLength(sin->sin_addr), NULL);
+        return 0;
+
+        case SIOCSIFBRDADDR:
+        link->bcast = sin->sin_addr;
+        return 0;
+
+        default:
+        errno = EOPNOTSUPP;
+        return -1;
+    }
+}
+
+/* Rtnetlink : every answer is built in fk->msg then handed over
+ */
+static void *answerStart(fake_kernel_t *fk, const struct nlmsghdr *req,
+        uint16_t type, uint16_t flags, size_t hdrlen)
+{
+    struct nlmsghdr *nlh;
+    void            *data;
+
+    netlinkReqReset(&fk->msg);
+    if ( (data = netlinkReqAdd(&fk->msg, type, 0, hdrlen)) == NULL )
+        return NULL;
+
+    nlh = (struct nlmsghdr *) fk->msg.buff;
+    nlh->nlmsg_flags = flags;
+    nlh->nlmsg_seq = req->nlmsg_seq;
+
+    return data;
+}
+
+static int answer(fake_kernel_t *fk, backend_reply_t reply, void *user)
+{
+    return reply((const struct nlmsghdr *) fk->msg.buff, user);
+}
+
+static int answerAck(fake_kernel_t *fk, const struct nlmsghdr *req,
+        int error, backend_reply_t reply, void *user)
+{
+    struct nlmsgerr *err;
+
+    if ( (err = answerStart(fk, req, NLMSG_ERROR, 0, sizeof(*err))) == NULL )
+        return -1;
+
+    err->error = error;
+    err->msg = *req;
+
+    return answer(fk, reply, user);
+}
+
+static int answerDone(fake_kernel_t *fk, const struct nlmsghdr *req,
+        backend_reply_t reply, void *user)
+{
+    if ( answerStart(fk, req, NLMSG_DONE, NLM_F_MULTI, sizeof(int)) == NULL )
+        return -1;
+
+    return answer(fk, reply, user);
+}
+
+static int answerLink(fake_kernel_t *fk, const struct nlmsghdr *req,
+        int ifindex, int stats, uint16_t flags)
+{
+    static const unsigned char  bcast[ETH_ALEN] =
+        { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
+    const fake_link_t           *link = &fk->links[ifindex - 1];
+    struct ifinfomsg            *ifi;
+    unsigned                    running;
+
+    if ( (ifi = answerStart(fk, req, RTM_NEWLINK, flags, sizeof(*ifi))) == NULL )
+        return -1;
+
+    ifi->ifi_family = AF_UNSPEC;
+    ifi->ifi_type = link->type;
+    ifi->ifi_index = ifindex;
+    ifi->ifi_flags = linkFlags(link);
+    running = (ifi->ifi_flags & IFF_RUNNING) != 0;
+
+    if ( netlinkReqAttrStr(&fk->msg, IFLA_IFNAME, link->name) ||
+            netlinkReqAttrU32(&fk->msg, IFLA_MTU, link->mtu) ||
+            netlinkReqAttrU32(&fk->msg, IFLA_TXQLEN, link->txqlen) ||
+            netlinkReqAttrU8(&fk->msg, IFLA_OPERSTATE,
+                running ? IF_OPER_UP : IF_OPER_DOWN) ||
+            netlinkReqAttrU8(&fk->msg, IFLA_CARRIER, link->carrier) ||
+            netlinkReqAttr(&fk->msg, IFLA_ADDRESS, link->mac, ETH_ALEN) ||
+            netlinkReqAttr(&fk->msg, IFLA_BROADCAST,
+                link->type == ARPHRD_LOOPBACK ? link->mac : bcast, ETH_ALEN) ||
+            (link->master &&
+             netlinkReqAttrU32(&fk->msg, IFLA_MASTER, link->master)) )
+        return -1;
+
+    if ( link->vrfTable )
+    {
+        size_t  info,
+                data;
+
+        info = netlinkReqNestStart(&fk->msg, IFLA_LINKINFO);
+        if ( netlinkReqAttrStr(&fk->msg, IFLA_INFO_KIND, "vrf") )
+            return -1;
+
+        data = netlinkReqNestStart(&fk->msg, IFLA_INFO_DATA);
+        if ( netlinkReqAttrU32(&fk->msg, IFLA_VRF_TABLE, link->vrfTable) )
+            return -1;
+
+        netlinkReqNestEnd(&fk->msg, data);
+        netlinkReqNestEnd(&fk->msg, info);
+    }
+
+    if ( stats )
+    {
+        struct rtnl_link_stats64    st;
+
+        memset(&st, 0, sizeof(st));
+        if ( netlinkReqAttr(&fk->msg, IFLA_STATS64, &st, sizeof(st)) )
+            return -1;
+    }
+
+    return 0;
+}
+
+static int answerAddr(fake_kernel_t *fk, const struct nlmsghdr *req,
+        int ifindex)
+{
+    const fake_link_t   *link = &fk->links[ifindex - 1];
+    struct ifaddrmsg    *ifa;
+
+    if ( (ifa = answerStart(fk, req, RTM_NEWADDR, NLM_F_MULTI,
+                    sizeof(*ifa))) == NULL )
+        return -1;
+
+    ifa->ifa_family = AF_INET;
+    ifa->ifa_prefixlen = prefixLength(link->mask);
+    ifa->ifa_flags = IFA_F_PERMANENT;
+    ifa->ifa_scope = link->type == ARPHRD_LOOPBACK ? RT_SCOPE_HOST :
+        RT_SCOPE_UNIVERSE;
+    ifa->ifa_index = ifindex;
+
+    if ( netlinkReqAttr(&fk->msg, IFA_ADDRESS, &link->addr, 4) ||
+            netlinkReqAttr(&fk->msg, IFA_LOCAL, &link->addr, 4) ||
+            (link->bcast.s_addr &&
+             netlinkReqAttr(&fk->msg, IFA_BROADCAST, &link->bcast, 4)) ||
+            netlinkReqAttrStr(&fk->msg, IFA_LABEL, link->name) )
+        return -1;
+
+    return 0;
+}
+
+static int answerRoute(fake_kernel_t *fk, const struct nlmsghdr *req,
+        const fake_route_t *route, const struct in_addr *src)
+{
+    struct rtmsg    *rtm;
+
+    if ( (rtm = answerStart(fk, req, RTM_NEWROUTE, NLM_F_MULTI,
+                    sizeof(*rtm))) == NULL )
+        return -1;
+
+    rtm->rtm_family = AF_INET;
+    rtm->rtm_dst_len = route->dstLen;
+    rtm->rtm_table = route->table < 256 ? route->table : RT_TABLE_COMPAT;
+    rtm->rtm_protocol = src ? RTPROT_KERNEL : RTPROT_BOOT;
+    rtm->rtm_scope = route->gw.s_addr ? RT_SCOPE_UNIVERSE : RT_SCOPE_LINK;
+    rtm->rtm_type = RTN_UNICAST;
+
+    if ( netlinkReqAttrU32(&fk->msg, RTA_TABLE, route->table) ||
+            (route->dstLen &&
+             netlinkReqAttr(&fk->msg, RTA_DST, &route->dst, 4)) ||
+            (src && netlinkReqAttr(&fk->msg, RTA_PREFSRC, src, 4)) ||
+            (route->gw.s_addr &&
+             netlinkReqAttr(&fk->msg, RTA_GATEWAY, &route->gw, 4)) ||
+            netlinkReqAttrU32(&fk->msg, RTA_OIF, route->ifindex) )
+        return -1;
+
+    return 0;
+}
+
+static const struct rtattr *requestAttr(const struct nlmsghdr *nlh,
+        size_t hdrlen, int type)
+{
+    const struct rtattr *rta;
+    int                 len;
+
+    if ( nlh->nlmsg_len < NLMSG_LENGTH(hdrlen) )
+        return NULL;
+
+    rta = (const struct rtattr *) ((const char *) NLMSG_DATA(nlh) +
+            NLMSG_ALIGN(hdrlen));
+    len = nlh->nlmsg_len - NLMSG_LENGTH(NLMSG_ALIGN(hdrlen));
+
+    for ( ; RTA_OK(rta, len) ; rta = RTA_NEXT(rta, len) )
+    {
+        if ( (rta->rta_type & NLA_TYPE_MASK) == type )
+            return rta;
+    }
+
+    return NULL;
+}
+
+static int dumpLinks(fake_kernel_t *fk, const struct nlmsghdr *nlh,
+        backend_reply_t reply, void *user)
+{
+    const struct rtattr *mask = requestAttr(nlh, sizeof(struct ifinfomsg),
+                            IFLA_EXT_MASK);
+    int                 stats = !(mask && RTA_PAYLOAD(mask) >= 4 &&
+                            (netlinkAttrU32(mask) & RTEXT_FILTER_SKIP_STATS));
+    size_t              i;
+
+    for ( i = 0 ; i < fk->nbLinks ; i++ )
+    {
+        if ( answerLink(fk, nlh, i + 1, stats, NLM_F_MULTI) ||
+                answer(fk, reply, user) )
+            return -1;
+    }
+
+    return 0;
+}
+
+static int dumpAddrs(fake_kernel_t *fk, const struct nlmsghdr *nlh,
+        backend_reply_t reply, void *user)
+{
+    const struct ifaddrmsg  *ifa = NLMSG_DATA(nlh);
+    size_t                  i;
+
+    if ( ifa->ifa_family != AF_INET && ifa->ifa_family != AF_UNSPEC )
+        return 0;
+
+    /* Filtered as on a strict socket
+     */
+    for ( i = 0 ; i < fk->nbLinks ; i++ )
+    {
+        if ( ifa->ifa_index && ifa->ifa_index != i + 1 )
+            continue;
+
+        if ( fk->links[i].hasAddr &&
+                (answerAddr(fk, nlh, i + 1) || answer(fk, reply, user)) )
+            return -1;
+    }
+
+    return 0;
+}
+
+/* The routes of the subnets are made up from the addresses of the links
+ * that are up, as the kernel adds them
+ */
+static int dumpRoutes(fake_kernel_t *fk, const struct nlmsghdr *nlh,
+        backend_reply_t reply, void *user)
+{
+    const struct rtmsg  *rtm = NLMSG_DATA(nlh);
+    const struct rtattr *oif = requestAttr(nlh, sizeof(*rtm), RTA_OIF),
+                        *table = requestAttr(nlh, sizeof(*rtm), RTA_TABLE);
+    fake_route_t        route;
+    unsigned            ifindex = 0;
+    uint32_t            tableId = rtm->rtm_table;
+    size_t              i;
+
+    if ( rtm->rtm_family != AF_INET && rtm->rtm_family != AF_UNSPEC )
+        return 0;
+
+    /* Filtered as on a strict socket
+     */
+    if ( oif && RTA_PAYLOAD(oif) >= 4 )
+        ifindex = netlinkAttrU32(oif);
+    if ( table && RTA_PAYLOAD(table) >= 4 )
+        tableId = netlinkAttrU32(table);
+
+    for ( i = 0 ; i < fk->nbLinks ; i++ )
+    {
+        const fake_link_t   *link = &fk->links[i],
+                            *master = linkByIndex(fk, link->master);
+
+        if ( !link->hasAddr || !(link->flags & IFF_UP) ||
+                link->type == ARPHRD_LOOPBACK || link->mask.s_addr == INADDR_NONE )
+            continue;
+
+        /* The routes of a VRF slave go to the table of the VRF
+         */
+        memset(&route, 0, sizeof(route));
+        route.dst.s_addr = link->addr.s_addr & link->mask.s_addr;
+        route.dstLen = prefixLength(link->mask);
+        route.ifindex = i + 1;
+        route.table = master && master->vrfTable ? master->vrfTable :
+            RT_TABLE_MAIN;
+
+        if ( (ifindex && ifindex != i + 1) ||
+                (tableId && tableId != route.table) )
+            continue;
+
+        if ( answerRoute(fk, nlh, &route, &link->addr) ||
+                answer(fk, reply, user) )
+            return -1;
+    }
+
+    for ( i = 0 ; i < fk->nbRoutes ; i++ )
+    {
+        if ( (ifindex && ifindex != (unsigned) fk->routes[i].ifindex) ||
+                (tableId && tableId != fk->routes[i].table) )
+            continue;
+
+        if ( answerRoute(fk, nlh, &fk->routes[i], NULL) ||
+                answer(fk, reply, user) )
+            return -1;
+    }
+
+    return 0;
+}
+
+static int dumpRules(fake_kernel_t *fk, const struct nlmsghdr *nlh,
+        backend_reply_t reply, void *user)
+{
+    const struct fib_rule_hdr   *req = NLMSG_DATA(nlh);
+    struct fib_rule_hdr         *frh;
+    const fake_rule_t           *rule;
+    size_t                      i;
+
+    if ( req->family != AF_INET && req->family != AF_UNSPEC )
+        return 0;
+
+    for ( i = 0 ; i < fk->nbRules ; i++ )
+    {
+        rule = &fk->rules[i];
+
+        if ( (frh = answerStart(fk, nlh, RTM_NEWRULE, NLM_F_MULTI,
+                        sizeof(*frh))) == NULL )
+            return -1;
+
+        frh->family = AF_INET;
+        frh->table = rule->table < 256 ? rule->table : RT_TABLE_COMPAT;
+        frh->action = FR_ACT_TO_TBL;
+
+        if ( netlinkReqAttrU32(&fk->msg, FRA_TABLE, rule->table) ||
+                netlinkReqAttrU32(&fk->msg, FRA_PRIORITY, rule->priority) ||
+                (rule->iif && netlinkReqAttrStr(&fk->msg, FRA_IIFNAME,
+                    fk->links[rule->iif - 1].name)) ||
+                (rule->oif && netlinkReqAttrStr(&fk->msg, FRA_OIFNAME,
+                    fk->links[rule->oif - 1].name)) ||
+                answer(fk, reply, user) )
+            return -1;
+    }
+
+    return 0;
+}
+
+static int requestLink(fake_kernel_t *fk, const struct nlmsghdr *nlh)
+{
+    const struct ifinfomsg  *ifi = NLMSG_DATA(nlh);
+    const struct rtattr     *name;
+    int                     ifindex;
+
+    if ( nlh->nlmsg_len < NLMSG_LENGTH(sizeof(*ifi)) )
+        return -EINVAL;
+
+    if ( ifi->ifi_index )
+        return linkByIndex(fk, ifi->ifi_index) ? ifi->ifi_index : -ENODEV;
+
+    if ( (name = requestAttr(nlh, sizeof(*ifi), IFLA_IFNAME)) == NULL )
+        return -EINVAL;
+
+    if ( (ifindex = linkIndex(fk, RTA_DATA(name))) == 0 )
+        return -ENODEV;
+
+    return ifindex;
+}
+
+static int newLink(fake_kernel_t *fk, const struct nlmsghdr *nlh)
+{
+    const struct ifinfomsg  *ifi = NLMSG_DATA(nlh);
+    const struct rtattr     *rta;
+    fake_link_t             *link;
+    int                     ifindex;
+    unsigned                change;
+
+    if ( (ifindex = requestLink(fk, nlh)) == -ENODEV &&
+            (nlh->nlmsg_flags & NLM_F_CREATE) &&
+            (rta = requestAttr(nlh, sizeof(*ifi), IFLA_IFNAME)) )
+    {
+        /* A new virtual link, with a carrier
+         */
+        if ( (ifindex = fakeKernelAddLink(fk, RTA_DATA(rta), IFF_RUNNING,
+                        NULL)) < 0 )
+            return -ENOMEM;
+    }
+    else if ( ifindex < 0 )
+        return ifindex;
+    else if ( (nlh->nlmsg_flags & NLM_F_EXCL) &&
+            nlh->nlmsg_type == RTM_NEWLINK )
+        return -EEXIST;
+
+    /* Like the kernel, the flags are left alone when neither the flags
+     * nor the change mask are given
+     */
+    link = &fk->links[ifindex - 1];
+    if ( ifi->ifi_flags || ifi->ifi_change )
+    {
+        change = ifi->ifi_change ? ifi->ifi_change : 0xffffffff;
+        change &= IFF_UP | IFF_PROMISC | IFF_ALLMULTI | IFF_NOARP;
+        link->flags = (link->flags & ~change) | (ifi->ifi_flags & change);
+    }
+
+    if ( (rta = requestAttr(nlh, sizeof(*ifi), IFLA_MTU)) &&
+            RTA_PAYLOAD(rta) == sizeof(uint32_t) )
+    {
+        if ( *(uint32_t *) RTA_DATA(rta) < 68 ||
+                (link->type == ARPHRD_ETHER &&
+                 *(uint32_t *) RTA_DATA(rta) > 65535) )
+            return -EINVAL;
+        link->mtu = *(uint32_t *) RTA_DATA(rta);
+    }
+
+    if ( (rta = requestAttr(nlh, sizeof(*ifi), IFLA_TXQLEN)) &&
+            RTA_PAYLOAD(rta) == sizeof(uint32_t) )
+        link->txqlen = *(uint32_t *) RTA_DATA(rta);
+
+    if ( (rta = requestAttr(nlh, sizeof(*ifi), IFLA_ADDRESS)) &&
+            RTA_PAYLOAD(rta) == ETH_ALEN )
+        memcpy(link->mac, RTA_DATA(rta), ETH_ALEN);
+
+    return 0;
+}
+
+static int newAddr(fake_kernel_t *fk, const struct nlmsghdr *nlh)
+{
+    const struct ifaddrmsg  *ifa = NLMSG_DATA(nlh);
+    const struct rtattr     *local,
+                            *brd;
+    fake_link_t             *link;
+
+    if ( nlh->nlmsg_len < NLMSG_LENGTH(sizeof(*ifa)) ||
+            ifa->ifa_family != AF_INET || ifa->ifa_prefixlen > 32 )
+        return -EOPNOTSUPP;
+
+    if ( (link = linkByIndex(fk, ifa->ifa_index)) == NULL )
+        return -ENODEV;
+
+    if ( nlh->nlmsg_type == RTM_DELADDR )
+    {
+        if ( !link->hasAddr )
+            return -EADDRNOTAVAIL;
+
+        link->hasAddr = 0;
+        memset(&link->addr, 0, sizeof(struct in_addr) * 3);
+        return 0;
+    }
+
+    if ( (local = requestAttr(nlh, sizeof(*ifa), IFA_LOCAL)) == NULL &&
+            (local = requestAttr(nlh, sizeof(*ifa), IFA_ADDRESS)) == NULL )
+        return -EINVAL;
+
+    if ( link->hasAddr && (nlh->nlmsg_flags & NLM_F_EXCL) &&
+            link->addr.s_addr == *(const uint32_t *) RTA_DATA(local) )
+        return -EEXIST;
+
+    brd = requestAttr(nlh, sizeof(*ifa), IFA_BROADCAST);
+    linkAddress(link, *(const struct in_addr *) RTA_DATA(local),
+            ifa->ifa_prefixlen, brd ? RTA_DATA(brd) : NULL);
+
+    return 0;
+}
+
+static int newRoute(fake_kernel_t *fk, const struct nlmsghdr *nlh)
+{
+    const struct rtmsg  *rtm = NLMSG_DATA(nlh);
+    const struct rtattr *rta;
+    fake_route_t        route;
+
+    if ( nlh->nlmsg_len < NLMSG_LENGTH(sizeof(*rtm)) ||
+            rtm->rtm_family != AF_INET || rtm->rtm_dst_len > 32 )
+        return -EOPNOTSUPP;
+
+    memset(&route, 0, sizeof(route));
+    route.dstLen = rtm->rtm_dst_len;
+    route.table = rtm->rtm_table;
+    if ( (rta = requestAttr(nlh, sizeof(*rtm), RTA_TABLE)) )
+        route.table = netlinkAttrU32(rta);
+    if ( route.table == RT_TABLE_UNSPEC )
+        route.table = RT_TABLE_MAIN;
+    if ( (rta = requestAttr(nlh, sizeof(*rtm), RTA_DST)) )
+        memcpy(&route.dst, RTA_DATA(rta), 4);
+    if ( (rta = requestAttr(nlh, sizeof(*rtm), RTA_GATEWAY)) )
+        memcpy(&route.gw, RTA_DATA(rta), 4);
+    if ( (rta = requestAttr(nlh, sizeof(*rtm), RTA_OIF)) )
+        route.ifindex = netlinkAttrU32(rta);
+
+    if ( nlh->nlmsg_type == RTM_DELROUTE )
+        return delRoute(fk, &route);
+
+    if ( linkByIndex(fk, route.ifindex) == NULL )
+        return -ENODEV;
+
+    return addRoute(fk, &route, nlh->nlmsg_flags);
+}
+
+static int fakeMessage(fake_kernel_t *fk, const struct nlmsghdr *nlh,
+        backend_reply_t reply, void *user)
+{
+    int     ret;
+
+    if ( (nlh->nlmsg_flags & NLM_F_DUMP) == NLM_F_DUMP )
+    {
+        switch ( nlh->nlmsg_type )
+        {
+            case RTM_GETLINK:
+            ret = dumpLinks(fk, nlh, reply, user);
+            break;
+
+            case RTM_GETADDR:
+            ret = dumpAddrs(fk, nlh, reply, user);
+            break;
+
+            case RTM_GETROUTE:
+            ret = dumpRoutes(fk, nlh, reply, user);
+            break;
+
+            case RTM_GETRULE:
+            ret = dumpRules(fk, nlh, reply, user);
+            break;
+
+            default:
+            /* Neighbors, qdiscs... : nothing to dump
+             */
+            ret = 0;
+            break;
+        }
+
+        return ret < 0 ? ret : answerDone(fk, nlh, reply, user);
+    }
+
+    switch ( nlh->nlmsg_type )
+    {
+        case RTM_GETLINK:
+        if ( (ret = requestLink(fk, nlh)) > 0 )
+        {
+            if ( answerLink(fk, nlh, ret, 1, 0) || answer(fk, reply, user) )
+                return -1;
+            ret = 0;
+        }
+        break;
+
+        case RTM_NEWLINK:
+        case RTM_SETLINK:
+        ret = newLink(fk, nlh);
+        break;
+
+        case RTM_NEWADDR:
+        case RTM_DELADDR:
+        ret = newAddr(fk, nlh);
+        break;
+
+        case RTM_NEWROUTE:
+        case RTM_DELROUTE:
+        ret = newRoute(fk, nlh);
+        break;
+
+        default:
+        ret = -EOPNOTSUPP;
+        break;
+    }
+
+    if ( ret == 0 && !(nlh->nlmsg_flags & NLM_F_ACK) )
+        return 0;
+
+    return answerAck(fk, nlh, ret, reply, user);
+}
+
+static int fakeTransact(void *ctx, const void *msgs, size_t len,
+        backend_reply_t reply, void *user)
+{
+    const struct nlmsghdr   *nlh;
+    int                     left = len;
+
+    for ( nlh = msgs ; NLMSG_OK(nlh, left) ; nlh = NLMSG_NEXT(nlh, left) )
+    {
+        if ( fakeMessage(ctx, nlh, reply, user) < 0 )
+        {
+            errno = ENOMEM;
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/* Files : a stream works on a copy, written back when it is closed
+ */
+static ssize_t streamRead(void *cookie, char *buff, size_t size)
+{
+    fake_stream_t   *st = cookie;
+
+    if ( st->pos >= st->len )
+        return 0;
+
+    if ( size > st->len - st->pos )
+        size = st->len - st->pos;
+
+    memcpy(buff, st->buff + st->pos, size);
+    st->pos += size;
+
+    return size;
+}
+
+static ssize_t streamWrite(void *cookie, const char *buff, size_t size)
+{
+    fake_stream_t   *st = cookie;
+
+    if ( !st->writing )
+    {
+        errno = EBADF;
+        return -1;
+    }
+
+    if ( st->pos + size + 1 > st->size )
+    {
+        size_t  len = st->size ? st->size : 1024;
+        char    *p;
+
+        while ( len < st->pos + size + 1 )
+            len *= 2;
+
+        if ( (p = realloc(st->buff, len)) == NULL )
+            return -1;
+
+        st->buff = p;
+        st->size = len;
+    }
+
+    memcpy(st->buff + st->pos, buff, size);
+    st->pos += size;
+    if ( st->pos > st->len )
+        st->len = st->pos;
+    st->buff[st->len] = '\0';
+
+    return size;
+}
+
+static int streamSeek(void *cookie, off64_t *offset, int whence)
+{
+    fake_stream_t   *st = cookie;
+    off64_t         pos = *offset;
+
+    if ( whence == SEEK_CUR )
+        pos += st->pos;
+    else if ( whence == SEEK_END )
+        pos += st->len;
+
+    if ( pos < 0 || (size_t) pos > st->len )
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    *offset = st->pos = pos;
+
+    return 0;
+}
+
+static int streamClose(void *cookie)
+{
+    fake_stream_t   *st = cookie;
+    int             ret = 0;
+
+    if ( st->writing )
+    {
+        if ( st->buff == NULL && (st->buff = calloc(1, 1)) == NULL )
+            ret = -1;
+        else if ( (ret = storeFile(st->fk, st->path, st->buff, st->len, 1)) == 0 )
+            st->buff = NULL;
+    }
+
+    free(st->buff);
+    free(st->path);
+    free(st);
+
+    return ret;
+}
+
+static char *renderDevices(fake_kernel_t *fk, size_t *len)
+{
+    char    *buff;
+    size_t  i,
+            size = 256 + fk->nbLinks * 128;
+    int     n;
+
+    if ( (buff = malloc(size)) == NULL )
+        return NULL;
+
+    n = snprintf(buff, size,
+            "Inter-|   Receive                                                |  Transmit\n"
+            " face |bytes    packets errs drop fifo frame compressed multicast|"
+            "bytes    packets errs drop fifo colls carrier compressed\n");
+    for ( i = 0 ; i < fk->nbLinks ; i++ )
+        n += snprintf(buff + n, size - n, "%6s: %7d %7d %4d %4d %4d %5d %10d %9d "
+                "%8d %7d %4d %4d %4d %5d %7d %10d\n", fk->links[i].name,
+                0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+
+    *len = n;
+
+    return buff;
+}
+
+static FILE *fakeOpen(void *ctx, const char *path, const char *mode)
+{
+    static const cookie_io_functions_t  io =
+    {
+        .read = &streamRead,
+        .write = &streamWrite,
+        .seek = &streamSeek,
+        .close = &streamClose,
+    };
+    fake_kernel_t       *fk = ctx;
+    const fake_file_t   *file = findFile(fk, path);
+    fake_stream_t       *st;
+    FILE                *f;
+
+    if ( file == NULL && *mode == 'r' && strcmp(path, FAKE_DEVICES) )
+    {
+        errno = ENOENT;
+        return NULL;
+    }
+
+    if ( (st = calloc(1, sizeof(*st))) == NULL ||
+            (st->path = strdup(path)) == NULL )
+        goto error;
+
+    st->fk = fk;
+    st->writing = *mode != 'r' || strchr(mode, '+');
+
+    if ( *mode != 'w' )
+    {
+        if ( file )
+        {
+            if ( (st->buff = malloc(file->len + 1)) == NULL )
+                goto error;
+
+            memcpy(st->buff, file->data, file->len + 1);
+            st->len = file->len;
+        }
+        else if ( (st->buff = renderDevices(fk, &st->len)) == NULL )
+            goto error;
+
+        st->size = st->len + 1;
+        if ( *mode == 'a' )
+            st->pos = st->len;
+    }
+
+    if ( (f = fopencookie(st, mode, io)) == NULL )
+        goto error;
+
+    return f;
+
+error:
+    if ( st )
+    {
+        free(st->buff);
+        free(st->path);
+        free(st);
+    }
+
+    errno = ENOMEM;
+
+    return NULL;
+}
+
+static int fakeRename(void *ctx, const char *from, const char *to)
+{
+    fake_kernel_t   *fk = ctx;
+    fake_file_t     *file,
+                    **prev;
+
+    for ( prev = &fk->files ; (file = *prev) ; prev = &file->next )
+    {
+        if ( strcmp(file->path, from) == 0 )
+            break;
+    }
+
+    if ( file == NULL )
+    {
+        errno = ENOENT;
+        return -1;
+    }
+
+    *prev = file->next;
+    if ( storeFile(fk, to, file->data, file->len, 1) )
+    {
+        *prev = file;
+        errno = ENOMEM;
+        return -1;
+    }
+
+    free(file->path);
+    free(file);
+
+    return 0;
+}
+
+static unsigned fakeNameToIndex(void *ctx, const char *ifname)
+{
+    int     ifindex;
+
+    if ( (ifindex = linkIndex(ctx, ifname)) == 0 )
+        errno = ENODEV;
+
+    return ifindex;
+}
+
+static char *fakeIndexToName(void *ctx, unsigned ifindex, char *ifname)
+{
+    const fake_link_t   *link;
+
+    if ( ifindex > INT32_MAX || (link = linkByIndex(ctx, ifindex)) == NULL )
+    {
+        errno = ENXIO;
+        return NULL;
+    }
+
+    return strncpy(ifname, link->name, IFNAMSIZ);
+}
+
+const netconfig_backend_t *fakeKernelBackend(fake_kernel_t *fk)
+{
+    if ( fk == NULL )
+        return NULL;
+
+    fk->backend.name = "fake";
+    fk->backend.ctx = fk;
+    fk->backend.ioctl = &fakeIoctl;
+    fk->backend.transact = &fakeTransact;
+    fk->backend.open = &fakeOpen;
+    fk->backend.rename = &fakeRename;
+    fk->backend.nameToIndex = &fakeNameToIndex;
+    fk->backend.indexToName = &fakeIndexToName;
+
+    return &fk->backend;
+}
+
+/* Seed file
+ */
+static int seedLink(fake_kernel_t *fk, char *args)
+{
+    const char  *name = strtok(args, " \t"),
+                *mac = NULL,
+                *addr = NULL,
+                *brd = NULL,
+                *master = NULL,
+                *vrf = NULL;
+    char        *tok;
+    unsigned    flags = 0;
+    int         prefixlen = 32,
+                ifindex;
+
+    while ( (tok = strtok(NULL, " \t")) )
+    {
+        if ( strcmp(tok, "up") == 0 )
+            flags |= IFF_UP;
+        else if ( strcmp(tok, "running") == 0 )
+            flags |= IFF_RUNNING;
+        else if ( strcmp(tok, "loopback") == 0 )
+            flags |= IFF_LOOPBACK;
+        else if ( strcmp(tok, "mac") == 0 && (mac = strtok(NULL, " \t")) )
+            ;
+        else if ( strcmp(tok, "addr") == 0 && (addr = strtok(NULL, " \t")) )
+        {
+            if ( (tok = strchr(addr, '/')) )
+            {
+                *tok++ = '\0';
+                prefixlen = atoi(tok);
+            }
+        }
+        else if ( strcmp(tok, "brd") == 0 && (brd = strtok(NULL, " \t")) )
+            ;
+        else if ( strcmp(tok, "master") == 0 && (master = strtok(NULL, " \t")) )
+            ;
+        else if ( strcmp(tok, "vrf") == 0 && (vrf = strtok(NULL, " \t")) )
+            ;
+        else
+            return -1;
+    }
+
+    if ( fakeKernelAddLink(fk, name, flags, mac) < 0 ||
+            (ifindex = linkIndex(fk, name)) == 0 )
+        return -1;
+
+    /* The master is seeded before its slaves
+     */
+    if ( master && (fk->links[ifindex - 1].master = linkIndex(fk, master)) == 0 )
+        return -1;
+
+    if ( vrf && (fk->links[ifindex - 1].vrfTable = strtoul(vrf, NULL, 10)) == 0 )
+        return -1;
+
+    return addr ? fakeKernelSetAddress(fk, name, addr, prefixlen, brd) : 0;
+}
+
+static int seedRoute(fake_kernel_t *fk, char *args)
+{
+    const char  *dst = strtok(args, " \t"),
+                *gw = NULL,
+                *dev = NULL,
+                *table = NULL;
+    char        *tok;
+
+    while ( (tok = strtok(NULL, " \t")) )
+    {
+        if ( strcmp(tok, "via") == 0 && (gw = strtok(NULL, " \t")) )
+            ;
+        else if ( strcmp(tok, "dev") == 0 && (dev = strtok(NULL, " \t")) )
+            ;
+        else if ( strcmp(tok, "table") == 0 && (table = strtok(NULL, " \t")) )
+            ;
+        else
+            return -1;
+    }
+
+    return dst ? addTableRoute(fk, dst, gw, dev,
+            table ? strtoul(table, NULL, 10) : RT_TABLE_MAIN) : -1;
+}
+
+/* rule iif|oif <dev> table <id> [pref <priority>]
+ */
+static int seedRule(fake_kernel_t *fk, char *args)
+{
+    fake_rule_t rule;
+    const char  *dev;
+    char        *tok;
+
+    memset(&rule, 0, sizeof(rule));
+
+    for ( tok = strtok(args, " \t") ; tok ; tok = strtok(NULL, " \t") )
+    {
+        if ( strcmp(tok, "iif") == 0 && (dev = strtok(NULL, " \t")) )
+            rule.iif = linkIndex(fk, dev);
+        else if ( strcmp(tok, "oif") == 0 && (dev = strtok(NULL, " \t")) )
+            rule.oif = linkIndex(fk, dev);
+        else if ( strcmp(tok, "table") == 0 && (tok = strtok(NULL, " \t")) )
+            rule.table = strtoul(tok, NULL, 10);
+        else if ( strcmp(tok, "pref") == 0 && (tok = strtok(NULL, " \t")) )
+            rule.priority = strtoul(tok, NULL, 10);
+        else
+            return -1;
+    }
+
+    if ( (rule.iif == 0 && rule.oif == 0) || rule.table == 0 )
+        return -1;
+
+    if ( fk->nbRules == fk->sizeRules )
+    {
+        size_t      size = fk->sizeRules ? fk->sizeRules * 2 : 16;
+        fake_rule_t *rules;
+
+        if ( (rules = realloc(fk->rules, size * sizeof(*rules))) == NULL )
+            return -1;
+
+        fk->rules = rules;
+        fk->sizeRules = size;
+    }
+
+    fk->rules[fk->nbRules++] = rule;
+
+    return 0;
+}
+
+static int seedFile(fake_kernel_t *fk, FILE *from, char *path, int *line)
+{
+#define BUFFLEN     1024
+    char    buff[BUFFLEN];
+    char    *data = NULL;
+    size_t  len = 0;
+    FILE    *to;
+    int     ret = -1;
+
+    if ( (path = strtok(path, " \t")) == NULL ||
+            (to = open_memstream(&data, &len)) == NULL )
+        return -1;
+
+    while ( fgets(buff, sizeof(buff), from) )
+    {
+        (*line)++;
+        if ( strcmp(buff, ".\n") == 0 || strcmp(buff, ".") == 0 )
+        {
+            ret = 0;
+            break;
+        }
+
+        fputs(buff, to);
+    }
+
+    fclose(to);
+
+    if ( ret == 0 )
+        ret = fakeKernelSetFile(fk, path, data, len);
+
+    free(data);
+
+    return ret;
+#undef BUFFLEN
+}
+
+int fakeKernelLoad(fake_kernel_t *fk, const char *path)
+{
+#define BUFFLEN     1024
+    char    buff[BUFFLEN];
+    FILE    *file;
+    char    *p,
+            *end;
+    int     line = 0,
+            ret = 0;
+
+    if ( fk == NULL || path == NULL )
+        return -1;
+
+    if ( (file = fopen(path, "r")) == NULL )
+    {
+        perror(path);
+        return -1;
+    }
+
+    while ( ret == 0 && fgets(buff, sizeof(buff), file) )
+    {
+        line++;
+        if ( (p = strchr(buff, '#')) )
+            *p = '\0';
+
+        for ( p = buff ; isspace(*p) ; p++ )
+            ;
+        end = p + strlen(p);
+        while ( end > p && isspace(end[-1]) )
+            *--end = '\0';
+
+        if ( *p == '\0' )
+            continue;
+
+        if ( strncmp(p, "link ", 5) == 0 )
+            ret = seedLink(fk, p + 5);
+        else if ( strncmp(p, "route ", 6) == 0 )
+            ret = seedRoute(fk, p + 6);
+        else if ( strncmp(p, "rule ", 5) == 0 )
+            ret = seedRule(fk, p + 5);
+        else if ( strncmp(p, "file ", 5) == 0 )
+            ret = seedFile(fk, file, p + 5, &line);
+        else
+            ret = -1;
+
+        if ( ret )
+            fprintf(stderr, "%s:%d: invalid statement\n", path, line);
+    }
+
+    fclose(file);
+
+    return ret;
+#undef BUFFLEN
+}
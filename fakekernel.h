@@ -0,0 +1,78 @@
+#ifndef __FAKEKERNEL_H__
+#define __FAKEKERNEL_H__
+
+#include "netconfig.h"
+#include "backend.h"
+
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/* An in-memory kernel : links, IPv4 addresses, routes and files, enough
+ * for the display, save and lookup paths to run in plain user space
+ * against tables of any size. Notifications, neighbors and raw sockets
+ * are not simulated.
+ */
+typedef struct fake_kernel fake_kernel_t;
+
+NETCONFIG_API
+fake_kernel_t *fakeKernelNew(void);
+
+NETCONFIG_API
+void fakeKernelFree(fake_kernel_t *fk);
+
+/* The backend to give to netconfigSetBackend(), valid as long as fk
+ */
+NETCONFIG_API
+const netconfig_backend_t *fakeKernelBackend(fake_kernel_t *fk);
+
+/* flags are IFF_XXX, IFF_RUNNING stands for the carrier and follows
+ * IFF_UP. mac may be NULL. Returns the ifindex or -1.
+ */
+NETCONFIG_API
+int fakeKernelAddLink(fake_kernel_t *fk, const char *name, unsigned flags,
+        const char *mac);
+
+/* bcast may be NULL for the one of the prefix
+ */
+NETCONFIG_API
+int fakeKernelSetAddress(fake_kernel_t *fk, const char *name, const char *ip,
+        int prefixlen, const char *bcast);
+
+/* dst is "default" or <addr>/<len>, gw may be NULL
+ */
+NETCONFIG_API
+int fakeKernelAddRoute(fake_kernel_t *fk, const char *dst, const char *gw,
+        const char *dev);
+
+NETCONFIG_API
+int fakeKernelSetFile(fake_kernel_t *fk, const char *path, const char *data,
+        size_t len);
+
+NETCONFIG_API
+const char *fakeKernelGetFile(const fake_kernel_t *fk, const char *path,
+        size_t *len);
+
+/* Seed from a text file, one statement per line, '#' for comments :
+ *  link <name> [up] [running] [loopback] [mac <mac>]
+ *          [addr <ip>/<len>] [brd <ip>]
+ *  route default|<addr>/<len> [via <gw>] dev <name>
+ *  file <path>
+ *  <content lines>
+ *  .
+ */
+NETCONFIG_API
+int fakeKernelLoad(fake_kernel_t *fk, const char *path);
+
+/* Print the files written since the seeding, or all of them
+ */
+NETCONFIG_API
+void fakeKernelDumpFiles(const fake_kernel_t *fk, FILE *out, int all);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __FAKEKERNEL_H__ */
@@ -0,0 +1,899 @@
+#include "iflink.h"
+#include "network.h"
+#include "netlink.h"
+
+/* See man (8) ip-link for the link kinds
+ */
+
+#include <linux/if_link.h>
+#include <linux/veth.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+
+#define NETNS_DIR   "/var/run/netns"
+
+enum
+{
+    LINK_ADD,
+    LINK_DEL,
+    LINK_ENSLAVE,
+    LINK_NETNS,
+};
+
+/* Deletions first so that a name can be reused by the same batch
+ */
+enum
+{
+    PHASE_DEL,
+    PHASE_LINK,
+    PHASE_VLAN,
+    PHASE_SLAVE,
+    NBPHASES
+};
+
+struct link_op
+{
+    int         op;
+    const char  *kind;
+    char        name[IFNAMSIZ];
+    char        other[IFNAMSIZ];
+    unsigned    id;
+    int         netns;
+    int         error;
+};
+
+struct link_netns
+{
+    char        name[NAME_MAX + 1];
+    int         fd;
+};
+
+typedef struct link_name
+{
+    char        name[IFNAMSIZ];
+    int         ifindex;
+} link_name_t;
+
+typedef struct link_commit
+{
+    link_batch_t    *batch;
+    size_t          *msgs;
+    const uint32_t  *seq;
+    link_name_t     *names;
+    size_t          nbNames;
+} link_commit_t;
+
+static const char   *bondModes [] =
+{
+    "balance-rr",
+    "active-backup",
+    "balance-xor",
+    "broadcast",
+    "802.3ad",
+    "balance-tlb",
+    "balance-alb",
+    NULL
+};
+
+static link_op_t *newOp(link_batch_t *batch, int op, const char *name)
+{
+    link_op_t   *ops;
+
+    if ( batch == NULL || name == NULL || !*name || strlen(name) >= IFNAMSIZ )
+        return NULL;
+
+    if ( batch->nb == batch->size )
+    {
+        size_t  size = batch->size ? batch->size * 2 : 64;
+
+        if ( (ops = realloc(batch->ops, size * sizeof(*ops))) == NULL )
+            return NULL;
+
+        batch->ops = ops;
+        batch->size = size;
+    }
+
+    ops = &batch->ops[batch->nb++];
+    memset(ops, 0, sizeof(*ops));
+    ops->op = op;
+    ops->netns = LINK_NETNS_NONE;
+    strcpy(ops->name, name);
+
+    return ops;
+}
+
+static int setOther(link_op_t *op, const char *other)
+{
+    if ( other == NULL || strlen(other) >= IFNAMSIZ )
+        return -1;
+
+    strcpy(op->other, other);
+
+    return 0;
+}
+
+int linkAddVlan(link_batch_t *batch, const char *name, const char *parent,
+        unsigned vid)
+{
+    link_op_t   *op;
+
+    if ( vid < 1 || vid > 4094 ||
+            (op = newOp(batch, LINK_ADD, name)) == NULL )
+        return -1;
+
+    op->kind = "vlan";
+    op->id = vid;
+
+    return setOther(op, parent) ? (batch->nb--, -1) : 0;
+}
+
+int linkAddBridge(link_batch_t *batch, const char *name)
+{
+    link_op_t   *op;
+
+    if ( (op = newOp(batch, LINK_ADD, name)) == NULL )
+        return -1;
+
+    op->kind = "bridge";
+
+    return 0;
+}
+
+int linkAddBond(link_batch_t *batch, const char *name, const char *mode)
+{
+    link_op_t   *op;
+    unsigned    i = 0;
+
+    if ( mode )
+    {
+        for ( i = 0 ; bondModes[i] && strcmp(bondModes[i], mode) ; i++ )
+            ;
+
+        if ( bondModes[i] == NULL )
+        {
+            fprintf(stderr, "Unknown bond mode %s\n", mode);
+            return -1;
+        }
+    }
+
+    if ( (op = newOp(batch, LINK_ADD, name)) == NULL )
+        return -1;
+
+    op->kind = "bond";
+    op->id = i;
+
+    return 0;
+}
+
+int linkAddDummy(link_batch_t *batch, const char *name)
+{
+    link_op_t   *op;
+
+    if ( (op = newOp(batch, LINK_ADD, name)) == NULL )
+        return -1;
+
+    op->kind = "dummy";
+
+    return 0;
+}
+
+int linkAddVeth(link_batch_t *batch, const char *name, const char *peer,
+        int netnsFd)
+{
+    link_op_t   *op;
+
+    if ( (op = newOp(batch, LINK_ADD, name)) == NULL )
+        return -1;
+
+    op->kind = "veth";
+    op->netns = netnsFd;
+
+    return setOther(op, peer) ? (batch->nb--, -1) : 0;
+}
+
+int linkDelete(link_batch_t *batch, const char *name)
+{
+    return newOp(batch, LINK_DEL, name) ? 0 : -1;
+}
+
+/* A NULL or empty master releases the link from its current master
+ */
+int linkEnslave(link_batch_t *batch, const char *name, const char *master)
+{
+    link_op_t   *op;
+
+    if ( (op = newOp(batch, LINK_ENSLAVE, name)) == NULL )
+        return -1;
+
+    return setOther(op, master ? master : "") ? (batch->nb--, -1) : 0;
+}
+
+int linkSetNetns(link_batch_t *batch, const char *name, int netnsFd)
+{
+    link_op_t   *op;
+
+    if ( netnsFd < 0 || (op = newOp(batch, LINK_NETNS, name)) == NULL )
+        return -1;
+
+    op->netns = netnsFd;
+
+    return 0;
+}
+
+/* A network namespace is either a name from ip-netns or a pid.
+ * The descriptors are kept open until the batch is freed.
+ */
+static int openNetns(link_batch_t *batch, const char *netns)
+{
+    struct link_netns   *ns;
+    char                path[PATH_MAX];
+    const char          *p;
+    size_t              i;
+
+    for ( i = 0 ; i < batch->nbNetns ; i++ )
+    {
+        if ( strcmp(batch->netns[i].name, netns) == 0 )
+            return batch->netns[i].fd;
+    }
+
+    if ( !*netns || strlen(netns) > NAME_MAX || strchr(netns, '/') )
+        return -1;
+
+    for ( p = netns ; isdigit(*p) ; p++ )
+        ;
+
+    if ( *p == '\0' )
+        snprintf(path, sizeof(path), "/proc/%s/ns/net", netns);
+    else
+        snprintf(path, sizeof(path), NETNS_DIR "/%s", netns);
+
+    if ( (ns = realloc(batch->netns, (batch->nbNetns + 1) * sizeof(*ns))) == NULL )
+        return -1;
+
+    batch->netns = ns;
+    ns = &batch->netns[batch->nbNetns];
+
+    if ( (ns->fd = open(path, O_RDONLY | O_CLOEXEC)) < 0 )
+    {
+        perror(path);
+        return -1;
+    }
+
+    strcpy(ns->name, netns);
+    batch->nbNetns++;
+
+    return ns->fd;
+}
+
+/* Specifications, fields separated by ':'
+ *  add vlan:<parent>:<id>[-<last>][:<name>]
+ *  add bridge:<name> | dummy:<name> | bond:<name>[:<mode>]
+ *  add veth:<name>:<peer>[:<netns>]
+ *  del <name>
+ *  enslave <name>:[<master>]
+ *  netns <name>:<netns>
+ */
+int linkBatchParse(link_batch_t *batch, const char *verb, const char *spec)
+{
+#define NBFIELDS    5
+    char        buff[256];
+    char        *field[NBFIELDS] = { NULL };
+    char        *p;
+    int         nb = 0,
+                netns = LINK_NETNS_NONE,
+                ret = -1;
+
+    if ( batch == NULL || verb == NULL || spec == NULL ||
+            strlen(spec) >= sizeof(buff) )
+        return -1;
+
+    strcpy(buff, spec);
+    for ( p = buff ; nb < NBFIELDS ; p++ )
+    {
+        field[nb++] = p;
+        if ( (p = strchr(p, ':')) == NULL )
+            break;
+
+        *p = '\0';
+    }
+
+    if ( !strcmp(verb, "del") )
+        ret = nb == 1 ? linkDelete(batch, field[0]) : -1;
+    else if ( !strcmp(verb, "enslave") )
+        ret = nb == 2 ? linkEnslave(batch, field[0], field[1]) : -1;
+    else if ( !strcmp(verb, "netns") )
+    {
+        if ( nb == 2 && (netns = openNetns(batch, field[1])) >= 0 )
+            ret = linkSetNetns(batch, field[0], netns);
+    }
+    else if ( strcmp(verb, "add") )
+        ret = -1;
+    else if ( !strcmp(field[0], "bridge") && nb == 2 )
+        ret = linkAddBridge(batch, field[1]);
+    else if ( !strcmp(field[0], "dummy") && nb == 2 )
+        ret = linkAddDummy(batch, field[1]);
+    else if ( !strcmp(field[0], "bond") && (nb == 2 || nb == 3) )
+        ret = linkAddBond(batch, field[1], field[2]);
+    else if ( !strcmp(field[0], "veth") && (nb == 3 || nb == 4) )
+    {
+        if ( nb == 3 || (netns = openNetns(batch, field[3])) >= 0 )
+            ret = linkAddVeth(batch, field[1], field[2], netns);
+    }
+    else if ( !strcmp(field[0], "vlan") && (nb == 3 || nb == 4) )
+    {
+        char        name[IFNAMSIZ + 8];
+        unsigned    vid,
+                    last;
+
+        vid = last = strtoul(field[2], &p, 10);
+        if ( *p == '-' )
+            last = strtoul(p + 1, &p, 10);
+
+        /* An explicit name only makes sense for a single VLAN
+         */
+        if ( *p || vid > last || (nb == 4 && vid != last) )
+            last = 0;
+
+        for ( ret = last ? 0 : -1 ; ret == 0 && vid <= last ; vid++ )
+        {
+            if ( nb == 4 )
+            {
+                ret = linkAddVlan(batch, field[3], field[1], vid);
+                continue;
+            }
+
+            snprintf(name, sizeof(name), "%s.%u", field[1], vid);
+            ret = linkAddVlan(batch, name, field[1], vid);
+        }
+    }
+
+    if ( ret )
+        fprintf(stderr, "Invalid link specification %s %s\n", verb, spec);
+
+    return ret;
+#undef NBFIELDS
+}
+
+/* One "<verb> <spec>" per line, '#' starts a comment
+ */
+int linkBatchLoad(link_batch_t *batch, const char *path)
+{
+#define BUFFLEN     1024
+    char    buff[BUFFLEN];
+    char    *verb,
+            *spec,
+            *save;
+    FILE    *file;
+    int     ret = 0;
+
+    if ( path == NULL || (file = fopen(path, "r")) == NULL )
+    {
+        perror(path);
+        return -1;
+    }
+
+    while ( ret == 0 && fgets(buff, sizeof(buff), file) )
+    {
+        if ( (verb = strchr(buff, '#')) )
+            *verb = '\0';
+
+        if ( (verb = strtok_r(buff, " \t\n", &save)) == NULL )
+            continue;
+
+        if ( (spec = strtok_r(NULL, " \t\n", &save)) == NULL )
+            ret = -1;
+        else
+            ret = linkBatchParse(batch, verb, spec);
+    }
+
+    fclose(file);
+
+    return ret;
+#undef BUFFLEN
+}
+
+static int compareName(const void *a, const void *b)
+{
+    return strncmp(((const link_name_t *) a)->name,
+            ((const link_name_t *) b)->name, IFNAMSIZ);
+}
+
+static int resolveReply(const struct nlmsghdr *nlh, void *user)
+{
+    link_commit_t           *commit = user;
+    const struct ifinfomsg  *ifi;
+    const struct rtattr     *tb[IFLA_MAX + 1];
+    link_name_t             key,
+                            *found;
+
+    if ( nlh->nlmsg_type != RTM_NEWLINK )
+        return 0;
+
+    ifi = NLMSG_DATA(nlh);
+    netlinkParseAttr(IFLA_RTA(ifi), IFLA_PAYLOAD(nlh), tb, IFLA_MAX);
+    if ( tb[IFLA_IFNAME] == NULL )
+        return 0;
+
+    memset(&key, 0, sizeof(key));
+    strncpy(key.name, RTA_DATA(tb[IFLA_IFNAME]), IFNAMSIZ - 1);
+
+    if ( (found = bsearch(&key, commit->names, commit->nbNames,
+                    sizeof(key), &compareName)) )
+        found->ifindex = ifi->ifi_index;
+
+    return 0;
+}
+
+static int needsIndex(const link_op_t *op, int phase)
+{
+    if ( phase == PHASE_VLAN )
+        return op->op == LINK_ADD && !strcmp(op->kind, "vlan");
+
+    return phase == PHASE_SLAVE && op->op == LINK_ENSLAVE && *op->other;
+}
+
+/* Parents and masters may have been created by the previous phases,
+ * their index is asked for with one RTM_GETLINK per distinct name
+ */
+static int resolveNames(netlink_t *nl, link_commit_t *commit, int phase)
+{
+    link_batch_t        *batch = commit->batch;
+    netlink_req_t       req = { 0 };
+    struct ifinfomsg    *ifi;
+    size_t              i,
+                        nb = 0;
+    int                 ret = 0;
+
+    free(commit->names);
+    if ( (commit->names = calloc(batch->nb, sizeof(link_name_t))) == NULL )
+        return -1;
+
+    for ( i = 0 ; i < batch->nb ; i++ )
+    {
+        if ( needsIndex(&batch->ops[i], phase) && !batch->ops[i].error )
+            memcpy(commit->names[nb++].name, batch->ops[i].other, IFNAMSIZ);
+    }
+
+    qsort(commit->names, nb, sizeof(link_name_t), &compareName);
+    for ( commit->nbNames = 0, i = 0 ; i < nb ; i++ )
+    {
+        if ( commit->nbNames &&
+                !compareName(&commit->names[commit->nbNames - 1], &commit->names[i]) )
+            continue;
+
+        commit->names[commit->nbNames++] = commit->names[i];
+    }
+
+    for ( i = 0 ; i < commit->nbNames ; i++ )
+    {
+        if ( (ifi = netlinkReqAdd(&req, RTM_GETLINK, 0, sizeof(*ifi))) == NULL ||
+                netlinkReqAttrStr(&req, IFLA_IFNAME, commit->names[i].name) ||
+                netlinkReqAttrU32(&req, IFLA_EXT_MASK, RTEXT_FILTER_SKIP_STATS) )
+        {
+            ret = -1;
+            break;
+        }
+    }
+
+    if ( ret == 0 && commit->nbNames )
+        ret = netlinkTransact(nl, &req, &resolveReply, commit) < 0 ? -1 : 0;
+
+    netlinkReqFree(&req);
+
+    return ret;
+}
+
+static int lookupIndex(const link_commit_t *commit, const char *name)
+{
+    link_name_t         key,
+                        *found;
+
+    memset(&key, 0, sizeof(key));
+    memcpy(key.name, name, IFNAMSIZ);
+
+    found = bsearch(&key, commit->names, commit->nbNames, sizeof(key),
+            &compareName);
+
+    return found ? found->ifindex : 0;
+}
+
+static int phaseOf(const link_op_t *op)
+{
+    switch ( op->op )
+    {
+        case LINK_ADD:
+        return strcmp(op->kind, "vlan") ? PHASE_LINK : PHASE_VLAN;
+
+        case LINK_DEL:
+        return PHASE_DEL;
+
+        default:
+        return PHASE_SLAVE;
+    }
+}
+
+static int commitReply(const struct nlmsghdr *nlh, void *user)
+{
+    link_commit_t   *commit = user;
+    link_op_t       *op;
+
+    if ( nlh->nlmsg_type != NLMSG_ERROR )
+        return 0;
+
+    op = &commit->batch->ops[commit->msgs[nlh->nlmsg_seq - *commit->seq]];
+    op->error = ((const struct nlmsgerr *) NLMSG_DATA(nlh))->error;
+
+    return 0;
+}
+
+/* Each RTM_DELLINK waits for the RCU grace period of its link : the
+ * links to delete are rather moved to a private group, then deleted
+ * with a single RTM_DELLINK on the whole group. The group a link leaves
+ * is kept in its id.
+ */
+static int buildGroup(netlink_req_t *req, const link_op_t *op,
+        uint32_t group)
+{
+    struct ifinfomsg    *ifi;
+
+    if ( (ifi = netlinkReqAdd(req, RTM_NEWLINK, 0, sizeof(*ifi))) == NULL )
+        return -1;
+
+    ifi->ifi_family = AF_UNSPEC;
+
+    if ( netlinkReqAttrStr(req, IFLA_IFNAME, op->name) ||
+            netlinkReqAttrU32(req, IFLA_GROUP, group) )
+        return -1;
+
+    return 0;
+}
+
+static int buildDelete(netlink_req_t *req, const link_op_t *op,
+        uint32_t group)
+{
+    struct ifinfomsg    *ifi;
+
+    if ( group )
+        return buildGroup(req, op, group);
+
+    if ( (ifi = netlinkReqAdd(req, RTM_DELLINK, 0, sizeof(*ifi))) == NULL )
+        return -1;
+
+    ifi->ifi_family = AF_UNSPEC;
+
+    return netlinkReqAttrStr(req, IFLA_IFNAME, op->name);
+}
+
+static int groupReply(const struct nlmsghdr *nlh, void *user)
+{
+    link_commit_t           *commit = user;
+    const struct ifinfomsg  *ifi;
+    const struct rtattr     *tb[IFLA_MAX + 1];
+
+    if ( nlh->nlmsg_type != RTM_NEWLINK )
+        return 0;
+
+    ifi = NLMSG_DATA(nlh);
+    netlinkParseAttr(IFLA_RTA(ifi), IFLA_PAYLOAD(nlh), tb, IFLA_MAX);
+    if ( tb[IFLA_GROUP] )
+        commit->batch->ops[commit->msgs[nlh->nlmsg_seq - *commit->seq]].id =
+                *(const uint32_t *) RTA_DATA(tb[IFLA_GROUP]);
+
+    return 0;
+}
+
+static int saveGroups(netlink_t *nl, netlink_req_t *req,
+        link_commit_t *commit)
+{
+    link_batch_t        *batch = commit->batch;
+    struct ifinfomsg    *ifi;
+    size_t              i;
+
+    netlinkReqReset(req);
+    for ( i = 0 ; i < batch->nb ; i++ )
+    {
+        if ( batch->ops[i].op != LINK_DEL )
+            continue;
+
+        commit->msgs[req->count] = i;
+        if ( (ifi = netlinkReqAdd(req, RTM_GETLINK, 0, sizeof(*ifi))) == NULL )
+            return -1;
+
+        ifi->ifi_family = AF_UNSPEC;
+
+        if ( netlinkReqAttrStr(req, IFLA_IFNAME, batch->ops[i].name) ||
+                netlinkReqAttrU32(req, IFLA_EXT_MASK, RTEXT_FILTER_SKIP_STATS) )
+            return -1;
+    }
+
+    /* A missing link is reported when it is moved
+     */
+    return netlinkTransact(nl, req, &groupReply, commit) < 0 ? -1 : 0;
+}
+
+/* The kernel refuses the whole group when one of its links has no
+ * dellink, lo or a physical link : they are then deleted one by one,
+ * and the ones left go back to their group.
+ */
+static int deleteGroup(netlink_t *nl, netlink_req_t *req,
+        link_commit_t *commit, uint32_t group)
+{
+    link_batch_t        *batch = commit->batch;
+    struct ifinfomsg    *ifi;
+    link_op_t           *op;
+    size_t              i,
+                        nb;
+    int                 ret;
+
+    netlinkReqReset(req);
+    if ( (ifi = netlinkReqAdd(req, RTM_DELLINK, 0, sizeof(*ifi))) == NULL )
+        return -1;
+
+    ifi->ifi_family = AF_UNSPEC;
+
+    if ( netlinkReqAttrU32(req, IFLA_GROUP, group) )
+        return -1;
+
+    if ( (ret = netlinkTransact(nl, req, NULL, NULL)) <= 0 )
+        return ret;
+
+    netlinkReqReset(req);
+    for ( i = 0 ; i < batch->nb ; i++ )
+    {
+        op = &batch->ops[i];
+        if ( op->op != LINK_DEL || op->error )
+            continue;
+
+        commit->msgs[req->count] = i;
+        if ( buildDelete(req, op, 0) )
+            return -1;
+    }
+
+    if ( req->count == 0 )
+        return 0;
+
+    if ( netlinkTransact(nl, req, &commitReply, commit) < 0 )
+        return -1;
+
+    /* The delete error is the one reported, msgs is packed in place
+     */
+    for ( nb = req->count, netlinkReqReset(req), i = 0 ; i < nb ; i++ )
+    {
+        op = &batch->ops[commit->msgs[i]];
+        if ( !op->error )
+            continue;
+
+        commit->msgs[req->count] = commit->msgs[i];
+        if ( buildGroup(req, op, op->id) )
+            return -1;
+    }
+
+    if ( req->count && netlinkTransact(nl, req, NULL, NULL) < 0 )
+        return -1;
+
+    return 0;
+}
+
+static int buildOp(netlink_req_t *req, const link_op_t *op, int ifindex)
+{
+    struct ifinfomsg    *ifi,
+                        peer;
+    size_t              info,
+                        data,
+                        nest;
+    uint16_t            type = op->op == LINK_DEL ? RTM_DELLINK : RTM_NEWLINK;
+    uint16_t            flags = op->op == LINK_ADD ? NLM_F_CREATE | NLM_F_EXCL : 0;
+
+    /* The header before the attributes, which may move the buffer
+     */
+    if ( (ifi = netlinkReqAdd(req, type, flags, sizeof(*ifi))) == NULL )
+        return -1;
+    ifi->ifi_family = AF_UNSPEC;
+
+    if ( netlinkReqAttrStr(req, IFLA_IFNAME, op->name) )
+        return -1;
+
+    switch ( op->op )
+    {
+        case LINK_ENSLAVE:
+        return netlinkReqAttrU32(req, IFLA_MASTER, ifindex);
+
+        case LINK_NETNS:
+        return netlinkReqAttrU32(req, IFLA_NET_NS_FD, op->netns);
+
+        default:
+        break;
+    }
+
+    if ( !strcmp(op->kind, "vlan") &&
+            netlinkReqAttrU32(req, IFLA_LINK, ifindex) )
+        return -1;
+
+    info = netlinkReqNestStart(req, IFLA_LINKINFO);
+    if ( netlinkReqAttrStr(req, IFLA_INFO_KIND, op->kind) )
+        return -1;
+
+    if ( !strcmp(op->kind, "vlan") )
+    {
+        data = netlinkReqNestStart(req, IFLA_INFO_DATA);
+        if ( netlinkReqAttrU16(req, IFLA_VLAN_ID, op->id) )
+            return -1;
+        netlinkReqNestEnd(req, data);
+    }
+    else if ( !strcmp(op->kind, "bond") )
+    {
+        data = netlinkReqNestStart(req, IFLA_INFO_DATA);
+        if ( netlinkReqAttrU8(req, IFLA_BOND_MODE, op->id) )
+            return -1;
+        netlinkReqNestEnd(req, data);
+    }
+    else if ( !strcmp(op->kind, "veth") )
+    {
+        /* The peer is described by its own ifinfomsg and attributes
+         */
+        memset(&peer, 0, sizeof(peer));
+        data = netlinkReqNestStart(req, IFLA_INFO_DATA);
+        nest = netlinkReqNestStart(req, VETH_INFO_PEER);
+        if ( netlinkReqRaw(req, &peer, sizeof(peer)) ||
+                netlinkReqAttrStr(req, IFLA_IFNAME, op->other) ||
+                (op->netns != LINK_NETNS_NONE &&
+                 netlinkReqAttrU32(req, IFLA_NET_NS_FD, op->netns)) )
+            return -1;
+        netlinkReqNestEnd(req, nest);
+        netlinkReqNestEnd(req, data);
+    }
+
+    netlinkReqNestEnd(req, info);
+
+    return 0;
+}
+
+static void registerOp(const link_op_t *op)
+{
+    switch ( op->op )
+    {
+        case LINK_ADD:
+        addInterface(op->name);
+        if ( !strcmp(op->kind, "veth") && op->netns == LINK_NETNS_NONE )
+            addInterface(op->other);
+        break;
+
+        case LINK_DEL:
+        case LINK_NETNS:
+        removeInterface(op->name);
+        break;
+
+        default:
+        break;
+    }
+}
+
+/* Send the whole batch in phases : deletions, standalone links, VLANs
+ * on top of their parents, then enslavements and namespace moves.
+ * The new links are registered in the interface table.
+ * Returns the number of failed operations or -1 on error.
+ */
+int linkBatchCommit(link_batch_t *batch)
+{
+    netlink_t       nl;
+    netlink_req_t   req = { 0 };
+    link_commit_t   commit;
+    link_op_t       *op;
+    size_t          i,
+                    nbDel = 0;
+    uint32_t        group = 0;
+    int             phase,
+                    ifindex,
+                    ret = 0;
+
+    if ( batch == NULL )
+        return -1;
+
+    if ( batch->nb == 0 )
+        return 0;
+
+    for ( i = 0 ; i < batch->nb ; i++ )
+        nbDel += batch->ops[i].op == LINK_DEL;
+
+    if ( nbDel > 1 )
+        group = 0x80000000u | getpid();
+
+    memset(&commit, 0, sizeof(commit));
+    commit.batch = batch;
+    commit.seq = &req.seq;
+    if ( (commit.msgs = calloc(batch->nb, sizeof(size_t))) == NULL )
+        return -1;
+
+    if ( netlinkOpen(&nl, NETLINK_ROUTE, 0) )
+    {
+        free(commit.msgs);
+        return -1;
+    }
+
+    for ( phase = 0 ; ret >= 0 && phase < NBPHASES ; phase++ )
+    {
+        if ( (phase == PHASE_VLAN || phase == PHASE_SLAVE) &&
+                resolveNames(&nl, &commit, phase) )
+        {
+            ret = -1;
+            break;
+        }
+
+        if ( phase == PHASE_DEL && group && saveGroups(&nl, &req, &commit) )
+        {
+            ret = -1;
+            break;
+        }
+
+        netlinkReqReset(&req);
+        for ( i = 0 ; i < batch->nb ; i++ )
+        {
+            op = &batch->ops[i];
+            if ( phaseOf(op) != phase )
+                continue;
+
+            ifindex = 0;
+            if ( needsIndex(op, phase) &&
+                    (ifindex = lookupIndex(&commit, op->other)) == 0 )
+            {
+                op->error = -ENODEV;
+                continue;
+            }
+
+            commit.msgs[req.count] = i;
+            if ( (op->op == LINK_DEL ? buildDelete(&req, op, group) :
+                        buildOp(&req, op, ifindex)) )
+            {
+                ret = -1;
+                break;
+            }
+        }
+
+        if ( ret == 0 && req.count &&
+                netlinkTransact(&nl, &req, &commitReply, &commit) < 0 )
+            ret = -1;
+
+        if ( ret == 0 && phase == PHASE_DEL && group )
+            ret = deleteGroup(&nl, &req, &commit, group);
+    }
+
+    for ( i = 0 ; ret >= 0 && i < batch->nb ; i++ )
+    {
+        op = &batch->ops[i];
+        if ( op->error )
+        {
+            fprintf(stderr, "%s: %s\n", op->name, strerror(-op->error));
+            ret++;
+        }
+        else
+            registerOp(op);
+    }
+
+    netlinkReqFree(&req);
+    netlinkClose(&nl);
+    free(commit.names);
+    free(commit.msgs);
+
+    return ret;
+}
+
+void linkBatchFree(link_batch_t *batch)
+{
+    size_t  i;
+
+    if ( batch == NULL )
+        return;
+
+    for ( i = 0 ; i < batch->nbNetns ; i++ )
+        close(batch->netns[i].fd);
+
+    free(batch->netns);
+    free(batch->ops);
+    memset(batch, 0, sizeof(*batch));
+}
@@ -0,0 +1,71 @@
+#ifndef __IFLINK_H__
+#define __IFLINK_H__
+
+#include "netconfig.h"
+
+#include <sys/types.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/* Virtual links are created, deleted and enslaved by batches : the
+ * operations are queued then sent at once by linkBatchCommit().
+ */
+typedef struct link_op link_op_t;
+
+typedef struct link_batch
+{
+    link_op_t           *ops;
+    size_t              nb;
+    size_t              size;
+    struct link_netns   *netns;
+    size_t              nbNetns;
+} link_batch_t;
+
+#define LINK_NETNS_NONE     (-1)
+
+NETCONFIG_API
+int linkAddVlan(link_batch_t *batch, const char *name, const char *parent,
+        unsigned vid);
+
+NETCONFIG_API
+int linkAddBridge(link_batch_t *batch, const char *name);
+
+NETCONFIG_API
+int linkAddBond(link_batch_t *batch, const char *name, const char *mode);
+
+NETCONFIG_API
+int linkAddDummy(link_batch_t *batch, const char *name);
+
+NETCONFIG_API
+int linkAddVeth(link_batch_t *batch, const char *name, const char *peer,
+        int netnsFd);
+
+NETCONFIG_API
+int linkDelete(link_batch_t *batch, const char *name);
+
+NETCONFIG_API
+int linkEnslave(link_batch_t *batch, const char *name, const char *master);
+
+NETCONFIG_API
+int linkSetNetns(link_batch_t *batch, const char *name, int netnsFd);
+
+NETCONFIG_API
+int linkBatchParse(link_batch_t *batch, const char *verb, const char *spec);
+
+NETCONFIG_API
+int linkBatchLoad(link_batch_t *batch, const char *path);
+
+NETCONFIG_API
+int linkBatchCommit(link_batch_t *batch);
+
+NETCONFIG_API
+void linkBatchFree(link_batch_t *batch);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __IFLINK_H__ */
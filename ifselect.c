@@ -0,0 +1,383 @@
+#include "ifselect.h"
+#include "netlink.h"
+#include "kernel.h"
+
+#include <linux/if_link.h>
+#include <net/if.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <fnmatch.h>
+#include <regex.h>
+
+/* The patterns are only compiled here : enumerating 20k interfaces to
+ * keep 10 of them costs string comparisons, not requests to the kernel.
+ */
+
+enum
+{
+    PATTERN_NAME,
+    PATTERN_GLOB,
+    PATTERN_REGEX,
+    PATTERN_KIND,
+    PATTERN_MASTER,
+};
+
+typedef struct if_pattern
+{
+    int         type;
+    const char  *arg;
+    regex_t     re;
+} if_pattern_t;
+
+struct if_selector
+{
+    if_pattern_t    *patterns;
+    size_t          nb;
+    int             names;
+    int             links;
+    char            *text;
+};
+
+typedef struct select_dump
+{
+    const if_selector_t *sel;
+    unsigned            *masters;
+    if_select_callback_t cb;
+    void                *user;
+} select_dump_t;
+
+static int compilePattern(if_pattern_t *pattern, char *text)
+{
+#define BUFFLEN     256
+    char    buff[BUFFLEN];
+    int     err;
+
+    if ( strncmp(text, "re:", 3) == 0 )
+    {
+        pattern->type = PATTERN_REGEX;
+        pattern->arg = text + 3;
+
+        /* Anchored, like a glob
+         */
+        if ( snprintf(buff, sizeof(buff), "^(%s)$", pattern->arg) >=
+                (int) sizeof(buff) )
+        {
+            fprintf(stderr, "%s: regular expression too long\n", text);
+            return -1;
+        }
+
+        if ( (err = regcomp(&pattern->re, buff, REG_EXTENDED | REG_NOSUB)) )
+        {
+            regerror(err, &pattern->re, buff, sizeof(buff));
+            fprintf(stderr, "%s: %s\n", text, buff);
+            return -1;
+        }
+    }
+    else if ( strncmp(text, "kind:", 5) == 0 )
+    {
+        pattern->type = PATTERN_KIND;
+        pattern->arg = text + 5;
+    }
+    else if ( strncmp(text, "master:", 7) == 0 )
+    {
+        pattern->type = PATTERN_MASTER;
+        pattern->arg = text + 7;
+    }
+    else
+    {
+        pattern->type = strpbrk(text, "*?[") ? PATTERN_GLOB : PATTERN_NAME;
+        pattern->arg = text;
+    }
+
+    if ( *pattern->arg == '\0' ||
+            ((pattern->type == PATTERN_NAME || pattern->type == PATTERN_MASTER) &&
+             strlen(pattern->arg) >= IFNAMSIZ) )
+    {
+        fprintf(stderr, "%s: invalid interface pattern\n", text);
+        return -1;
+    }
+
+    return 0;
+#undef BUFFLEN
+}
+
+if_selector_t *ifSelectorCompile(const char * const *patterns, size_t nb)
+{
+    if_selector_t   *sel;
+    size_t          len = 0,
+                    i;
+    char            *p;
+
+    if ( patterns == NULL || nb == 0 )
+        return NULL;
+
+    for ( i = 0 ; i < nb ; i++ )
+        len += strlen(patterns[i]) + 1;
+
+    if ( (sel = calloc(1, sizeof(*sel))) == NULL ||
+            (sel->patterns = calloc(nb, sizeof(*sel->patterns))) == NULL ||
+            (sel->text = malloc(len)) == NULL )
+    {
+        ifSelectorFree(sel);
+        return NULL;
+    }
+
+    sel->names = 1;
+
+    for ( i = 0, p = sel->text ; i < nb ; i++ )
+    {
+        strcpy(p, patterns[i]);
+
+        if ( compilePattern(&sel->patterns[i], p) )
+        {
+            ifSelectorFree(sel);
+            return NULL;
+        }
+
+        sel->nb++;
+        sel->names &= sel->patterns[i].type == PATTERN_NAME;
+        sel->links |= sel->patterns[i].type == PATTERN_KIND ||
+            sel->patterns[i].type == PATTERN_MASTER;
+
+        p += strlen(p) + 1;
+    }
+
+    return sel;
+}
+
+static int matchName(const if_pattern_t *pattern, const char *ifname)
+{
+    switch ( pattern->type )
+    {
+        case PATTERN_NAME:
+        return strcmp(pattern->arg, ifname) == 0;
+
+        case PATTERN_GLOB:
+        return fnmatch(pattern->arg, ifname, 0) == 0;
+
+        case PATTERN_REGEX:
+        return regexec(&pattern->re, ifname, 0, NULL, 0) == 0;
+
+        default:
+        return 0;
+    }
+}
+
+int ifSelectorMatchName(const if_selector_t *sel, const char *ifname)
+{
+    size_t  i;
+
+    if ( sel == NULL || ifname == NULL )
+        return 0;
+
+    for ( i = 0 ; i < sel->nb ; i++ )
+    {
+        if ( matchName(&sel->patterns[i], ifname) )
+            return 1;
+    }
+
+    return 0;
+}
+
+static const char *linkKind(const struct rtattr *linkinfo)
+{
+    const struct rtattr *info[IFLA_INFO_MAX + 1];
+
+    netlinkParseAttr(RTA_DATA(linkinfo), RTA_PAYLOAD(linkinfo), info,
+            IFLA_INFO_MAX);
+
+    return info[IFLA_INFO_KIND] ? RTA_DATA(info[IFLA_INFO_KIND]) : NULL;
+}
+
+static int selectLink(const struct nlmsghdr *nlh, void *user)
+{
+    select_dump_t           *dump = user;
+    const struct ifinfomsg  *ifi = NLMSG_DATA(nlh);
+    const struct rtattr     *tb[IFLA_MAX + 1];
+    const if_pattern_t      *pattern;
+    const char              *ifname,
+                            *kind = NULL;
+    unsigned                master = 0;
+    size_t                  i;
+
+    if ( nlh->nlmsg_type != RTM_NEWLINK )
+        return 0;
+
+    netlinkParseAttr(IFLA_RTA(ifi), IFLA_PAYLOAD(nlh), tb, IFLA_MAX);
+    if ( tb[IFLA_IFNAME] == NULL )
+        return 0;
+
+    ifname = RTA_DATA(tb[IFLA_IFNAME]);
+    if ( tb[IFLA_LINKINFO] )
+        kind = linkKind(tb[IFLA_LINKINFO]);
+    if ( tb[IFLA_MASTER] )
+        master = netlinkAttrU32(tb[IFLA_MASTER]);
+
+    for ( i = 0 ; i < dump->sel->nb ; i++ )
+    {
+        pattern = &dump->sel->patterns[i];
+
+        if ( pattern->type == PATTERN_KIND ?
+                kind != NULL && strcmp(pattern->arg, kind) == 0 :
+                pattern->type == PATTERN_MASTER ?
+                master != 0 && master == dump->masters[i] :
+                matchName(pattern, ifname) )
+            return dump->cb(ifname, dump->user);
+    }
+
+    return 0;
+}
+
+/* One RTM_GETLINK dump without the statistics. A lone kind or master
+ * pattern is also given to the kernel, which then only dumps the matching
+ * links; the callback checks again for the kernels that ignore it.
+ */
+static int foreachLink(const if_selector_t *sel, if_select_callback_t cb,
+        void *user)
+{
+    netlink_t           nl;
+    netlink_req_t       req = { 0 };
+    struct ifinfomsg    *ifi;
+    select_dump_t       dump;
+    size_t              nest,
+                        i;
+    int                 ret = -1;
+
+    memset(&dump, 0, sizeof(dump));
+    dump.sel = sel;
+    dump.cb = cb;
+    dump.user = user;
+
+    if ( (dump.masters = calloc(sel->nb, sizeof(*dump.masters))) == NULL )
+        return -1;
+
+    /* A master that does not exist selects nothing
+     */
+    for ( i = 0 ; i < sel->nb ; i++ )
+    {
+        if ( sel->patterns[i].type == PATTERN_MASTER )
+            dump.masters[i] = kernelNameToIndex(sel->patterns[i].arg);
+    }
+
+    if ( netlinkOpen(&nl, NETLINK_ROUTE, 0) )
+    {
+        free(dump.masters);
+        return -1;
+    }
+
+    netlinkStrict(&nl);
+
+    if ( (ifi = netlinkReqAdd(&req, RTM_GETLINK, NLM_F_DUMP, sizeof(*ifi))) == NULL ||
+            netlinkReqAttrU32(&req, IFLA_EXT_MASK, RTEXT_FILTER_SKIP_STATS) )
+        goto out;
+
+    if ( sel->nb == 1 && sel->patterns[0].type == PATTERN_MASTER )
+    {
+        if ( dump.masters[0] == 0 )
+        {
+            ret = 0;
+            goto out;
+        }
+
+        if ( netlinkReqAttrU32(&req, IFLA_MASTER, dump.masters[0]) )
+            goto out;
+    }
+    else if ( sel->nb == 1 && sel->patterns[0].type == PATTERN_KIND )
+    {
+        nest = netlinkReqNestStart(&req, IFLA_LINKINFO);
+        if ( netlinkReqAttrStr(&req, IFLA_INFO_KIND, sel->patterns[0].arg) )
+            goto out;
+        netlinkReqNestEnd(&req, nest);
+    }
+
+    ret = netlinkTransact(&nl, &req, &selectLink, &dump);
+
+out:
+    netlinkReqFree(&req);
+    netlinkClose(&nl);
+    free(dump.masters);
+
+    return ret;
+}
+
+static char *trimSpace(char *str)
+{
+    while ( isspace(*str) )
+        str++;
+
+    return str;
+}
+
+static int foreachName(const if_selector_t *sel, if_select_callback_t cb,
+        void *user)
+{
+#define BUFFLEN     1024
+    FILE    *dev;
+    char    buff[BUFFLEN],
+            *name,
+            *p;
+    int     ret = 0;
+
+    if ( (dev = kernelOpen("/proc/net/dev", "r")) == NULL )
+        return -1;
+
+    while ( ret == 0 && fgets(buff, sizeof(buff), dev) )
+    {
+        if ( (p = strchr(buff, ':')) == NULL )
+            continue;
+
+        *p = '\0';
+        name = trimSpace(buff);
+
+        if ( ifSelectorMatchName(sel, name) )
+            ret = cb(name, user);
+    }
+
+    fclose(dev);
+
+    return ret;
+#undef BUFFLEN
+}
+
+int foreachSelectedInterface(const if_selector_t *sel,
+        if_select_callback_t cb, void *user)
+{
+    size_t  i;
+    int     ret;
+
+    if ( sel == NULL || cb == NULL )
+        return -1;
+
+    if ( sel->names )
+    {
+        for ( i = 0 ; i < sel->nb ; i++ )
+        {
+            if ( (ret = cb(sel->patterns[i].arg, user)) )
+                return ret;
+        }
+
+        return 0;
+    }
+
+    return sel->links ? foreachLink(sel, cb, user) : foreachName(sel, cb, user);
+}
+
+void ifSelectorFree(if_selector_t *sel)
+{
+    size_t  i;
+
+    if ( sel == NULL )
+        return;
+
+    for ( i = 0 ; i < sel->nb ; i++ )
+    {
+        if ( sel->patterns[i].type == PATTERN_REGEX )
+            regfree(&sel->patterns[i].re);
+    }
+
+    free(sel->patterns);
+    free(sel->text);
+    free(sel);
+}
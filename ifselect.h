@@ -0,0 +1,51 @@
+#ifndef __IFSELECT_H__
+#define __IFSELECT_H__
+
+#include "netconfig.h"
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/* A selection of interfaces, compiled once from patterns that are ORed :
+ *  eth0            the interface of that name
+ *  veth* eth[0-3]  a shell glob on the name, see man (7) glob
+ *  re:<regex>      an extended regular expression matching the whole name
+ *  kind:<kind>     the kind of a virtual link, vlan, bridge, bond, vrf...
+ *  master:<name>   the links enslaved to that interface
+ */
+typedef struct if_selector if_selector_t;
+
+/* A non-zero return stops the enumeration and is returned
+ */
+typedef int (*if_select_callback_t)(const char *ifname, void *user);
+
+/* NULL, with a message on stderr, when a pattern is not valid
+ */
+NETCONFIG_API
+if_selector_t *ifSelectorCompile(const char * const *patterns, size_t nb);
+
+/* Only looks at the name : kind and master patterns never match
+ */
+NETCONFIG_API
+int ifSelectorMatchName(const if_selector_t *sel, const char *ifname);
+
+/* Calls cb with the name of each selected interface, before anything is
+ * asked about them. Names are read from /proc/net/dev, kind and master
+ * patterns take a single dump of the links instead. Exact names only are
+ * given back as is, in their order, whether they exist or not.
+ */
+NETCONFIG_API
+int foreachSelectedInterface(const if_selector_t *sel,
+        if_select_callback_t cb, void *user);
+
+NETCONFIG_API
+void ifSelectorFree(if_selector_t *sel);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __IFSELECT_H__ */
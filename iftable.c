@@ -0,0 +1,770 @@
+#include "iftable.h"
+#include "inventory.h"
+#include "dhcp.h"
+
+/* A filter is compiled into a postfix program. It runs block after block
+ * of rows: every condition is a branch free loop over one or two columns
+ * writing a byte per row, the operators combine these bytes. Such loops
+ * are vectorized by the compiler and a block of masks stays in cache.
+ */
+
+#include <linux/if_arp.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#define FILTER_BLOCK    1024
+#define FILTER_DEPTH    32
+
+enum
+{
+    CODE_FLAGS_SET,
+    CODE_FLAGS_CLEAR,
+    CODE_IP_IN,
+    CODE_GW_IN,
+    CODE_MAC_EQ,
+    CODE_NAME_EQ,
+    CODE_NAME_PREFIX,
+    CODE_IFINDEX,
+    CODE_PREFIXLEN,
+    CODE_NOT,
+    CODE_AND,
+    CODE_OR,
+};
+
+enum
+{
+    CMP_EQ,
+    CMP_NE,
+    CMP_LT,
+    CMP_LE,
+    CMP_GT,
+    CMP_GE,
+};
+
+typedef struct filter_op
+{
+    int         code;
+    uint32_t    a;
+    uint32_t    b;
+    uint64_t    mac;
+    char        name[IFNAMSIZ];
+    size_t      len;
+} filter_op_t;
+
+struct if_filter
+{
+    filter_op_t *ops;
+    size_t      nb;
+    size_t      size;
+    int         depth;
+    int         maxDepth;
+};
+
+static int growTable(if_table_t *table)
+{
+    size_t  size = table->size ? table->size * 2 : 256;
+    void    *p;
+
+#define GROW(col) \
+    if ( (p = realloc(table->col, size * sizeof(*table->col))) == NULL ) \
+        return -1; \
+    table->col = p;
+
+    GROW(name);
+    GROW(ifindex);
+    GROW(flags);
+    GROW(type);
+    GROW(ip);
+    GROW(prefixlen);
+    GROW(bcast);
+    GROW(gw);
+    GROW(mac);
+#undef GROW
+
+    table->size = size;
+
+    return 0;
+}
+
+int ifTableLoad(if_table_t *table)
+{
+    inventory_t         inv = { 0 };
+    inventory_link_t    *link;
+    netlink_t           nl;
+    size_t              i;
+    int                 ret = -1,
+                        j;
+
+    memset(table, 0, sizeof(*table));
+
+    if ( netlinkOpen(&nl, NETLINK_ROUTE, 0) )
+        return -1;
+
+    if ( inventoryLoad(&inv, &nl) )
+        goto out;
+
+    while ( table->size < inv.nb )
+    {
+        if ( growTable(table) )
+            goto out;
+    }
+
+    for ( i = 0 ; i < inv.nb ; i++ )
+    {
+        link = &inv.links[i];
+
+        memcpy(table->name[i], link->name, IFNAMSIZ);
+        table->ifindex[i] = link->ifindex;
+        table->flags[i] = link->flags;
+        table->type[i] = link->type;
+        table->ip[i] = link->hasAddr ? ntohl(link->addr.s_addr) : 0;
+        table->prefixlen[i] = link->hasAddr ? link->prefixlen : 0;
+        table->bcast[i] = link->hasAddr ? ntohl(link->bcast.s_addr) : 0;
+        table->gw[i] = link->hasGateway ? ntohl(link->gateway.s_addr) : 0;
+
+        table->mac[i] = 0;
+        if ( link->hasMac )
+        {
+            for ( j = 0 ; j < 6 ; j++ )
+                table->mac[i] = (table->mac[i] << 8) | link->mac[j];
+
+            table->mac[i] |= IF_TABLE_MAC;
+        }
+    }
+
+    table->nb = inv.nb;
+    ret = 0;
+
+out:
+    if ( ret )
+        ifTableFree(table);
+
+    inventoryFree(&inv);
+    netlinkClose(&nl);
+
+    return ret;
+}
+
+void ifTableFree(if_table_t *table)
+{
+    free(table->name);
+    free(table->ifindex);
+    free(table->flags);
+    free(table->type);
+    free(table->ip);
+    free(table->prefixlen);
+    free(table->bcast);
+    free(table->gw);
+    free(table->mac);
+
+    memset(table, 0, sizeof(*table));
+}
+
+static void formatIp(uint32_t ip, char *dest, size_t len)
+{
+    struct in_addr  in = { htonl(ip) };
+
+    inet_ntop(AF_INET, &in, dest, len);
+}
+
+/* Same rules as the ioctl based getters, see inventoryInfo()
+ */
+int ifTableInfo(const if_table_t *table, size_t row, const char *ns,
+        interface_info_t *info)
+{
+    uint64_t    mac;
+    uint32_t    flags;
+
+    if ( row >= table->nb )
+        return -1;
+
+    memset(info, 0, sizeof(*info));
+    memcpy(info->name, table->name[row], IFNAMSIZ);
+
+    flags = table->flags[row];
+    mac = table->mac[row];
+
+    info->plugged = (flags & IFF_UP) && (flags & IFF_RUNNING);
+    info->dynamic = isInterfaceDynamic(info->name) ? 1 : 0;
+
+    if ( (mac & IF_TABLE_MAC) && !(flags & IFF_LOOPBACK) &&
+            table->type[row] != ARPHRD_LOOPBACK )
+        snprintf(info->mac, sizeof(info->mac), "%02x:%02x:%02x:%02x:%02x:%02x",
+                (unsigned) (mac >> 40) & 0xff, (unsigned) (mac >> 32) & 0xff,
+                (unsigned) (mac >> 24) & 0xff, (unsigned) (mac >> 16) & 0xff,
+                (unsigned) (mac >> 8) & 0xff, (unsigned) mac & 0xff);
+
+    if ( info->plugged && table->ip[row] )
+    {
+        formatIp(table->ip[row], info->ip, sizeof(info->ip));
+        formatIp(table->prefixlen[row] ?
+                ~0u << (32 - table->prefixlen[row]) : 0,
+                info->mask, sizeof(info->mask));
+        formatIp(table->bcast[row], info->bcast, sizeof(info->bcast));
+    }
+
+    if ( table->gw[row] )
+        formatIp(table->gw[row], info->gw, sizeof(info->gw));
+
+    if ( ns )
+        snprintf(info->ns, sizeof(info->ns), "%s", ns);
+
+    return 0;
+}
+
+/* Compilation : a recursive descent parser emitting the postfix program
+ */
+typedef struct filter_parser
+{
+    const char  *expr;
+    const char  *p;
+    char        token[64];
+    if_filter_t *filter;
+} filter_parser_t;
+
+static int parseOr(filter_parser_t *parser);
+
+static int syntaxError(const filter_parser_t *parser, const char *what)
+{
+    fprintf(stderr, "filter: %s near \"%s\"\n", what,
+            parser->token[0] ? parser->token : "end of expression");
+
+    return -1;
+}
+
+/* Operators, brackets, quoted strings and words
+ */
+static void nextToken(filter_parser_t *parser)
+{
+    const char  *p = parser->p,
+                *end;
+    size_t      len;
+
+    while ( isspace((unsigned char) *p) )
+        p++;
+
+    if ( *p == '\0' )
+        len = 0;
+    else if ( strchr("()", *p) )
+        len = 1;
+    else if ( !strncmp(p, "&&", 2) || !strncmp(p, "||", 2) ||
+            !strncmp(p, "==", 2) || !strncmp(p, "!=", 2) ||
+            !strncmp(p, "<=", 2) || !strncmp(p, ">=", 2) )
+        len = 2;
+    else if ( strchr("!<>", *p) )
+        len = 1;
+    else if ( *p == '"' )
+    {
+        for ( p++, len = 0 ; p[len] && p[len] != '"' ; len++ )
+            ;
+    }
+    else
+    {
+        for ( len = 0 ; p[len] && !isspace((unsigned char) p[len]) &&
+                !strchr("()!<>=&|\"", p[len]) ; len++ )
+            ;
+    }
+
+    end = p + len;
+    if ( p > parser->p && p[-1] == '"' && *end == '"' )
+        end++;
+
+    if ( len >= sizeof(parser->token) )
+        len = sizeof(parser->token) - 1;
+
+    memcpy(parser->token, p, len);
+    parser->token[len] = '\0';
+    parser->p = end;
+}
+
+static int acceptToken(filter_parser_t *parser, const char *a, const char *b)
+{
+    if ( strcmp(parser->token, a) && (b == NULL || strcmp(parser->token, b)) )
+        return 0;
+
+    nextToken(parser);
+
+    return 1;
+}
+
+static filter_op_t *emit(filter_parser_t *parser, int code)
+{
+    if_filter_t *filter = parser->filter;
+    filter_op_t *op;
+
+    if ( filter->nb == filter->size )
+    {
+        size_t  size = filter->size ? filter->size * 2 : 16;
+
+        if ( (op = realloc(filter->ops, size * sizeof(*op))) == NULL )
+            return NULL;
+
+        filter->ops = op;
+        filter->size = size;
+    }
+
+    op = &filter->ops[filter->nb++];
+    memset(op, 0, sizeof(*op));
+    op->code = code;
+
+    /* Conditions push a mask, operators pop two and push one
+     */
+    if ( code < CODE_NOT )
+        filter->depth++;
+    else if ( code != CODE_NOT )
+        filter->depth--;
+
+    if ( filter->depth > filter->maxDepth )
+        filter->maxDepth = filter->depth;
+
+    return op;
+}
+
+static int parseCompare(filter_parser_t *parser)
+{
+    static const char   *ops [] = {"==", "!=", "<", "<=", ">", ">="};
+    size_t              i;
+
+    for ( i = 0 ; i < sizeof(ops) / sizeof(ops[0]) ; i++ )
+    {
+        if ( !strcmp(parser->token, ops[i]) )
+        {
+            nextToken(parser);
+            return i;
+        }
+    }
+
+    return syntaxError(parser, "comparison expected");
+}
+
+/* <addr>[/<len>] as a network and a mask in host byte order
+ */
+static int parseNetwork(filter_parser_t *parser, int allowLen,
+        uint32_t *net, uint32_t *mask)
+{
+    struct in_addr  in;
+    char            *slash,
+                    *end;
+    long            len = 32;
+
+    if ( (slash = strchr(parser->token, '/')) )
+    {
+        if ( !allowLen )
+            return syntaxError(parser, "address expected");
+
+        *slash++ = '\0';
+        len = strtol(slash, &end, 10);
+        if ( *end || len < 0 || len > 32 )
+            return syntaxError(parser, "bad prefix length");
+    }
+
+    if ( inet_pton(AF_INET, parser->token, &in) != 1 )
+        return syntaxError(parser, "address expected");
+
+    *mask = len ? ~0u << (32 - len) : 0;
+    *net = ntohl(in.s_addr) & *mask;
+
+    nextToken(parser);
+
+    return 0;
+}
+
+static int parseAddress(filter_parser_t *parser, int code)
+{
+    filter_op_t *op;
+    int         negate = 0,
+                ret;
+    uint32_t    net = 0,
+                mask = 0;
+
+    if ( acceptToken(parser, "in", NULL) )
+        ret = parseNetwork(parser, 1, &net, &mask);
+    else if ( acceptToken(parser, "==", NULL) )
+        ret = parseNetwork(parser, 0, &net, &mask);
+    else if ( acceptToken(parser, "!=", NULL) )
+    {
+        ret = parseNetwork(parser, 0, &net, &mask);
+        negate = 1;
+    }
+    else
+        ret = 0;
+
+    /* Without an operator, the mere presence of an address
+     */
+    if ( ret || (op = emit(parser, code)) == NULL )
+        return -1;
+
+    op->a = net;
+    op->b = mask;
+
+    if ( negate && emit(parser, CODE_NOT) == NULL )
+        return -1;
+
+    return 0;
+}
+
+static int parseMac(filter_parser_t *parser)
+{
+    unsigned    b[6];
+    filter_op_t *op;
+    int         negate,
+                i;
+    char        c;
+
+    if ( acceptToken(parser, "==", NULL) )
+        negate = 0;
+    else if ( acceptToken(parser, "!=", NULL) )
+        negate = 1;
+    else
+        return syntaxError(parser, "== or != expected");
+
+    if ( sscanf(parser->token, "%x:%x:%x:%x:%x:%x%c", &b[0], &b[1], &b[2],
+                &b[3], &b[4], &b[5], &c) != 6 )
+        return syntaxError(parser, "MAC address expected");
+
+    if ( (op = emit(parser, CODE_MAC_EQ)) == NULL )
+        return -1;
+
+    for ( op->mac = IF_TABLE_MAC, i = 0 ; i < 6 ; i++ )
+        op->mac |= (uint64_t) (b[i] & 0xff) << (40 - 8 * i);
+
+    nextToken(parser);
+
+    return negate && emit(parser, CODE_NOT) == NULL ? -1 : 0;
+}
+
+static int parseName(filter_parser_t *parser)
+{
+    filter_op_t *op;
+    size_t      len;
+    int         negate,
+                prefix;
+
+    if ( acceptToken(parser, "==", NULL) )
+        negate = 0;
+    else if ( acceptToken(parser, "!=", NULL) )
+        negate = 1;
+    else
+        return syntaxError(parser, "== or != expected");
+
+    if ( (len = strlen(parser->token)) == 0 )
+        return syntaxError(parser, "interface name expected");
+
+    prefix = parser->token[len - 1] == '*';
+    if ( (len -= prefix) >= IFNAMSIZ )
+        return syntaxError(parser, "interface name too long");
+
+    if ( (op = emit(parser, prefix ? CODE_NAME_PREFIX : CODE_NAME_EQ)) == NULL )
+        return -1;
+
+    memcpy(op->name, parser->token, len);
+    op->len = len;
+
+    nextToken(parser);
+
+    return negate && emit(parser, CODE_NOT) == NULL ? -1 : 0;
+}
+
+static int parseNumber(filter_parser_t *parser, int code)
+{
+    filter_op_t *op;
+    char        *end;
+    long        n;
+    int         cmp;
+
+    if ( (cmp = parseCompare(parser)) < 0 )
+        return -1;
+
+    n = strtol(parser->token, &end, 0);
+    if ( parser->token[0] == '\0' || *end || n < 0 || n > INT32_MAX )
+        return syntaxError(parser, "number expected");
+
+    if ( (op = emit(parser, code)) == NULL )
+        return -1;
+
+    op->a = n;
+    op->b = cmp;
+
+    nextToken(parser);
+
+    return 0;
+}
+
+static int parseCondition(filter_parser_t *parser)
+{
+    static const struct
+    {
+        const char  *name;
+        int         code;
+        uint32_t    mask;
+    } flags [] =
+    {
+        {"up",          CODE_FLAGS_SET,     IFF_UP},
+        {"down",        CODE_FLAGS_CLEAR,   IFF_UP},
+        {"running",     CODE_FLAGS_SET,     IFF_RUNNING},
+        {"plugged",     CODE_FLAGS_SET,     IFF_UP | IFF_RUNNING},
+        {"loopback",    CODE_FLAGS_SET,     IFF_LOOPBACK},
+        {NULL,          0,                  0},
+    }, *flag;
+    filter_op_t *op;
+
+    if ( acceptToken(parser, "(", NULL) )
+    {
+        if ( parseOr(parser) )
+            return -1;
+
+        return acceptToken(parser, ")", NULL) ? 0 : syntaxError(parser, "')' expected");
+    }
+
+    if ( acceptToken(parser, "not", "!") )
+    {
+        if ( parseCondition(parser) )
+            return -1;
+
+        return emit(parser, CODE_NOT) ? 0 : -1;
+    }
+
+    if ( acceptToken(parser, "ip", NULL) )
+        return parseAddress(parser, CODE_IP_IN);
+
+    if ( acceptToken(parser, "gw", NULL) )
+        return parseAddress(parser, CODE_GW_IN);
+
+    if ( acceptToken(parser, "mac", NULL) )
+        return parseMac(parser);
+
+    if ( acceptToken(parser, "name", NULL) )
+        return parseName(parser);
+
+    if ( acceptToken(parser, "ifindex", NULL) )
+        return parseNumber(parser, CODE_IFINDEX);
+
+    if ( acceptToken(parser, "prefixlen", NULL) )
+        return parseNumber(parser, CODE_PREFIXLEN);
+
+    for ( flag = flags ; flag->name ; flag++ )
+    {
+        if ( acceptToken(parser, flag->name, NULL) )
+        {
+            if ( (op = emit(parser, flag->code)) == NULL )
+                return -1;
+
+            op->a = flag->mask;
+            return 0;
+        }
+    }
+
+    return syntaxError(parser, "condition expected");
+}
+
+static int parseAnd(filter_parser_t *parser)
+{
+    if ( parseCondition(parser) )
+        return -1;
+
+    while ( acceptToken(parser, "and", "&&") )
+    {
+        if ( parseCondition(parser) || emit(parser, CODE_AND) == NULL )
+            return -1;
+    }
+
+    return 0;
+}
+
+static int parseOr(filter_parser_t *parser)
+{
+    if ( parseAnd(parser) )
+        return -1;
+
+    while ( acceptToken(parser, "or", "||") )
+    {
+        if ( parseAnd(parser) || emit(parser, CODE_OR) == NULL )
+            return -1;
+    }
+
+    return 0;
+}
+
+if_filter_t *ifFilterCompile(const char *expr)
+{
+    filter_parser_t parser;
+
+    if ( expr == NULL )
+        return NULL;
+
+    memset(&parser, 0, sizeof(parser));
+    parser.expr = parser.p = expr;
+
+    if ( (parser.filter = calloc(1, sizeof(if_filter_t))) == NULL )
+        return NULL;
+
+    nextToken(&parser);
+    if ( parseOr(&parser) == 0 && parser.token[0] != '\0' )
+        syntaxError(&parser, "unexpected token");
+    else if ( parser.filter->maxDepth > FILTER_DEPTH )
+        fprintf(stderr, "filter: expression too deep\n");
+    else if ( parser.filter->nb )
+        return parser.filter;
+
+    ifFilterFree(parser.filter);
+
+    return NULL;
+}
+
+void ifFilterFree(if_filter_t *filter)
+{
+    if ( filter == NULL )
+        return;
+
+    free(filter->ops);
+    free(filter);
+}
+
+static int compare(uint32_t v, uint32_t n, int cmp)
+{
+    switch ( cmp )
+    {
+        case CMP_EQ:    return v == n;
+        case CMP_NE:    return v != n;
+        case CMP_LT:    return v < n;
+        case CMP_LE:    return v <= n;
+        case CMP_GT:    return v > n;
+        default:        return v >= n;
+    }
+}
+
+/* Evaluate a condition on the rows [base, base + n), one byte per row
+ */
+static void evalCondition(const if_table_t *table, const filter_op_t *op,
+        size_t base, size_t n, uint8_t * restrict m)
+{
+    const uint32_t  * restrict u32;
+    const int32_t   * restrict i32;
+    const uint8_t   * restrict u8;
+    const uint64_t  * restrict u64;
+    uint32_t        a = op->a,
+                    b = op->b;
+    size_t          i;
+
+    switch ( op->code )
+    {
+        case CODE_FLAGS_SET:
+        for ( u32 = table->flags + base, i = 0 ; i < n ; i++ )
+            m[i] = (u32[i] & a) == a;
+        break;
+
+        case CODE_FLAGS_CLEAR:
+        for ( u32 = table->flags + base, i = 0 ; i < n ; i++ )
+            m[i] = (u32[i] & a) == 0;
+        break;
+
+        case CODE_IP_IN:
+        case CODE_GW_IN:
+        u32 = (op->code == CODE_IP_IN ? table->ip : table->gw) + base;
+        for ( i = 0 ; i < n ; i++ )
+            m[i] = ((u32[i] & b) == a) & (u32[i] != 0);
+        break;
+
+        case CODE_MAC_EQ:
+        for ( u64 = table->mac + base, i = 0 ; i < n ; i++ )
+            m[i] = u64[i] == op->mac;
+        break;
+
+        case CODE_NAME_EQ:
+        case CODE_NAME_PREFIX:
+        for ( i = 0 ; i < n ; i++ )
+            m[i] = memcmp(table->name[base + i], op->name,
+                    op->code == CODE_NAME_EQ ? IFNAMSIZ : op->len) == 0;
+        break;
+
+        case CODE_IFINDEX:
+        /* Specialized loops, a switch inside would not vectorize
+         */
+        i32 = table->ifindex + base;
+        switch ( b )
+        {
+            case CMP_EQ: for ( i = 0 ; i < n ; i++ ) m[i] = (uint32_t) i32[i] == a; break;
+            case CMP_NE: for ( i = 0 ; i < n ; i++ ) m[i] = (uint32_t) i32[i] != a; break;
+            case CMP_LT: for ( i = 0 ; i < n ; i++ ) m[i] = (uint32_t) i32[i] < a; break;
+            case CMP_LE: for ( i = 0 ; i < n ; i++ ) m[i] = (uint32_t) i32[i] <= a; break;
+            case CMP_GT: for ( i = 0 ; i < n ; i++ ) m[i] = (uint32_t) i32[i] > a; break;
+            default:     for ( i = 0 ; i < n ; i++ ) m[i] = (uint32_t) i32[i] >= a; break;
+        }
+        break;
+
+        case CODE_PREFIXLEN:
+        for ( u8 = table->prefixlen + base, u32 = table->ip + base, i = 0 ; i < n ; i++ )
+            m[i] = compare(u8[i], a, b) & (u32[i] != 0);
+        break;
+    }
+}
+
+ssize_t ifTableSelect(const if_table_t *table, const if_filter_t *filter,
+        uint32_t *rows)
+{
+    uint8_t         *stack,
+                    * restrict m,
+                    * restrict o;
+    const filter_op_t *op;
+    size_t          base,
+                    count = 0,
+                    n,
+                    i;
+    int             sp;
+
+    if ( table == NULL || filter == NULL || rows == NULL )
+        return -1;
+
+    if ( (stack = malloc(filter->maxDepth * FILTER_BLOCK)) == NULL )
+        return -1;
+
+    for ( base = 0 ; base < table->nb ; base += FILTER_BLOCK )
+    {
+        n = table->nb - base < FILTER_BLOCK ? table->nb - base : FILTER_BLOCK;
+
+        for ( sp = 0, op = filter->ops ; op < filter->ops + filter->nb ; op++ )
+        {
+            switch ( op->code )
+            {
+                case CODE_NOT:
+                for ( m = stack + (sp - 1) * FILTER_BLOCK, i = 0 ; i < n ; i++ )
+                    m[i] ^= 1;
+                break;
+
+                case CODE_AND:
+                sp--;
+                m = stack + (sp - 1) * FILTER_BLOCK;
+                o = stack + sp * FILTER_BLOCK;
+                for ( i = 0 ; i < n ; i++ )
+                    m[i] &= o[i];
+                break;
+
+                case CODE_OR:
+                sp--;
+                m = stack + (sp - 1) * FILTER_BLOCK;
+                o = stack + sp * FILTER_BLOCK;
+                for ( i = 0 ; i < n ; i++ )
+                    m[i] |= o[i];
+                break;
+
+                default:
+                evalCondition(table, op, base, n, stack + sp++ * FILTER_BLOCK);
+                break;
+            }
+        }
+
+        /* Branch free compaction of the matching rows
+         */
+        for ( m = stack, i = 0 ; i < n ; i++ )
+        {
+            rows[count] = base + i;
+            count += m[i];
+        }
+    }
+
+    free(stack);
+
+    return count;
+}
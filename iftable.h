@@ -0,0 +1,74 @@
+#ifndef __IFTABLE_H__
+#define __IFTABLE_H__
+
+#include "netconfig.h"
+#include "network.h"
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/* Column oriented snapshot of the interfaces, one array per field, rows
+ * sorted by ifindex. Addresses are in host byte order, 0 when there is
+ * none. The MAC address is packed in the low 48 bits, bit 48 is set when
+ * the interface has one.
+ */
+typedef struct if_table
+{
+    size_t      nb;
+    size_t      size;
+    char        (*name)[IFNAMSIZ];
+    int32_t     *ifindex;
+    uint32_t    *flags;
+    uint16_t    *type;
+    uint32_t    *ip;
+    uint8_t     *prefixlen;
+    uint32_t    *bcast;
+    uint32_t    *gw;
+    uint64_t    *mac;
+} if_table_t;
+
+#define IF_TABLE_MAC    (1ULL << 48)
+
+typedef struct if_filter if_filter_t;
+
+NETCONFIG_API
+int ifTableLoad(if_table_t *table);
+
+NETCONFIG_API
+void ifTableFree(if_table_t *table);
+
+NETCONFIG_API
+int ifTableInfo(const if_table_t *table, size_t row, const char *ns,
+        interface_info_t *info);
+
+/* Filter expressions combine conditions with and, or, not and brackets
+ * (&&, || and ! as well). Conditions are:
+ *  up, down, running, plugged, loopback
+ *  ip, gw                          : has an address, a gateway
+ *  ip|gw in <addr>/<len>, ip|gw == <addr>, ip|gw != <addr>
+ *  mac == <mac>, mac != <mac>
+ *  name == <name>, name != <name>  : a trailing '*' matches a prefix
+ *  ifindex|prefixlen <op> <n>      : op is one of == != < <= > >=
+ * A NULL is returned, with a message, on a syntax error.
+ */
+NETCONFIG_API
+if_filter_t *ifFilterCompile(const char *expr);
+
+NETCONFIG_API
+void ifFilterFree(if_filter_t *filter);
+
+/* rows must hold table->nb indexes, the number of matching rows is
+ * returned
+ */
+NETCONFIG_API
+ssize_t ifTableSelect(const if_table_t *table, const if_filter_t *filter,
+        uint32_t *rows);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __IFTABLE_H__ */
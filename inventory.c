@@ -0,0 +1,532 @@
+#include "inventory.h"
+#include "dhcp.h"
+
+#include <linux/if_arp.h>
+#include <linux/fib_rules.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+static int compareLink(const void *a, const void *b)
+{
+    const inventory_link_t  *la = a,
+                            *lb = b;
+
+    return (la->ifindex > lb->ifindex) - (la->ifindex < lb->ifindex);
+}
+
+void inventorySort(inventory_t *inv)
+{
+    qsort(inv->links, inv->nb, sizeof(*inv->links), &compareLink);
+}
+
+inventory_link_t *inventoryFind(const inventory_t *inv, int ifindex)
+{
+    inventory_link_t    key;
+
+    key.ifindex = ifindex;
+
+    return bsearch(&key, inv->links, inv->nb, sizeof(key), &compareLink);
+}
+
+static int compareRoute(const void *a, const void *b)
+{
+    const inventory_route_t *ra = a,
+                            *rb = b;
+
+    if ( ra->table != rb->table )
+        return ra->table < rb->table ? -1 : 1;
+
+    if ( ra->ifindex != rb->ifindex )
+        return ra->ifindex < rb->ifindex ? -1 : 1;
+
+    return (ra->metric > rb->metric) - (ra->metric < rb->metric);
+}
+
+static int compareRule(const void *a, const void *b)
+{
+    const inventory_rule_t  *ra = a,
+                            *rb = b;
+    int                     ret;
+
+    if ( (ret = strncmp(ra->dev, rb->dev, IFNAMSIZ)) )
+        return ret;
+
+    return (ra->priority > rb->priority) - (ra->priority < rb->priority);
+}
+
+/* Returns the slot of a new element, the arrays double as they fill up
+ */
+static void *append(void **array, size_t *nb, size_t *size, size_t elemSize)
+{
+    char    *grown;
+
+    if ( *nb == *size )
+    {
+        size_t  n = *size ? *size * 2 : 64;
+
+        if ( (grown = realloc(*array, n * elemSize)) == NULL )
+            return NULL;
+
+        *array = grown;
+        *size = n;
+    }
+
+    grown = (char *) *array + (*nb)++ * elemSize;
+    memset(grown, 0, elemSize);
+
+    return grown;
+}
+
+/* The table of a VRF device is in its IFLA_LINKINFO
+ */
+uint32_t inventoryVrfTable(const struct rtattr *linkinfo)
+{
+    const struct rtattr *info[IFLA_INFO_MAX + 1],
+                        *vrf[IFLA_VRF_MAX + 1];
+
+    netlinkParseAttr(RTA_DATA(linkinfo), RTA_PAYLOAD(linkinfo), info,
+            IFLA_INFO_MAX);
+    if ( info[IFLA_INFO_KIND] == NULL || info[IFLA_INFO_DATA] == NULL ||
+            strcmp(RTA_DATA(info[IFLA_INFO_KIND]), "vrf") )
+        return 0;
+
+    netlinkParseAttr(RTA_DATA(info[IFLA_INFO_DATA]),
+            RTA_PAYLOAD(info[IFLA_INFO_DATA]), vrf, IFLA_VRF_MAX);
+
+    return vrf[IFLA_VRF_TABLE] ? netlinkAttrU32(vrf[IFLA_VRF_TABLE]) : 0;
+}
+
+static int parseLink(inventory_t *inv, const struct nlmsghdr *nlh)
+{
+    const struct ifinfomsg  *ifi = NLMSG_DATA(nlh);
+    const struct rtattr     *tb[IFLA_MAX + 1];
+    inventory_link_t        *link;
+
+    netlinkParseAttr(IFLA_RTA(ifi), IFLA_PAYLOAD(nlh), tb, IFLA_MAX);
+    if ( tb[IFLA_IFNAME] == NULL )
+        return 0;
+
+    if ( (link = append((void **) &inv->links, &inv->nb, &inv->size,
+                    sizeof(*link))) == NULL )
+        return -1;
+
+    link->ifindex = ifi->ifi_index;
+    link->flags = ifi->ifi_flags;
+    link->type = ifi->ifi_type;
+    strncpy(link->name, RTA_DATA(tb[IFLA_IFNAME]), IFNAMSIZ - 1);
+
+    if ( tb[IFLA_MASTER] )
+        link->master = netlinkAttrU32(tb[IFLA_MASTER]);
+
+    if ( tb[IFLA_LINKINFO] )
+        link->vrfTable = inventoryVrfTable(tb[IFLA_LINKINFO]);
+
+    if ( tb[IFLA_ADDRESS] && RTA_PAYLOAD(tb[IFLA_ADDRESS]) == sizeof(link->mac) )
+    {
+        memcpy(link->mac, RTA_DATA(tb[IFLA_ADDRESS]), sizeof(link->mac));
+        link->hasMac = 1;
+    }
+
+    /* Only there when the dump did not ask to skip the statistics
+     */
+    if ( tb[IFLA_STATS64] )
+    {
+        memcpy(&link->stats, RTA_DATA(tb[IFLA_STATS64]),
+                RTA_PAYLOAD(tb[IFLA_STATS64]) < sizeof(link->stats) ?
+                RTA_PAYLOAD(tb[IFLA_STATS64]) : sizeof(link->stats));
+        link->hasStats = 1;
+    }
+
+    return 0;
+}
+
+static int parseAddr(inventory_t *inv, const struct nlmsghdr *nlh)
+{
+    const struct ifaddrmsg  *ifa = NLMSG_DATA(nlh);
+    const struct rtattr     *tb[IFA_MAX + 1];
+    inventory_link_t        *link;
+
+    if ( ifa->ifa_family != AF_INET ||
+            (ifa->ifa_flags & IFA_F_SECONDARY) ||
+            (link = inventoryFind(inv, ifa->ifa_index)) == NULL ||
+            link->hasAddr )
+        return 0;
+
+    netlinkParseAttr(IFA_RTA(ifa), IFA_PAYLOAD(nlh), tb, IFA_MAX);
+
+    /* SIOCGIFADDR only sees the address labelled as the interface
+     */
+    if ( tb[IFA_LABEL] &&
+            strncmp(RTA_DATA(tb[IFA_LABEL]), link->name, IFNAMSIZ) )
+        return 0;
+
+    if ( tb[IFA_LOCAL] == NULL && (tb[IFA_LOCAL] = tb[IFA_ADDRESS]) == NULL )
+        return 0;
+
+    memcpy(&link->addr, RTA_DATA(tb[IFA_LOCAL]), sizeof(link->addr));
+    if ( tb[IFA_BROADCAST] )
+        memcpy(&link->bcast, RTA_DATA(tb[IFA_BROADCAST]), sizeof(link->bcast));
+
+    link->prefixlen = ifa->ifa_prefixlen;
+    link->hasAddr = 1;
+
+    return 0;
+}
+
+/* Routes are kept whatever their table, IDs above 255 only come in
+ * RTA_TABLE
+ */
+static int parseRoute(inventory_t *inv, const struct nlmsghdr *nlh)
+{
+    const struct rtmsg  *rtm = NLMSG_DATA(nlh);
+    const struct rtattr *tb[RTA_MAX + 1];
+    inventory_route_t   *route;
+
+    if ( rtm->rtm_family != AF_INET || rtm->rtm_dst_len != 0 )
+        return 0;
+
+    netlinkParseAttr(RTM_RTA(rtm), RTM_PAYLOAD(nlh), tb, RTA_MAX);
+    if ( tb[RTA_OIF] == NULL )
+        return 0;
+
+    if ( (route = append((void **) &inv->routes, &inv->nbRoutes,
+                    &inv->sizeRoutes, sizeof(*route))) == NULL )
+        return -1;
+
+    route->table = tb[RTA_TABLE] ? netlinkAttrU32(tb[RTA_TABLE]) : rtm->rtm_table;
+    route->ifindex = netlinkAttrU32(tb[RTA_OIF]);
+
+    if ( tb[RTA_PRIORITY] )
+        route->metric = netlinkAttrU32(tb[RTA_PRIORITY]);
+
+    if ( tb[RTA_GATEWAY] )
+        memcpy(&route->gateway, RTA_DATA(tb[RTA_GATEWAY]), sizeof(route->gateway));
+
+    return 0;
+}
+
+static int addRule(inventory_t *inv, const struct rtattr *dev,
+        uint32_t priority, uint32_t table)
+{
+    inventory_rule_t    *rule;
+
+    if ( (rule = append((void **) &inv->rules, &inv->nbRules,
+                    &inv->sizeRules, sizeof(*rule))) == NULL )
+        return -1;
+
+    strncpy(rule->dev, RTA_DATA(dev), IFNAMSIZ - 1);
+    rule->priority = priority;
+    rule->table = table;
+
+    return 0;
+}
+
+/* Only the rules choosing a table on a device alone : the ones matching
+ * addresses, marks or inverted would not apply to all the traffic
+ */
+static int parseRule(inventory_t *inv, const struct nlmsghdr *nlh)
+{
+    const struct fib_rule_hdr   *frh = NLMSG_DATA(nlh);
+    const struct rtattr         *tb[FRA_MAX + 1];
+    uint32_t                    priority,
+                                table;
+
+    if ( frh->family != AF_INET || frh->action != FR_ACT_TO_TBL ||
+            frh->src_len || frh->dst_len || frh->tos ||
+            (frh->flags & FIB_RULE_INVERT) )
+        return 0;
+
+    netlinkParseAttr((const struct rtattr *) ((const char *) frh +
+                NLMSG_ALIGN(sizeof(*frh))),
+            nlh->nlmsg_len - NLMSG_LENGTH(sizeof(*frh)), tb, FRA_MAX);
+    if ( tb[FRA_FWMARK] || (tb[FRA_IIFNAME] == NULL && tb[FRA_OIFNAME] == NULL) )
+        return 0;
+
+    table = tb[FRA_TABLE] ? netlinkAttrU32(tb[FRA_TABLE]) : frh->table;
+    priority = tb[FRA_PRIORITY] ? netlinkAttrU32(tb[FRA_PRIORITY]) : 0;
+
+    if ( (tb[FRA_IIFNAME] && addRule(inv, tb[FRA_IIFNAME], priority, table)) ||
+            (tb[FRA_OIFNAME] && addRule(inv, tb[FRA_OIFNAME], priority, table)) )
+        return -1;
+
+    return 0;
+}
+
+static const inventory_route_t *findRoute(const inventory_t *inv,
+        uint32_t table, int ifindex)
+{
+    inventory_route_t   key = { .table = table, .ifindex = ifindex };
+    size_t              lo = 0,
+                        hi = inv->nbRoutes;
+
+    /* First of the metrics
+     */
+    while ( lo < hi )
+    {
+        size_t  mid = lo + (hi - lo) / 2;
+
+        if ( compareRoute(&inv->routes[mid], &key) < 0 )
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    if ( lo == inv->nbRoutes || inv->routes[lo].table != table ||
+            inv->routes[lo].ifindex != ifindex )
+        return NULL;
+
+    return &inv->routes[lo];
+}
+
+static const inventory_rule_t *findRule(const inventory_t *inv,
+        const char *dev)
+{
+    inventory_rule_t    key = { .priority = 0 };
+    size_t              lo = 0,
+                        hi = inv->nbRules;
+
+    strncpy(key.dev, dev, IFNAMSIZ - 1);
+
+    /* The one of highest precedence
+     */
+    while ( lo < hi )
+    {
+        size_t  mid = lo + (hi - lo) / 2;
+
+        if ( compareRule(&inv->rules[mid], &key) < 0 )
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    if ( lo == inv->nbRules || strncmp(inv->rules[lo].dev, dev, IFNAMSIZ) )
+        return NULL;
+
+    return &inv->rules[lo];
+}
+
+static uint32_t linkTable(const inventory_t *inv, const inventory_link_t *link)
+{
+    const inventory_link_t  *master = NULL;
+    const inventory_rule_t  *rule;
+
+    if ( (rule = findRule(inv, link->name)) )
+        return rule->table;
+
+    if ( link->master && (master = inventoryFind(inv, link->master)) )
+    {
+        if ( (rule = findRule(inv, master->name)) )
+            return rule->table;
+
+        if ( master->vrfTable )
+            return master->vrfTable;
+    }
+
+    return link->vrfTable ? link->vrfTable : RT_TABLE_MAIN;
+}
+
+void inventoryResolve(inventory_t *inv)
+{
+    const inventory_route_t *route;
+    inventory_link_t        *link;
+    size_t                  i;
+
+    qsort(inv->routes, inv->nbRoutes, sizeof(*inv->routes), &compareRoute);
+    qsort(inv->rules, inv->nbRules, sizeof(*inv->rules), &compareRule);
+
+    for ( i = 0 ; i < inv->nb ; i++ )
+    {
+        link = &inv->links[i];
+        link->table = linkTable(inv, link);
+
+        if ( (route = findRoute(inv, link->table, link->ifindex)) )
+        {
+            link->gateway = route->gateway;
+            link->hasGateway = 1;
+        }
+        else
+        {
+            link->gateway.s_addr = INADDR_ANY;
+            link->hasGateway = 0;
+        }
+    }
+}
+
+/* Links must all be parsed, and sorted, before addresses
+ */
+int inventoryParse(inventory_t *inv, const struct nlmsghdr *nlh)
+{
+    switch ( nlh->nlmsg_type )
+    {
+        case RTM_NEWLINK:
+        return parseLink(inv, nlh);
+
+        case RTM_NEWADDR:
+        return parseAddr(inv, nlh);
+
+        case RTM_NEWROUTE:
+        return parseRoute(inv, nlh);
+
+        case RTM_NEWRULE:
+        return parseRule(inv, nlh);
+
+        default:
+        return 0;
+    }
+}
+
+/* Same rules as the ioctl based getters : no MAC for the loopback and
+ * no address unless the interface is UP and RUNNING
+ */
+void inventoryInfo(const inventory_link_t *link, const char *ns,
+        interface_info_t *info)
+{
+    struct in_addr  mask;
+
+    memset(info, 0, sizeof(*info));
+    memcpy(info->name, link->name, IFNAMSIZ);
+
+    info->plugged = (link->flags & IFF_UP) && (link->flags & IFF_RUNNING);
+    info->dynamic = isInterfaceDynamic(link->name) ? 1 : 0;
+
+    if ( link->hasMac && !(link->flags & IFF_LOOPBACK) &&
+            link->type != ARPHRD_LOOPBACK )
+        snprintf(info->mac, sizeof(info->mac), "%02x:%02x:%02x:%02x:%02x:%02x",
+                link->mac[0], link->mac[1], link->mac[2],
+                link->mac[3], link->mac[4], link->mac[5]);
+
+    if ( info->plugged && link->hasAddr )
+    {
+        mask.s_addr = link->prefixlen ?
+            htonl(~0u << (32 - link->prefixlen)) : 0;
+
+        inet_ntop(AF_INET, &link->addr, info->ip, sizeof(info->ip));
+        inet_ntop(AF_INET, &mask, info->mask, sizeof(info->mask));
+        inet_ntop(AF_INET, &link->bcast, info->bcast, sizeof(info->bcast));
+    }
+
+    if ( link->hasGateway )
+        inet_ntop(AF_INET, &link->gateway, info->gw, sizeof(info->gw));
+
+    if ( ns )
+        snprintf(info->ns, sizeof(info->ns), "%s", ns);
+}
+
+static int inventoryReply(const struct nlmsghdr *nlh, void *user)
+{
+    return inventoryParse(user, nlh);
+}
+
+/* The routes of all the tables come in a single dump, along with the
+ * rules
+ */
+static int inventoryReqRoutes(netlink_req_t *req, int ifindex)
+{
+    struct rtmsg        *rtm;
+    struct fib_rule_hdr *frh;
+
+    if ( (rtm = netlinkReqAdd(req, RTM_GETROUTE, NLM_F_DUMP, sizeof(*rtm))) == NULL )
+        return -1;
+    rtm->rtm_family = AF_INET;
+
+    if ( ifindex && netlinkReqAttrU32(req, RTA_OIF, ifindex) )
+        return -1;
+
+    if ( (frh = netlinkReqAdd(req, RTM_GETRULE, NLM_F_DUMP, sizeof(*frh))) == NULL )
+        return -1;
+    frh->family = AF_INET;
+
+    return 0;
+}
+
+/* Synchronous load : one dump of the links, then of the IPv4 addresses,
+ * routes and rules
+ */
+int inventoryLoad(inventory_t *inv, netlink_t *nl)
+{
+    netlink_req_t       req = { 0 };
+    struct ifinfomsg    *ifi;
+    struct ifaddrmsg    *ifa;
+    int                 ret = -1;
+
+    if ( (ifi = netlinkReqAdd(&req, RTM_GETLINK, NLM_F_DUMP, sizeof(*ifi))) == NULL ||
+            netlinkReqAttrU32(&req, IFLA_EXT_MASK, RTEXT_FILTER_SKIP_STATS) ||
+            netlinkTransact(nl, &req, &inventoryReply, inv) )
+        goto out;
+
+    inventorySort(inv);
+
+    netlinkReqReset(&req);
+    if ( (ifa = netlinkReqAdd(&req, RTM_GETADDR, NLM_F_DUMP, sizeof(*ifa))) == NULL )
+        goto out;
+    ifa->ifa_family = AF_INET;
+
+    if ( inventoryReqRoutes(&req, 0) == 0 &&
+            netlinkTransact(nl, &req, &inventoryReply, inv) == 0 )
+    {
+        inventoryResolve(inv);
+        ret = 0;
+    }
+
+out:
+    netlinkReqFree(&req);
+
+    return ret;
+}
+
+/* The same for one interface, in a single batch : the link is asked by
+ * index and, on a strict socket, the kernel only dumps its addresses and
+ * routes. The VRF master of an enslaved link takes one more request.
+ */
+int inventoryLoadLink(inventory_t *inv, netlink_t *nl, int ifindex)
+{
+    netlink_req_t       req = { 0 };
+    struct ifinfomsg    *ifi;
+    struct ifaddrmsg    *ifa;
+    int                 ret = -1;
+
+    if ( (ifi = netlinkReqAdd(&req, RTM_GETLINK, 0, sizeof(*ifi))) == NULL )
+        goto out;
+    ifi->ifi_index = ifindex;
+
+    if ( netlinkReqAttrU32(&req, IFLA_EXT_MASK, RTEXT_FILTER_SKIP_STATS) ||
+            (ifa = netlinkReqAdd(&req, RTM_GETADDR, NLM_F_DUMP, sizeof(*ifa))) == NULL )
+        goto out;
+    ifa->ifa_family = AF_INET;
+    ifa->ifa_index = ifindex;
+
+    if ( inventoryReqRoutes(&req, ifindex) ||
+            netlinkTransact(nl, &req, &inventoryReply, inv) || inv->nb == 0 )
+        goto out;
+
+    if ( inv->links[0].master )
+    {
+        netlinkReqReset(&req);
+        if ( (ifi = netlinkReqAdd(&req, RTM_GETLINK, 0, sizeof(*ifi))) == NULL )
+            goto out;
+        ifi->ifi_index = inv->links[0].master;
+
+        if ( netlinkReqAttrU32(&req, IFLA_EXT_MASK, RTEXT_FILTER_SKIP_STATS) ||
+                netlinkTransact(nl, &req, &inventoryReply, inv) )
+            goto out;
+
+        inventorySort(inv);
+    }
+
+    inventoryResolve(inv);
+    ret = 0;
+
+out:
+    netlinkReqFree(&req);
+
+    return ret;
+}
+
+void inventoryFree(inventory_t *inv)
+{
+    free(inv->links);
+    free(inv->routes);
+    free(inv->rules);
+    memset(inv, 0, sizeof(*inv));
+}
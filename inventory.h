@@ -0,0 +1,99 @@
+#ifndef __INVENTORY_H__
+#define __INVENTORY_H__
+
+/* Internal view of the interfaces built from rtnetlink link, address
+ * and route messages, as an alternative to the per interface ioctls.
+ */
+
+#include "network.h"
+#include "netlink.h"
+
+#include <linux/if_link.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+typedef struct inventory_link
+{
+    int             ifindex;
+    unsigned        flags;
+    unsigned short  type;
+    char            name[IFNAMSIZ];
+    unsigned char   mac[6];
+    int             hasMac;
+    struct in_addr  addr;
+    struct in_addr  bcast;
+    int             prefixlen;
+    int             hasAddr;
+    struct in_addr  gateway;
+    int             hasGateway;
+    int             master;
+    uint32_t        vrfTable;
+    uint32_t        table;
+    struct rtnl_link_stats64    stats;
+    int             hasStats;
+} inventory_link_t;
+
+/* Default routes of every table, whatever their interface
+ */
+typedef struct inventory_route
+{
+    uint32_t        table;
+    int             ifindex;
+    uint32_t        metric;
+    struct in_addr  gateway;
+} inventory_route_t;
+
+/* Policy rules sending the traffic of a device, as iif or oif, to a table
+ */
+typedef struct inventory_rule
+{
+    char            dev[IFNAMSIZ];
+    uint32_t        priority;
+    uint32_t        table;
+} inventory_rule_t;
+
+typedef struct inventory
+{
+    inventory_link_t    *links;
+    size_t              nb;
+    size_t              size;
+    inventory_route_t   *routes;
+    size_t              nbRoutes;
+    size_t              sizeRoutes;
+    inventory_rule_t    *rules;
+    size_t              nbRules;
+    size_t              sizeRules;
+} inventory_t;
+
+int inventoryParse(inventory_t *inv, const struct nlmsghdr *nlh);
+
+void inventorySort(inventory_t *inv);
+
+/* The table of a VRF device from its IFLA_LINKINFO, 0 for any other link
+ */
+uint32_t inventoryVrfTable(const struct rtattr *linkinfo);
+
+inventory_link_t *inventoryFind(const inventory_t *inv, int ifindex);
+
+/* Once everything is parsed : the table of each link, from the rules
+ * naming it or its VRF master, else the table of its VRF, else the main
+ * one, and its gateway in that table
+ */
+void inventoryResolve(inventory_t *inv);
+
+void inventoryInfo(const inventory_link_t *link, const char *ns,
+        interface_info_t *info);
+
+int inventoryLoad(inventory_t *inv, netlink_t *nl);
+
+int inventoryLoadLink(inventory_t *inv, netlink_t *nl, int ifindex);
+
+void inventoryFree(inventory_t *inv);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __INVENTORY_H__ */
@@ -0,0 +1,35 @@
+#ifndef __KERNEL_H__
+#define __KERNEL_H__
+
+/* Internal entry points to the active backend, see backend.h
+ */
+
+#include "backend.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+int kernelIoctl(int fd, unsigned long request, void *arg);
+
+/* Returns 1 when rtnetlink requests go to kernelTransact() instead of a
+ * socket
+ */
+int kernelSimulated(void);
+
+int kernelTransact(const void *msgs, size_t len, backend_reply_t reply,
+        void *user);
+
+FILE *kernelOpen(const char *path, const char *mode);
+
+int kernelRename(const char *from, const char *to);
+
+unsigned kernelNameToIndex(const char *ifname);
+
+char *kernelIndexToName(unsigned ifindex, char *ifname);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __KERNEL_H__ */
@@ -0,0 +1,1318 @@
+/* sendmmsg(), recvmmsg() and timegm()
+ */
+#define _GNU_SOURCE
+
+#include "lease.h"
+#include "netlink.h"
+#include "kernel.h"
+
+/* See RFC 2131 for DHCP and RFC 2132 for its options
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <libgen.h>
+#include <sys/stat.h>
+#include <sys/random.h>
+#include <net/if_arp.h>
+#include <netinet/ether.h>
+
+#define LEASE_MAGIC         0x4e434c53
+#define LEASE_VERSION       1
+
+/* Four levels of 64 slots of one second : 64 s, 68 min, 3 days then
+ * 194 days, farther deadlines wait in the last level
+ */
+#define WHEEL_BITS          6
+#define WHEEL_SLOTS         (1 << WHEEL_BITS)
+#define WHEEL_MASK          (WHEEL_SLOTS - 1)
+#define WHEEL_LEVELS        4
+#define WHEEL_SPAN          (1LL << (WHEEL_BITS * WHEEL_LEVELS))
+
+#define NIL                 UINT32_MAX
+#define NO_SLOT             UINT16_MAX
+#define NAME_REMOVED        UINT32_MAX
+
+/* The low bits of a xid give back the lease, the high ones count the
+ * transactions
+ */
+#define XID_BITS            20
+#define XID_MASK            ((1U << XID_BITS) - 1)
+#define LEASE_MAX           XID_MASK
+
+#define LEASE_BATCH         256
+#define LEASE_PKTLEN        576
+#define LEASE_RETRY_MIN     60
+#define LEASE_SAVE_DELAY    10
+#define LEASE_RESOLVE_DELAY 30
+#define LEASE_SOCKBUF       (8*1024*1024)
+
+#define DHCP_SERVER_PORT    67
+#define DHCP_CLIENT_PORT    68
+#define DHCP_COOKIE         0x63825363
+#define DHCP_FIXED_LEN      236
+#define DHCP_MIN_LEN        300
+
+enum
+{
+    DHCP_OPT_PAD = 0,
+    DHCP_OPT_MASK = 1,
+    DHCP_OPT_ROUTER = 3,
+    DHCP_OPT_DNS = 6,
+    DHCP_OPT_LEASE_TIME = 51,
+    DHCP_OPT_MSG_TYPE = 53,
+    DHCP_OPT_SERVER_ID = 54,
+    DHCP_OPT_PARAMS = 55,
+    DHCP_OPT_MAX_SIZE = 57,
+    DHCP_OPT_T1 = 58,
+    DHCP_OPT_T2 = 59,
+    DHCP_OPT_CLIENT_ID = 61,
+    DHCP_OPT_END = 255,
+};
+
+enum
+{
+    DHCPREQUEST = 3,
+    DHCPACK = 5,
+    DHCPNAK = 6,
+};
+
+typedef struct lease_header
+{
+    uint32_t    magic;
+    uint32_t    version;
+    uint32_t    count;
+    uint32_t    entrySize;
+} lease_header_t;
+
+/* What is saved of a lease, 64 bytes
+ */
+typedef struct lease_record
+{
+    char        name[IFNAMSIZ];
+    uint32_t    addr;
+    uint32_t    mask;
+    uint32_t    router;
+    uint32_t    server;
+    uint32_t    dns;
+    uint32_t    state;
+    int64_t     renew;
+    int64_t     rebind;
+    int64_t     expire;
+} lease_record_t;
+
+typedef struct lease_entry
+{
+    lease_record_t  rec;
+    int64_t         when;
+    uint32_t        next;
+    uint32_t        prev;
+    uint32_t        xid;
+    int32_t         ifindex;
+    uint16_t        slot;
+    uint8_t         used;
+    uint8_t         changed;
+    unsigned char   mac[ETH_ALEN];
+} lease_entry_t;
+
+typedef struct lease_packet
+{
+    uint32_t            idx;
+    struct sockaddr_in  to;
+    struct iovec        iov;
+    unsigned char       data[LEASE_PKTLEN];
+    union
+    {
+        struct cmsghdr  align;
+        char            buff[CMSG_SPACE(sizeof(struct in_pktinfo))];
+    } ctrl;
+} lease_packet_t;
+
+struct lease_manager
+{
+    char            *path;
+
+    /* Removed entries are chained by next from freeList
+     */
+    lease_entry_t   *entries;
+    size_t          nb;
+    size_t          size;
+    size_t          count;
+    uint32_t        freeList;
+    size_t          unresolved;
+    int64_t         resolved;
+
+    uint32_t        *names;
+    size_t          namesSize;
+    size_t          namesUsed;
+
+    /* tick is the next second to run
+     */
+    uint32_t        wheel[WHEEL_LEVELS][WHEEL_SLOTS];
+    int64_t         tick;
+
+    int             fd;
+    uint32_t        xidKey;
+    uint32_t        xidSeq;
+
+    int             dirty;
+    int64_t         saved;
+
+    netlink_t       nl;
+    netlink_req_t   req;
+
+    lease_packet_t  *pkts;
+    struct mmsghdr  *msgs;
+    unsigned        nbPkts;
+};
+
+static size_t hashName(const char *name)
+{
+    size_t  h = 2166136261u;
+    int     i;
+
+    for ( i = 0 ; i < IFNAMSIZ && name[i] ; i++ )
+        h = (h ^ (unsigned char) name[i]) * 16777619u;
+
+    return h;
+}
+
+static uint32_t *lookupName(const lease_manager_t *lm, const char *name)
+{
+    size_t  i,
+            mask = lm->namesSize - 1;
+
+    if ( lm->namesSize == 0 )
+        return NULL;
+
+    for ( i = hashName(name) & mask ; lm->names[i] ; i = (i + 1) & mask )
+    {
+        if ( lm->names[i] != NAME_REMOVED &&
+                strncmp(lm->entries[lm->names[i] - 1].rec.name, name, IFNAMSIZ) == 0 )
+            return &lm->names[i];
+    }
+
+    return NULL;
+}
+
+static int indexName(lease_manager_t *lm, uint32_t idx)
+{
+    size_t  i,
+            mask;
+
+    /* Keep the table at most half full, removed slots included
+     */
+    if ( (lm->namesUsed + 1) * 2 > lm->namesSize )
+    {
+        uint32_t    *old = lm->names;
+        size_t      oldSize = lm->namesSize,
+                    size = lm->namesSize ? lm->namesSize : 64;
+
+        if ( (lm->count + 1) * 4 > size )
+            size *= 2;
+
+        if ( (lm->names = calloc(size, sizeof(*lm->names))) == NULL )
+        {
+            lm->names = old;
+            return -1;
+        }
+
+        lm->namesSize = size;
+        lm->namesUsed = 0;
+        for ( i = 0 ; i < oldSize ; i++ )
+        {
+            if ( old[i] && old[i] != NAME_REMOVED )
+                indexName(lm, old[i] - 1);
+        }
+
+        free(old);
+    }
+
+    mask = lm->namesSize - 1;
+    for ( i = hashName(lm->entries[idx].rec.name) & mask ;
+            lm->names[i] && lm->names[i] != NAME_REMOVED ; i = (i + 1) & mask )
+        ;
+
+    if ( lm->names[i] == 0 )
+        lm->namesUsed++;
+
+    lm->names[i] = idx + 1;
+
+    return 0;
+}
+
+/* Timer wheel : the entries of a slot are doubly chained by index
+ */
+static void wheelUnlink(lease_manager_t *lm, uint32_t idx)
+{
+    lease_entry_t   *e = &lm->entries[idx];
+    uint32_t        *head;
+
+    if ( e->slot == NO_SLOT )
+        return;
+
+    head = &lm->wheel[e->slot >> WHEEL_BITS][e->slot & WHEEL_MASK];
+    if ( e->prev != NIL )
+        lm->entries[e->prev].next = e->next;
+    else
+        *head = e->next;
+
+    if ( e->next != NIL )
+        lm->entries[e->next].prev = e->prev;
+
+    e->slot = NO_SLOT;
+}
+
+static void wheelInsert(lease_manager_t *lm, uint32_t idx)
+{
+    lease_entry_t   *e = &lm->entries[idx];
+    int64_t         when = e->when,
+                    delta = when - lm->tick;
+    int             level;
+    uint32_t        *head;
+
+    /* Overdue entries run on the next tick
+     */
+    if ( delta < 0 )
+        when = lm->tick;
+    else if ( delta >= WHEEL_SPAN )
+        when = lm->tick + WHEEL_SPAN - 1;
+
+    for ( level = 0 ; level < WHEEL_LEVELS - 1 ; level++ )
+    {
+        if ( when - lm->tick < (1LL << (WHEEL_BITS * (level + 1))) )
+            break;
+    }
+
+    e->slot = level << WHEEL_BITS | ((when >> (WHEEL_BITS * level)) & WHEEL_MASK);
+    head = &lm->wheel[level][e->slot & WHEEL_MASK];
+
+    e->prev = NIL;
+    e->next = *head;
+    if ( *head != NIL )
+        lm->entries[*head].prev = idx;
+    *head = idx;
+}
+
+static void wheelSchedule(lease_manager_t *lm, uint32_t idx, int64_t when)
+{
+    wheelUnlink(lm, idx);
+    lm->entries[idx].when = when;
+    wheelInsert(lm, idx);
+}
+
+/* Spread the entries of a slot over the lower levels, returns the index
+ * of the slot
+ */
+static int wheelCascade(lease_manager_t *lm, int level)
+{
+    int         slot = (lm->tick >> (WHEEL_BITS * level)) & WHEEL_MASK;
+    uint32_t    idx = lm->wheel[level][slot],
+                next;
+
+    lm->wheel[level][slot] = NIL;
+    for ( ; idx != NIL ; idx = next )
+    {
+        next = lm->entries[idx].next;
+        lm->entries[idx].slot = NO_SLOT;
+        wheelInsert(lm, idx);
+    }
+
+    return slot;
+}
+
+/* Run the wheel up to now, the entries that fell due are chained by next
+ * in the returned list
+ */
+static uint32_t wheelAdvance(lease_manager_t *lm, int64_t now)
+{
+    uint32_t    due = NIL,
+                idx,
+                next;
+    size_t      i;
+    int         level,
+                slot;
+
+    /* After a long sleep or a clock jump, everything is inserted again
+     */
+    if ( now - lm->tick > WHEEL_SLOTS * WHEEL_SLOTS || now + 1 < lm->tick )
+    {
+        lm->tick = now;
+        memset(lm->wheel, 0xff, sizeof(lm->wheel));
+        for ( i = 0 ; i < lm->nb ; i++ )
+        {
+            if ( lm->entries[i].slot != NO_SLOT )
+            {
+                lm->entries[i].slot = NO_SLOT;
+                wheelInsert(lm, i);
+            }
+        }
+    }
+
+    for ( ; lm->tick <= now ; lm->tick++ )
+    {
+        slot = lm->tick & WHEEL_MASK;
+
+        /* A level is cascaded when the one below wraps
+         */
+        for ( level = 1 ; slot == 0 && level < WHEEL_LEVELS &&
+                wheelCascade(lm, level) == 0 ; level++ )
+            ;
+
+        idx = lm->wheel[0][slot];
+        lm->wheel[0][slot] = NIL;
+        for ( ; idx != NIL ; idx = next )
+        {
+            next = lm->entries[idx].next;
+            lm->entries[idx].slot = NO_SLOT;
+            lm->entries[idx].next = due;
+            due = idx;
+        }
+    }
+
+    return due;
+}
+
+static void recordToLease(const lease_record_t *rec, dhcp_lease_t *lease)
+{
+    memset(lease, 0, sizeof(*lease));
+    memcpy(lease->name, rec->name, IFNAMSIZ);
+    lease->name[IFNAMSIZ - 1] = '\0';
+    lease->addr.s_addr = rec->addr;
+    lease->mask.s_addr = rec->mask;
+    lease->router.s_addr = rec->router;
+    lease->server.s_addr = rec->server;
+    lease->dns.s_addr = rec->dns;
+    lease->renew = rec->renew;
+    lease->rebind = rec->rebind;
+    lease->expire = rec->expire;
+    lease->state = rec->state;
+}
+
+static int addRecord(lease_manager_t *lm, const lease_record_t *rec)
+{
+    lease_entry_t   *e;
+    uint32_t        *slot,
+                    idx;
+
+    if ( (slot = lookupName(lm, rec->name)) != NULL )
+        idx = *slot - 1;
+    else
+    {
+        if ( lm->freeList != NIL )
+        {
+            idx = lm->freeList;
+            lm->freeList = lm->entries[idx].next;
+        }
+        else
+        {
+            if ( lm->nb == LEASE_MAX )
+            {
+                fprintf(stderr, "Too many leases\n");
+                return -1;
+            }
+
+            if ( lm->nb == lm->size )
+            {
+                size_t  size = lm->size ? lm->size * 2 : 64;
+
+                if ( (e = realloc(lm->entries, size * sizeof(*e))) == NULL )
+                    return -1;
+
+                lm->entries = e;
+                lm->size = size;
+            }
+
+            idx = lm->nb++;
+        }
+
+        e = &lm->entries[idx];
+        memset(e, 0, sizeof(*e));
+        e->slot = NO_SLOT;
+        e->used = 1;
+        memcpy(e->rec.name, rec->name, IFNAMSIZ);
+        lm->count++;
+        lm->unresolved++;
+
+        if ( indexName(lm, idx) )
+            return -1;
+    }
+
+    e = &lm->entries[idx];
+    e->rec = *rec;
+    e->xid = 0;
+
+    if ( e->rec.state == LEASE_EXPIRED )
+        wheelUnlink(lm, idx);
+    else
+    {
+        e->rec.state = LEASE_BOUND;
+        wheelSchedule(lm, idx, e->rec.renew);
+    }
+
+    lm->dirty = 1;
+
+    return 0;
+}
+
+int leaseManagerAdd(lease_manager_t *lm, const dhcp_lease_t *lease)
+{
+    lease_record_t  rec;
+
+    if ( lm == NULL || lease == NULL || *lease->name == '\0' ||
+            lease->addr.s_addr == INADDR_ANY )
+        return -1;
+
+    memset(&rec, 0, sizeof(rec));
+    snprintf(rec.name, sizeof(rec.name), "%.*s", IFNAMSIZ - 1, lease->name);
+    rec.addr = lease->addr.s_addr;
+    rec.mask = lease->mask.s_addr;
+    rec.router = lease->router.s_addr;
+    rec.server = lease->server.s_addr;
+    rec.dns = lease->dns.s_addr;
+    rec.renew = lease->renew;
+    rec.rebind = lease->rebind;
+    rec.expire = lease->expire;
+    rec.state = LEASE_BOUND;
+
+    return addRecord(lm, &rec);
+}
+
+int leaseManagerRemove(lease_manager_t *lm, const char *ifname)
+{
+    uint32_t    *slot,
+                idx;
+
+    if ( lm == NULL || ifname == NULL ||
+            (slot = lookupName(lm, ifname)) == NULL )
+        return -1;
+
+    idx = *slot - 1;
+    *slot = NAME_REMOVED;
+
+    wheelUnlink(lm, idx);
+    if ( lm->entries[idx].ifindex == 0 )
+        lm->unresolved--;
+    lm->entries[idx].used = 0;
+    lm->entries[idx].next = lm->freeList;
+    lm->freeList = idx;
+    lm->count--;
+    lm->dirty = 1;
+
+    return 0;
+}
+
+static int loadLeases(lease_manager_t *lm)
+{
+    lease_header_t  hdr;
+    lease_record_t  rec;
+    FILE            *file;
+    uint32_t        i;
+    int             ret = 0;
+
+    if ( (file = kernelOpen(lm->path, "r")) == NULL )
+    {
+        if ( errno == ENOENT )
+            return 0;
+
+        perror(lm->path);
+        return -1;
+    }
+
+    if ( fread(&hdr, sizeof(hdr), 1, file) != 1 ||
+            hdr.magic != LEASE_MAGIC || hdr.version != LEASE_VERSION ||
+            hdr.entrySize != sizeof(rec) )
+    {
+        fprintf(stderr, "%s: not a lease file\n", lm->path);
+        fclose(file);
+        return -1;
+    }
+
+    for ( i = 0 ; ret == 0 && i < hdr.count ; i++ )
+    {
+        if ( fread(&rec, sizeof(rec), 1, file) != 1 )
+            ret = -1;
+        else
+        {
+            rec.name[IFNAMSIZ - 1] = '\0';
+            ret = addRecord(lm, &rec);
+        }
+    }
+
+    fclose(file);
+    lm->dirty = 0;
+
+    return ret;
+}
+
+int leaseManagerSave(lease_manager_t *lm)
+{
+    char            tmp[PATH_MAX];
+    lease_header_t  hdr;
+    FILE            *file;
+    size_t          i;
+    int             ret = 0;
+
+    if ( lm == NULL )
+        return -1;
+
+    /* The directory of the default file may not exist yet
+     */
+    if ( !kernelSimulated() )
+    {
+        snprintf(tmp, sizeof(tmp), "%s", lm->path);
+        mkdir(dirname(tmp), 0755);
+    }
+
+    snprintf(tmp, sizeof(tmp), "%s.tmp", lm->path);
+    if ( (file = kernelOpen(tmp, "w")) == NULL )
+    {
+        perror(tmp);
+        return -1;
+    }
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = LEASE_MAGIC;
+    hdr.version = LEASE_VERSION;
+    hdr.count = lm->count;
+    hdr.entrySize = sizeof(lease_record_t);
+
+    if ( fwrite(&hdr, sizeof(hdr), 1, file) != 1 )
+        ret = -1;
+
+    for ( i = 0 ; ret == 0 && i < lm->nb ; i++ )
+    {
+        if ( lm->entries[i].used &&
+                fwrite(&lm->entries[i].rec, sizeof(lease_record_t), 1, file) != 1 )
+            ret = -1;
+    }
+
+    if ( fclose(file) )
+        ret = -1;
+
+    if ( ret == 0 && (ret = kernelRename(tmp, lm->path)) )
+        perror("rename");
+
+    if ( ret == 0 )
+    {
+        lm->dirty = 0;
+        lm->saved = time(NULL);
+    }
+
+    return ret;
+}
+
+lease_manager_t *leaseManagerOpen(const char *path)
+{
+    lease_manager_t *lm;
+
+    if ( (lm = calloc(1, sizeof(*lm))) == NULL )
+        return NULL;
+
+    lm->fd = -1;
+    lm->nl.fd = -1;
+    lm->freeList = NIL;
+    lm->tick = time(NULL);
+    memset(lm->wheel, 0xff, sizeof(lm->wheel));
+
+    if ( (lm->path = strdup(path ? path : LEASE_FILE)) == NULL ||
+            loadLeases(lm) )
+    {
+        leaseManagerClose(lm);
+        return NULL;
+    }
+
+    return lm;
+}
+
+void leaseManagerClose(lease_manager_t *lm)
+{
+    if ( lm == NULL )
+        return;
+
+    if ( lm->dirty && lm->path )
+        leaseManagerSave(lm);
+
+    if ( lm->fd >= 0 )
+        close(lm->fd);
+
+    netlinkClose(&lm->nl);
+    netlinkReqFree(&lm->req);
+    free(lm->pkts);
+    free(lm->msgs);
+    free(lm->entries);
+    free(lm->names);
+    free(lm->path);
+    free(lm);
+}
+
+int foreachLease(const lease_manager_t *lm, lease_callback_t cb, void *user)
+{
+    dhcp_lease_t    lease;
+    size_t          i;
+    int             ret;
+
+    if ( lm == NULL )
+        return -1;
+
+    for ( i = 0 ; i < lm->nb ; i++ )
+    {
+        if ( !lm->entries[i].used )
+            continue;
+
+        recordToLease(&lm->entries[i].rec, &lease);
+        if ( cb && (ret = cb(&lease, user)) )
+            return ret;
+    }
+
+    return 0;
+}
+
+/* dhclient.leases
+ */
+static int64_t parseLeaseDate(const char *str)
+{
+    struct tm   tm;
+    long long   epoch;
+
+    if ( sscanf(str, "epoch %lld", &epoch) == 1 )
+        return epoch;
+
+    if ( strncmp(str, "never", 5) == 0 )
+        return INT64_MAX;
+
+    /* <weekday> <year>/<month>/<day> <hour>:<minute>:<second> in UTC
+     */
+    memset(&tm, 0, sizeof(tm));
+    if ( sscanf(str, "%*d %d/%d/%d %d:%d:%d", &tm.tm_year, &tm.tm_mon,
+                &tm.tm_mday, &tm.tm_hour, &tm.tm_min, &tm.tm_sec) != 6 )
+        return 0;
+
+    tm.tm_year -= 1900;
+    tm.tm_mon -= 1;
+
+    return timegm(&tm);
+}
+
+static void parseLeaseAddr(const char *str, uint32_t *addr)
+{
+#define BUFFLEN     INET_ADDRSTRLEN
+    char    buff[BUFFLEN];
+    size_t  len = strcspn(str, ",; \t\n");
+
+    if ( len >= sizeof(buff) )
+        return;
+
+    memcpy(buff, str, len);
+    buff[len] = '\0';
+    inet_pton(AF_INET, buff, addr);
+#undef BUFFLEN
+}
+
+int leaseManagerImport(lease_manager_t *lm, const char *dhclientLeases)
+{
+#define BUFFLEN     1024
+    char            buff[BUFFLEN];
+    lease_record_t  rec;
+    FILE            *file;
+    char            *p,
+                    *q;
+    int             inLease = 0,
+                    nb = 0;
+
+    if ( lm == NULL || dhclientLeases == NULL )
+        return -1;
+
+    if ( (file = kernelOpen(dhclientLeases, "r")) == NULL )
+    {
+        perror(dhclientLeases);
+        return -1;
+    }
+
+    while ( fgets(buff, sizeof(buff), file) )
+    {
+        for ( p = buff ; *p == ' ' || *p == '\t' ; p++ )
+            ;
+
+        if ( strncmp(p, "lease {", 7) == 0 )
+        {
+            memset(&rec, 0, sizeof(rec));
+            inLease = 1;
+        }
+        else if ( !inLease )
+            continue;
+        else if ( *p == '}' )
+        {
+            /* The last lease of an interface wins
+             */
+            inLease = 0;
+            if ( *rec.name && rec.addr && rec.expire &&
+                    addRecord(lm, &rec) == 0 )
+                nb++;
+        }
+        else if ( strncmp(p, "interface \"", 11) == 0 )
+        {
+            p += 11;
+            if ( (q = strchr(p, '"')) && q - p < IFNAMSIZ )
+            {
+                memset(rec.name, 0, sizeof(rec.name));
+                memcpy(rec.name, p, q - p);
+            }
+        }
+        else if ( strncmp(p, "fixed-address ", 14) == 0 )
+            parseLeaseAddr(p + 14, &rec.addr);
+        else if ( strncmp(p, "option subnet-mask ", 19) == 0 )
+            parseLeaseAddr(p + 19, &rec.mask);
+        else if ( strncmp(p, "option routers ", 15) == 0 )
+            parseLeaseAddr(p + 15, &rec.router);
+        else if ( strncmp(p, "option domain-name-servers ", 27) == 0 )
+            parseLeaseAddr(p + 27, &rec.dns);
+        else if ( strncmp(p, "option dhcp-server-identifier ", 30) == 0 )
+            parseLeaseAddr(p + 30, &rec.server);
+        else if ( strncmp(p, "renew ", 6) == 0 )
+            rec.renew = parseLeaseDate(p + 6);
+        else if ( strncmp(p, "rebind ", 7) == 0 )
+            rec.rebind = parseLeaseDate(p + 7);
+        else if ( strncmp(p, "expire ", 7) == 0 )
+            rec.expire = parseLeaseDate(p + 7);
+    }
+
+    fclose(file);
+
+    return nb;
+#undef BUFFLEN
+}
+
+/* The ifindex and MAC address of the leases come from one link dump
+ */
+static int resolveReply(const struct nlmsghdr *nlh, void *user)
+{
+    lease_manager_t         *lm = user;
+    const struct ifinfomsg  *ifi = NLMSG_DATA(nlh);
+    const struct rtattr     *tb[IFLA_MAX + 1];
+    lease_entry_t           *e;
+    uint32_t                *slot;
+
+    if ( nlh->nlmsg_type != RTM_NEWLINK )
+        return 0;
+
+    netlinkParseAttr(IFLA_RTA(ifi), IFLA_PAYLOAD(nlh), tb, IFLA_MAX);
+    if ( tb[IFLA_IFNAME] == NULL ||
+            (slot = lookupName(lm, RTA_DATA(tb[IFLA_IFNAME]))) == NULL )
+        return 0;
+
+    e = &lm->entries[*slot - 1];
+    if ( e->ifindex == 0 )
+        lm->unresolved--;
+
+    e->ifindex = ifi->ifi_index;
+    if ( tb[IFLA_ADDRESS] && RTA_PAYLOAD(tb[IFLA_ADDRESS]) == ETH_ALEN )
+        memcpy(e->mac, RTA_DATA(tb[IFLA_ADDRESS]), ETH_ALEN);
+
+    return 0;
+}
+
+static int resolveLinks(lease_manager_t *lm)
+{
+    netlink_req_t       req = { 0 };
+    struct ifinfomsg    *ifi;
+    int                 ret = -1;
+
+    if ( (ifi = netlinkReqAdd(&req, RTM_GETLINK, NLM_F_DUMP,
+                    sizeof(*ifi))) != NULL &&
+            netlinkReqAttrU32(&req, IFLA_EXT_MASK, RTEXT_FILTER_SKIP_STATS) == 0 &&
+            netlinkTransact(&lm->nl, &req, &resolveReply, lm) >= 0 )
+        ret = 0;
+
+    netlinkReqFree(&req);
+
+    return ret;
+}
+
+static int openSocket(lease_manager_t *lm)
+{
+    struct sockaddr_in  addr;
+    int                 opt;
+
+    if ( (lm->fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                    0)) < 0 )
+    {
+        perror("socket");
+        return -1;
+    }
+
+    /* dhclient may hold the port as well
+     */
+    opt = 1;
+    setsockopt(lm->fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    setsockopt(lm->fd, SOL_SOCKET, SO_BROADCAST, &opt, sizeof(opt));
+
+    opt = LEASE_SOCKBUF;
+    if ( setsockopt(lm->fd, SOL_SOCKET, SO_RCVBUFFORCE, &opt, sizeof(opt)) < 0 )
+        setsockopt(lm->fd, SOL_SOCKET, SO_RCVBUF, &opt, sizeof(opt));
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(DHCP_CLIENT_PORT);
+    addr.sin_addr.s_addr = INADDR_ANY;
+
+    if ( bind(lm->fd, (struct sockaddr *) &addr, sizeof(addr)) < 0 )
+    {
+        perror("bind");
+        close(lm->fd);
+        lm->fd = -1;
+        return -1;
+    }
+
+    return 0;
+}
+
+int leaseManagerFd(lease_manager_t *lm)
+{
+    if ( lm == NULL )
+        return -1;
+
+    if ( lm->pkts == NULL )
+    {
+        if ( (lm->pkts = calloc(LEASE_BATCH, sizeof(*lm->pkts))) == NULL ||
+                (lm->msgs = calloc(LEASE_BATCH, sizeof(*lm->msgs))) == NULL )
+            return -1;
+
+        if ( getrandom(&lm->xidKey, sizeof(lm->xidKey), GRND_NONBLOCK) !=
+                sizeof(lm->xidKey) )
+            lm->xidKey = time(NULL) ^ ((uint32_t) getpid() << 16);
+        lm->xidKey &= ~XID_MASK;
+    }
+
+    if ( lm->nl.fd < 0 && lm->nl.buff == NULL &&
+            netlinkOpen(&lm->nl, NETLINK_ROUTE, 0) )
+        return -1;
+
+    if ( lm->fd < 0 && openSocket(lm) )
+        return -1;
+
+    return lm->fd;
+}
+
+/* A timer runs at the next second at the latest
+ */
+int leaseManagerTimeout(const lease_manager_t *lm)
+{
+    struct timespec ts;
+
+    if ( lm == NULL || lm->count == 0 )
+        return -1;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+
+    return 1000 - ts.tv_nsec / 1000000;
+}
+
+static unsigned char *putOption(unsigned char *p, int code, const void *data,
+        size_t len)
+{
+    *p++ = code;
+    *p++ = len;
+    memcpy(p, data, len);
+
+    return p + len;
+}
+
+/* A DHCPREQUEST from a bound client, see RFC 2131 4.3.2 : ciaddr is set
+ * and neither the requested address nor the server identifier are given
+ */
+static int queueRequest(lease_manager_t *lm, lease_entry_t *e, int broadcast)
+{
+    static const unsigned char  params[] =
+    {
+        DHCP_OPT_MASK, DHCP_OPT_ROUTER, DHCP_OPT_DNS,
+        DHCP_OPT_LEASE_TIME, DHCP_OPT_T1, DHCP_OPT_T2,
+    };
+    lease_packet_t      *pkt = &lm->pkts[lm->nbPkts];
+    struct msghdr       *msg = &lm->msgs[lm->nbPkts].msg_hdr;
+    struct cmsghdr      *cmsg;
+    struct in_pktinfo   *info;
+    unsigned char       *p = pkt->data,
+                        clientId[ETH_ALEN + 1];
+    uint32_t            xid;
+    uint16_t            maxSize = htons(LEASE_PKTLEN);
+
+    /* 0 stands for no transaction
+     */
+    do
+    {
+        lm->xidSeq++;
+        e->xid = ((lm->xidSeq << XID_BITS) | (uint32_t) (e - lm->entries)) ^
+            lm->xidKey;
+    }
+    while ( e->xid == 0 );
+
+    memset(pkt->data, 0, sizeof(pkt->data));
+    p[0] = 1;
+    p[1] = ARPHRD_ETHER;
+    p[2] = ETH_ALEN;
+    xid = htonl(e->xid);
+    memcpy(p + 4, &xid, 4);
+    memcpy(p + 12, &e->rec.addr, 4);
+    memcpy(p + 28, e->mac, ETH_ALEN);
+
+    p += DHCP_FIXED_LEN;
+    xid = htonl(DHCP_COOKIE);
+    memcpy(p, &xid, 4);
+    p += 4;
+
+    clientId[0] = ARPHRD_ETHER;
+    memcpy(clientId + 1, e->mac, ETH_ALEN);
+
+    p = putOption(p, DHCP_OPT_MSG_TYPE, &(uint8_t){ DHCPREQUEST }, 1);
+    p = putOption(p, DHCP_OPT_CLIENT_ID, clientId, sizeof(clientId));
+    p = putOption(p, DHCP_OPT_PARAMS, params, sizeof(params));
+    p = putOption(p, DHCP_OPT_MAX_SIZE, &maxSize, sizeof(maxSize));
+    *p++ = DHCP_OPT_END;
+
+    pkt->idx = e - lm->entries;
+    memset(&pkt->to, 0, sizeof(pkt->to));
+    pkt->to.sin_family = AF_INET;
+    pkt->to.sin_port = htons(DHCP_SERVER_PORT);
+    pkt->to.sin_addr.s_addr = broadcast || e->rec.server == 0 ?
+        INADDR_BROADCAST : e->rec.server;
+
+    pkt->iov.iov_base = pkt->data;
+    pkt->iov.iov_len = p - pkt->data < DHCP_MIN_LEN ? DHCP_MIN_LEN : p - pkt->data;
+
+    /* The interface and the source address of the lease
+     */
+    memset(msg, 0, sizeof(*msg));
+    msg->msg_name = &pkt->to;
+    msg->msg_namelen = sizeof(pkt->to);
+    msg->msg_iov = &pkt->iov;
+    msg->msg_iovlen = 1;
+    msg->msg_control = pkt->ctrl.buff;
+    msg->msg_controllen = sizeof(pkt->ctrl.buff);
+
+    cmsg = CMSG_FIRSTHDR(msg);
+    cmsg->cmsg_level = IPPROTO_IP;
+    cmsg->cmsg_type = IP_PKTINFO;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(*info));
+    info = (struct in_pktinfo *) CMSG_DATA(cmsg);
+    memset(info, 0, sizeof(*info));
+    info->ipi_ifindex = e->ifindex;
+    info->ipi_spec_dst.s_addr = e->rec.addr;
+
+    return ++lm->nbPkts == LEASE_BATCH;
+}
+
+static void notify(lease_manager_t *lm, lease_callback_t cb, void *user)
+{
+    dhcp_lease_t    lease;
+    size_t          i;
+
+    for ( i = 0 ; i < lm->nb ; i++ )
+    {
+        if ( !lm->entries[i].changed )
+            continue;
+
+        lm->entries[i].changed = 0;
+        if ( cb && lm->entries[i].used )
+        {
+            recordToLease(&lm->entries[i].rec, &lease);
+            cb(&lease, user);
+        }
+    }
+}
+
+/* The address of a lost lease is removed in the same batch as the others
+ */
+static void expireLease(lease_manager_t *lm, lease_entry_t *e)
+{
+    struct ifaddrmsg    *ifa;
+
+    wheelUnlink(lm, e - lm->entries);
+    e->rec.state = LEASE_EXPIRED;
+    e->xid = 0;
+    e->changed = 1;
+    lm->dirty = 1;
+
+    if ( e->ifindex == 0 ||
+            (ifa = netlinkReqAdd(&lm->req, RTM_DELADDR, 0, sizeof(*ifa))) == NULL )
+        return;
+
+    ifa->ifa_family = AF_INET;
+    ifa->ifa_prefixlen = __builtin_popcount(e->rec.mask);
+    ifa->ifa_index = e->ifindex;
+    netlinkReqAttr(&lm->req, IFA_LOCAL, &e->rec.addr, 4);
+    netlinkReqAttr(&lm->req, IFA_ADDRESS, &e->rec.addr, 4);
+}
+
+static int sendRequests(lease_manager_t *lm)
+{
+    unsigned    off = 0;
+    int         ret;
+
+    while ( off < lm->nbPkts )
+    {
+        if ( (ret = sendmmsg(lm->fd, lm->msgs + off, lm->nbPkts - off, 0)) < 0 )
+        {
+            if ( errno == EINTR )
+                continue;
+
+            /* Skip the datagram that failed, its lease will retry and
+             * an interface that went away will be looked for again
+             */
+            if ( errno == ENODEV || errno == ENXIO )
+            {
+                lm->entries[lm->pkts[off].idx].ifindex = 0;
+                lm->unresolved++;
+            }
+            else if ( errno != EAGAIN && errno != ENOBUFS )
+                perror("sendmmsg");
+            ret = 1;
+        }
+
+        off += ret;
+    }
+
+    lm->nbPkts = 0;
+
+    return 0;
+}
+
+/* Renew, rebind or give up : the retransmissions wait half of the time
+ * left before the next deadline, one minute at least (RFC 2131 4.4.5)
+ */
+static void runLease(lease_manager_t *lm, uint32_t idx, int64_t now)
+{
+    lease_entry_t   *e = &lm->entries[idx];
+    int64_t         deadline,
+                    retry;
+    int             state;
+
+    if ( now >= e->rec.expire )
+    {
+        expireLease(lm, e);
+        return;
+    }
+
+    if ( now < e->rec.renew )
+    {
+        wheelSchedule(lm, idx, e->rec.renew);
+        return;
+    }
+
+    state = now >= e->rec.rebind ? LEASE_REBINDING : LEASE_RENEWING;
+    if ( state != (int) e->rec.state )
+    {
+        e->rec.state = state;
+        e->changed = 1;
+    }
+
+    deadline = state == LEASE_RENEWING ? e->rec.rebind : e->rec.expire;
+    if ( (retry = (deadline - now) / 2) < LEASE_RETRY_MIN )
+        retry = LEASE_RETRY_MIN;
+    wheelSchedule(lm, idx, now + retry < deadline ? now + retry : deadline);
+
+    if ( e->ifindex && queueRequest(lm, e, state == LEASE_REBINDING) )
+        sendRequests(lm);
+}
+
+static const unsigned char *findOption(const unsigned char *opt,
+        const unsigned char *end, int code, size_t len)
+{
+    while ( opt < end && *opt != DHCP_OPT_END )
+    {
+        if ( *opt == DHCP_OPT_PAD )
+        {
+            opt++;
+            continue;
+        }
+
+        if ( opt + 2 > end || opt + 2 + opt[1] > end )
+            return NULL;
+
+        if ( *opt == code )
+            return opt[1] >= len ? opt + 2 : NULL;
+
+        opt += 2 + opt[1];
+    }
+
+    return NULL;
+}
+
+static uint32_t optionU32(const unsigned char *opt)
+{
+    uint32_t    v;
+
+    memcpy(&v, opt, 4);
+
+    return v;
+}
+
+static void handleReply(lease_manager_t *lm, const unsigned char *data,
+        size_t len, int64_t now)
+{
+    const unsigned char *end = data + len,
+                        *opt,
+                        *type;
+    lease_entry_t       *e;
+    uint32_t            xid,
+                        idx,
+                        yiaddr,
+                        leaseTime,
+                        t1,
+                        t2;
+
+    if ( len < DHCP_FIXED_LEN + 4 || data[0] != 2 ||
+            ntohl(optionU32(data + DHCP_FIXED_LEN)) != DHCP_COOKIE )
+        return;
+
+    xid = ntohl(optionU32(data + 4));
+    if ( (idx = (xid ^ lm->xidKey) & XID_MASK) >= lm->nb )
+        return;
+
+    e = &lm->entries[idx];
+    if ( !e->used || e->xid == 0 || e->xid != xid ||
+            memcmp(data + 28, e->mac, ETH_ALEN) )
+        return;
+
+    opt = data + DHCP_FIXED_LEN + 4;
+    if ( (type = findOption(opt, end, DHCP_OPT_MSG_TYPE, 1)) == NULL )
+        return;
+
+    e->xid = 0;
+
+    /* A renewal does not move the lease to another address
+     */
+    yiaddr = optionU32(data + 16);
+    if ( *type == DHCPNAK || (*type == DHCPACK && yiaddr != e->rec.addr) )
+    {
+        expireLease(lm, e);
+        return;
+    }
+
+    if ( *type != DHCPACK ||
+            (opt = findOption(data + DHCP_FIXED_LEN + 4, end,
+                              DHCP_OPT_LEASE_TIME, 4)) == NULL )
+        return;
+
+    leaseTime = ntohl(optionU32(opt));
+    opt = findOption(data + DHCP_FIXED_LEN + 4, end, DHCP_OPT_T1, 4);
+    t1 = opt ? ntohl(optionU32(opt)) : leaseTime / 2;
+    opt = findOption(data + DHCP_FIXED_LEN + 4, end, DHCP_OPT_T2, 4);
+    t2 = opt ? ntohl(optionU32(opt)) : leaseTime / 8 * 7;
+
+    if ( (opt = findOption(data + DHCP_FIXED_LEN + 4, end, DHCP_OPT_MASK, 4)) )
+        e->rec.mask = optionU32(opt);
+    if ( (opt = findOption(data + DHCP_FIXED_LEN + 4, end, DHCP_OPT_ROUTER, 4)) )
+        e->rec.router = optionU32(opt);
+    if ( (opt = findOption(data + DHCP_FIXED_LEN + 4, end, DHCP_OPT_DNS, 4)) )
+        e->rec.dns = optionU32(opt);
+    if ( (opt = findOption(data + DHCP_FIXED_LEN + 4, end, DHCP_OPT_SERVER_ID, 4)) )
+        e->rec.server = optionU32(opt);
+
+    e->rec.renew = now + t1;
+    e->rec.rebind = now + t2;
+    e->rec.expire = leaseTime == UINT32_MAX ? INT64_MAX : now + leaseTime;
+    e->rec.state = LEASE_BOUND;
+    e->changed = 1;
+    lm->dirty = 1;
+
+    wheelSchedule(lm, idx, e->rec.renew);
+}
+
+/* The buffers of the requests are free while receiving
+ */
+static int receiveReplies(lease_manager_t *lm, int64_t now)
+{
+    int     nb,
+            i;
+
+    for ( i = 0 ; i < LEASE_BATCH ; i++ )
+    {
+        lm->pkts[i].iov.iov_base = lm->pkts[i].data;
+        lm->pkts[i].iov.iov_len = sizeof(lm->pkts[i].data);
+        memset(&lm->msgs[i], 0, sizeof(lm->msgs[i]));
+        lm->msgs[i].msg_hdr.msg_iov = &lm->pkts[i].iov;
+        lm->msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    while ( (nb = recvmmsg(lm->fd, lm->msgs, LEASE_BATCH, MSG_DONTWAIT, NULL)) > 0 )
+    {
+        for ( i = 0 ; i < nb ; i++ )
+            handleReply(lm, lm->pkts[i].data, lm->msgs[i].msg_len, now);
+    }
+
+    if ( nb < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR )
+    {
+        perror("recvmmsg");
+        return -1;
+    }
+
+    return 0;
+}
+
+int leaseManagerProcess(lease_manager_t *lm, lease_callback_t cb, void *user)
+{
+    int64_t     now = time(NULL);
+    uint32_t    idx,
+                next;
+
+    if ( lm == NULL || (lm->fd < 0 && leaseManagerFd(lm) < 0) )
+        return -1;
+
+    netlinkReqReset(&lm->req);
+    if ( receiveReplies(lm, now) )
+        return -1;
+
+    if ( lm->unresolved && now - lm->resolved >= LEASE_RESOLVE_DELAY )
+    {
+        if ( resolveLinks(lm) )
+            return -1;
+
+        lm->resolved = now;
+    }
+
+    for ( idx = wheelAdvance(lm, now) ; idx != NIL ; idx = next )
+    {
+        next = lm->entries[idx].next;
+        runLease(lm, idx, now);
+    }
+
+    sendRequests(lm);
+
+    /* The addresses may already be gone, the errors do not matter
+     */
+    if ( lm->req.count )
+        netlinkTransact(&lm->nl, &lm->req, NULL, NULL);
+
+    notify(lm, cb, user);
+
+    if ( lm->dirty && now - lm->saved >= LEASE_SAVE_DELAY )
+        leaseManagerSave(lm);
+
+    return 0;
+}
+
+int leaseManagerRun(lease_manager_t *lm, lease_callback_t cb, void *user)
+{
+    struct pollfd   pfd = { .events = POLLIN };
+
+    if ( (pfd.fd = leaseManagerFd(lm)) < 0 )
+        return -1;
+
+    for ( ;; )
+    {
+        if ( poll(&pfd, 1, leaseManagerTimeout(lm)) < 0 && errno != EINTR )
+        {
+            perror("poll");
+            return -1;
+        }
+
+        if ( leaseManagerProcess(lm, cb, user) )
+            return -1;
+    }
+}
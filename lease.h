@@ -0,0 +1,105 @@
+#ifndef __LEASE_H__
+#define __LEASE_H__
+
+#include "netconfig.h"
+#include "network.h"
+
+#include <stdint.h>
+#include <time.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#define LEASE_FILE      "/var/lib/netconfig/leases"
+#define DHCLIENT_LEASES "/var/lib/dhcp/dhclient.leases"
+
+enum
+{
+    LEASE_BOUND = 0,
+    LEASE_RENEWING,
+    LEASE_REBINDING,
+    LEASE_EXPIRED,
+};
+
+/* Addresses in network byte order, times in seconds since the Epoch
+ */
+typedef struct dhcp_lease
+{
+    char            name[IFNAMSIZ];
+    struct in_addr  addr;
+    struct in_addr  mask;
+    struct in_addr  router;
+    struct in_addr  server;
+    struct in_addr  dns;
+    int64_t         renew;
+    int64_t         rebind;
+    int64_t         expire;
+    int             state;
+} dhcp_lease_t;
+
+typedef int (*lease_callback_t)(const dhcp_lease_t *lease, void *user);
+
+/* Keeps bound leases alive from a single thread : the T1, T2 and expiry
+ * deadlines of all the leases sit in a hierarchical timer wheel, the
+ * DHCPREQUESTs falling due in the same second leave in one sendmmsg()
+ * from one UDP socket and the address of an expired or refused lease is
+ * removed. Leases are acquired elsewhere, by getDhcpLease() for instance,
+ * then imported or added. Their state is kept in path, a compact binary
+ * file, LEASE_FILE when NULL.
+ */
+typedef struct lease_manager lease_manager_t;
+
+NETCONFIG_API
+lease_manager_t *leaseManagerOpen(const char *path);
+
+/* Saves the leases if they changed
+ */
+NETCONFIG_API
+void leaseManagerClose(lease_manager_t *lm);
+
+/* Adds or replaces the lease of lease->name, state is ignored
+ */
+NETCONFIG_API
+int leaseManagerAdd(lease_manager_t *lm, const dhcp_lease_t *lease);
+
+NETCONFIG_API
+int leaseManagerRemove(lease_manager_t *lm, const char *ifname);
+
+/* Imports the last lease of every interface of a dhclient.leases file,
+ * returns the number of leases imported
+ */
+NETCONFIG_API
+int leaseManagerImport(lease_manager_t *lm, const char *dhclientLeases);
+
+NETCONFIG_API
+int leaseManagerSave(lease_manager_t *lm);
+
+NETCONFIG_API
+int foreachLease(const lease_manager_t *lm, lease_callback_t cb, void *user);
+
+/* The socket to poll for input, opened on the first call, and the delay
+ * (ms) before the next call to leaseManagerProcess() is due
+ */
+NETCONFIG_API
+int leaseManagerFd(lease_manager_t *lm);
+
+NETCONFIG_API
+int leaseManagerTimeout(const lease_manager_t *lm);
+
+/* Reads the pending replies then runs the timers that fell due, cb, when
+ * not NULL, sees every lease that changed state. Returns -1 on error.
+ */
+NETCONFIG_API
+int leaseManagerProcess(lease_manager_t *lm, lease_callback_t cb, void *user);
+
+/* Event loop, only returns on error
+ */
+NETCONFIG_API
+int leaseManagerRun(lease_manager_t *lm, lease_callback_t cb, void *user);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __LEASE_H__ */
@@ -1,11 +1,75 @@
 #include "network.h"
 #include "dhcp.h"
+#include "snapshot.h"
+#include "iflink.h"
+#include "exporter.h"
+#include "iftable.h"
+#include "probe.h"
+#include "fakekernel.h"
+#include "lease.h"
+#include "failover.h"
+#include "steering.h"
+#include "profile.h"
+#include "qdisc.h"
+#include "sysctl.h"
+#include "baseline.h"
+#include "ifselect.h"
+#include "checkpoint.h"
 
 #include <string.h>
+#include <stdlib.h>
+#include <limits.h>
 #include <getopt.h>
+#include <linux/rtnetlink.h>
 
 static const char   *prgname = "netconfig";
 
+#define UP_TIMEOUT      10000
+#define PROBE_TIMEOUT   1000
+
+/* Options without a short form
+ */
+enum
+{
+    OPT_UP = 256,
+    OPT_TIMEOUT,
+    OPT_JOBS,
+    OPT_CACHE,
+    OPT_LINK_ADD,
+    OPT_LINK_DEL,
+    OPT_LINK_ENSLAVE,
+    OPT_LINK_NETNS,
+    OPT_LINK_FILE,
+    OPT_METRICS,
+    OPT_WHERE,
+    OPT_NEIGH,
+    OPT_NEIGH_GET,
+    OPT_NUD,
+    OPT_PROBE,
+    OPT_SIMULATE,
+    OPT_LEASES,
+    OPT_LEASE_FILE,
+    OPT_LEASE_IMPORT,
+    OPT_LEASE_RUN,
+    OPT_FAILOVER,
+    OPT_STEERING,
+    OPT_STEERING_SET,
+    OPT_STEERING_RESTORE,
+    OPT_PROFILE,
+    OPT_PROFILE_SET,
+    OPT_PROFILE_RESTORE,
+    OPT_QDISC,
+    OPT_QDISC_SET,
+    OPT_QDISC_RESTORE,
+    OPT_SYSCTL,
+    OPT_SYSCTL_RESTORE,
+    OPT_SINCE,
+    OPT_ROUTES,
+    OPT_JSON,
+    OPT_CHECKPOINT,
+    OPT_CHECKPOINT_RESTORE,
+};
+
 typedef struct config
 {
     char        *eth;
@@ -14,9 +78,39 @@ typedef struct config
     char        *bcast;
     char        *gw;
     char        *ns;
+    char        *metrics;
+    char        *where;
+    char        *neighGet;
+    char        *simulate;
+    char        *leaseFile;
+    char        *leaseImport;
+    char        *failover;
+    char        *steeringSet;
+    char        *profileSet;
+    char        *qdiscSet;
+    char        *sysctl;
+    char        *since;
+    unsigned    nud;
+    int         timeout;
+    int         jobs;
     int         save:1,
                 dhcp:1,
-                all:1;
+                all:1,
+                up:1,
+                cache:1,
+                neigh:1,
+                routes:1,
+                json:1,
+                probe:1,
+                leases:1,
+                leaseRun:1,
+                steeringRestore:1,
+                profileRestore:1,
+                qdiscRestore:1,
+                sysctlRestore:1,
+                checkpoint:1,
+                checkpointRestore:1,
+                timed:1;
 } config_t;
 
 static const struct option  long_options [] =
@@ -32,6 +126,43 @@ static const struct option  long_options [] =
     {"save",    no_argument,        NULL,   0},
     {"csv",     no_argument,        NULL,   0},
     {"all",     no_argument,        NULL,   0},
+    {"up",      no_argument,        NULL,   OPT_UP},
+    {"timeout", required_argument,  NULL,   OPT_TIMEOUT},
+    {"jobs",    required_argument,  NULL,   OPT_JOBS},
+    {"cache",   no_argument,        NULL,   OPT_CACHE},
+    {"link-add",        required_argument,  NULL,   OPT_LINK_ADD},
+    {"link-del",        required_argument,  NULL,   OPT_LINK_DEL},
+    {"link-enslave",    required_argument,  NULL,   OPT_LINK_ENSLAVE},
+    {"link-netns",      required_argument,  NULL,   OPT_LINK_NETNS},
+    {"link-file",       required_argument,  NULL,   OPT_LINK_FILE},
+    {"metrics",         required_argument,  NULL,   OPT_METRICS},
+    {"where",           required_argument,  NULL,   OPT_WHERE},
+    {"neigh",           no_argument,        NULL,   OPT_NEIGH},
+    {"neigh-get",       required_argument,  NULL,   OPT_NEIGH_GET},
+    {"nud",             required_argument,  NULL,   OPT_NUD},
+    {"probe",           no_argument,        NULL,   OPT_PROBE},
+    {"simulate",        required_argument,  NULL,   OPT_SIMULATE},
+    {"leases",          no_argument,        NULL,   OPT_LEASES},
+    {"lease-file",      required_argument,  NULL,   OPT_LEASE_FILE},
+    {"lease-import",    optional_argument,  NULL,   OPT_LEASE_IMPORT},
+    {"lease-run",       no_argument,        NULL,   OPT_LEASE_RUN},
+    {"failover",        required_argument,  NULL,   OPT_FAILOVER},
+    {"steering",        no_argument,        NULL,   OPT_STEERING},
+    {"steering-set",    required_argument,  NULL,   OPT_STEERING_SET},
+    {"steering-restore", no_argument,       NULL,   OPT_STEERING_RESTORE},
+    {"profile",         no_argument,        NULL,   OPT_PROFILE},
+    {"profile-set",     required_argument,  NULL,   OPT_PROFILE_SET},
+    {"profile-restore", no_argument,        NULL,   OPT_PROFILE_RESTORE},
+    {"qdisc",           no_argument,        NULL,   OPT_QDISC},
+    {"qdisc-set",       required_argument,  NULL,   OPT_QDISC_SET},
+    {"qdisc-restore",   no_argument,        NULL,   OPT_QDISC_RESTORE},
+    {"sysctl",          required_argument,  NULL,   OPT_SYSCTL},
+    {"sysctl-restore",  no_argument,        NULL,   OPT_SYSCTL_RESTORE},
+    {"since",           required_argument,  NULL,   OPT_SINCE},
+    {"routes",          no_argument,        NULL,   OPT_ROUTES},
+    {"json",            no_argument,        NULL,   OPT_JSON},
+    {"checkpoint",      no_argument,        NULL,   OPT_CHECKPOINT},
+    {"checkpoint-restore", no_argument,     NULL,   OPT_CHECKPOINT_RESTORE},
 
     {0,         0,                  0,      0},
 };
@@ -42,10 +173,27 @@ static int display(const struct ifreq *ifr, void *unused);
 typedef int (* display_t)(const struct ifreq *ifr, void *unused);
 static display_t display_func = &display;
 
+static link_batch_t links;
+
+static gateway_probe_t  *probes;
+static size_t           nbProbes;
+
+static int              steering;
+static int              profile;
+static int              qdisc;
+
+/* With --qdisc, the roots of one dump for all the rows
+ */
+static qdisc_info_t     *roots;
+static size_t           nbRoots;
+
+static baseline_t       *since;
+
 static void usage(const char *prg)
 {
     fprintf(stderr, "Display or set network informations\n");
-    fprintf(stderr, "usage: %s [options] [interface]\n", prg);
+    fprintf(stderr, "usage: %s [options] [interface|pattern...]\n", prg);
+    fprintf(stderr, "patterns: 'veth*' 'eth[0-3]' re:<regex> kind:<kind> master:<name>\n");
     fprintf(stderr, "options:\n");
     fprintf(stderr, "\t--help  |-h           : display this and exit\n");
     fprintf(stderr, "\t--dhcp  |-d           : dhcp mode\n");
@@ -58,6 +206,63 @@ static void usage(const char *prg)
     fprintf(stderr, "\t--save  |-s           : save the configuration\n");
     fprintf(stderr, "\t--csv   |-c           : output display as a CSV\n");
     fprintf(stderr, "\t--all   |-a           : consider all of the interfaces\n");
+    fprintf(stderr, "\t--up                  : bring the interfaces up and wait for their carrier\n");
+    fprintf(stderr, "\t--timeout <ms>        : carrier wait or probe deadline (default %d or %d)\n",
+            UP_TIMEOUT, PROBE_TIMEOUT);
+    fprintf(stderr, "\t--cache               : serve the CSV from the snapshot in %s\n", SNAPSHOT);
+    fprintf(stderr, "\t--jobs <n>            : query the interfaces of the CSV on n threads\n");
+    fprintf(stderr, "\t--since <baseline>    : CSV of the changes since the baseline file, which\n");
+    fprintf(stderr, "\t                        is then updated: +,<row> -,<if> ~,<if>,<column>,<value>\n");
+    fprintf(stderr, "\t--link-add <spec>     : create a link, spec is one of\n");
+    fprintf(stderr, "\t                        vlan:<parent>:<id>[-<last>][:<name>]\n");
+    fprintf(stderr, "\t                        bridge:<name> | dummy:<name> | bond:<name>[:<mode>]\n");
+    fprintf(stderr, "\t                        veth:<name>:<peer>[:<netns>]\n");
+    fprintf(stderr, "\t--link-del <name>     : delete a link\n");
+    fprintf(stderr, "\t--link-enslave <name>:[<master>] : set or release the master of a link\n");
+    fprintf(stderr, "\t--link-netns <name>:<netns> : move a link to a namespace (name or pid)\n");
+    fprintf(stderr, "\t--link-file <file>    : read \"add|del|enslave|netns <spec>\" lines\n");
+    fprintf(stderr, "\t--metrics <listen>    : serve OpenMetrics on a unix socket path or [host:]port\n");
+    fprintf(stderr, "\t--where <expr>        : CSV of the interfaces matching a filter such as\n");
+    fprintf(stderr, "\t                        \"down and ip in 10.0.0.0/8\", see iftable.h\n");
+    fprintf(stderr, "\t--neigh               : list the neighbors, of the interface if given\n");
+    fprintf(stderr, "\t--neigh-get <ip>      : display the neighbor <ip> of the interface\n");
+    fprintf(stderr, "\t--routes              : list the routes of all the tables, of the interface\n");
+    fprintf(stderr, "\t                        if given, as a CSV with --csv\n");
+    fprintf(stderr, "\t--json                : output the routes as JSON\n");
+    fprintf(stderr, "\t--nud <state,...>     : only the neighbors in these states (reachable,\n");
+    fprintf(stderr, "\t                        stale, delay, probe, incomplete, failed, noarp, permanent)\n");
+    fprintf(stderr, "\t--probe               : ARP probe the gateways, CSV gets reachability and RTT\n");
+    fprintf(stderr, "\t--simulate <seed>     : run against an in-memory kernel seeded from a file,\n");
+    fprintf(stderr, "\t                        see fakekernel.h, and print the files written\n");
+    fprintf(stderr, "\t--leases              : list the leases kept by the lease manager\n");
+    fprintf(stderr, "\t--lease-file <file>   : lease manager file (default %s)\n", LEASE_FILE);
+    fprintf(stderr, "\t--lease-import[=<file>] : import the leases of dhclient (default %s)\n",
+            DHCLIENT_LEASES);
+    fprintf(stderr, "\t--lease-run           : renew the leases until killed\n");
+    fprintf(stderr, "\t--failover <if>:<gw>[,<if>:<gw>...]\n");
+    fprintf(stderr, "\t                      : keep the default route on the first gateway\n");
+    fprintf(stderr, "\t                        alive until killed, probed every --timeout ms\n");
+    fprintf(stderr, "\t--steering            : add the queues and CPUs steering to the CSV\n");
+    fprintf(stderr, "\t--steering-set <policy> <if>... : apply and save the steering of the\n");
+    fprintf(stderr, "\t                        interfaces, spread|pack|cpus <list> [rfs <flows>]\n");
+    fprintf(stderr, "\t--steering-restore    : apply the steering saved in the interfaces file\n");
+    fprintf(stderr, "\t--profile             : add the MTU, queue length, offloads and rings\n");
+    fprintf(stderr, "\t                        to the CSV\n");
+    fprintf(stderr, "\t--profile-set <profile> <if>... : apply and save the profile of the\n");
+    fprintf(stderr, "\t                        interfaces, [mtu <n>] [txqueuelen <n>]\n");
+    fprintf(stderr, "\t                        [gro|gso|tso on|off] [rx|tx <n>]\n");
+    fprintf(stderr, "\t--profile-restore     : apply the profiles saved in the interfaces file\n");
+    fprintf(stderr, "\t--qdisc               : add the root qdisc to the CSV\n");
+    fprintf(stderr, "\t--qdisc-set <qdisc> <if>... : apply and save the root qdisc of the\n");
+    fprintf(stderr, "\t                        interfaces, e.g. \"fq maxrate <bytes/s>\" or\n");
+    fprintf(stderr, "\t                        \"mq fq_codel target <us>\"\n");
+    fprintf(stderr, "\t--qdisc-restore       : apply the qdiscs saved in the interfaces file\n");
+    fprintf(stderr, "\t--sysctl <file>       : apply a sysctl.conf profile, with --save keep it\n");
+    fprintf(stderr, "\t                        in %s\n", SYSCTL_CONF);
+    fprintf(stderr, "\t--sysctl-restore      : apply the saved sysctl profile\n");
+    fprintf(stderr, "\t--checkpoint          : rebuild %s, done by --save\n", CHECKPOINT);
+    fprintf(stderr, "\t--checkpoint-restore  : apply the links, addresses, routes and name\n");
+    fprintf(stderr, "\t                        servers of the checkpoint in a single batch\n");
 }
 
 static int parse_long_options(const char *opt)
@@ -83,10 +288,13 @@ static int parse_long_options(const char *opt)
 
 static int parse_options(int argc, char * const argv[], config_t *conf)
 {
+    char    *end;
+    long    value;
     int     c,
             index;
 
     memset(conf, 0, sizeof(config_t));
+    conf->timeout = UP_TIMEOUT;
 
     while ( (c = getopt_long(argc, argv, "hde:i:m:b:g:n:sca",
                     long_options, &index)) != -1 )
@@ -141,71 +349,996 @@ static int parse_options(int argc, char * const argv[], config_t *conf)
             conf->all++;
             break;
 
+            case OPT_UP:
+            conf->up++;
+            break;
+
+            case OPT_TIMEOUT:
+            value = strtol(optarg, &end, 10);
+            if ( end == optarg || *end || value < 0 || value > INT_MAX )
+            {
+                fprintf(stderr, "--timeout needs a number of milliseconds\n");
+                return -1;
+            }
+
+            conf->timeout = value;
+            conf->timed = 1;
+            break;
+
+            case OPT_JOBS:
+            if ( (conf->jobs = atoi(optarg)) <= 0 )
+            {
+                fprintf(stderr, "--jobs needs a number of threads\n");
+                return -1;
+            }
+            break;
+
+            case OPT_CACHE:
+            conf->cache++;
+            break;
+
+            case OPT_LINK_ADD:
+            if ( linkBatchParse(&links, "add", optarg) )
+                return -1;
+            break;
+
+            case OPT_LINK_DEL:
+            if ( linkBatchParse(&links, "del", optarg) )
+                return -1;
+            break;
+
+            case OPT_LINK_ENSLAVE:
+            if ( linkBatchParse(&links, "enslave", optarg) )
+                return -1;
+            break;
+
+            case OPT_LINK_NETNS:
+            if ( linkBatchParse(&links, "netns", optarg) )
+                return -1;
+            break;
+
+            case OPT_LINK_FILE:
+            if ( linkBatchLoad(&links, optarg) )
+                return -1;
+            break;
+
+            case OPT_METRICS:
+            conf->metrics = optarg;
+            break;
+
+            case OPT_WHERE:
+            conf->where = optarg;
+            break;
+
+            case OPT_NEIGH:
+            conf->neigh++;
+            break;
+
+            case OPT_ROUTES:
+            conf->routes++;
+            break;
+
+            case OPT_JSON:
+            conf->json++;
+            break;
+
+            case OPT_NEIGH_GET:
+            conf->neighGet = optarg;
+            break;
+
+            case OPT_PROBE:
+            conf->probe++;
+            break;
+
+            case OPT_SIMULATE:
+            conf->simulate = optarg;
+            break;
+
+            case OPT_LEASES:
+            conf->leases++;
+            break;
+
+            case OPT_LEASE_FILE:
+            conf->leaseFile = optarg;
+            break;
+
+            case OPT_LEASE_IMPORT:
+            conf->leaseImport = optarg ? optarg : DHCLIENT_LEASES;
+            break;
+
+            case OPT_LEASE_RUN:
+            conf->leaseRun++;
+            break;
+
+            case OPT_FAILOVER:
+            conf->failover = optarg;
+            break;
+
+            case OPT_STEERING:
+            steering++;
+            break;
+
+            case OPT_STEERING_SET:
+            conf->steeringSet = optarg;
+            break;
+
+            case OPT_STEERING_RESTORE:
+            conf->steeringRestore++;
+            break;
+
+            case OPT_PROFILE:
+            profile++;
+            break;
+
+            case OPT_PROFILE_SET:
+            conf->profileSet = optarg;
+            break;
+
+            case OPT_PROFILE_RESTORE:
+            conf->profileRestore++;
+            break;
+
+            case OPT_QDISC:
+            qdisc++;
+            break;
+
+            case OPT_QDISC_SET:
+            conf->qdiscSet = optarg;
+            break;
+
+            case OPT_QDISC_RESTORE:
+            conf->qdiscRestore++;
+            break;
+
+            case OPT_SYSCTL:
+            conf->sysctl = optarg;
+            break;
+
+            case OPT_SYSCTL_RESTORE:
+            conf->sysctlRestore++;
+            break;
+
+            case OPT_CHECKPOINT:
+            conf->checkpoint++;
+            break;
+
+            case OPT_CHECKPOINT_RESTORE:
+            conf->checkpointRestore++;
+            break;
+
+            case OPT_SINCE:
+            conf->since = optarg;
+            display_func = &csv_display;
+            break;
+
+            case OPT_NUD:
+            if ( parseNeighborStates(optarg, &conf->nud) )
+                return -1;
+            break;
+
             default:
             fprintf(stderr, "unknow option -%c\n", c);
             return -1;
         }
     }
 
+    /* Raw sockets and notifications are not simulated : these would run
+     * against the host with the inventory of the seed
+     */
+    if ( conf->simulate &&
+            (conf->probe || conf->metrics || conf->leaseRun || conf->failover) )
+    {
+        fprintf(stderr, "--simulate excludes --probe, --metrics, --lease-run and --failover\n");
+        return -1;
+    }
+
     return 1;
 }
 
+static void csv_field(FILE *out, int value)
+{
+    if ( value == PROFILE_UNSET )
+        fprintf(out, ",");
+    else
+        fprintf(out, "%d,", value);
+}
+
+static void csv_header(FILE *out)
+{
+    fprintf(out, "if,plug,dyn,mac,ip,mask,bcast,gw,ns%s%s%s%s\n",
+            steering ? ",numa,rxq,txq,irqs,rps,xps,irq,flows" : "",
+            profile ? ",mtu,txqlen,gro,gso,tso,rxring,txring" : "",
+            qdisc ? ",qdisc" : "",
+            probes ? ",reach,rtt" : "");
+}
+
+static void csv_row(FILE *out, const interface_info_t *info)
+{
+    const gateway_probe_t   *probe;
+    const qdisc_info_t      *root;
+    steering_info_t         steer;
+    link_profile_t          prof;
+    char                    buff[256];
+
+    fprintf(out, "%s,%d,%d,%s,%s,%s,%s,%s,%s", info->name,
+            info->plugged, info->dynamic, info->mac, info->ip,
+            info->mask, info->bcast, info->gw, info->ns);
+
+    /* CPU lists, quoted as they hold commas
+     */
+    if ( steering && getInterfaceSteering(info->name, &steer) )
+        fprintf(out, ",,,,,,,,");
+    else if ( steering )
+        fprintf(out, ",%d,%d,%d,%d,\"%s\",\"%s\",\"%s\",%u", steer.numa,
+                steer.nbRx, steer.nbTx, steer.nbIrqs, steer.rps, steer.xps,
+                steer.irq, steer.flows);
+
+    /* Empty fields for what the device does not report
+     */
+    if ( profile && getInterfaceProfile(info->name, &prof) )
+        fprintf(out, ",,,,,,,");
+    else if ( profile )
+    {
+        fprintf(out, ",");
+        csv_field(out, prof.mtu);
+        csv_field(out, prof.txqlen);
+        csv_field(out, prof.gro);
+        csv_field(out, prof.gso);
+        csv_field(out, prof.tso);
+        csv_field(out, prof.rx);
+        if ( prof.tx != PROFILE_UNSET )
+            fprintf(out, "%d", prof.tx);
+    }
+
+    if ( qdisc && (root = findRootQdisc(roots, nbRoots, info->name)) &&
+            !qdiscFormat(&root->qdisc, buff, sizeof(buff)) )
+        fprintf(out, ",\"%s\"", buff);
+    else if ( qdisc )
+        fprintf(out, ",");
+
+    /* Reachability of the gateway and round trip in microseconds, empty
+     * when it was not probed
+     */
+    if ( probes == NULL )
+        fprintf(out, "\n");
+    else if ( (probe = findGatewayProbe(probes, nbProbes, info->name)) == NULL )
+        fprintf(out, ",,\n");
+    else if ( probe->reachable )
+        fprintf(out, ",1,%ld\n", probe->rtt);
+    else
+        fprintf(out, ",0,\n");
+}
+
+/* With --since the rows go to the new baseline instead of stdout
+ */
+static int csv_print(const interface_info_t *info, void *unused)
+{
+    static int  header = 0;
+    char        *row = NULL;
+    size_t      len = 0;
+    FILE        *out;
+    int         ret;
+
+    if ( since == NULL )
+    {
+        if ( !header )
+        {
+            csv_header(stdout);
+            header++;
+        }
+
+        csv_row(stdout, info);
+        return 0;
+    }
+
+    if ( (out = open_memstream(&row, &len)) == NULL )
+        return -1;
+
+    csv_row(out, info);
+    fclose(out);
+
+    ret = baselineAdd(since, row, len);
+    free(row);
+
+    return ret;
+}
+
 static int csv_display(const struct ifreq *ifr, void *unused)
 {
-    char    str[NI_MAXHOST];
+    interface_info_t    info;
+
+    if ( getInterfaceInfo(ifr, &info) )
+        return 0;
+
+    return csv_print(&info, unused);
+}
+
+static int where_display(const char *expr)
+{
+    char        ns[INET6_ADDRSTRLEN] = "";
+    if_table_t  table;
+    if_filter_t *filter;
+    uint32_t    *rows = NULL;
+    ssize_t     nb,
+                i;
+    int         ret = -1;
+
+    if ( (filter = ifFilterCompile(expr)) == NULL )
+        return -1;
+
+    if ( ifTableLoad(&table) )
+    {
+        ifFilterFree(filter);
+        return -1;
+    }
+
+    if ( (rows = malloc((table.nb ? table.nb : 1) * sizeof(*rows))) &&
+            (nb = ifTableSelect(&table, filter, rows)) >= 0 )
+    {
+        interface_info_t    info;
+
+        getDomainNameServer(ns, sizeof(ns));
+        for ( i = 0 ; i < nb ; i++ )
+        {
+            if ( ifTableInfo(&table, rows[i], ns, &info) == 0 )
+                csv_print(&info, NULL);
+        }
+
+        ret = 0;
+    }
 
+    free(rows);
+    ifTableFree(&table);
+    ifFilterFree(filter);
+
+    return ret;
+}
+
+static int neigh_print(const neighbor_info_t *info, void *unused)
+{
     static int header = 0;
 
+    if ( display_func != &csv_display )
+    {
+        printf("%s dev %s lladdr %s %s\n", info->ip, info->name,
+                info->mac[0] ? info->mac : "-", neighborStateName(info->state));
+        return 0;
+    }
+
     if ( !header )
     {
-        printf("if,plug,dyn,mac,ip,mask,bcast,gw,ns\n");;
+        printf("if,ip,mac,state\n");
         header++;
     }
 
-    printf("%s,", ifr->ifr_name);
+    printf("%s,%s,%s,%s\n", info->name, info->ip, info->mac,
+            neighborStateName(info->state));
 
-    printf("%d,", isInterfacePlugged(ifr) ? 1 : 0);
+    return 0;
+}
 
-    printf("%d,", isInterfaceDynamic(ifr->ifr_name) ?
-                1 : 0);
+static void route_table(unsigned table, char *buff, size_t len)
+{
+    switch ( table )
+    {
+        case RT_TABLE_MAIN:
+        snprintf(buff, len, "main");
+        break;
 
-    if ( getMacAddress(ifr, str, sizeof(str)) == 0 )
-        printf("%s", str);
+        case RT_TABLE_LOCAL:
+        snprintf(buff, len, "local");
+        break;
 
-    printf(",");
-    if ( getIpAddress(ifr, str, sizeof(str)) == 0 )
-        printf("%s", str);
+        default:
+        snprintf(buff, len, "%u", table);
+        break;
+    }
+}
 
-    printf(",");
-    if ( getIpMask(ifr, str, sizeof(str)) == 0 )
-        printf("%s", str);
+static void json_string(const char *str)
+{
+    putchar('"');
+    for ( ; *str ; str++ )
+    {
+        if ( *str == '"' || *str == '\\' )
+            putchar('\\');
+        putchar(*str);
+    }
+    putchar('"');
+}
 
-    printf(",");
-    if ( getIpBroadcast(ifr, str, sizeof(str)) == 0 )
-        printf("%s", str);
+/* Nothing is kept between two routes but the count, for the header and
+ * the commas of the JSON array
+ */
+typedef struct route_output
+{
+    const config_t  *conf;
+    unsigned long   count;
+} route_output_t;
+
+static int route_print(const route_info_t *info, void *user)
+{
+    route_output_t  *out = user;
+    const char      *proto = routeProtocolName(info->protocol);
+    char            table[16],
+                    protocol[16];
 
-    printf(",");
-    if ( getIpGateway(ifr, str, sizeof(str)) == 0 )
-        printf("%s", str);
+    route_table(info->table, table, sizeof(table));
+    if ( proto == NULL )
+        snprintf(protocol, sizeof(protocol), "%u", info->protocol);
 
-    printf(",");
-    if ( getDomainNameServer(str, sizeof(str)) == 0 )
-        printf("%s", str);
+    if ( out->conf->json )
+    {
+        printf("%s{\"table\":\"%s\",\"dst\":\"%s\",\"prefix\":%u,\"gateway\":\"%s\",\"if\":",
+                out->count++ ? ",\n" : "[\n", table, info->dst, info->prefix,
+                info->gateway);
+        json_string(info->name);
+        printf(",\"metric\":%u,\"protocol\":\"%s\"}", info->metric,
+                proto ? proto : protocol);
+        return 0;
+    }
+
+    if ( display_func == &csv_display )
+    {
+        if ( out->count++ == 0 )
+            printf("table,dst,prefix,gateway,if,metric,protocol\n");
+
+        printf("%s,%s,%u,%s,%s,%u,%s\n", table, info->dst, info->prefix,
+                info->gateway, info->name, info->metric, proto ? proto : protocol);
+        return 0;
+    }
 
-    printf("\n");
+    if ( info->prefix == 0 )
+        printf("default");
+    else
+        printf("%s/%u", info->dst, info->prefix);
+
+    if ( info->gateway[0] )
+        printf(" via %s", info->gateway);
+    if ( info->name[0] )
+        printf(" dev %s", info->name);
+
+    printf(" table %s proto %s metric %u\n", table, proto ? proto : protocol,
+            info->metric);
+
+    return 0;
+}
+
+static int route_display(const config_t *conf, const char *ifname)
+{
+    route_output_t  out = { conf, 0 };
+    int             ret;
+
+    ret = foreachRoute(ifname, &route_print, &out);
+
+    if ( conf->json )
+        printf(out.count ? "\n]\n" : "[]\n");
+
+    return ret;
+}
+
+static int neigh_display(const config_t *conf, const char *ifname)
+{
+    neighbor_info_t info;
+    int             ret;
+
+    if ( conf->neighGet == NULL )
+        return foreachNeighbor(ifname, conf->nud, &neigh_print, NULL);
+
+    if ( ifname == NULL )
+    {
+        fprintf(stderr, "--neigh-get needs an interface\n");
+        return -1;
+    }
+
+    if ( (ret = getNeighbor(ifname, conf->neighGet, &info)) == 0 )
+        neigh_print(&info, NULL);
+    else if ( ret > 0 )
+        fprintf(stderr, "%s: no neighbor %s\n", ifname, conf->neighGet);
+
+    return ret;
+}
+
+static void format_time(int64_t t, char *dest, size_t len)
+{
+    time_t      tt = t;
+    struct tm   tm;
+
+    if ( t == INT64_MAX )
+        snprintf(dest, len, "never");
+    else if ( gmtime_r(&tt, &tm) == NULL ||
+            strftime(dest, len, "%Y-%m-%dT%H:%M:%SZ", &tm) == 0 )
+        snprintf(dest, len, "%lld", (long long) t);
+}
+
+static int lease_print(const dhcp_lease_t *lease, void *unused)
+{
+    static const char   *states [] = {"bound", "renewing", "rebinding", "expired"};
+    static int          header = 0;
+    char                addr[INET_ADDRSTRLEN],
+                        mask[INET_ADDRSTRLEN],
+                        router[INET_ADDRSTRLEN],
+                        server[INET_ADDRSTRLEN],
+                        renew[32],
+                        rebind[32],
+                        expire[32];
+    const char          *state = lease->state >= 0 && lease->state <= LEASE_EXPIRED ?
+                            states[lease->state] : "?";
+
+    inet_ntop(AF_INET, &lease->addr, addr, sizeof(addr));
+    inet_ntop(AF_INET, &lease->mask, mask, sizeof(mask));
+    inet_ntop(AF_INET, &lease->router, router, sizeof(router));
+    inet_ntop(AF_INET, &lease->server, server, sizeof(server));
+    format_time(lease->renew, renew, sizeof(renew));
+    format_time(lease->rebind, rebind, sizeof(rebind));
+    format_time(lease->expire, expire, sizeof(expire));
+
+    if ( display_func != &csv_display )
+    {
+        printf("%s %s mask %s via %s server %s %s expire %s\n", lease->name,
+                addr, mask, router, server, state, expire);
+        return 0;
+    }
+
+    if ( !header )
+    {
+        printf("if,ip,mask,gw,server,state,renew,rebind,expire\n");
+        header++;
+    }
+
+    printf("%s,%s,%s,%s,%s,%s,%s,%s,%s\n", lease->name, addr, mask, router,
+            server, state, renew, rebind, expire);
 
     return 0;
 }
 
+static int lease_manage(const config_t *conf)
+{
+    lease_manager_t *lm;
+    int             ret = 0;
+
+    if ( (lm = leaseManagerOpen(conf->leaseFile)) == NULL )
+        return -1;
+
+    if ( conf->leaseImport )
+    {
+        if ( (ret = leaseManagerImport(lm, conf->leaseImport)) >= 0 )
+        {
+            fprintf(stderr, "%d leases imported\n", ret);
+            ret = leaseManagerSave(lm);
+        }
+    }
+
+    if ( ret == 0 && conf->leases )
+        ret = foreachLease(lm, &lease_print, NULL);
+
+    if ( ret == 0 && conf->leaseRun )
+    {
+        setvbuf(stdout, NULL, _IOLBF, 0);
+        ret = leaseManagerRun(lm, &lease_print, NULL);
+    }
+
+    leaseManagerClose(lm);
+
+    return ret;
+}
+
+static int failover_print(const failover_event_t *ev, void *unused)
+{
+    static int  header = 0;
+
+    if ( display_func != &csv_display )
+    {
+        if ( ev->from[0] )
+            printf("%s %s -> %s %s (%s) in %ld us\n", ev->fromName, ev->from,
+                    ev->name, ev->gw, ev->reason, ev->elapsed);
+        else
+            printf("%s %s (%s) in %ld us\n", ev->name, ev->gw, ev->reason,
+                    ev->elapsed);
+        return 0;
+    }
+
+    if ( !header )
+    {
+        printf("time,from_if,from,if,gw,reason,elapsed_us\n");
+        header++;
+    }
+
+    printf("%lld,%s,%s,%s,%s,%s,%ld\n", (long long) time(NULL), ev->fromName,
+            ev->from, ev->name, ev->gw, ev->reason, ev->elapsed);
+
+    return 0;
+}
+
+static int failover(const config_t *conf)
+{
+    gateway_failover_t  *fo;
+    char                *list,
+                        *item,
+                        *gw,
+                        *save = NULL;
+    int                 ret = -1;
+
+    if ( (list = strdup(conf->failover)) == NULL )
+        return -1;
+
+    if ( (fo = failoverOpen(conf->timed ? conf->timeout : 0)) == NULL )
+        goto out;
+
+    for ( item = strtok_r(list, ",", &save) ; item ;
+            item = strtok_r(NULL, ",", &save) )
+    {
+        if ( (gw = strchr(item, ':')) == NULL )
+        {
+            fprintf(stderr, "%s: <if>:<gw> expected\n", item);
+            goto out;
+        }
+
+        *gw++ = '\0';
+        if ( failoverAddGateway(fo, item, gw) )
+            goto out;
+    }
+
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    ret = failoverRun(fo, &failover_print, NULL);
+
+out:
+    failoverClose(fo);
+    free(list);
+
+    return ret;
+}
+
+static int steering_set(const config_t *conf, char * const *ifnames, int nb)
+{
+    steering_policy_t   policy;
+    int                 i,
+                        ret,
+                        failed = 0;
+
+    if ( steeringParse(conf->steeringSet, &policy) )
+        return -1;
+
+    if ( nb == 0 )
+    {
+        fprintf(stderr, "--steering-set needs interfaces\n");
+        return -1;
+    }
+
+    for ( i = 0 ; i < nb ; i++ )
+    {
+        if ( (ret = saveInterfaceSteering(ifnames[i], &policy)) < 0 )
+            return -1;
+
+        failed += ret;
+    }
+
+    return failed ? 1 : 0;
+}
+
+static int profile_set(const config_t *conf, char * const *ifnames, int nb)
+{
+    link_profile_t  prof;
+    int             i,
+                    ret,
+                    failed = 0;
+
+    if ( profileParse(conf->profileSet, &prof) )
+        return -1;
+
+    if ( nb == 0 )
+    {
+        fprintf(stderr, "--profile-set needs interfaces\n");
+        return -1;
+    }
+
+    for ( i = 0 ; i < nb ; i++ )
+    {
+        if ( (ret = saveInterfaceProfile(ifnames[i], &prof)) < 0 )
+            return -1;
+
+        failed += ret;
+    }
+
+    return failed ? 1 : 0;
+}
+
+static int qdisc_set(const config_t *conf, char * const *ifnames, int nb)
+{
+    qdisc_t root;
+    int     i,
+            ret,
+            failed = 0;
+
+    if ( qdiscParse(conf->qdiscSet, &root) )
+        return -1;
+
+    if ( nb == 0 )
+    {
+        fprintf(stderr, "--qdisc-set needs interfaces\n");
+        return -1;
+    }
+
+    for ( i = 0 ; i < nb ; i++ )
+    {
+        if ( (ret = saveInterfaceQdisc(ifnames[i], &root)) < 0 )
+            return -1;
+
+        failed += ret;
+    }
+
+    return failed ? 1 : 0;
+}
+
+static void sysctl_print(const sysctl_stats_t *stats)
+{
+    printf("%u keys: %u changed, %u unchanged, %u failed, %u ignored\n",
+            stats->changed + stats->same + stats->failed + stats->ignored,
+            stats->changed, stats->same, stats->failed, stats->ignored);
+}
+
+/* After a run that rewrote the interfaces file, once for all of its
+ * interfaces
+ */
+static int checkpoint_update(int ret)
+{
+    if ( saveCheckpoint() && ret >= 0 )
+        return -1;
+
+    return ret;
+}
+
+static void checkpoint_print(const checkpoint_stats_t *stats)
+{
+    printf("%u links, %u addresses, %u routes: %u failed\n", stats->links,
+            stats->addrs, stats->routes, stats->failed);
+}
+
+static int sysctl_apply(const config_t *conf)
+{
+    sysctl_profile_t    profile;
+    sysctl_stats_t      stats;
+    int                 ret;
+
+    if ( sysctlProfileLoad(conf->sysctl, &profile) )
+        return -1;
+
+    if ( (ret = applySysctlProfile(&profile, &stats)) >= 0 )
+        sysctl_print(&stats);
+
+    if ( ret >= 0 && conf->save && saveSysctlProfile(&profile) )
+        ret = -1;
+
+    sysctlProfileFree(&profile);
+
+    return ret < 0 ? -1 : ret ? 1 : 0;
+}
+
 static int display(const struct ifreq *ifr, void *unused)
 {
 	saveInterfaceIpConfig(ifr, MANUAL);
     return 0;
 }
 
-int main(int argc, char *argv[])
+/* Only the named interfaces are asked to the kernel, with no walk of the
+ * others
+ */
+static int select_display(const char *ifname, void *failed)
+{
+    interface_info_t    info;
+    const struct ifreq  *ifr;
+
+    if ( display_func == &csv_display )
+    {
+        if ( getInterfaceInfoByName(ifname, &info) == 0 )
+        {
+            csv_print(&info, NULL);
+            return 0;
+        }
+    }
+    else if ( (ifr = getInterfaceByNameIpv4(ifname)) != NULL )
+    {
+        display_func(ifr, NULL);
+        return 0;
+    }
+
+    fprintf(stderr, "%s: no such interface\n", ifname);
+    (*(int *) failed)++;
+
+    return 0;
+}
+
+/* The patterns are matched while the interfaces are enumerated, only the
+ * selected ones are then asked for
+ */
+static int interface_display(char * const *patterns, int nb)
+{
+    if_selector_t   *sel;
+    int             failed = 0,
+                    ret;
+
+    if ( (sel = ifSelectorCompile((const char * const *) patterns, nb)) == NULL )
+        return -1;
+
+    ret = foreachSelectedInterface(sel, &select_display, &failed);
+    ifSelectorFree(sel);
+
+    if ( ret < 0 )
+        return -1;
+
+    return failed ? 1 : 0;
+}
+
+static int bring_up(const config_t *conf, const char * const *ifnames, int nb)
 {
-    int ret = -1;
+    int     *running,
+            ret,
+            i;
+
+    if ( nb <= 0 )
+    {
+        fprintf(stderr, "--up needs at least one interface\n");
+        return -1;
+    }
+
+    if ( (running = calloc(nb, sizeof(int))) == NULL )
+        return -1;
+
+    if ( (ret = bringInterfacesUp(ifnames, nb, conf->timeout, running)) >= 0 )
+    {
+        for ( i = 0 ; i < nb ; i++ )
+            printf("%s: %s\n", ifnames[i], running[i] ? "running" : "no carrier");
+
+        ret = ret == nb ? 0 : 1;
+    }
+
+    free(running);
+
+    return ret;
+}
+
+static int walk(const config_t *conf, int argc, char *argv[])
+{
+    if ( optind < argc )
+        return interface_display(argv + optind, argc - optind);
+
+    if ( conf->cache && display_func == &csv_display )
+        return foreachInterfaceCached(SNAPSHOT, &csv_print, NULL);
+
+    addAllInterfaces();
+
+    if ( conf->jobs > 1 && display_func == &csv_display )
+        return foreachInterfaceInfo(AF_INET, conf->jobs, &csv_print, NULL);
+
+    return foreachInterfaceIpv4(display_func, NULL);
+}
+
+static int since_print(const baseline_change_t *change, void *unused)
+{
+    switch ( change->op )
+    {
+        case '-':
+        printf("-,%.*s\n", (int) change->keyLen, change->key);
+        break;
+
+        case '~':
+        printf("~,%.*s,%.*s,%.*s\n", (int) change->keyLen, change->key,
+                (int) change->columnLen, change->column,
+                (int) change->valueLen, change->value);
+        break;
+
+        default:
+        printf("%c,%.*s\n", change->op, (int) change->valueLen, change->value);
+        break;
+    }
+
+    return 0;
+}
+
+/* The rows of the walk make the new baseline, only what differs from the
+ * stored one is printed before it is replaced
+ */
+static int since_display(const config_t *conf, int argc, char *argv[])
+{
+    baseline_t  *old;
+    char        *columns = NULL;
+    size_t      len = 0;
+    FILE        *out;
+    int         ret;
+
+    if ( (out = open_memstream(&columns, &len)) == NULL )
+        return -1;
+
+    csv_header(out);
+    fclose(out);
+
+    since = baselineNew(columns);
+    free(columns);
+    if ( since == NULL )
+        return -1;
+
+    if ( (ret = walk(conf, argc, argv)) >= 0 )
+    {
+        old = baselineLoad(conf->since);
+        if ( baselineDiff(old, since, &since_print, NULL) ||
+                baselineSave(since, conf->since) )
+            ret = -1;
+        baselineFree(old);
+    }
+
+    baselineFree(since);
+    since = NULL;
+
+    return ret;
+}
+
+static int run(const config_t *conf, int argc, char *argv[])
+{
+    int         ret = -1;
+
+    if ( conf->metrics )
+        return serveMetrics(conf->metrics);
+
+    if ( conf->where )
+        return where_display(conf->where);
+
+    if ( conf->failover )
+        return failover(conf);
+
+    if ( conf->steeringSet )
+        return checkpoint_update(steering_set(conf, argv + optind, argc - optind));
+
+    if ( conf->steeringRestore )
+        return restoreSteering() ? 1 : 0;
+
+    if ( conf->profileSet )
+        return checkpoint_update(profile_set(conf, argv + optind, argc - optind));
+
+    if ( conf->profileRestore )
+        return restoreProfiles() ? 1 : 0;
+
+    if ( conf->qdiscSet )
+        return checkpoint_update(qdisc_set(conf, argv + optind, argc - optind));
+
+    if ( conf->qdiscRestore )
+        return restoreQdiscs() ? 1 : 0;
+
+    if ( conf->sysctl )
+        return sysctl_apply(conf);
+
+    if ( conf->sysctlRestore )
+    {
+        sysctl_stats_t  stats;
+
+        if ( (ret = restoreSysctl(&stats)) >= 0 )
+            sysctl_print(&stats);
+        return ret < 0 ? -1 : ret ? 1 : 0;
+    }
+
+    if ( conf->checkpoint )
+        return saveCheckpoint();
+
+    if ( conf->checkpointRestore )
+    {
+        checkpoint_stats_t  stats;
+
+        if ( (ret = restoreCheckpoint(&stats)) >= 0 )
+            checkpoint_print(&stats);
+        return ret < 0 ? -1 : ret ? 1 : 0;
+    }
+
+    if ( conf->leases || conf->leaseImport || conf->leaseRun )
+        return lease_manage(conf);
+
+    if ( conf->neigh || conf->neighGet )
+        return neigh_display(conf, optind < argc ? argv[optind] : NULL);
+
+    if ( conf->routes )
+        return route_display(conf, optind < argc ? argv[optind] : NULL);
+
+    if ( conf->up )
+        return bring_up(conf, (const char * const *) argv + optind,
+                argc - optind);
 
     if ( networkInit() )
     {
@@ -213,8 +1346,59 @@ int main(int argc, char *argv[])
         return -1;
     }
 
-    addAllInterfaces();
+    if ( links.nb )
+    {
+        ret = linkBatchCommit(&links);
+        linkBatchFree(&links);
+        return ret > 0 ? 1 : ret;
+    }
+
+    if ( conf->probe && probeGateways(conf->timed ? conf->timeout : PROBE_TIMEOUT,
+                &probes, &nbProbes) )
+        return -1;
+
+    if ( qdisc && getRootQdiscs(&roots, &nbRoots) )
+        return -1;
+
+    if ( conf->since )
+        return since_display(conf, argc, argv);
+
+    /* The default display saves each interface it walks
+     */
+    ret = walk(conf, argc, argv);
+
+    return display_func == &display ? checkpoint_update(ret) : ret;
+}
+
+int main(int argc, char *argv[])
+{
+    config_t        conf;
+    fake_kernel_t   *fk = NULL;
+    int             ret = -1;
+
+    if ( (ret = parse_options(argc, argv, &conf)) <= 0 )
+        return ret;
+
+    if ( conf.simulate )
+    {
+        if ( (fk = fakeKernelNew()) == NULL || fakeKernelLoad(fk, conf.simulate) )
+        {
+            fakeKernelFree(fk);
+            return -1;
+        }
+
+        netconfigSetBackend(fakeKernelBackend(fk));
+    }
+
+    ret = run(&conf, argc, argv);
+
+    if ( fk )
+    {
+        networkClean();
+        netconfigSetBackend(NULL);
+        fakeKernelDumpFiles(fk, stdout, 0);
+        fakeKernelFree(fk);
+    }
 
-	ret = foreachInterfaceIpv4(display_func, NULL);
     return ret;
 }
@@ -0,0 +1,18 @@
+#ifndef __NETCONFIG_H__
+#define __NETCONFIG_H__
+
+/* Library version and symbol export. The library is built with hidden
+ * symbols by default, only what is marked NETCONFIG_API is exported.
+ */
+
+#define NETCONFIG_VERSION_MAJOR     1
+#define NETCONFIG_VERSION_MINOR     1
+#define NETCONFIG_VERSION_PATCH     0
+
+#if defined(__GNUC__) && __GNUC__ >= 4
+#define NETCONFIG_API   __attribute__ ((visibility ("default")))
+#else
+#define NETCONFIG_API
+#endif
+
+#endif /* __NETCONFIG_H__ */
@@ -0,0 +1,437 @@
+#include "netlink.h"
+#include "kernel.h"
+#include "trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/socket.h>
+
+#ifndef NETLINK_CAP_ACK
+#define NETLINK_CAP_ACK     10
+#endif
+
+#ifndef NETLINK_GET_STRICT_CHK
+#define NETLINK_GET_STRICT_CHK  12
+#endif
+
+/* The kernel refuses datagrams bigger than the socket send buffer and
+ * every message of a batch gets its own ACK : big batches are cut in
+ * chunks and the ACKs of a chunk are drained before sending the next one.
+ */
+#define NETLINK_SENDLEN     (32*1024)
+#define NETLINK_SOCKBUF     (4*1024*1024)
+
+int netlinkOpen(netlink_t *nl, int protocol, uint32_t groups)
+{
+    struct sockaddr_nl  addr;
+    socklen_t           addrLen = sizeof(addr);
+    int                 opt;
+
+    if ( nl == NULL )
+        return -1;
+
+    memset(nl, 0, sizeof(*nl));
+
+    /* A simulated kernel answers the requests itself and sends no
+     * notification
+     */
+    if ( kernelSimulated() )
+    {
+        nl->fd = -1;
+        if ( (nl->buff = malloc(NETLINK_BUFFLEN)) == NULL )
+            return -1;
+
+        nl->seq = (uint32_t) getpid() << 16;
+        return 0;
+    }
+
+    if ( (nl->fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, protocol)) < 0 )
+    {
+        perror("socket");
+        return -1;
+    }
+
+    /* Only the header of a request is sent back in an error ACK and
+     * the receive buffer must hold a whole batch of ACKs
+     */
+    opt = 1;
+    setsockopt(nl->fd, SOL_NETLINK, NETLINK_CAP_ACK, &opt, sizeof(opt));
+
+    opt = NETLINK_SOCKBUF;
+    if ( setsockopt(nl->fd, SOL_SOCKET, SO_RCVBUFFORCE, &opt, sizeof(opt)) < 0 )
+        setsockopt(nl->fd, SOL_SOCKET, SO_RCVBUF, &opt, sizeof(opt));
+
+    memset(&addr, 0, sizeof(addr));
+    addr.nl_family = AF_NETLINK;
+    addr.nl_groups = groups;
+
+    if ( bind(nl->fd, (struct sockaddr *) &addr, sizeof(addr)) < 0 ||
+            getsockname(nl->fd, (struct sockaddr *) &addr, &addrLen) < 0 )
+    {
+        perror("bind");
+        close(nl->fd);
+        return -1;
+    }
+
+    if ( (nl->buff = malloc(NETLINK_BUFFLEN)) == NULL )
+    {
+        close(nl->fd);
+        return -1;
+    }
+
+    nl->pid = addr.nl_pid;
+    nl->seq = (uint32_t) getpid() << 16;
+
+    return 0;
+}
+
+int netlinkStrict(netlink_t *nl)
+{
+    int     opt = 1;
+
+    if ( nl == NULL )
+        return -1;
+
+    /* The simulated kernel always filters
+     */
+    if ( nl->fd < 0 )
+        return 0;
+
+    return setsockopt(nl->fd, SOL_NETLINK, NETLINK_GET_STRICT_CHK, &opt,
+            sizeof(opt)) < 0 ? -1 : 0;
+}
+
+void netlinkClose(netlink_t *nl)
+{
+    if ( nl == NULL || nl->buff == NULL )
+        return;
+
+    if ( nl->fd >= 0 )
+        close(nl->fd);
+    free(nl->buff);
+    nl->buff = NULL;
+}
+
+static int netlinkReqGrow(netlink_req_t *req, size_t len)
+{
+    char    *buff;
+    size_t  size;
+
+    if ( req->len + len <= req->size )
+        return 0;
+
+    for ( size = req->size ? req->size : 4096 ; size < req->len + len ; size *= 2 )
+        ;
+
+    if ( (buff = realloc(req->buff, size)) == NULL )
+        return -1;
+
+    memset(buff + req->size, 0, size - req->size);
+    req->buff = buff;
+    req->size = size;
+
+    return 0;
+}
+
+/* A dump is answered by NLMSG_DONE, any other request is asked for an
+ * ACK so that the end of a batch can always be detected.
+ * NLM_F_DUMP shares its bits with NLM_F_REPLACE and NLM_F_EXCL !
+ */
+void *netlinkReqAdd(netlink_req_t *req, uint16_t type, uint16_t flags,
+        size_t hdrlen)
+{
+    struct nlmsghdr *nlh;
+
+    if ( req == NULL || netlinkReqGrow(req, NLMSG_SPACE(hdrlen)) )
+        return NULL;
+
+    if ( (flags & NLM_F_DUMP) != NLM_F_DUMP || (flags & NLM_F_CREATE) )
+        flags |= NLM_F_ACK;
+
+    nlh = (struct nlmsghdr *) (req->buff + req->len);
+    memset(nlh, 0, NLMSG_SPACE(hdrlen));
+    nlh->nlmsg_len = NLMSG_LENGTH(hdrlen);
+    nlh->nlmsg_type = type;
+    nlh->nlmsg_flags = flags | NLM_F_REQUEST;
+
+    req->last = req->len;
+    req->len += NLMSG_ALIGN(nlh->nlmsg_len);
+    req->count++;
+
+    return NLMSG_DATA(nlh);
+}
+
+int netlinkReqAttr(netlink_req_t *req, uint16_t type, const void *data,
+        size_t len)
+{
+    struct nlmsghdr *nlh;
+    struct rtattr   *rta;
+
+    if ( req == NULL || req->count == 0 ||
+            netlinkReqGrow(req, RTA_SPACE(len)) )
+        return -1;
+
+    nlh = (struct nlmsghdr *) (req->buff + req->last);
+    rta = (struct rtattr *) (req->buff + req->len);
+    rta->rta_type = type;
+    rta->rta_len = RTA_LENGTH(len);
+    if ( len )
+        memcpy(RTA_DATA(rta), data, len);
+
+    nlh->nlmsg_len = NLMSG_ALIGN(nlh->nlmsg_len) + RTA_SPACE(len);
+    req->len += RTA_SPACE(len);
+
+    return 0;
+}
+
+/* Append a bare structure, like the ifinfomsg heading a veth peer
+ */
+int netlinkReqRaw(netlink_req_t *req, const void *data, size_t len)
+{
+    struct nlmsghdr *nlh;
+
+    if ( req == NULL || req->count == 0 ||
+            netlinkReqGrow(req, NLMSG_ALIGN(len)) )
+        return -1;
+
+    nlh = (struct nlmsghdr *) (req->buff + req->last);
+    memcpy(req->buff + req->len, data, len);
+
+    nlh->nlmsg_len = NLMSG_ALIGN(nlh->nlmsg_len) + NLMSG_ALIGN(len);
+    req->len += NLMSG_ALIGN(len);
+
+    return 0;
+}
+
+size_t netlinkReqNestStart(netlink_req_t *req, uint16_t type)
+{
+    size_t  nest = req->len;
+
+    if ( netlinkReqAttr(req, type | NLA_F_NESTED, NULL, 0) )
+        return 0;
+
+    return nest;
+}
+
+void netlinkReqNestEnd(netlink_req_t *req, size_t nest)
+{
+    struct rtattr   *rta;
+
+    if ( nest == 0 )
+        return;
+
+    rta = (struct rtattr *) (req->buff + nest);
+    rta->rta_len = req->len - nest;
+}
+
+void netlinkReqReset(netlink_req_t *req)
+{
+    if ( req->buff )
+        memset(req->buff, 0, req->len);
+
+    req->len = req->last = 0;
+    req->count = 0;
+}
+
+void netlinkReqFree(netlink_req_t *req)
+{
+    free(req->buff);
+    memset(req, 0, sizeof(*req));
+}
+
+typedef struct netlink_reply
+{
+    netlink_callback_t  cb;
+    void                *user;
+    uint32_t            first;
+    uint32_t            last;
+    unsigned            pending;
+    int                 failed;
+    int                 stop;
+    size_t              received;
+} netlink_reply_t;
+
+static int netlinkReply(const struct nlmsghdr *nlh, void *user)
+{
+    netlink_reply_t *reply = user;
+
+    reply->received += nlh->nlmsg_len;
+
+    /* Unsolicited or stale messages (seq out of range) are ignored
+     */
+    if ( nlh->nlmsg_seq - reply->first >= reply->last - reply->first )
+        return 0;
+
+    if ( nlh->nlmsg_type == NLMSG_DONE )
+    {
+        /* A dump may be cut by an error reported in the DONE payload
+         */
+        reply->pending--;
+        if ( *(const int *) NLMSG_DATA(nlh) < 0 )
+            reply->failed++;
+
+        return 0;
+    }
+
+    if ( nlh->nlmsg_type == NLMSG_ERROR )
+    {
+        const struct nlmsgerr   *err = NLMSG_DATA(nlh);
+
+        reply->pending--;
+        if ( err->error == 0 )
+            return 0;
+
+        reply->failed++;
+    }
+
+    if ( reply->cb && !reply->stop )
+        reply->stop = reply->cb(nlh, reply->user);
+
+    return 0;
+}
+
+static int netlinkDone(const netlink_reply_t *reply)
+{
+    int ret = reply->failed ? reply->failed : reply->stop;
+
+    TRACE_PROBE2(netlink_done, reply->received, ret);
+
+    return ret;
+}
+
+/* Send all the messages of a request and wait for all the answers.
+ * The callback sees every answer, including the error ACKs, whose
+ * nlmsg_seq - req->seq gives back the index of the failed message.
+ * Returns -1 on a socket error, the number of messages rejected by the
+ * kernel, or the first non-zero value returned by the callback.
+ */
+int netlinkTransact(netlink_t *nl, netlink_req_t *req,
+        netlink_callback_t cb, void *user)
+{
+    struct sockaddr_nl  kernel = { .nl_family = AF_NETLINK };
+    struct nlmsghdr     *nlh;
+    netlink_reply_t     reply;
+    size_t              off,
+                        start;
+
+    if ( nl == NULL || req == NULL )
+        return -1;
+
+    memset(&reply, 0, sizeof(reply));
+    reply.cb = cb;
+    reply.user = user;
+
+    TRACE_PROBE2(netlink_start, req->len, req->count);
+
+    req->seq = nl->seq;
+    for ( off = 0 ; off < req->len ; off += NLMSG_ALIGN(nlh->nlmsg_len) )
+    {
+        nlh = (struct nlmsghdr *) (req->buff + off);
+        nlh->nlmsg_seq = nl->seq++;
+        nlh->nlmsg_pid = 0;
+    }
+
+    if ( nl->fd < 0 )
+    {
+        reply.first = req->seq;
+        reply.last = nl->seq;
+        reply.pending = req->count;
+
+        if ( kernelTransact(req->buff, req->len, &netlinkReply, &reply) < 0 )
+        {
+            perror("transact");
+            TRACE_PROBE2(netlink_done, reply.received, -1);
+            return -1;
+        }
+
+        return netlinkDone(&reply);
+    }
+
+    for ( start = off = 0 ; start < req->len ; start = off )
+    {
+        reply.first = ((struct nlmsghdr *) (req->buff + start))->nlmsg_seq;
+        reply.pending = 0;
+
+        /* A socket runs one dump at a time : a dump ends its chunk
+         */
+        while ( off < req->len && (off == start || off - start < NETLINK_SENDLEN) )
+        {
+            nlh = (struct nlmsghdr *) (req->buff + off);
+            off += NLMSG_ALIGN(nlh->nlmsg_len);
+            reply.pending++;
+
+            if ( !(nlh->nlmsg_flags & NLM_F_ACK) )
+                break;
+        }
+        reply.last = reply.first + reply.pending;
+
+        if ( sendto(nl->fd, req->buff + start, off - start, 0,
+                    (struct sockaddr *) &kernel, sizeof(kernel)) < 0 )
+        {
+            perror("sendto");
+            TRACE_PROBE2(netlink_done, reply.received, -1);
+            return -1;
+        }
+
+        while ( reply.pending )
+        {
+            if ( netlinkRecv(nl, &netlinkReply, &reply) < 0 &&
+                    errno != EAGAIN && errno != EINTR )
+            {
+                perror("recv");
+                TRACE_PROBE2(netlink_done, reply.received, -1);
+                return -1;
+            }
+        }
+    }
+
+    return netlinkDone(&reply);
+}
+
+/* Read one datagram and hand over each message it carries.
+ * Returns the datagram size, 0 when nothing is pending on a
+ * non-blocking socket, -1 on error (ENOBUFS means events were lost).
+ */
+int netlinkRecv(netlink_t *nl, netlink_callback_t cb, void *user)
+{
+    const struct nlmsghdr   *nlh;
+    ssize_t                 len;
+    int                     ret;
+
+    if ( (len = recv(nl->fd, nl->buff, NETLINK_BUFFLEN, 0)) < 0 )
+    {
+        if ( errno == EAGAIN || errno == EWOULDBLOCK )
+            return 0;
+
+        return -1;
+    }
+
+    ret = (int) len;
+    for ( nlh = (const struct nlmsghdr *) nl->buff ; NLMSG_OK(nlh, len) ;
+            nlh = NLMSG_NEXT(nlh, len) )
+    {
+        if ( cb )
+            cb(nlh, user);
+    }
+
+    return ret;
+}
+
+int netlinkParseAttr(const struct rtattr *rta, int len,
+        const struct rtattr **tb, int max)
+{
+    memset(tb, 0, sizeof(*tb) * (max + 1));
+
+    for ( ; RTA_OK(rta, len) ; rta = RTA_NEXT(rta, len) )
+    {
+        unsigned short  type = rta->rta_type & NLA_TYPE_MASK;
+
+        if ( type <= max )
+            tb[type] = rta;
+    }
+
+    return 0;
+}
@@ -0,0 +1,94 @@
+#ifndef __NETLINK_H__
+#define __NETLINK_H__
+
+/* Internal rtnetlink helpers shared by the network modules.
+ * See man (7) netlink and man (7) rtnetlink
+ */
+
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/* Large enough for one dump datagram whatever the kernel page size
+ */
+#define NETLINK_BUFFLEN     (64*1024)
+
+typedef struct netlink
+{
+    int         fd;
+    uint32_t    pid;
+    uint32_t    seq;
+    char        *buff;
+} netlink_t;
+
+/* A request is one or more messages stacked in a single buffer, so that a
+ * whole batch goes to the kernel with a minimum of system calls.
+ */
+typedef struct netlink_req
+{
+    char        *buff;
+    size_t      size;
+    size_t      len;
+    size_t      last;
+    unsigned    count;
+    uint32_t    seq;
+} netlink_req_t;
+
+typedef int (*netlink_callback_t)(const struct nlmsghdr *nlh, void *user);
+
+int netlinkOpen(netlink_t *nl, int protocol, uint32_t groups);
+
+/* Since Linux 4.20 the headers of the dump requests are then checked and
+ * their fields and attributes filter the dump, an interface index or a
+ * route table for example. Older kernels refuse the option and send the
+ * whole dump : the callbacks must still filter.
+ */
+int netlinkStrict(netlink_t *nl);
+
+void netlinkClose(netlink_t *nl);
+
+void *netlinkReqAdd(netlink_req_t *req, uint16_t type, uint16_t flags,
+        size_t hdrlen);
+
+int netlinkReqAttr(netlink_req_t *req, uint16_t type, const void *data,
+        size_t len);
+
+#define netlinkReqAttrU8(req, type, v) \
+    netlinkReqAttr(req, type, &(uint8_t){ (v) }, sizeof(uint8_t))
+#define netlinkReqAttrU16(req, type, v) \
+    netlinkReqAttr(req, type, &(uint16_t){ (v) }, sizeof(uint16_t))
+#define netlinkReqAttrU32(req, type, v) \
+    netlinkReqAttr(req, type, &(uint32_t){ (v) }, sizeof(uint32_t))
+#define netlinkReqAttrStr(req, type, s) \
+    netlinkReqAttr(req, type, s, strlen(s) + 1)
+
+int netlinkReqRaw(netlink_req_t *req, const void *data, size_t len);
+
+size_t netlinkReqNestStart(netlink_req_t *req, uint16_t type);
+
+void netlinkReqNestEnd(netlink_req_t *req, size_t nest);
+
+void netlinkReqReset(netlink_req_t *req);
+
+void netlinkReqFree(netlink_req_t *req);
+
+int netlinkTransact(netlink_t *nl, netlink_req_t *req,
+        netlink_callback_t cb, void *user);
+
+int netlinkRecv(netlink_t *nl, netlink_callback_t cb, void *user);
+
+int netlinkParseAttr(const struct rtattr *rta, int len,
+        const struct rtattr **tb, int max);
+
+#define netlinkAttrU32(rta)     (*(const uint32_t *) RTA_DATA(rta))
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __NETLINK_H__ */
@@ -1,5 +1,13 @@
 #include "network.h"
 #include "dhcp.h"
+#include "netlink.h"
+#include "inventory.h"
+#include "kernel.h"
+#include "steering.h"
+#include "profile.h"
+#include "qdisc.h"
+#include "checkpoint.h"
+#include "trace.h"
 
 /* See man (7) netdevice for IOCTL's interface
  * See man (3) rtnetlink for RTA_XXX
@@ -12,8 +20,14 @@
 #include <netinet/ether.h>
 
 #include <string.h>
+#include <stdlib.h>
 #include <unistd.h>
 #include <ctype.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <pthread.h>
 
 #define NBIFACE     32
 
@@ -22,25 +36,47 @@
  */
 static int              init = 0;
 
+/* The interfaces are stored in chunks of NBIFACE entries, so that the
+ * pointers handed out stay valid while the table grows, and indexed by
+ * name in an open addressing hash table.
+ */
+typedef struct iface_chunk
+{
+    struct iface_chunk  *next;
+    unsigned            nb;
+    struct ifreq        ifr[NBIFACE];
+} iface_chunk_t;
+
 static struct ifconf    ifconf;
-static struct ifreq     ifreqs[NBIFACE];
+static iface_chunk_t    ifaces;
+static iface_chunk_t    *lastChunk = &ifaces;
+
+static struct ifreq     **ifHash;
+static size_t           ifHashSize;
+static size_t           ifHashUsed;
+static struct ifreq     ifRemoved;
 
 static int              fd;
 
+/* The socket of a worker of foreachInterfaceInfo(), -1 elsewhere
+ */
+static __thread int     threadFd = -1;
+
 static const char       *interface = "/mnt/boot/conf/interfaces";
 static const char       *tmpInterface = "/mnt/boot/conf/interfaces.tmp";
 
-static const char       *resolv = "/etc/resolv.conf";
-static const char       *tmpResolv = "/etc/resolv.conf.tmp";
+/* Options kept when saveInterfaceIpConfig() rewrites a stanza, they are
+ * not about the addresses
+ */
+static const char       *keptOptions [] = {STEERING_OPTION, QDISC_OPTION,
+    PROFILE_OPTION, NULL};
+
+static const char       *resolv = RESOLV_CONF;
+static const char       *tmpResolv = RESOLV_CONF ".tmp";
 
 static const char       *devices = "/proc/net/dev";
 
-typedef struct route_info
-{
-    struct in_addr  dstAddr;
-    struct in_addr  gateway;
-    char            ifName[IF_NAMESIZE];
-} route_info_t;
+static void neighborClean(void);
 
 static inline int getFileDescriptor(void)
 {
@@ -52,6 +88,11 @@ static inline void closeFileDescriptor(int fd)
     close(fd);
 }
 
+static inline int ioctlFd(void)
+{
+    return threadFd >= 0 ? threadFd : fd;
+}
+
 int getIfaceList(struct ifconf *ifc)
 {
     int ret;
@@ -59,33 +100,150 @@ int getIfaceList(struct ifconf *ifc)
     if ( ifc == NULL )
         return -1;
 
-    if ( (ret = ioctl(fd, SIOCGIFCONF, ifc)) < 0 )
+    if ( (ret = kernelIoctl(ioctlFd(), SIOCGIFCONF, ifc)) < 0 )
         perror("ioctl failed");
 
     return ret;
 }
 
+static size_t hashName(const char *ifname, int domain)
+{
+    size_t  h = 2166136261u ^ domain;
+    int     i;
+
+    for ( i = 0 ; i < IFNAMSIZ && ifname[i] ; i++ )
+        h = (h ^ (unsigned char) ifname[i]) * 16777619u;
+
+    return h;
+}
+
+static struct ifreq **lookupInterface(const char *ifname, int domain)
+{
+    size_t  i,
+            mask = ifHashSize - 1;
+
+    if ( ifHashSize == 0 )
+        return NULL;
+
+    for ( i = hashName(ifname, domain) & mask ; ifHash[i] ; i = (i + 1) & mask )
+    {
+        if ( ifHash[i] != &ifRemoved &&
+                ifHash[i]->ifr_addr.sa_family == domain &&
+                strncmp(ifname, ifHash[i]->ifr_name, IFNAMSIZ) == 0 )
+            return &ifHash[i];
+    }
+
+    return NULL;
+}
+
+static int indexInterface(struct ifreq *ifr)
+{
+    size_t  i,
+            mask;
+
+    /* Keep the table at most half full, removed slots included
+     */
+    if ( (ifHashUsed + 1) * 2 > ifHashSize )
+    {
+        struct ifreq    **old = ifHash;
+        size_t          oldSize = ifHashSize,
+                        size = ifHashSize ? ifHashSize * 2 : 2 * NBIFACE;
+
+        if ( (ifHash = calloc(size, sizeof(*ifHash))) == NULL )
+        {
+            ifHash = old;
+            return -1;
+        }
+
+        ifHashSize = size;
+        ifHashUsed = 0;
+        for ( i = 0 ; i < oldSize ; i++ )
+        {
+            if ( old[i] && old[i] != &ifRemoved )
+                indexInterface(old[i]);
+        }
+
+        free(old);
+    }
+
+    mask = ifHashSize - 1;
+    for ( i = hashName(ifr->ifr_name, ifr->ifr_addr.sa_family) & mask ;
+            ifHash[i] && ifHash[i] != &ifRemoved ; i = (i + 1) & mask )
+        ;
+
+    if ( ifHash[i] == NULL )
+        ifHashUsed++;
+
+    ifHash[i] = ifr;
+
+    return 0;
+}
+
+static const struct ifreq *appendInterface(const struct ifreq *src)
+{
+    struct ifreq    *ifr;
+
+    if ( lastChunk->nb == NBIFACE )
+    {
+        iface_chunk_t   *chunk;
+
+        if ( (chunk = calloc(1, sizeof(*chunk))) == NULL )
+        {
+            fprintf(stderr, "Too many interfaces");
+            return NULL;
+        }
+
+        lastChunk->next = chunk;
+        lastChunk = chunk;
+    }
+
+    ifr = &lastChunk->ifr[lastChunk->nb];
+    memcpy(ifr, src, sizeof(*ifr));
+
+    if ( indexInterface(ifr) )
+        return NULL;
+
+    lastChunk->nb++;
+
+    return ifr;
+}
+
 int networkInit(void)
 {
+    unsigned    i;
+
+    TRACE_ENTRY(NULL);
+
     if ( init )
-        return 0;
+        return TRACE_RETURN(0);
 
     if ( (fd = getFileDescriptor()) < 0 )
-        return -1;
+        return TRACE_RETURN(-1);
 
     /* Get the list for the devices
      */
-    ifconf.ifc_buf = (char *) ifreqs;
-    ifconf.ifc_len = sizeof(ifreqs);
+    ifconf.ifc_buf = (char *) ifaces.ifr;
+    ifconf.ifc_len = sizeof(ifaces.ifr);
     if ( getIfaceList(&ifconf) < 0 )
     {
         closeFileDescriptor(fd);
-        return -1;
+        return TRACE_RETURN(-1);
+    }
+
+    /* SIOCGIFCONF gives one entry per address, only the first one
+     * of an interface is indexed
+     */
+    ifaces.nb = ifconf.ifc_len / sizeof(struct ifreq);
+    for ( i = 0 ; i < ifaces.nb ; i++ )
+    {
+        if ( lookupInterface(ifaces.ifr[i].ifr_name,
+                    ifaces.ifr[i].ifr_addr.sa_family) == NULL )
+            indexInterface(&ifaces.ifr[i]);
     }
 
     init = 1;
 
-    return 0;
+    return TRACE_RETURN(0);
 }
 
 static char *trimSpace(char *str)
@@ -111,11 +269,13 @@ int addAllInterfaces(void)
     char    buff[BUFFLEN];
     int     ret = 0;
 
+    TRACE_ENTRY(NULL);
+
     if ( !init )
-        return -1;
+        return TRACE_RETURN(-1);
 
-    if ( (dev = fopen(devices, "r")) == NULL )
-        return -1;
+    if ( (dev = kernelOpen(devices, "r")) == NULL )
+        return TRACE_RETURN(-1);
 
     while ( fgets(buff, sizeof(buff), dev) )
     {
@@ -132,34 +292,57 @@ int addAllInterfaces(void)
 
     fclose(dev);
 
-    return ret;
+    return TRACE_RETURN(ret);
 #undef BUFFLEN
 }
 
 void networkClean(void)
 {
+    iface_chunk_t   *chunk,
+                    *next;
+
+    TRACE_ENTRY(NULL);
+
     if ( init )
     {
         close(fd);
+
+        for ( chunk = ifaces.next ; chunk ; chunk = next )
+        {
+            next = chunk->next;
+            free(chunk);
+        }
+
+        free(ifHash);
+        ifHash = NULL;
+        ifHashSize = ifHashUsed = 0;
+
+        memset(&ifaces, 0, sizeof(ifaces));
+        lastChunk = &ifaces;
+
         init = 0;
     }
+
+    neighborClean();
+
+    TRACE_EXIT(0);
 }
 
 const struct ifreq *getInterfaceByName(const char *ifname, int domain)
 {
-    char                *ptr;
-    const struct ifreq  *ifr;
+    struct ifreq        **slot;
     struct ifreq        dummy;
-    unsigned            nb = 0;
+
+    TRACE_ENTRY(ifname);
 
     if ( !init )
     {
         fprintf(stderr, "network uninitialized !\n");
-        return NULL;
+        return TRACE_RETURN(NULL);
     }
 
     if ( ifname == NULL )
-        return NULL;
+        return TRACE_RETURN(NULL);
 
     switch ( domain )
     {
@@ -168,92 +351,118 @@ const struct ifreq *getInterfaceByName(const char *ifname, int domain)
         break;
 
         default:
-        return NULL;
+        return TRACE_RETURN(NULL);
     }
 
-    for ( ptr = ifconf.ifc_buf ; ptr < ifconf.ifc_len + ifconf.ifc_buf ; ptr += sizeof(struct ifreq) )
-    {
-        ifr = (const struct ifreq *) ptr;
-
-        if ( ifr->ifr_addr.sa_family != domain )
-            continue;
-
-        if ( strncmp(ifname, ifr->ifr_name, IFNAMSIZ) == 0 )
-            return ifr;
-
-        nb++;
-    }
+    if ( (slot = lookupInterface(ifname, domain)) != NULL )
+        return TRACE_RETURN(*slot);
 
     /* Dirty hack
      * If the interface is down, SIOCGIFCONF does not see it !
      */
     strncpy(dummy.ifr_name, ifname, IFNAMSIZ);
-    if( ioctl(fd, SIOCGIFFLAGS, &dummy) < 0 )
+    if( kernelIoctl(ioctlFd(), SIOCGIFFLAGS, &dummy) < 0 )
     {
         perror("ioctl");
-        return NULL;
+        return TRACE_RETURN(NULL);
     }
 
-    /* Check overflow and insert it in the list if found
+    /* Insert it in the list if found
      */
-    if ( ++nb > NBIFACE )
-    {
-        fprintf(stderr, "Too many interfaces");
-        return NULL;
-    }
+    dummy.ifr_addr.sa_family = AF_INET;
+    return TRACE_RETURN(appendInterface(&dummy));
+}
+
+/* Register an interface known to exist, without asking the kernel
+ */
+const struct ifreq *addInterface(const char *ifname)
+{
+    struct ifreq        **slot;
+    struct ifreq        dummy;
+
+    TRACE_ENTRY(ifname);
 
+    if ( !init || ifname == NULL )
+        return TRACE_RETURN(NULL);
+
+    if ( (slot = lookupInterface(ifname, AF_INET)) != NULL )
+        return TRACE_RETURN(*slot);
+
+    memset(&dummy, 0, sizeof(dummy));
+    strncpy(dummy.ifr_name, ifname, IFNAMSIZ - 1);
     dummy.ifr_addr.sa_family = AF_INET;
-    memcpy(ptr, &dummy, sizeof(struct ifreq));
-    ifconf.ifc_len += sizeof(struct ifreq);
-    return (const struct ifreq *) ptr;
+
+    return TRACE_RETURN(appendInterface(&dummy));
+}
+
+/* Forget an interface, its entry is kept but is no longer walked
+ */
+int removeInterface(const char *ifname)
+{
+    struct ifreq        **slot;
+
+    TRACE_ENTRY(ifname);
+
+    if ( !init || ifname == NULL ||
+            (slot = lookupInterface(ifname, AF_INET)) == NULL )
+        return TRACE_RETURN(-1);
+
+    (*slot)->ifr_addr.sa_family = AF_UNSPEC;
+    *slot = &ifRemoved;
+
+    return TRACE_RETURN(0);
 }
 
 int isInterfacePlugged(const struct ifreq *ifr)
 {
     struct ifreq    dummy;
 
+    TRACE_ENTRY(TRACE_IFR(ifr));
+
     if ( ifr == NULL )
-        return 0;
+        return TRACE_RETURN(0);
 
     strncpy(dummy.ifr_name, ifr->ifr_name, IFNAMSIZ);
-    if ( ioctl(fd, SIOCGIFFLAGS, &dummy) < 0 )
+    if ( kernelIoctl(ioctlFd(), SIOCGIFFLAGS, &dummy) < 0 )
     {
         perror("ioctl failed");
-        return -1;
+        return TRACE_RETURN(-1);
     }
 
-    return (dummy.ifr_flags & IFF_UP) &&
-            (dummy.ifr_flags & IFF_RUNNING);
+    return TRACE_RETURN((dummy.ifr_flags & IFF_UP) &&
+                (dummy.ifr_flags & IFF_RUNNING));
 }
 
 int getIpAddress(const struct ifreq *ifr, char *dest, size_t len)
 {
     struct ifreq    dummy;
 
+    TRACE_ENTRY(TRACE_IFR(ifr));
+
     if ( ifr == NULL || dest == NULL || len < INET_ADDRSTRLEN )
-        return -1;
+        return TRACE_RETURN(-1);
 
     strncpy(dummy.ifr_name, ifr->ifr_name, IFNAMSIZ);
-    if ( ioctl(fd, SIOCGIFFLAGS, &dummy) < 0 )
+    if ( kernelIoctl(ioctlFd(), SIOCGIFFLAGS, &dummy) < 0 )
     {
         perror("ioctl failed");
-        return -1;
+        return TRACE_RETURN(-1);
     }
 
     /* Check if the interface is UP and RUNNING to ask an address
      */
     if ( !((dummy.ifr_flags & IFF_UP) &&
             (dummy.ifr_flags & IFF_RUNNING)) )
-        return -1;
+        return TRACE_RETURN(-1);
 
-    if ( ioctl(fd, SIOCGIFADDR, &dummy) < 0 )
+    if ( kernelIoctl(ioctlFd(), SIOCGIFADDR, &dummy) < 0 )
     {
         perror("ioctl failed");
-        return -1;
+        return TRACE_RETURN(-1);
     }
 
-    return getnameinfo(&dummy.ifr_addr, sizeof(struct sockaddr_in),
-            dest, len, NULL, 0, NI_NUMERICHOST);
+    return TRACE_RETURN(getnameinfo(&dummy.ifr_addr,
+                sizeof(struct sockaddr_in), dest, len, NULL, 0, NI_NUMERICHOST));
 }
 
 int setInterfaceIpAddress(const struct ifreq *ifr, const char *ip)
@@ -262,19 +471,21 @@ int setInterfaceIpAddress(const struct ifreq *ifr, const char *ip)
     struct in_addr			in;
     struct ifreq			dummy;
 
+    TRACE_ENTRY(TRACE_IFR(ifr));
+
     if ( ifr == NULL || ip == NULL )
-        return -1;
+        return TRACE_RETURN(-1);
 
     /* Grab the address in network order
      */
     if ( inet_aton(ip, &in) == 0 )
-        return -2;
+        return TRACE_RETURN(-2);
 
     strncpy(dummy.ifr_name, ifr->ifr_name, IFNAMSIZ);
-    if ( ioctl(fd, SIOCGIFADDR, &dummy) < 0 )
+    if ( kernelIoctl(ioctlFd(), SIOCGIFADDR, &dummy) < 0 )
     {
         perror("ioctl failed");
-        return -1;
+        return TRACE_RETURN(-1);
     }
 
     memset(&sin, 0, sizeof(struct sockaddr));
@@ -283,13 +494,13 @@ int setInterfaceIpAddress(const struct ifreq *ifr, const char *ip)
     sin.sin_addr.s_addr = in.s_addr;
     memcpy((char *)&dummy + offsetof(struct ifreq, ifr_addr), &sin, sizeof(struct sockaddr));
 
-    if ( ioctl(fd, SIOCSIFADDR, &dummy) < 0 )
+    if ( kernelIoctl(ioctlFd(), SIOCSIFADDR, &dummy) < 0 )
     {
         perror("ioctl failed");
-        return -1;
+        return TRACE_RETURN(-1);
     }
 
-    return 0;
+    return TRACE_RETURN(0);
 }
 
 int getMacAddress(const struct ifreq *ifr, char *dest, size_t len)
@@ -297,25 +508,27 @@ int getMacAddress(const struct ifreq *ifr, char *dest, size_t len)
     struct ifreq              dummy;
     const struct ether_addr   *eth;
 
+    TRACE_ENTRY(TRACE_IFR(ifr));
+
     if ( ifr == NULL || dest == NULL || len < INET_ADDRSTRLEN )
-        return -1;
+        return TRACE_RETURN(-1);
 
     /* Do not count loopback
      */
     strncpy(dummy.ifr_name, ifr->ifr_name, IFNAMSIZ);
-    if ( ioctl(fd, SIOCGIFFLAGS, &dummy) < 0 )
+    if ( kernelIoctl(ioctlFd(), SIOCGIFFLAGS, &dummy) < 0 )
     {
         perror("ioctl failed");
-        return -1;
+        return TRACE_RETURN(-1);
     }
 
     if ( (dummy.ifr_flags & IFF_LOOPBACK) )
-        return -2;
+        return TRACE_RETURN(-2);
 
-    if ( ioctl(fd, SIOCGIFHWADDR, &dummy) < 0 )
+    if ( kernelIoctl(ioctlFd(), SIOCGIFHWADDR, &dummy) < 0 )
     {
         perror("ioctl failed");
-        return -1;
+        return TRACE_RETURN(-1);
     }
 
     eth = (const struct ether_addr *) dummy.ifr_hwaddr.sa_data;
@@ -328,7 +541,7 @@ int getMacAddress(const struct ifreq *ifr, char *dest, size_t len)
                 eth->ether_addr_octet[4],
                 eth->ether_addr_octet[5]);
 
-    return 0;
+    return TRACE_RETURN(0);
 }
 
 int setInterfaceMacAddress(const struct ifreq *ifr, const char *mac)
@@ -336,64 +549,68 @@ int setInterfaceMacAddress(const struct ifreq *ifr, const char *mac)
     struct ifreq              dummy;
     struct ether_addr         *eth;
 
+    TRACE_ENTRY(TRACE_IFR(ifr));
+
     if ( ifr == NULL || mac == NULL )
-        return -1;
+        return TRACE_RETURN(-1);
 
     /* ether_aton returns a pointer to a statically allocated buffer
      */
     if ( (eth = ether_aton(mac)) == NULL )
-        return -1;
+        return TRACE_RETURN(-1);
 
     /* Do not count loopback
      */
     strncpy(dummy.ifr_name, ifr->ifr_name, IFNAMSIZ);
-    if ( ioctl(fd, SIOCGIFFLAGS, &dummy) < 0 )
+    if ( kernelIoctl(ioctlFd(), SIOCGIFFLAGS, &dummy) < 0 )
     {
         perror("ioctl failed");
-        return -1;
+        return TRACE_RETURN(-1);
     }
 
     if ( (dummy.ifr_flags & IFF_LOOPBACK) )
-        return -2;
+        return TRACE_RETURN(-2);
 
     memcpy(dummy.ifr_hwaddr.sa_data, eth, sizeof(struct ether_addr));
-    if ( ioctl(fd, SIOCSIFHWADDR, &dummy) < 0 )
+    if ( kernelIoctl(ioctlFd(), SIOCSIFHWADDR, &dummy) < 0 )
     {
         perror("ioctl failed");
-        return -1;
+        return TRACE_RETURN(-1);
     }
 
-    return 0;
+    return TRACE_RETURN(0);
 }
 
 int getIpMask(const struct ifreq *ifr, char *dest, size_t len)
 {
     struct ifreq    dummy;
 
+    TRACE_ENTRY(TRACE_IFR(ifr));
+
     if ( ifr == NULL || dest == NULL || len < INET_ADDRSTRLEN )
-        return -1;
+        return TRACE_RETURN(-1);
 
     strncpy(dummy.ifr_name, ifr->ifr_name, IFNAMSIZ);
-    if ( ioctl(fd, SIOCGIFFLAGS, &dummy) < 0 )
+    if ( kernelIoctl(ioctlFd(), SIOCGIFFLAGS, &dummy) < 0 )
     {
         perror("ioctl failed");
-        return -1;
+        return TRACE_RETURN(-1);
     }
 
     /* Check if the interface is UP and RUNNING to ask an address
      */
     if ( !((dummy.ifr_flags & IFF_UP) &&
             (dummy.ifr_flags & IFF_RUNNING)) )
-        return -1;
+        return TRACE_RETURN(-1);
 
-    if ( ioctl(fd, SIOCGIFNETMASK, &dummy) < 0 )
+    if ( kernelIoctl(ioctlFd(), SIOCGIFNETMASK, &dummy) < 0 )
     {
         perror("ioctl failed");
-        return -1;
+        return TRACE_RETURN(-1);
     }
 
-    return getnameinfo(&dummy.ifr_netmask, sizeof(struct sockaddr_in),
-            dest, len, NULL, 0, NI_NUMERICHOST);
+    return TRACE_RETURN(getnameinfo(&dummy.ifr_netmask,
+                sizeof(struct sockaddr_in), dest, len, NULL, 0, NI_NUMERICHOST));
 }
 
 int setInterfaceIpMask(const struct ifreq *ifr, const char *mask)
@@ -401,14 +618,16 @@ int setInterfaceIpMask(const struct ifreq *ifr, const char *mask)
     struct sockaddr_in		sin;
     struct ifreq			dummy;
 
+    TRACE_ENTRY(TRACE_IFR(ifr));
+
     if ( ifr == NULL || mask == NULL )
-        return -1;
+        return TRACE_RETURN(-1);
 
     strncpy(dummy.ifr_name, ifr->ifr_name, IFNAMSIZ);
-    if ( ioctl(fd, SIOCGIFNETMASK, &dummy) < 0 )
+    if ( kernelIoctl(ioctlFd(), SIOCGIFNETMASK, &dummy) < 0 )
     {
         perror("ioctl failed");
-        return -1;
+        return TRACE_RETURN(-1);
     }
 
     /* Grab the address in network order.
@@ -417,49 +636,51 @@ int setInterfaceIpMask(const struct ifreq *ifr, const char *mask)
      */
     memset(&sin, 0, sizeof(struct sockaddr));
     if ( (sin.sin_addr.s_addr = inet_addr(mask)) == INADDR_NONE )
-        return -2;
+        return TRACE_RETURN(-2);
 
     sin.sin_family = AF_INET;
     sin.sin_port = 0;
     memcpy((char *)&dummy + offsetof(struct ifreq, ifr_netmask), &sin, sizeof(struct sockaddr));
 
-    if ( ioctl(fd, SIOCSIFNETMASK, &dummy) < 0 )
+    if ( kernelIoctl(ioctlFd(), SIOCSIFNETMASK, &dummy) < 0 )
     {
         perror("ioctl failed");
-        return -1;
+        return TRACE_RETURN(-1);
     }
 
-    return 0;
+    return TRACE_RETURN(0);
 }
 
 int getIpBroadcast(const struct ifreq *ifr, char *dest, size_t len)
 {
     struct ifreq			dummy;
 
+    TRACE_ENTRY(TRACE_IFR(ifr));
+
     if ( ifr == NULL || len < INET_ADDRSTRLEN )
-        return -1;
+        return TRACE_RETURN(-1);
 
     strncpy(dummy.ifr_name, ifr->ifr_name, IFNAMSIZ);
-    if ( ioctl(fd, SIOCGIFFLAGS, &dummy) < 0 )
+    if ( kernelIoctl(ioctlFd(), SIOCGIFFLAGS, &dummy) < 0 )
     {
         perror("ioctl failed");
-        return -1;
+        return TRACE_RETURN(-1);
     }
 
     /* Check if the interface is UP and RUNNING to ask an address
      */
     if ( !((dummy.ifr_flags & IFF_UP) &&
             (dummy.ifr_flags & IFF_RUNNING)) )
-        return -1;
+        return TRACE_RETURN(-1);
 
-    if ( ioctl(fd, SIOCGIFBRDADDR, &dummy) < 0 )
+    if ( kernelIoctl(ioctlFd(), SIOCGIFBRDADDR, &dummy) < 0 )
     {
         perror("ioctl failed");
-        return -1;
+        return TRACE_RETURN(-1);
     }
 
-    return getnameinfo(&dummy.ifr_broadaddr, sizeof(struct sockaddr_in),
-            dest, len, NULL, 0, NI_NUMERICHOST);
+    return TRACE_RETURN(getnameinfo(&dummy.ifr_broadaddr,
+                sizeof(struct sockaddr_in), dest, len, NULL, 0, NI_NUMERICHOST));
 }
 
 int setInterfaceIpBroadcast(const struct ifreq *ifr, const char *bcast)
@@ -467,14 +688,16 @@ int setInterfaceIpBroadcast(const struct ifreq *ifr, const char *bcast)
     struct sockaddr_in		sin;
     struct ifreq			dummy;
 
+    TRACE_ENTRY(TRACE_IFR(ifr));
+
     if ( ifr == NULL )
-        return -1;
+        return TRACE_RETURN(-1);
 
     strncpy(dummy.ifr_name, ifr->ifr_name, IFNAMSIZ);
-    if ( ioctl(fd, SIOCGIFBRDADDR, &dummy) < 0 )
+    if ( kernelIoctl(ioctlFd(), SIOCGIFBRDADDR, &dummy) < 0 )
     {
         perror("ioctl failed");
-        return -1;
+        return TRACE_RETURN(-1);
     }
 
     /* Grab the address in network order.
@@ -483,224 +706,782 @@ int setInterfaceIpBroadcast(const struct ifreq *ifr, const char *bcast)
      */
     memset(&sin, 0, sizeof(struct sockaddr));
     if ( (sin.sin_addr.s_addr = inet_addr(bcast)) == INADDR_NONE )
-        return -2;
+        return TRACE_RETURN(-2);
 
     sin.sin_family = AF_INET;
     sin.sin_port = 0;
     memcpy((char *)&dummy + offsetof(struct ifreq, ifr_broadaddr), &sin, sizeof(struct sockaddr));
 
-    if ( ioctl(fd, SIOCSIFBRDADDR, &dummy) < 0 )
+    if ( kernelIoctl(ioctlFd(), SIOCSIFBRDADDR, &dummy) < 0 )
     {
         perror("ioctl failed");
-        return -1;
+        return TRACE_RETURN(-1);
     }
 
-    return 0;
+    return TRACE_RETURN(0);
 }
 
-static int getRouteInfo(const char *buff, size_t len, route_info_t *ri)
+/* One interface from a strict socket, see inventoryLoadLink()
+ */
+static inventory_link_t *loadLink(const char *ifname, inventory_t *inv)
 {
-    const struct nlmsghdr   *nlMsg;
-    const struct rtattr     *rtAttr;
-    const struct rtmsg      *rtMsg;
-    int                     rtLen;
-
-    nlMsg = (const struct nlmsghdr *) buff;
-    rtMsg = (struct rtmsg *) NLMSG_DATA(nlMsg);
-    if ( rtMsg->rtm_family != AF_INET ||
-            rtMsg->rtm_table != RT_TABLE_MAIN )
-        return -1;
-
-    rtAttr = (struct rtattr *) RTM_RTA(rtMsg);
-    rtLen = RTM_PAYLOAD(nlMsg);
-
-    /* We have no warranty that the attributes appear in order.
-     */
-    for ( ; RTA_OK(rtAttr, rtLen) ; rtAttr = RTA_NEXT(rtAttr, rtLen) )
-    {
-        switch ( rtAttr->rta_type )
-        {
-            case RTA_OIF:
-            if_indextoname(*(const int*)RTA_DATA(rtAttr), ri->ifName);
-            break;
+    netlink_t   nl;
+    unsigned    ifindex;
+    int         ret;
 
-            case RTA_GATEWAY:
-            memcpy(&ri->gateway, RTA_DATA(rtAttr), sizeof(ri->gateway));
-            break;
+    if ( (ifindex = kernelNameToIndex(ifname)) == 0 ||
+            netlinkOpen(&nl, NETLINK_ROUTE, 0) )
+        return NULL;
 
-            case RTA_DST:
-            memcpy(&ri->dstAddr, RTA_DATA(rtAttr), sizeof(ri->dstAddr));
-            break;
+    netlinkStrict(&nl);
 
-            default:
-            /* We don't really care about them...
-             */
-            break;
-        }
-    }
+    ret = inventoryLoadLink(inv, &nl, ifindex);
+    netlinkClose(&nl);
 
-    return 0;
+    return ret ? NULL : inventoryFind(inv, ifindex);
 }
 
+/* The default route of the table the interface uses : the main one, the
+ * one of its VRF or the one a policy rule gives to it
+ */
 int getIpGateway(const struct ifreq *ifr, char *dest, size_t len)
 {
-/* 1 kB is not enough too handle the whole response
- */
-#define BUFFLEN     (1024*3)
-    char            buff[BUFFLEN];
-    int             sock,
-                    rlen,
-                    msgLen;
-    struct nlmsghdr *nlMsg;
-    route_info_t    ri;
-    static uint32_t seqnum = 0;
-    pid_t           pid;
+    inventory_t         inv = { 0 };
+    inventory_link_t    *link;
+    int                 ret = -1;
+
+    TRACE_ENTRY(TRACE_IFR(ifr));
 
     /* FIXME
      * for Ipv6, it is INET6_ADDRSTRLEN
      */
     if ( ifr == NULL || dest == NULL || len < INET_ADDRSTRLEN )
-        return -1;
+        return TRACE_RETURN(-1);
 
-    /* Create a new socket
-     */
-    if ( (sock = socket(PF_NETLINK, SOCK_DGRAM, NETLINK_ROUTE)) < 0 )
+    if ( (link = loadLink(ifr->ifr_name, &inv)) && link->hasGateway )
     {
-        perror("socket");
-        return -1;
+        /* Overflow is already check at the begining
+         */
+        memset(dest, 0, len);
+        ret = inet_ntop(AF_INET, &link->gateway, dest, len) != NULL ? 0 : 1;
     }
 
-    /* Init
-     */
-    memset(buff, 0, BUFFLEN);
-    nlMsg = (struct nlmsghdr *) buff;
+    inventoryFree(&inv);
 
-    /* Prepare the request
-     */
-    nlMsg->nlmsg_len = NLMSG_LENGTH(sizeof(struct rtmsg));
-    nlMsg->nlmsg_type = RTM_GETROUTE;
-    nlMsg->nlmsg_flags = NLM_F_DUMP | NLM_F_REQUEST;
-    nlMsg->nlmsg_seq = seqnum++;
-    pid = nlMsg->nlmsg_pid = getpid();
+    return TRACE_RETURN(ret);
+}
 
-    if ( send(sock, nlMsg, nlMsg->nlmsg_len, 0) < 0 )
+/* Neighbors : the dumps are streamed, one datagram at a time, and the
+ * cache is an open addressing hash table keyed by (ifindex, address) kept
+ * up to date from the RTMGRP_NEIGH notifications.
+ */
+#define NEIGH_REMOVED   -1
+
+typedef struct neigh_entry
+{
+    int32_t         ifindex;
+    uint16_t        state;
+    uint8_t         family;
+    uint8_t         lladdrLen;
+    unsigned char   addr[16];
+    unsigned char   lladdr[8];
+} neigh_entry_t;
+
+static neigh_entry_t    *neighTable;
+static size_t           neighSize;
+static size_t           neighUsed;
+static size_t           neighCount;
+static netlink_t        neighEvents = { .fd = -1 };
+
+static const struct
+{
+    const char  *name;
+    unsigned    state;
+} neighStates [] =
+{
+    {"incomplete",  NUD_INCOMPLETE},
+    {"reachable",   NUD_REACHABLE},
+    {"stale",       NUD_STALE},
+    {"delay",       NUD_DELAY},
+    {"probe",       NUD_PROBE},
+    {"failed",      NUD_FAILED},
+    {"noarp",       NUD_NOARP},
+    {"permanent",   NUD_PERMANENT},
+    {NULL,          0},
+};
+
+const char *neighborStateName(unsigned state)
+{
+    int i;
+
+    for ( i = 0 ; neighStates[i].name ; i++ )
     {
-        perror("send");
-        close(sock);
-        return -1;
+        if ( state & neighStates[i].state )
+            return neighStates[i].name;
     }
 
-    /* Read the answer :
-     */
-    msgLen = 0;
-    memset(buff, 0, BUFFLEN);
-    do
+    return "none";
+}
+
+int parseNeighborStates(const char *list, unsigned *states)
+{
+    const char  *p;
+    size_t      len;
+    int         i;
+
+    if ( list == NULL || states == NULL )
+        return -1;
+
+    for ( *states = 0, p = list ; *p ; p += len + (p[len] == ',') )
     {
-        if ( (rlen = recv(sock, buff + msgLen,
-                        BUFFLEN - msgLen, 0)) < 0 )
+        len = strcspn(p, ",");
+
+        for ( i = 0 ; neighStates[i].name ; i++ )
         {
-            perror("recv");
-            close(sock);
-            return -1;
+            if ( strlen(neighStates[i].name) == len &&
+                    strncmp(neighStates[i].name, p, len) == 0 )
+                break;
         }
 
-        nlMsg = (struct nlmsghdr *) (buff + msgLen);
-        if ( NLMSG_OK(nlMsg, rlen) == 0 ||
-                nlMsg->nlmsg_type == NLMSG_ERROR )
+        if ( neighStates[i].name == NULL )
         {
-            fprintf(stderr, "buffer too small\n");
-            close(sock);
+            fprintf(stderr, "Unknown neighbor state %.*s\n", (int) len, p);
             return -1;
         }
 
-        if ( nlMsg->nlmsg_type == NLMSG_DONE )
-            break;
-
-        msgLen += rlen;
-
-        if ( (nlMsg->nlmsg_flags & NLM_F_MULTI) == 0 )
-            break;
+        *states |= neighStates[i].state;
     }
-    while ( nlMsg->nlmsg_seq != seqnum-1 || nlMsg->nlmsg_pid != pid );
 
-    /* Parse the messages and extract routes
-     */
-    for ( nlMsg = (struct nlmsghdr *) buff ; NLMSG_OK(nlMsg, msgLen) ; nlMsg = NLMSG_NEXT(nlMsg, msgLen) )
-    {
-        memset(&ri, 0, sizeof(ri));
+    return 0;
+}
 
-        if ( getRouteInfo((const char *)nlMsg, msgLen, &ri) != 0 )
-            continue;
+/* Neighbors come grouped by interface and routes use a few of them, a
+ * small cache of the names saves an ioctl for each entry
+ */
+#define NAMES_SLOTS     64
 
-        /* We only care about the default gateway
-         */
-        if ( ri.dstAddr.s_addr != INADDR_ANY )
-            continue;
+typedef struct neigh_names
+{
+    int     ifindex[NAMES_SLOTS];
+    char    name[NAMES_SLOTS][IFNAMSIZ];
+} neigh_names_t;
 
-        if ( strncmp(ifr->ifr_name, ri.ifName, sizeof(ri.ifName)) != 0 )
-            continue;
+static const char *neighborIfName(neigh_names_t *names, int ifindex)
+{
+    int slot = ifindex & (NAMES_SLOTS - 1);
 
-        /* Overflow is already check at the begining
-         */
-        memset(dest, 0, len);
+    if ( names->ifindex[slot] != ifindex )
+    {
+        if ( kernelIndexToName(ifindex, names->name[slot]) == NULL )
+            snprintf(names->name[slot], IFNAMSIZ, "if%d", ifindex);
 
-        return inet_ntop(AF_INET, &ri.gateway, dest, len) != NULL
-            ? 0 : 1;
+        names->ifindex[slot] = ifindex;
     }
 
-    return -1;
-#undef BUFFLEN
+    return names->name[slot];
 }
 
-static void prepareRouteEntry(const struct in_addr *inp, const struct ifreq *ifr, struct rtentry *rt)
+static void neighborInfo(const neigh_entry_t *e, neigh_names_t *names,
+        neighbor_info_t *info)
 {
-    struct sockaddr_in  *in;
-
-    memset(rt, 0, sizeof(*rt));
-
-    in = (struct sockaddr_in *) &rt->rt_gateway;
-    in->sin_family = AF_INET;
-    in->sin_addr = *inp;
-
-    in = (struct sockaddr_in *) &rt->rt_dst;
-    in->sin_family = AF_INET;
-    in->sin_addr.s_addr = INADDR_ANY;
+    char    *p;
+    int     i;
 
-    in = (struct sockaddr_in *) &rt->rt_genmask;
-    in->sin_family = AF_INET;
-    in->sin_addr.s_addr = INADDR_ANY;
+    memset(info, 0, sizeof(*info));
+    info->ifindex = e->ifindex;
+    info->state = e->state;
+    snprintf(info->name, sizeof(info->name), "%s",
+            neighborIfName(names, e->ifindex));
 
-    /* FIXME
-     * avoid cast and copy the content
-     */
-    if ( ifr )
-        rt->rt_dev = (char*) ifr->ifr_name;
+    inet_ntop(e->family, e->addr, info->ip, sizeof(info->ip));
 
-    rt->rt_flags = RTF_UP | RTF_GATEWAY;
+    for ( p = info->mac, i = 0 ; i < e->lladdrLen ; i++ )
+        p += sprintf(p, i ? ":%02x" : "%02x", e->lladdr[i]);
 }
 
-int setInterfaceIpGateway(const struct ifreq *ifr, const char *gw)
+/* NDA_DST is mandatory, the link layer address is missing for
+ * incomplete and failed entries
+ */
+static int parseNeighbor(const struct nlmsghdr *nlh, neigh_entry_t *e)
 {
-    struct rtentry  route;
-    struct in_addr  ina;
+    const struct ndmsg  *ndm = NLMSG_DATA(nlh);
+    const struct rtattr *tb[NDA_MAX + 1];
+    size_t              len;
 
-    if ( ifr == NULL || gw == NULL )
+    if ( (nlh->nlmsg_type != RTM_NEWNEIGH && nlh->nlmsg_type != RTM_DELNEIGH) ||
+            (ndm->ndm_family != AF_INET && ndm->ndm_family != AF_INET6) )
         return -1;
 
-    if ( inet_aton(gw, &ina) != 1 )
+    netlinkParseAttr((const struct rtattr *) ((const char *) ndm +
+                NLMSG_ALIGN(sizeof(*ndm))), NLMSG_PAYLOAD(nlh, sizeof(*ndm)),
+            tb, NDA_MAX);
+
+    if ( tb[NDA_DST] == NULL )
         return -1;
 
-    prepareRouteEntry(&ina, ifr, &route);
+    memset(e, 0, sizeof(*e));
+    e->ifindex = ndm->ndm_ifindex;
+    e->state = ndm->ndm_state;
+    e->family = ndm->ndm_family;
+
+    len = RTA_PAYLOAD(tb[NDA_DST]);
+    memcpy(e->addr, RTA_DATA(tb[NDA_DST]), len < sizeof(e->addr) ? len : sizeof(e->addr));
 
-    if ( ioctl(fd, SIOCADDRT, &route) < 0 )
+    if ( tb[NDA_LLADDR] && RTA_PAYLOAD(tb[NDA_LLADDR]) <= sizeof(e->lladdr) )
     {
-        perror("ioctl failed");
+        e->lladdrLen = RTA_PAYLOAD(tb[NDA_LLADDR]);
+        memcpy(e->lladdr, RTA_DATA(tb[NDA_LLADDR]), e->lladdrLen);
+    }
+
+    return 0;
+}
+
+typedef struct neigh_walk
+{
+    int                 ifindex;
+    unsigned            states;
+    neighbor_callback_t cb;
+    void                *user;
+    neigh_names_t       names;
+} neigh_walk_t;
+
+static int neighborWalk(const neigh_entry_t *e, neigh_walk_t *walk)
+{
+    neighbor_info_t info;
+
+    if ( (walk->ifindex && e->ifindex != walk->ifindex) ||
+            (walk->states && !(e->state & walk->states)) )
+        return 0;
+
+    neighborInfo(e, &walk->names, &info);
+
+    return walk->cb(&info, walk->user);
+}
+
+static int neighborStream(const struct nlmsghdr *nlh, void *user)
+{
+    neigh_entry_t   e;
+
+    if ( parseNeighbor(nlh, &e) )
+        return 0;
+
+    return neighborWalk(&e, user);
+}
+
+static int neighborDump(netlink_t *nl, int ifindex, netlink_callback_t cb,
+        void *user)
+{
+    netlink_req_t   req = { 0 };
+    struct ndmsg    *ndm;
+    int             ret = -1;
+
+    if ( (ndm = netlinkReqAdd(&req, RTM_GETNEIGH, NLM_F_DUMP, sizeof(*ndm))) == NULL )
+        goto out;
+
+    ndm->ndm_family = AF_UNSPEC;
+
+    if ( ifindex && netlinkReqAttrU32(&req, NDA_IFINDEX, ifindex) )
+        goto out;
+
+    ret = netlinkTransact(nl, &req, cb, user);
+
+out:
+    netlinkReqFree(&req);
+
+    return ret;
+}
+
+static int neighborIfIndex(const char *ifname)
+{
+    int ifindex = 0;
+
+    if ( ifname && (ifindex = kernelNameToIndex(ifname)) == 0 )
+        fprintf(stderr, "%s: unknown interface\n", ifname);
+
+    return ifindex ? ifindex : ifname ? -1 : 0;
+}
+
+int foreachNeighbor(const char *ifname, unsigned states,
+        neighbor_callback_t cb, void *user)
+{
+    neigh_walk_t    walk;
+    netlink_t       nl;
+    int             ret;
+
+    TRACE_ENTRY(ifname);
+
+    if ( cb == NULL )
+        return TRACE_RETURN(-1);
+
+    memset(&walk, 0, sizeof(walk));
+    if ( (walk.ifindex = neighborIfIndex(ifname)) < 0 )
+        return TRACE_RETURN(-1);
+
+    walk.states = states;
+    walk.cb = cb;
+    walk.user = user;
+
+    if ( netlinkOpen(&nl, NETLINK_ROUTE, 0) )
+        return TRACE_RETURN(-1);
+
+    ret = neighborDump(&nl, walk.ifindex, &neighborStream, &walk);
+    netlinkClose(&nl);
+
+    return TRACE_RETURN(ret);
+}
+
+static const struct
+{
+    const char  *name;
+    unsigned    protocol;
+} routeProtocols [] =
+{
+    {"redirect",    RTPROT_REDIRECT},
+    {"kernel",      RTPROT_KERNEL},
+    {"boot",        RTPROT_BOOT},
+    {"static",      RTPROT_STATIC},
+    {"ra",          RTPROT_RA},
+    {"dhcp",        RTPROT_DHCP},
+    {"bgp",         RTPROT_BGP},
+    {"isis",        RTPROT_ISIS},
+    {"ospf",        RTPROT_OSPF},
+    {"rip",         RTPROT_RIP},
+    {NULL,          0},
+};
+
+const char *routeProtocolName(unsigned protocol)
+{
+    int i;
+
+    for ( i = 0 ; routeProtocols[i].name ; i++ )
+    {
+        if ( routeProtocols[i].protocol == protocol )
+            return routeProtocols[i].name;
+    }
+
+    return NULL;
+}
+
+typedef struct route_walk
+{
+    route_callback_t    cb;
+    void                *user;
+    int                 ifindex;
+    neigh_names_t       names;
+} route_walk_t;
+
+static int routeHop(route_walk_t *walk, route_info_t *info, int ifindex,
+        const struct rtattr *gateway)
+{
+    if ( walk->ifindex && ifindex != walk->ifindex )
+        return 0;
+
+    info->ifindex = ifindex;
+    info->name[0] = '\0';
+    if ( ifindex )
+        snprintf(info->name, sizeof(info->name), "%s",
+                neighborIfName(&walk->names, ifindex));
+
+    info->gateway[0] = '\0';
+    if ( gateway )
+        inet_ntop(info->family, RTA_DATA(gateway), info->gateway,
+                sizeof(info->gateway));
+
+    return walk->cb(info, walk->user);
+}
+
+/* Straight from the receive buffer to the callback, nothing is kept
+ */
+static int routeStream(const struct nlmsghdr *nlh, void *user)
+{
+    route_walk_t            *walk = user;
+    const struct rtmsg      *rtm = NLMSG_DATA(nlh);
+    const struct rtattr     *tb[RTA_MAX + 1],
+                            *hop[RTA_MAX + 1];
+    const struct rtnexthop  *nh;
+    route_info_t            info;
+    int                     len,
+                            ret;
+
+    if ( nlh->nlmsg_type != RTM_NEWROUTE ||
+            (rtm->rtm_family != AF_INET && rtm->rtm_family != AF_INET6) ||
+            (rtm->rtm_flags & RTM_F_CLONED) )
+        return 0;
+
+    netlinkParseAttr(RTM_RTA(rtm), RTM_PAYLOAD(nlh), tb, RTA_MAX);
+
+    info.family = rtm->rtm_family;
+    info.prefix = rtm->rtm_dst_len;
+    info.protocol = rtm->rtm_protocol;
+    info.table = tb[RTA_TABLE] ? netlinkAttrU32(tb[RTA_TABLE]) : rtm->rtm_table;
+    info.metric = tb[RTA_PRIORITY] ? netlinkAttrU32(tb[RTA_PRIORITY]) : 0;
+
+    if ( tb[RTA_DST] )
+        inet_ntop(info.family, RTA_DATA(tb[RTA_DST]), info.dst, sizeof(info.dst));
+    else
+        snprintf(info.dst, sizeof(info.dst), info.family == AF_INET ? "0.0.0.0" : "::");
+
+    if ( tb[RTA_MULTIPATH] == NULL )
+        return routeHop(walk, &info,
+                tb[RTA_OIF] ? (int) netlinkAttrU32(tb[RTA_OIF]) : 0,
+                tb[RTA_GATEWAY]);
+
+    nh = RTA_DATA(tb[RTA_MULTIPATH]);
+    len = RTA_PAYLOAD(tb[RTA_MULTIPATH]);
+
+    for ( ; RTNH_OK(nh, len) ; len -= RTNH_ALIGN(nh->rtnh_len), nh = RTNH_NEXT(nh) )
+    {
+        netlinkParseAttr(RTNH_DATA(nh), nh->rtnh_len - RTNH_LENGTH(0), hop, RTA_MAX);
+        if ( (ret = routeHop(walk, &info, nh->rtnh_ifindex, hop[RTA_GATEWAY])) )
+            return ret;
+    }
+
+    return 0;
+}
+
+int foreachRoute(const char *ifname, route_callback_t cb, void *user)
+{
+    netlink_req_t   req = { 0 };
+    route_walk_t    walk;
+    netlink_t       nl;
+    struct rtmsg    *rtm;
+    int             ret = -1;
+
+    TRACE_ENTRY(ifname);
+
+    if ( cb == NULL )
+        return TRACE_RETURN(-1);
+
+    memset(&walk, 0, sizeof(walk));
+    if ( (walk.ifindex = neighborIfIndex(ifname)) < 0 )
+        return TRACE_RETURN(-1);
+
+    walk.cb = cb;
+    walk.user = user;
+
+    if ( netlinkOpen(&nl, NETLINK_ROUTE, 0) )
+        return TRACE_RETURN(-1);
+
+    /* The kernel only dumps the routes of the interface on a strict
+     * socket, routeHop() filters for the others
+     */
+    netlinkStrict(&nl);
+
+    if ( (rtm = netlinkReqAdd(&req, RTM_GETROUTE, NLM_F_DUMP, sizeof(*rtm))) == NULL )
+        goto out;
+    rtm->rtm_family = AF_UNSPEC;
+
+    if ( walk.ifindex == 0 || netlinkReqAttrU32(&req, RTA_OIF, walk.ifindex) == 0 )
+        ret = netlinkTransact(&nl, &req, &routeStream, &walk);
+
+out:
+    netlinkReqFree(&req);
+    netlinkClose(&nl);
+
+    return TRACE_RETURN(ret);
+}
+
+static size_t neighborHash(int ifindex, const unsigned char *addr)
+{
+    size_t  h = 2166136261u;
+    size_t  i;
+
+    h = (h ^ ifindex) * 16777619u;
+    for ( i = 0 ; i < 16 ; i++ )
+        h = (h ^ addr[i]) * 16777619u;
+
+    return h;
+}
+
+/* The slot of an entry, or the free one it would go to
+ */
+static neigh_entry_t *neighborSlot(int ifindex, const unsigned char *addr)
+{
+    neigh_entry_t   *slot,
+                    *removed = NULL;
+    size_t          i;
+
+    for ( i = neighborHash(ifindex, addr) & (neighSize - 1) ;
+            (slot = &neighTable[i])->ifindex ; i = (i + 1) & (neighSize - 1) )
+    {
+        if ( slot->ifindex == NEIGH_REMOVED )
+        {
+            if ( removed == NULL )
+                removed = slot;
+        }
+        else if ( slot->ifindex == ifindex && !memcmp(slot->addr, addr, 16) )
+            return slot;
+    }
+
+    return removed ? removed : slot;
+}
+
+static int neighborGrow(void)
+{
+    neigh_entry_t   *old = neighTable,
+                    *slot;
+    size_t          oldSize = neighSize,
+                    i;
+
+    /* Only the removed entries are dropped when the table is sparse
+     */
+    if ( neighSize == 0 || neighCount * 4 > neighSize )
+        neighSize = neighSize ? neighSize * 2 : 1024;
+
+    if ( (neighTable = calloc(neighSize, sizeof(*neighTable))) == NULL )
+    {
+        neighTable = old;
+        neighSize = oldSize;
         return -1;
     }
 
+    neighUsed = 0;
+    for ( i = 0 ; i < oldSize ; i++ )
+    {
+        if ( old[i].ifindex <= 0 )
+            continue;
+
+        slot = neighborSlot(old[i].ifindex, old[i].addr);
+        *slot = old[i];
+        neighUsed++;
+    }
+
+    free(old);
+
     return 0;
 }
 
+static int neighborCache(const struct nlmsghdr *nlh, void *unused)
+{
+    neigh_entry_t   e,
+                    *slot;
+
+    if ( parseNeighbor(nlh, &e) )
+        return 0;
+
+    if ( neighUsed * 2 >= neighSize && neighborGrow() )
+        return -1;
+
+    slot = neighborSlot(e.ifindex, e.addr);
+
+    if ( nlh->nlmsg_type == RTM_DELNEIGH )
+    {
+        if ( slot->ifindex > 0 )
+        {
+            slot->ifindex = NEIGH_REMOVED;
+            neighCount--;
+        }
+
+        return 0;
+    }
+
+    if ( slot->ifindex == 0 )
+        neighUsed++;
+
+    if ( slot->ifindex <= 0 )
+        neighCount++;
+
+    *slot = e;
+
+    return 0;
+}
+
+static void neighborFlush(void)
+{
+    free(neighTable);
+    neighTable = NULL;
+    neighSize = neighUsed = neighCount = 0;
+}
+
+static void neighborClean(void)
+{
+    neighborFlush();
+
+    if ( neighEvents.fd >= 0 )
+    {
+        netlinkClose(&neighEvents);
+        neighEvents.fd = -1;
+    }
+}
+
+/* Subscribe first, so that no change is lost between the dump and the
+ * first update. Returns a descriptor to watch for updateNeighbors().
+ */
+int loadNeighbors(void)
+{
+    netlink_t   nl;
+    int         ret;
+
+    TRACE_ENTRY(NULL);
+
+    if ( neighEvents.fd < 0 )
+    {
+        if ( netlinkOpen(&neighEvents, NETLINK_ROUTE, RTMGRP_NEIGH) )
+        {
+            neighEvents.fd = -1;
+            return TRACE_RETURN(-1);
+        }
+
+        if ( fcntl(neighEvents.fd, F_SETFL, O_NONBLOCK) < 0 )
+        {
+            perror("fcntl");
+            netlinkClose(&neighEvents);
+            neighEvents.fd = -1;
+            return TRACE_RETURN(-1);
+        }
+    }
+
+    if ( netlinkOpen(&nl, NETLINK_ROUTE, 0) )
+    {
+        neighborClean();
+        return TRACE_RETURN(-1);
+    }
+
+    neighborFlush();
+    ret = neighborGrow() || neighborDump(&nl, 0, &neighborCache, NULL) ? -1 : 0;
+    netlinkClose(&nl);
+
+    /* No half-filled cache : the next call reloads it all
+     */
+    if ( ret )
+    {
+        neighborClean();
+        return TRACE_RETURN(-1);
+    }
+
+    return TRACE_RETURN(neighEvents.fd);
+}
+
+/* Apply the pending notifications, a lost one means a full reload
+ */
+int updateNeighbors(void)
+{
+    int ret;
+
+    TRACE_ENTRY(NULL);
+
+    if ( neighEvents.fd < 0 )
+        return TRACE_RETURN(loadNeighbors() < 0 ? -1 : 0);
+
+    while ( (ret = netlinkRecv(&neighEvents, &neighborCache, NULL)) > 0 )
+        ;
+
+    if ( ret < 0 && errno == ENOBUFS )
+        return TRACE_RETURN(loadNeighbors() < 0 ? -1 : 0);
+
+    return TRACE_RETURN(ret);
+}
+
+int getNeighbor(const char *ifname, const char *ip, neighbor_info_t *info)
+{
+    unsigned char   addr[16] = { 0 };
+    neigh_names_t   names;
+    neigh_entry_t   *slot;
+    int             ifindex;
+
+    TRACE_ENTRY(ifname);
+
+    if ( ip == NULL || info == NULL || ifname == NULL ||
+            (ifindex = neighborIfIndex(ifname)) <= 0 )
+        return TRACE_RETURN(-1);
+
+    if ( inet_pton(AF_INET, ip, addr) != 1 && inet_pton(AF_INET6, ip, addr) != 1 )
+        return TRACE_RETURN(-1);
+
+    if ( updateNeighbors() < 0 )
+        return TRACE_RETURN(-1);
+
+    slot = neighborSlot(ifindex, addr);
+    if ( slot->ifindex != ifindex )
+        return TRACE_RETURN(1);
+
+    memset(&names, 0, sizeof(names));
+    neighborInfo(slot, &names, info);
+
+    return TRACE_RETURN(0);
+}
+
+int foreachNeighborCached(const char *ifname, unsigned states,
+        neighbor_callback_t cb, void *user)
+{
+    neigh_walk_t    walk;
+    size_t          i;
+    int             ret;
+
+    TRACE_ENTRY(ifname);
+
+    if ( cb == NULL )
+        return TRACE_RETURN(-1);
+
+    memset(&walk, 0, sizeof(walk));
+    if ( (walk.ifindex = neighborIfIndex(ifname)) < 0 || updateNeighbors() < 0 )
+        return TRACE_RETURN(-1);
+
+    walk.states = states;
+    walk.cb = cb;
+    walk.user = user;
+
+    for ( i = 0 ; i < neighSize ; i++ )
+    {
+        if ( neighTable[i].ifindex > 0 &&
+                (ret = neighborWalk(&neighTable[i], &walk)) )
+            return TRACE_RETURN(ret);
+    }
+
+    return TRACE_RETURN(0);
+}
+
+static void prepareRouteEntry(const struct in_addr *inp, const struct ifreq *ifr, struct rtentry *rt)
+{
+    struct sockaddr_in  *in;
+
+    memset(rt, 0, sizeof(*rt));
+
+    in = (struct sockaddr_in *) &rt->rt_gateway;
+    in->sin_family = AF_INET;
+    in->sin_addr = *inp;
+
+    in = (struct sockaddr_in *) &rt->rt_dst;
+    in->sin_family = AF_INET;
+    in->sin_addr.s_addr = INADDR_ANY;
+
+    in = (struct sockaddr_in *) &rt->rt_genmask;
+    in->sin_family = AF_INET;
+    in->sin_addr.s_addr = INADDR_ANY;
+
+    /* FIXME
+     * avoid cast and copy the content
+     */
+    if ( ifr )
+        rt->rt_dev = (char*) ifr->ifr_name;
+
+    rt->rt_flags = RTF_UP | RTF_GATEWAY;
+}
+
+int setInterfaceIpGateway(const struct ifreq *ifr, const char *gw)
+{
+    struct rtentry  route;
+    struct in_addr  ina;
+
+    TRACE_ENTRY(TRACE_IFR(ifr));
+
+    if ( ifr == NULL || gw == NULL )
+        return TRACE_RETURN(-1);
+
+    if ( inet_aton(gw, &ina) != 1 )
+        return TRACE_RETURN(-1);
+
+    prepareRouteEntry(&ina, ifr, &route);
+
+    if ( kernelIoctl(ioctlFd(), SIOCADDRT, &route) < 0 )
+    {
+        perror("ioctl failed");
+        return TRACE_RETURN(-1);
+    }
+
+    return TRACE_RETURN(0);
+}
+
 int delInterfaceIpGateway(const struct ifreq *ifr, const char *gw)
 {
     struct rtentry      route;
@@ -714,7 +1495,7 @@ int delInterfaceIpGateway(const struct ifreq *ifr, const char *gw)
 
     prepareRouteEntry(&ina, ifr, &route);
 
-    if ( ioctl(fd, SIOCDELRT, &route) < 0 )
+    if ( kernelIoctl(ioctlFd(), SIOCDELRT, &route) < 0 )
     {
         perror("ioctl failed");
         return -1;
@@ -723,174 +1504,614 @@ int delInterfaceIpGateway(const struct ifreq *ifr, const char *gw)
     return 0;
 }
 
-static int saveInterfaceIpConfigManual(FILE *file, const struct ifreq *ifr)
+static int saveInterfaceIpConfigManual(FILE *file, const struct ifreq *ifr)
+{
+    /* See man interfaces
+     */
+    char    str[INET_ADDRSTRLEN];
+
+    if ( ifr == NULL )
+        return -1;
+
+    fprintf(file, "auto %s\n", ifr->ifr_name);
+    fprintf(file, "iface %s inet static\n", ifr->ifr_name);
+
+    if ( getIpAddress(ifr, str, sizeof(str)) == 0 )
+        fprintf(file, "\taddress %s\n", str);
+
+    if ( getIpMask(ifr, str, sizeof(str)) == 0 )
+        fprintf(file, "\tnetmask %s\n", str);
+
+    if ( getIpBroadcast(ifr, str, sizeof(str)) == 0 )
+        fprintf(file, "\tbroadcast %s\n", str);
+
+    if ( getIpGateway(ifr, str, sizeof(str)) == 0 )
+        fprintf(file, "\tgateway %s\n", str);
+
+    return 0;
+}
+
+static int saveInterfaceIpConfigAuto(FILE *file, const struct ifreq *ifr)
+{
+    fprintf(file, "iface %s inet dhcp\n", ifr->ifr_name);
+
+    return 0;
+}
+
+/* See man interfaces, a stanza starts with its first word
+ */
+static int isStanzaStart(const char *word)
+{
+    return !strcmp(word, "iface") || !strcmp(word, "mapping") ||
+        !strcmp(word, "auto") || !strncmp(word, "allow-", 6) ||
+        !strncmp(word, "source", 6) || !strcmp(word, "rename") ||
+        !strncmp(word, "no-", 3);
+}
+
+static int isStanzaOf(const char *line, const char *ifname)
+{
+    char    word[16],
+            name[IFNAMSIZ];
+
+    return sscanf(line, " %15s %15s", word, name) == 2 &&
+        (!strcmp(word, "iface") || !strcmp(word, "mapping")) &&
+        !strcmp(name, ifname);
+}
+
+/* A line "auto <ifname>" alone, the one written with a static stanza
+ */
+static int isAutoOf(const char *line, const char *ifname)
+{
+    char    word[16],
+            name[IFNAMSIZ],
+            more;
+
+    return sscanf(line, " %15s %15s %c", word, name, &more) == 2 &&
+        !strcmp(word, "auto") && !strcmp(name, ifname);
+}
+
+static int isKeptOption(const char *line)
+{
+    char    word[32];
+    int     i;
+
+    if ( sscanf(line, " %31s", word) != 1 )
+        return 0;
+
+    for ( i = 0 ; keptOptions[i] ; i++ )
+    {
+        if ( !strcmp(word, keptOptions[i]) )
+            return 1;
+    }
+
+    return 0;
+}
+
+/* The options of the stanza of ifname to keep are appended to kept, its
+ * auto line is dropped when the new stanza writes one
+ */
+static int saveFrom(FILE *from, FILE *to, const char *ifname, int dropAuto,
+        char *kept, size_t keptLen)
+{
+#define BUFFLEN     1024
+    char    buff[BUFFLEN],
+            word[32];
+    size_t  off = 0;
+    int     found = 0;
+    fpos_t  pos;
+
+    while ( fgets(buff, sizeof(buff), from) )
+    {
+        if ( found )
+        {
+            /* Search for a new interface
+             */
+            if ( sscanf(buff, " %31s", word) == 1 && isStanzaStart(word) )
+            {
+                fsetpos(from, &pos);
+                break;
+            }
+
+            if ( isKeptOption(buff) && off + strlen(buff) < keptLen )
+                off += snprintf(kept + off, keptLen - off, "%s", buff);
+        }
+        else if ( isStanzaOf(buff, ifname) )
+        {
+            found++;
+        }
+        else if ( !dropAuto || !isAutoOf(buff, ifname) )
+        {
+            /* Write the buff
+             */
+            fprintf(to, "%s", buff);
+        }
+
+        fgetpos(from, &pos);
+    }
+
+    return 0;
+#undef BUFFLEN
+}
+
+int saveInterfaceIpConfig(const struct ifreq *ifr, int isDhcp)
+{
+#define BUFFLEN     1024
+    char            buff[BUFFLEN],
+                    kept[BUFFLEN] = "";
+    FILE            *file = NULL;
+    FILE            *original = NULL;
+    int             ret;
+
+    TRACE_ENTRY(TRACE_IFR(ifr));
+
+    if ( ifr == NULL )
+        return TRACE_RETURN(-1);
+
+    if ( (file = kernelOpen(tmpInterface, "w")) == NULL )
+        return TRACE_RETURN(-1);
+
+    /* Write the other interfaces if there is already a file
+     */
+    if ( (original = kernelOpen(interface, "r")) != NULL )
+    {
+        if ( saveFrom(original, file, ifr->ifr_name, isDhcp == 0, kept,
+                    sizeof(kept)) )
+        {
+            fclose(original);
+            fclose(file);
+            return TRACE_RETURN(-1);
+        }
+    }
+
+    switch ( isDhcp )
+    {
+        case 0:
+        ret = saveInterfaceIpConfigManual(file, ifr);
+        break;
+
+        case 1:
+        ret = saveInterfaceIpConfigAuto(file, ifr);
+        break;
+
+        default:
+        ret = -1;
+        break;
+    }
+
+    fprintf(file, "%s", kept);
+
+    /* Write the end of original
+     */
+    if ( original )
+    {
+        while ( fgets(buff, sizeof(buff), original) )
+            fprintf(file, "%s", buff);
+
+        fclose(original);
+    }
+
+    fflush(file);
+    TRACE_PROBE3(file_write, ifr->ifr_name, tmpInterface, ftell(file));
+    fclose(file);
+
+    if ( ret == 0 )
+    {
+        if ( (ret = kernelRename(tmpInterface, interface)) )
+            perror("rename");
+        TRACE_PROBE3(file_rename, ifr->ifr_name, interface, ret);
+    }
+
+    return TRACE_RETURN(ret);
+#undef BUFFLEN
+}
+
+int getDomainNameServer(char *dest, size_t len)
+{
+#define BUFFLEN 256
+    FILE    *file = NULL;
+    char    buff[BUFFLEN];
+    char    *ns;
+    int     nsLen;
+
+    TRACE_ENTRY(NULL);
+
+    if ( (file = kernelOpen(resolv, "r")) == NULL )
+        return TRACE_RETURN(-1);
+
+    while ( fgets(buff, BUFFLEN, file) != NULL )
+    {
+        /* Ignore comments or empty line
+         */
+        if ( !*buff || *buff == '#' )
+            continue;
+
+        if ( (ns = strstr(buff, "nameserver")) )
+        {
+            ns += sizeof("nameserver");
+            if ( (nsLen = strlen(ns)) && ns[nsLen - 1] == '\n' )
+                ns[--nsLen] = '\0';
+
+            if ( (ns = trimSpace(ns)) )
+            {
+                snprintf(dest, len, "%s", ns);
+            }
+        }
+    }
+
+    fclose(file);
+
+    return TRACE_RETURN(0);
+#undef BUFFLEN
+}
+
+/* One pass over the interfaces file, stanza by stanza
+ */
+int foreachInterfaceOption(const char *option,
+        interface_option_callback_t cb, void *user)
+{
+#define BUFFLEN     1024
+    char    buff[BUFFLEN],
+            word[32],
+            name[IFNAMSIZ] = "",
+            *value,
+            *end;
+    FILE    *file;
+    int     len,
+            ret = 0;
+
+    TRACE_ENTRY(NULL);
+
+    if ( option == NULL || cb == NULL )
+        return TRACE_RETURN(-1);
+
+    /* No file, no option
+     */
+    if ( (file = kernelOpen(interface, "r")) == NULL )
+        return TRACE_RETURN(errno == ENOENT ? 0 : -1);
+
+    while ( ret == 0 && fgets(buff, sizeof(buff), file) )
+    {
+        if ( sscanf(buff, " %31s%n", word, &len) != 1 )
+            continue;
+
+        if ( isStanzaStart(word) )
+        {
+            if ( strcmp(word, "iface") || sscanf(buff + len, " %15s", name) != 1 )
+                *name = '\0';
+            continue;
+        }
+
+        if ( *name == '\0' || strcmp(word, option) )
+            continue;
+
+        for ( value = buff + len ; isspace((unsigned char) *value) ; value++ )
+            ;
+        for ( end = value + strlen(value) ; end > value && isspace((unsigned char) end[-1]) ; )
+            *--end = '\0';
+
+        ret = cb(name, value, user);
+    }
+
+    fclose(file);
+
+    return TRACE_RETURN(ret);
+#undef BUFFLEN
+}
+
+int setInterfaceOption(const char *ifname, const char *option,
+        const char *value)
+{
+#define BUFFLEN     1024
+    char    buff[BUFFLEN],
+            word[32];
+    FILE    *file,
+            *original;
+    int     in = 0,
+            found = 0,
+            ret;
+
+    TRACE_ENTRY(ifname);
+
+    if ( ifname == NULL || option == NULL )
+        return TRACE_RETURN(-1);
+
+    if ( (file = kernelOpen(tmpInterface, "w")) == NULL )
+        return TRACE_RETURN(-1);
+
+    /* The option follows the first iface line of the interface, its
+     * other occurrences are removed
+     */
+    if ( (original = kernelOpen(interface, "r")) != NULL )
+    {
+        while ( fgets(buff, sizeof(buff), original) )
+        {
+            if ( sscanf(buff, " %31s", word) == 1 && isStanzaStart(word) )
+            {
+                fprintf(file, "%s", buff);
+
+                if ( (in = !strcmp(word, "iface") && isStanzaOf(buff, ifname)) &&
+                        !found++ && value )
+                    fprintf(file, "\t%s %s\n", option, value);
+                continue;
+            }
+
+            if ( in && !strcmp(word, option) )
+                continue;
+
+            fprintf(file, "%s", buff);
+        }
+
+        fclose(original);
+    }
+
+    if ( !found && value )
+        fprintf(file, "\niface %s inet manual\n\t%s %s\n", ifname, option, value);
+
+    ret = fflush(file) ? -1 : 0;
+    fclose(file);
+
+    if ( ret == 0 && (ret = kernelRename(tmpInterface, interface)) )
+        perror("rename");
+
+    return TRACE_RETURN(ret);
+#undef BUFFLEN
+}
+
+/* Gather in one record everything the display knows about an interface.
+ * A field is left empty when it cannot be read.
+ */
+int getInterfaceInfo(const struct ifreq *ifr, interface_info_t *info)
 {
-    /* See man interfaces
-     */
-    char    str[INET_ADDRSTRLEN];
+    TRACE_ENTRY(TRACE_IFR(ifr));
 
-    if ( ifr == NULL )
-        return -1;
+    if ( ifr == NULL || info == NULL )
+        return TRACE_RETURN(-1);
 
-    fprintf(file, "auto %s\n", ifr->ifr_name);
-    fprintf(file, "iface %s inet static\n", ifr->ifr_name);
+    memset(info, 0, sizeof(*info));
+    snprintf(info->name, sizeof(info->name), "%.*s", IFNAMSIZ - 1, ifr->ifr_name);
 
-    if ( getIpAddress(ifr, str, sizeof(str)) == 0 )
-        fprintf(file, "\taddress %s\n", str);
+    info->plugged = isInterfacePlugged(ifr) > 0;
+    info->dynamic = isInterfaceDynamic(ifr->ifr_name) ? 1 : 0;
 
-    if ( getIpMask(ifr, str, sizeof(str)) == 0 )
-        fprintf(file, "\tnetmask %s\n", str);
+    if ( getMacAddress(ifr, info->mac, sizeof(info->mac)) )
+        *info->mac = '\0';
 
-    if ( getIpBroadcast(ifr, str, sizeof(str)) == 0 )
-        fprintf(file, "\tbroadcast %s\n", str);
+    if ( getIpAddress(ifr, info->ip, sizeof(info->ip)) )
+        *info->ip = '\0';
 
-    if ( getIpGateway(ifr, str, sizeof(str)) == 0 )
-        fprintf(file, "\tgateway %s\n", str);
+    if ( getIpMask(ifr, info->mask, sizeof(info->mask)) )
+        *info->mask = '\0';
 
-    return 0;
-}
+    if ( getIpBroadcast(ifr, info->bcast, sizeof(info->bcast)) )
+        *info->bcast = '\0';
 
-static int saveInterfaceIpConfigAuto(FILE *file, const struct ifreq *ifr)
-{
-    fprintf(file, "iface %s inet dhcp\n", ifr->ifr_name);
+    if ( getIpGateway(ifr, info->gw, sizeof(info->gw)) )
+        *info->gw = '\0';
 
-    return 0;
+    if ( getDomainNameServer(info->ns, sizeof(info->ns)) )
+        *info->ns = '\0';
+
+    return TRACE_RETURN(0);
 }
 
-static int saveFrom(FILE *from, FILE *to, const char *ifname)
+int getInterfaceInfoByName(const char *ifname, interface_info_t *info)
 {
-#define BUFFLEN     1024
-    char    buff[BUFFLEN];
-    int     found = 0;
-    fpos_t  pos;
+    inventory_t         inv = { 0 };
+    inventory_link_t    *link;
+    char                ns[sizeof(info->ns)];
+    int                 ret = -1;
 
-    while ( fgets(buff, sizeof(buff), from) )
+    TRACE_ENTRY(ifname);
+
+    if ( ifname == NULL || info == NULL )
+        return TRACE_RETURN(-1);
+
+    if ( (link = loadLink(ifname, &inv)) != NULL )
     {
-        if ( found )
-        {
-            /* Search for a new interface
-             */
-            if ( strstr(buff, "iface") || strstr(buff, "mapping") )
-            {
-                fsetpos(from, &pos);
-                break;
-            }
-        }
-        else if ( (strstr(buff, "iface") || strstr(buff, "mapping")) &&
-                    strstr(buff, ifname) )
-        {
-            found++;
-        }
-        else
-        {
-            /* Write the buff
-             */
-            fprintf(to, "%s", buff);
-        }
+        if ( getDomainNameServer(ns, sizeof(ns)) )
+            *ns = '\0';
 
-        fgetpos(from, &pos);
+        inventoryInfo(link, ns, info);
+        ret = 0;
     }
 
-    return 0;
-#undef BUFFLEN
+    inventoryFree(&inv);
+
+    return TRACE_RETURN(ret);
 }
 
-int saveInterfaceIpConfig(const struct ifreq *ifr, int isDhcp)
+/* The interfaces of a worker are a range of the slots, it takes them from
+ * the head and the thieves from the tail
+ */
+typedef struct info_queue
 {
-#define BUFFLEN     1024
-    char    buff[BUFFLEN];
-    FILE    *file = NULL;
-    FILE    *original = NULL;
-    int     ret;
+    pthread_mutex_t lock;
+    size_t          head;
+    size_t          tail;
+} info_queue_t;
 
-    if ( ifr == NULL )
-        return -1;
+typedef struct info_slot
+{
+    const struct ifreq  *ifr;
+    interface_info_t    info;
+    int                 done;
+} info_slot_t;
 
-    if ( (file = fopen(tmpInterface, "w")) == NULL )
-        return -1;
+typedef struct info_pool
+{
+    info_slot_t     *slots;
+    size_t          nb;
+    info_queue_t    *queues;
+    int             nbQueues;
+    int             stop;
+    pthread_mutex_t lock;
+    pthread_cond_t  done;
+} info_pool_t;
+
+typedef struct info_worker
+{
+    info_pool_t *pool;
+    int         id;
+    pthread_t   thread;
+} info_worker_t;
 
-    /* Write the other interfaces if there is already a file
-     */
-    if ( (original = fopen(interface, "r")) != NULL )
+static int takeSlot(info_pool_t *pool, int id, size_t *slot)
+{
+    info_queue_t    *queue;
+    int             i,
+                    found = 0;
+
+    for ( i = 0 ; !found && i < pool->nbQueues ; i++ )
     {
-        if ( saveFrom(original, file, ifr->ifr_name) )
+        queue = &pool->queues[(id + i) % pool->nbQueues];
+
+        pthread_mutex_lock(&queue->lock);
+        if ( queue->head < queue->tail )
         {
-            fclose(original);
-            fclose(file);
-            return -1;
+            *slot = i == 0 ? queue->head++ : --queue->tail;
+            found = 1;
         }
+        pthread_mutex_unlock(&queue->lock);
     }
 
-    switch ( isDhcp )
-    {
-        case 0:
-        ret = saveInterfaceIpConfigManual(file, ifr);
-        break;
-
-        case 1:
-        ret = saveInterfaceIpConfigAuto(file, ifr);
-        break;
+    return found;
+}
 
-        default:
-        ret = -1;
-        break;
-    }
+static void *infoWorker(void *arg)
+{
+    info_worker_t   *worker = arg;
+    info_pool_t     *pool = worker->pool;
+    size_t          slot;
+    int             stop = 0;
 
-    /* Write the end of original
+    /* Without a socket of its own, the worker shares the one of the
+     * library
      */
-    if ( original )
+    threadFd = getFileDescriptor();
+
+    while ( !stop && takeSlot(pool, worker->id, &slot) )
     {
-        while ( fgets(buff, sizeof(buff), original) )
-            fprintf(file, "%s", buff);
+        getInterfaceInfo(pool->slots[slot].ifr, &pool->slots[slot].info);
 
-        fclose(original);
+        pthread_mutex_lock(&pool->lock);
+        pool->slots[slot].done = 1;
+        pthread_cond_broadcast(&pool->done);
+        stop = pool->stop;
+        pthread_mutex_unlock(&pool->lock);
     }
 
-    fflush(file);
-    fclose(file);
+    if ( threadFd >= 0 )
+        closeFileDescriptor(threadFd);
+    threadFd = -1;
 
-    if ( ret == 0 && (ret = rename(tmpInterface, interface)) )
-        perror("rename");
+    return NULL;
+}
 
-    return ret;
-#undef BUFFLEN
+static int collectSlot(const struct ifreq *ifr, void *user)
+{
+    info_pool_t *pool = user;
+
+    pool->slots[pool->nb++].ifr = ifr;
+
+    return 0;
 }
 
-int getDomainNameServer(char *dest, size_t len)
+int foreachInterfaceInfo(int domain, int threads, interface_info_callback_t cb,
+        void *user)
 {
-#define BUFFLEN 256
-    FILE    *file = NULL;
-    char    buff[BUFFLEN];
-    char    *ns;
-    int     nsLen;
+    info_pool_t         pool;
+    info_worker_t       *workers = NULL;
+    const iface_chunk_t *chunk;
+    size_t              i,
+                        nb = 0;
+    int                 started = 0,
+                        ret;
 
-    if ( (file = fopen(resolv, "r")) == NULL )
-        return -1;
+    TRACE_ENTRY(NULL);
 
-    while ( fgets(buff, BUFFLEN, file) != NULL )
+    if ( !init || cb == NULL )
+        return TRACE_RETURN(-1);
+
+    for ( chunk = &ifaces ; chunk ; chunk = chunk->next )
+        nb += chunk->nb;
+
+    memset(&pool, 0, sizeof(pool));
+    if ( (pool.slots = calloc(nb ? nb : 1, sizeof(*pool.slots))) == NULL )
+        return TRACE_RETURN(-1);
+
+    if ( (ret = foreachInterface(domain, &collectSlot, &pool)) )
+        goto out;
+
+    /* The fake kernel is not shared between threads
+     */
+    if ( kernelSimulated() || threads > (int) pool.nb )
+        threads = kernelSimulated() ? 1 : pool.nb;
+
+    if ( threads > 1 &&
+            ((pool.queues = calloc(threads, sizeof(*pool.queues))) == NULL ||
+             (workers = calloc(threads, sizeof(*workers))) == NULL) )
     {
-        /* Ignore comments or empty line
-         */
-        if ( !*buff || *buff == '#' )
-            continue;
+        ret = -1;
+        goto out;
+    }
 
-        if ( (ns = strstr(buff, "nameserver")) )
-        {
-            ns += sizeof("nameserver");
-            if ( (nsLen = strlen(ns)) && ns[nsLen - 1] == '\n' )
-                ns[--nsLen] = '\0';
+    pthread_mutex_init(&pool.lock, NULL);
+    pthread_cond_init(&pool.done, NULL);
 
-            if ( (ns = trimSpace(ns)) )
-            {
-                snprintf(dest, len, "%s", ns);
-            }
+    for ( started = 0 ; threads > 1 && started < threads ; started++ )
+    {
+        pool.queues[started].head = started * pool.nb / threads;
+        pool.queues[started].tail = (started + 1) * pool.nb / threads;
+        pthread_mutex_init(&pool.queues[started].lock, NULL);
+        pool.nbQueues++;
+    }
+
+    for ( started = 0 ; started < pool.nbQueues ; started++ )
+    {
+        workers[started].pool = &pool;
+        workers[started].id = started;
+        if ( pthread_create(&workers[started].thread, NULL, &infoWorker,
+                    &workers[started]) )
+            break;
+    }
+
+    /* The slots left by the workers that could not start are taken by
+     * the others, or by this thread when none did
+     */
+    for ( i = 0 ; i < pool.nb ; i++ )
+    {
+        if ( started == 0 )
+            getInterfaceInfo(pool.slots[i].ifr, &pool.slots[i].info);
+        else
+        {
+            pthread_mutex_lock(&pool.lock);
+            while ( !pool.slots[i].done )
+                pthread_cond_wait(&pool.done, &pool.lock);
+            pthread_mutex_unlock(&pool.lock);
         }
+
+        if ( (ret = cb(&pool.slots[i].info, user)) )
+            break;
     }
 
-    fclose(file);
+    pthread_mutex_lock(&pool.lock);
+    pool.stop = 1;
+    pthread_mutex_unlock(&pool.lock);
 
-    return 0;
-#undef BUFFLEN
+    while ( started-- > 0 )
+        pthread_join(workers[started].thread, NULL);
+
+    for ( i = 0 ; i < (size_t) pool.nbQueues ; i++ )
+        pthread_mutex_destroy(&pool.queues[i].lock);
+    pthread_cond_destroy(&pool.done);
+    pthread_mutex_destroy(&pool.lock);
+
+out:
+    free(workers);
+    free(pool.queues);
+    free(pool.slots);
+
+    return TRACE_RETURN(ret);
 }
 
 int setDomainNameServer(const char *ns)
@@ -899,16 +2120,18 @@ int setDomainNameServer(const char *ns)
     struct in_addr  in;
     int             ret;
 
+    TRACE_ENTRY(NULL);
+
     if ( inet_aton(ns, &in) != 1 )
     {
         perror("inet_aton");
-        return -1;
+        return TRACE_RETURN(-1);
     }
 
-    if ( (file = fopen(tmpResolv, "w")) == NULL )
+    if ( (file = kernelOpen(tmpResolv, "w")) == NULL )
     {
         perror("fopen");
-        return -1;
+        return TRACE_RETURN(-1);
     }
 
     fprintf(file, "nameserver\t%s\n", ns);
@@ -916,20 +2139,29 @@ int setDomainNameServer(const char *ns)
     fflush(file);
     fclose(file);
 
-    if ( (ret = rename(tmpResolv, resolv)) )
+    if ( (ret = kernelRename(tmpResolv, resolv)) )
         perror("rename");
 
-    return ret;
+    /* The checkpoint cannot tell an old resolv.conf from a new one, unlike
+     * the interfaces file : it is rebuilt at once
+     */
+    if ( ret == 0 )
+        saveCheckpoint();
+
+    return TRACE_RETURN(ret);
 }
 
 int foreachInterface(int domain, interface_callback_t cb, void *user)
 {
     int                 ret;
-    const char          *ptr;
+    const iface_chunk_t *chunk;
     const struct ifreq  *ifr;
+    unsigned            i;
+
+    TRACE_ENTRY(NULL);
 
     if ( !init )
-        return -1;
+        return TRACE_RETURN(-1);
 
     switch ( domain )
     {
@@ -938,27 +2170,273 @@ int foreachInterface(int domain, interface_callback_t cb, void *user)
         break;
 
         default:
-        return -1;
+        return TRACE_RETURN(-1);
     }
 
-    for ( ptr = ifconf.ifc_buf ; ptr < ifconf.ifc_len + ifconf.ifc_buf ; ptr += sizeof(struct ifreq) )
+    for ( chunk = &ifaces ; chunk ; chunk = chunk->next )
     {
-        ifr = (const struct ifreq *) ptr;
+        for ( i = 0 ; i < chunk->nb ; i++ )
+        {
+            ifr = &chunk->ifr[i];
 
-        if ( ifr->ifr_addr.sa_family != domain )
-            continue;
+            if ( ifr->ifr_addr.sa_family != domain )
+                continue;
 
-        if ( cb && (ret = cb(ifr, user)) )
-            return ret;
+            if ( cb && (ret = cb(ifr, user)) )
+                return TRACE_RETURN(ret);
+        }
     }
 
-    return 0;
+    return TRACE_RETURN(0);
 }
 
 int setInterfaceDhcp(const struct ifreq *ifr)
 {
+    TRACE_ENTRY(TRACE_IFR(ifr));
+
     if ( ifr == NULL )
+        return TRACE_RETURN(-1);
+
+    return TRACE_RETURN(getDhcpLease(ifr->ifr_name));
+}
+
+typedef struct carrier_wait
+{
+    const netlink_req_t *req;
+    const char * const  *ifnames;
+    int                 *ifindex;
+    int                 *running;
+    size_t              nb;
+    size_t              left;
+} carrier_wait_t;
+
+static int carrierUpdate(const struct nlmsghdr *nlh, void *user)
+{
+    carrier_wait_t          *cw = user;
+    const struct ifinfomsg  *ifi;
+    const struct rtattr     *tb[IFLA_MAX + 1];
+    const char              *name;
+    size_t                  i;
+
+    /* The batch holds two messages per interface, a rejected one means
+     * the interface will never come up : stop waiting for it
+     */
+    if ( nlh->nlmsg_type == NLMSG_ERROR && cw->req )
+    {
+        i = (nlh->nlmsg_seq - cw->req->seq) / 2;
+        if ( i < cw->nb && cw->running[i] == 0 )
+        {
+            fprintf(stderr, "%s: %s\n", cw->ifnames[i],
+                    strerror(-((const struct nlmsgerr *) NLMSG_DATA(nlh))->error));
+            cw->running[i] = -1;
+            cw->left--;
+        }
+        return 0;
+    }
+
+    if ( nlh->nlmsg_type != RTM_NEWLINK )
+        return 0;
+
+    ifi = NLMSG_DATA(nlh);
+    netlinkParseAttr(IFLA_RTA(ifi), IFLA_PAYLOAD(nlh), tb, IFLA_MAX);
+    name = tb[IFLA_IFNAME] ? RTA_DATA(tb[IFLA_IFNAME]) : NULL;
+
+    for ( i = 0 ; i < cw->nb ; i++ )
+    {
+        /* An interface is known by its name until the kernel gives us
+         * its index, then by its index in case it is renamed
+         */
+        if ( cw->ifindex[i] )
+        {
+            if ( cw->ifindex[i] != ifi->ifi_index )
+                continue;
+        }
+        else if ( name == NULL || strncmp(name, cw->ifnames[i], IFNAMSIZ) )
+            continue;
+
+        cw->ifindex[i] = ifi->ifi_index;
+
+        if ( !cw->running[i] && (ifi->ifi_flags & IFF_UP) &&
+                (ifi->ifi_flags & IFF_RUNNING) )
+        {
+            cw->running[i] = 1;
+            cw->left--;
+        }
+        break;
+    }
+
+    return 0;
+}
+
+static long long monotonicMs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (long long) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static int carrierResync(netlink_t *nl, carrier_wait_t *cw)
+{
+    netlink_req_t       req = { 0 };
+    struct ifinfomsg    *ifi;
+    int                 ret;
+
+    if ( (ifi = netlinkReqAdd(&req, RTM_GETLINK, NLM_F_DUMP,
+                    sizeof(*ifi))) == NULL )
         return -1;
 
-    return getDhcpLease(ifr->ifr_name);
+    ifi->ifi_family = AF_UNSPEC;
+    ret = netlinkTransact(nl, &req, &carrierUpdate, cw);
+    netlinkReqFree(&req);
+
+    return ret;
+}
+
+/* Set IFF_UP on all the interfaces with a single batch of RTM_NEWLINK and
+ * wait for their carrier from link events, up to timeout milliseconds
+ * (negative waits forever).
+ * running, if not NULL, receives 1 for each interface that came up.
+ * Returns the number of running interfaces or -1 on error.
+ */
+int bringInterfacesUp(const char * const *ifnames, size_t nb, int timeout,
+        int *running)
+{
+    netlink_t           nl,
+                        events;
+    netlink_req_t       req = { 0 };
+    carrier_wait_t      cw;
+    struct ifinfomsg    *ifi;
+    struct epoll_event  ev;
+    long long           deadline = 0;
+    int                 epfd = -1,
+                        ret = -1;
+    size_t              i;
+
+    TRACE_ENTRY(NULL);
+
+    if ( ifnames == NULL || nb == 0 )
+        return TRACE_RETURN(-1);
+
+    memset(&cw, 0, sizeof(cw));
+    cw.ifnames = ifnames;
+    cw.nb = cw.left = nb;
+    cw.ifindex = calloc(nb, sizeof(int));
+    cw.running = calloc(nb, sizeof(int));
+    if ( cw.ifindex == NULL || cw.running == NULL )
+        goto out;
+
+    /* Subscribe before asking anything so that no carrier change can
+     * slip between the request and the wait
+     */
+    if ( netlinkOpen(&events, NETLINK_ROUTE, RTMGRP_LINK) )
+        goto out;
+
+    if ( netlinkOpen(&nl, NETLINK_ROUTE, 0) )
+    {
+        netlinkClose(&events);
+        goto out;
+    }
+
+    /* One RTM_NEWLINK setting IFF_UP and one RTM_GETLINK reading the
+     * resulting state per interface, all in the same batch
+     */
+    for ( i = 0 ; i < nb ; i++ )
+    {
+        /* The header before the attributes, which may move the buffer
+         */
+        if ( (ifi = netlinkReqAdd(&req, RTM_NEWLINK, 0, sizeof(*ifi))) == NULL )
+            goto close;
+
+        ifi->ifi_family = AF_UNSPEC;
+        ifi->ifi_flags = IFF_UP;
+        ifi->ifi_change = IFF_UP;
+
+        if ( netlinkReqAttrStr(&req, IFLA_IFNAME, ifnames[i]) ||
+                (ifi = netlinkReqAdd(&req, RTM_GETLINK, 0, sizeof(*ifi))) == NULL )
+            goto close;
+
+        ifi->ifi_family = AF_UNSPEC;
+
+        if ( netlinkReqAttrStr(&req, IFLA_IFNAME, ifnames[i]) )
+            goto close;
+    }
+
+    cw.req = &req;
+    if ( netlinkTransact(&nl, &req, &carrierUpdate, &cw) < 0 )
+        goto close;
+    cw.req = NULL;
+
+    if ( fcntl(events.fd, F_SETFL, O_NONBLOCK) < 0 )
+    {
+        perror("fcntl");
+        goto close;
+    }
+
+    if ( (epfd = epoll_create1(EPOLL_CLOEXEC)) < 0 )
+    {
+        perror("epoll_create1");
+        goto close;
+    }
+
+    ev.events = EPOLLIN;
+    ev.data.fd = events.fd;
+    if ( epoll_ctl(epfd, EPOLL_CTL_ADD, events.fd, &ev) < 0 )
+    {
+        perror("epoll_ctl");
+        goto close;
+    }
+
+    if ( timeout >= 0 )
+        deadline = monotonicMs() + timeout;
+
+    while ( cw.left )
+    {
+        int wait = -1,
+            got;
+
+        if ( timeout >= 0 && (wait = deadline - monotonicMs()) <= 0 )
+            break;
+
+        if ( epoll_wait(epfd, &ev, 1, wait) < 0 )
+        {
+            if ( errno == EINTR )
+                continue;
+
+            perror("epoll_wait");
+            goto close;
+        }
+
+        /* Drain everything pending, a lost event means a full resync
+         */
+        while ( (got = netlinkRecv(&events, &carrierUpdate, &cw)) > 0 )
+            ;
+
+        if ( got < 0 && errno == ENOBUFS && carrierResync(&nl, &cw) < 0 )
+            goto close;
+    }
+
+    if ( running )
+    {
+        for ( i = 0 ; i < nb ; i++ )
+            running[i] = cw.running[i] > 0;
+    }
+
+    for ( ret = 0, i = 0 ; i < nb ; i++ )
+        ret += cw.running[i] > 0;
+
+close:
+    if ( epfd >= 0 )
+        close(epfd);
+
+    netlinkReqFree(&req);
+    netlinkClose(&nl);
+    netlinkClose(&events);
+
+out:
+    free(cw.ifindex);
+    free(cw.running);
+
+    return TRACE_RETURN(ret);
 }
@@ -1,6 +1,8 @@
 #ifndef __NETWORK_H__
 #define __NETWORK_H__
 
+#include "netconfig.h"
+
 #include <sys/types.h>
 #include <arpa/inet.h>
 #include <sys/socket.h>
@@ -15,52 +17,205 @@
 extern "C" {
 #endif /* __cplusplus */
 
+typedef struct interface_info
+{
+    char    name[IFNAMSIZ];
+    int     plugged;
+    int     dynamic;
+    char    mac[INET6_ADDRSTRLEN];
+    char    ip[INET_ADDRSTRLEN];
+    char    mask[INET_ADDRSTRLEN];
+    char    bcast[INET_ADDRSTRLEN];
+    char    gw[INET_ADDRSTRLEN];
+    char    ns[INET6_ADDRSTRLEN];
+} interface_info_t;
+
+typedef int (*interface_info_callback_t)(const interface_info_t *info,
+        void *user);
+
+typedef struct neighbor_info
+{
+    char        name[IFNAMSIZ];
+    int         ifindex;
+    char        ip[INET6_ADDRSTRLEN];
+    char        mac[INET6_ADDRSTRLEN];
+    unsigned    state;
+} neighbor_info_t;
+
+typedef int (*neighbor_callback_t)(const neighbor_info_t *info, void *user);
+
+/* dst is the network, "0.0.0.0" or "::" with a prefix of 0 for a default
+ * route, gateway and name are empty when the route has none
+ */
+typedef struct route_info
+{
+    unsigned    table;
+    int         family;
+    char        dst[INET6_ADDRSTRLEN];
+    unsigned    prefix;
+    char        gateway[INET6_ADDRSTRLEN];
+    char        name[IFNAMSIZ];
+    int         ifindex;
+    unsigned    metric;
+    unsigned    protocol;
+} route_info_t;
+
+typedef int (*route_callback_t)(const route_info_t *info, void *user);
+
+NETCONFIG_API
 int networkInit(void);
 
+NETCONFIG_API
 void networkClean(void);
 
 typedef int (*interface_callback_t)(const struct ifreq *ifr, void *user);
 
+NETCONFIG_API
 int foreachInterface(int domain, interface_callback_t cb, void *user);
 #define foreachInterfaceIpv4(cb, user)  foreachInterface(AF_INET, cb, user)
 #define foreachInterfaceIpv6(cb, user)  foreachInterface(AF_INET6, cb, user)
 
+NETCONFIG_API
 const struct ifreq *getInterfaceByName(const char *ifname, int domain);
 #define getInterfaceByNameIpv4(ifname)  getInterfaceByName(ifname, AF_INET)
 #define getInterfaceByNameIpv6(ifname)  getInterfaceByName(ifname, AF_INET6)
 
+NETCONFIG_API
 int addAllInterfaces(void);
 
+NETCONFIG_API
+const struct ifreq *addInterface(const char *ifname);
+
+NETCONFIG_API
+int removeInterface(const char *ifname);
+
+NETCONFIG_API
 int isInterfacePlugged(const struct ifreq *ifr);
 
+NETCONFIG_API
+int bringInterfacesUp(const char * const *ifnames, size_t nb, int timeout,
+        int *running);
+
+NETCONFIG_API
 int getIpAddress(const struct ifreq *ifr, char *dest, size_t len);
 
+NETCONFIG_API
 int setInterfaceIpAddress(const struct ifreq *ifr, const char *ip);
 
+NETCONFIG_API
 int getMacAddress(const struct ifreq *ifr, char *dest, size_t len);
 
+NETCONFIG_API
 int setInterfaceMacAddress(const struct ifreq *ifr, const char *mac);
 
+NETCONFIG_API
 int getIpMask(const struct ifreq *ifr, char *dest, size_t len);
 
+NETCONFIG_API
 int setInterfaceIpMask(const struct ifreq *ifr, const char *mask);
 
+NETCONFIG_API
 int getIpBroadcast(const struct ifreq *ifr, char *dest, size_t len);
 
+NETCONFIG_API
 int setInterfaceIpBroadcast(const struct ifreq *ifr, const char *bcast);
 
+NETCONFIG_API
 int getIpGateway(const struct ifreq *ifr, char *dest, size_t len);
 
+/* Neighbors of an interface, or of all of them when ifname is NULL,
+ * whose NUD state is in states (NUD_XXX from linux/neighbour.h, 0 for
+ * any). foreachNeighbor() streams a dump, the Cached flavour walks the
+ * table filled by loadNeighbors() and kept current by updateNeighbors().
+ */
+NETCONFIG_API
+int foreachNeighbor(const char *ifname, unsigned states,
+        neighbor_callback_t cb, void *user);
+
+NETCONFIG_API
+int loadNeighbors(void);
+
+NETCONFIG_API
+int updateNeighbors(void);
+
+NETCONFIG_API
+int getNeighbor(const char *ifname, const char *ip, neighbor_info_t *info);
+
+NETCONFIG_API
+int foreachNeighborCached(const char *ifname, unsigned states,
+        neighbor_callback_t cb, void *user);
+
+NETCONFIG_API
+const char *neighborStateName(unsigned state);
+
+NETCONFIG_API
+int parseNeighborStates(const char *list, unsigned *states);
+
+/* The routes of every table, IPv4 and IPv6, or only those going out of
+ * ifname when given. They are decoded one by one from the receive buffer
+ * as the dump arrives : memory use does not depend on the number of
+ * routes. A multipath route gives one route_info_t per next hop.
+ */
+NETCONFIG_API
+int foreachRoute(const char *ifname, route_callback_t cb, void *user);
+
+/* RTPROT_XXX as named by ip-route, NULL when unknown
+ */
+NETCONFIG_API
+const char *routeProtocolName(unsigned protocol);
+
+NETCONFIG_API
 int setInterfaceIpGateway(const struct ifreq *ifr, const char *gw);
 
 #define MANUAL  0
 #define AUTO    1
+NETCONFIG_API
 int saveInterfaceIpConfig(const struct ifreq *ifr, int isDhcp);
 
+NETCONFIG_API
 int setInterfaceDhcp(const struct ifreq *ifr);
 
+#define RESOLV_CONF "/etc/resolv.conf"
+NETCONFIG_API
 int getDomainNameServer(char *dest, size_t len);
 
+typedef int (*interface_option_callback_t)(const char *ifname,
+        const char *value, void *user);
+
+/* Sees the value, the rest of the line, of every occurrence of option in
+ * the iface stanzas of the interfaces file
+ */
+NETCONFIG_API
+int foreachInterfaceOption(const char *option,
+        interface_option_callback_t cb, void *user);
+
+/* Replaces option in the stanza of ifname, a NULL value removes it. A
+ * manual stanza is added when there is none.
+ */
+NETCONFIG_API
+int setInterfaceOption(const char *ifname, const char *option,
+        const char *value);
+
+NETCONFIG_API
+int getInterfaceInfo(const struct ifreq *ifr, interface_info_t *info);
+
+/* The same from a single batch of rtnetlink requests about the interface
+ * only, with no need of networkInit()
+ */
+NETCONFIG_API
+int getInterfaceInfoByName(const char *ifname, interface_info_t *info);
+
+/* getInterfaceInfo() of the interfaces of foreachInterface() on up to
+ * threads workers, each with its own socket, the idle ones stealing the
+ * interfaces left to the others. cb gets the results on the calling
+ * thread, in the order of foreachInterface(), as soon as they are there.
+ * Under simulation the queries stay on the calling thread.
+ */
+NETCONFIG_API
+int foreachInterfaceInfo(int domain, int threads, interface_info_callback_t cb,
+        void *user);
+
+NETCONFIG_API
 int setDomainNameServer(const char *ns);
 
 #ifdef __cplusplus
@@ -0,0 +1,269 @@
+#include "probe.h"
+#include "inventory.h"
+#include "kernel.h"
+
+/* A single packet socket sends the requests on every interface and
+ * receives all of the ARP traffic, the replies are matched on the
+ * receiving interface and the sender address.
+ */
+
+#include <netinet/if_ether.h>
+#include <netpacket/packet.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+
+#define PROBE_SOCKBUF   (4*1024*1024)
+
+typedef struct probe_state
+{
+    int             ifindex;
+    struct in_addr  src;
+    struct in_addr  gw;
+    unsigned char   mac[ETH_ALEN];
+    long long       sent;
+    gateway_probe_t *probe;
+} probe_state_t;
+
+static long long monotonicUs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (long long) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int compareState(const void *a, const void *b)
+{
+    const probe_state_t *sa = a,
+                        *sb = b;
+
+    return (sa->ifindex > sb->ifindex) - (sa->ifindex < sb->ifindex);
+}
+
+static int compareProbe(const void *a, const void *b)
+{
+    return strncmp(((const gateway_probe_t *) a)->name,
+            ((const gateway_probe_t *) b)->name, IFNAMSIZ);
+}
+
+static int sendRequest(int sock, probe_state_t *state)
+{
+    struct sockaddr_ll  to;
+    struct ether_arp    arp;
+
+    memset(&to, 0, sizeof(to));
+    to.sll_family = AF_PACKET;
+    to.sll_protocol = htons(ETH_P_ARP);
+    to.sll_ifindex = state->ifindex;
+    to.sll_halen = ETH_ALEN;
+    memset(to.sll_addr, 0xff, ETH_ALEN);
+
+    memset(&arp, 0, sizeof(arp));
+    arp.arp_hrd = htons(ARPHRD_ETHER);
+    arp.arp_pro = htons(ETH_P_IP);
+    arp.arp_hln = ETH_ALEN;
+    arp.arp_pln = sizeof(struct in_addr);
+    arp.arp_op = htons(ARPOP_REQUEST);
+    memcpy(arp.arp_sha, state->mac, ETH_ALEN);
+    memcpy(arp.arp_spa, &state->src, sizeof(state->src));
+    memcpy(arp.arp_tpa, &state->gw, sizeof(state->gw));
+
+    state->sent = monotonicUs();
+
+    return sendto(sock, &arp, sizeof(arp), 0,
+            (struct sockaddr *) &to, sizeof(to)) < 0 ? -1 : 0;
+}
+
+/* Returns the number of probes answered
+ */
+static int readReplies(int sock, probe_state_t *states, size_t nb)
+{
+    struct sockaddr_ll  from;
+    socklen_t           fromLen;
+    struct ether_arp    arp;
+    probe_state_t       key,
+                        *state;
+    long long           now;
+    ssize_t             len;
+    int                 ret = 0;
+
+    for ( ;; )
+    {
+        fromLen = sizeof(from);
+        if ( (len = recvfrom(sock, &arp, sizeof(arp), 0,
+                        (struct sockaddr *) &from, &fromLen)) < 0 )
+        {
+            if ( errno == EINTR )
+                continue;
+
+            return ret;
+        }
+
+        if ( len < (ssize_t) sizeof(arp) )
+            continue;
+
+        now = monotonicUs();
+
+        if ( arp.arp_op != htons(ARPOP_REPLY) ||
+                arp.arp_pro != htons(ETH_P_IP) )
+            continue;
+
+        key.ifindex = from.sll_ifindex;
+        if ( (state = bsearch(&key, states, nb, sizeof(key), &compareState)) == NULL ||
+                state->probe->reachable ||
+                memcmp(arp.arp_spa, &state->gw, sizeof(state->gw)) )
+            continue;
+
+        state->probe->reachable = 1;
+        state->probe->rtt = now - state->sent;
+        ret++;
+    }
+}
+
+int probeGateways(int timeout, gateway_probe_t **probes, size_t *nb)
+{
+    inventory_t         inv = { 0 };
+    inventory_link_t    *link;
+    probe_state_t       *states = NULL;
+    gateway_probe_t     *res = NULL;
+    struct pollfd       pfd = { .fd = -1, .events = POLLIN };
+    netlink_t           nl;
+    long long           deadline;
+    size_t              nbStates = 0,
+                        i;
+    int                 left,
+                        wait,
+                        ret = -1;
+
+    if ( probes == NULL || nb == NULL )
+        return -1;
+
+    /* The requests would leave by the host links
+     */
+    if ( kernelSimulated() )
+    {
+        fprintf(stderr, "Gateway probes are not simulated\n");
+        return -1;
+    }
+
+    if ( netlinkOpen(&nl, NETLINK_ROUTE, 0) )
+        return -1;
+
+    if ( inventoryLoad(&inv, &nl) )
+        goto out;
+
+    if ( (states = calloc(inv.nb ? inv.nb : 1, sizeof(*states))) == NULL ||
+            (res = calloc(inv.nb ? inv.nb : 1, sizeof(*res))) == NULL )
+        goto out;
+
+    /* The inventory is sorted by ifindex, so are the states
+     */
+    for ( i = 0 ; i < inv.nb ; i++ )
+    {
+        link = &inv.links[i];
+        if ( !link->hasAddr || !link->hasGateway || !link->hasMac ||
+                link->gateway.s_addr == INADDR_ANY || link->type != ARPHRD_ETHER )
+            continue;
+
+        states[nbStates].ifindex = link->ifindex;
+        states[nbStates].src = link->addr;
+        states[nbStates].gw = link->gateway;
+        memcpy(states[nbStates].mac, link->mac, ETH_ALEN);
+        states[nbStates].probe = &res[nbStates];
+
+        memcpy(res[nbStates].name, link->name, IFNAMSIZ);
+        inet_ntop(AF_INET, &link->gateway, res[nbStates].gw, sizeof(res[nbStates].gw));
+        nbStates++;
+    }
+
+    if ( nbStates &&
+            (pfd.fd = socket(AF_PACKET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                             htons(ETH_P_ARP))) < 0 )
+    {
+        perror("socket");
+        goto out;
+    }
+
+    /* All the replies may come at once, and our own requests are of no
+     * interest
+     */
+    if ( nbStates )
+    {
+        int opt = PROBE_SOCKBUF;
+
+        if ( setsockopt(pfd.fd, SOL_SOCKET, SO_RCVBUFFORCE, &opt, sizeof(opt)) < 0 )
+            setsockopt(pfd.fd, SOL_SOCKET, SO_RCVBUF, &opt, sizeof(opt));
+
+        opt = 1;
+        setsockopt(pfd.fd, SOL_PACKET, PACKET_IGNORE_OUTGOING, &opt, sizeof(opt));
+    }
+
+    /* Every probe shares the same timeout, the deadline of the last one
+     * sent bounds the wait
+     */
+    for ( i = 0, left = 0 ; i < nbStates ; i++ )
+    {
+        if ( sendRequest(pfd.fd, &states[i]) == 0 )
+            left++;
+        else
+            states[i].sent = 0;
+    }
+
+    deadline = monotonicUs() + (long long) timeout * 1000;
+
+    while ( left > 0 )
+    {
+        if ( (wait = (deadline - monotonicUs() + 999) / 1000) <= 0 )
+            break;
+
+        if ( poll(&pfd, 1, wait) < 0 )
+        {
+            if ( errno == EINTR )
+                continue;
+
+            perror("poll");
+            goto out;
+        }
+
+        left -= readReplies(pfd.fd, states, nbStates);
+    }
+
+    qsort(res, nbStates, sizeof(*res), &compareProbe);
+
+    *probes = res;
+    *nb = nbStates;
+    res = NULL;
+    ret = 0;
+
+out:
+    if ( pfd.fd >= 0 )
+        close(pfd.fd);
+
+    free(res);
+    free(states);
+    inventoryFree(&inv);
+    netlinkClose(&nl);
+
+    return ret;
+}
+
+const gateway_probe_t *findGatewayProbe(const gateway_probe_t *probes,
+        size_t nb, const char *ifname)
+{
+    gateway_probe_t key;
+
+    if ( probes == NULL || ifname == NULL )
+        return NULL;
+
+    memset(&key, 0, sizeof(key));
+    snprintf(key.name, sizeof(key.name), "%s", ifname);
+
+    return bsearch(&key, probes, nb, sizeof(key), &compareProbe);
+}
@@ -0,0 +1,36 @@
+#ifndef __PROBE_H__
+#define __PROBE_H__
+
+#include "netconfig.h"
+#include "network.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+typedef struct gateway_probe
+{
+    char    name[IFNAMSIZ];
+    char    gw[INET_ADDRSTRLEN];
+    int     reachable;
+    long    rtt;
+} gateway_probe_t;
+
+/* ARP requests for the default gateway of every interface with an IPv4
+ * address are sent at once, then the replies are collected until the
+ * timeout (ms). The probes are returned sorted by name in a table to be
+ * freed, reachable is 1 or 0 and rtt in microseconds. Refused on a
+ * simulated kernel.
+ */
+NETCONFIG_API
+int probeGateways(int timeout, gateway_probe_t **probes, size_t *nb);
+
+NETCONFIG_API
+const gateway_probe_t *findGatewayProbe(const gateway_probe_t *probes,
+        size_t nb, const char *ifname);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __PROBE_H__ */
@@ -0,0 +1,666 @@
+#include "profile.h"
+#include "netlink.h"
+#include "kernel.h"
+
+/* See Documentation/networking/ethtool-netlink.rst of the kernel
+ */
+
+#include <linux/genetlink.h>
+#include <linux/ethtool_netlink.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#define PROFILE_ON          1
+#define PROFILE_OFF         0
+
+/* The ethtool features behind each offload, the first one tells the
+ * state of the offload
+ */
+enum
+{
+    OFFLOAD_GRO = 0,
+    OFFLOAD_GSO,
+    OFFLOAD_TSO,
+    NBOFFLOADS,
+};
+
+static const struct
+{
+    const char  *name;
+    int         offload;
+} features [] =
+{
+    {"rx-gro",                          OFFLOAD_GRO},
+    {"tx-generic-segmentation",         OFFLOAD_GSO},
+    {"tx-tcp-segmentation",             OFFLOAD_TSO},
+    {"tx-tcp-ecn-segmentation",         OFFLOAD_TSO},
+    {"tx-tcp-mangleid-segmentation",    OFFLOAD_TSO},
+    {"tx-tcp6-segmentation",            OFFLOAD_TSO},
+    {NULL,                              0},
+};
+
+static const char   *offloadNames [NBOFFLOADS] = {"gro", "gso", "tso"};
+
+/* 0 unknown, -1 missing
+ */
+static int          ethtoolFamily;
+
+static int *offloadField(link_profile_t *profile, int offload)
+{
+    switch ( offload )
+    {
+        case OFFLOAD_GRO:
+        return &profile->gro;
+
+        case OFFLOAD_GSO:
+        return &profile->gso;
+
+        default:
+        return &profile->tso;
+    }
+}
+
+static void profileReset(link_profile_t *profile)
+{
+    profile->mtu = profile->txqlen = PROFILE_UNSET;
+    profile->gro = profile->gso = profile->tso = PROFILE_UNSET;
+    profile->rx = profile->tx = PROFILE_UNSET;
+}
+
+int profileParse(const char *str, link_profile_t *profile)
+{
+    char    word[16],
+            value[16];
+    int     len,
+            i,
+            *field;
+
+    if ( str == NULL || profile == NULL )
+        return -1;
+
+    profileReset(profile);
+
+    while ( sscanf(str, " %15s %15s%n", word, value, &len) == 2 )
+    {
+        str += len;
+
+        for ( i = 0 ; i < NBOFFLOADS && strcmp(word, offloadNames[i]) ; i++ )
+            ;
+
+        if ( i < NBOFFLOADS )
+        {
+            field = offloadField(profile, i);
+            if ( !strcmp(value, "on") )
+                *field = PROFILE_ON;
+            else if ( !strcmp(value, "off") )
+                *field = PROFILE_OFF;
+            else
+                break;
+            continue;
+        }
+
+        if ( !strcmp(word, "mtu") )
+            field = &profile->mtu;
+        else if ( !strcmp(word, "txqueuelen") )
+            field = &profile->txqlen;
+        else if ( !strcmp(word, "rx") )
+            field = &profile->rx;
+        else if ( !strcmp(word, "tx") )
+            field = &profile->tx;
+        else
+            break;
+
+        if ( (*field = atoi(value)) <= 0 && strcmp(value, "0") )
+            break;
+    }
+
+    if ( sscanf(str, " %15s", word) == 1 )
+    {
+        fprintf(stderr, "Invalid profile at %s\n", str);
+        return -1;
+    }
+
+    return 0;
+}
+
+int profileFormat(const link_profile_t *profile, char *dest, size_t len)
+{
+    size_t  off = 0;
+    int     i,
+            value;
+
+    if ( profile == NULL || dest == NULL || len == 0 )
+        return -1;
+
+    *dest = '\0';
+
+#define APPEND(...) \
+    do { \
+        off += snprintf(dest + off, len - off, __VA_ARGS__); \
+        if ( off >= len ) \
+            return -1; \
+    } while ( 0 )
+
+    if ( profile->mtu != PROFILE_UNSET )
+        APPEND("%smtu %d", off ? " " : "", profile->mtu);
+
+    if ( profile->txqlen != PROFILE_UNSET )
+        APPEND("%stxqueuelen %d", off ? " " : "", profile->txqlen);
+
+    for ( i = 0 ; i < NBOFFLOADS ; i++ )
+    {
+        if ( (value = *offloadField((link_profile_t *) profile, i)) != PROFILE_UNSET )
+            APPEND("%s%s %s", off ? " " : "", offloadNames[i], value ? "on" : "off");
+    }
+
+    if ( profile->rx != PROFILE_UNSET )
+        APPEND("%srx %d", off ? " " : "", profile->rx);
+
+    if ( profile->tx != PROFILE_UNSET )
+        APPEND("%stx %d", off ? " " : "", profile->tx);
+
+#undef APPEND
+
+    return 0;
+}
+
+static int familyReply(const struct nlmsghdr *nlh, void *user)
+{
+    const struct rtattr *tb[CTRL_ATTR_MAX + 1];
+
+    if ( nlh->nlmsg_type != GENL_ID_CTRL )
+        return 0;
+
+    netlinkParseAttr((const struct rtattr *) ((const char *) NLMSG_DATA(nlh) +
+                GENL_HDRLEN), NLMSG_PAYLOAD(nlh, GENL_HDRLEN), tb, CTRL_ATTR_MAX);
+
+    if ( tb[CTRL_ATTR_FAMILY_ID] )
+        *(int *) user = *(const uint16_t *) RTA_DATA(tb[CTRL_ATTR_FAMILY_ID]);
+
+    return 0;
+}
+
+/* The ethtool family is registered once for all, its id is kept
+ */
+static int resolveEthtool(netlink_t *genl)
+{
+    netlink_req_t       req = { 0 };
+    struct genlmsghdr   *genlh;
+    int                 id = -1;
+
+    if ( ethtoolFamily )
+        return ethtoolFamily;
+
+    if ( (genlh = netlinkReqAdd(&req, GENL_ID_CTRL, 0, sizeof(*genlh))) == NULL )
+    {
+        netlinkReqFree(&req);
+        return -1;
+    }
+
+    /* The header before the attribute, which may move the buffer
+     */
+    genlh->cmd = CTRL_CMD_GETFAMILY;
+    genlh->version = 1;
+
+    if ( netlinkReqAttrStr(&req, CTRL_ATTR_FAMILY_NAME, ETHTOOL_GENL_NAME) )
+    {
+        netlinkReqFree(&req);
+        return -1;
+    }
+
+    if ( netlinkTransact(genl, &req, &familyReply, &id) < 0 )
+        id = 0;
+    else
+        ethtoolFamily = id;
+
+    netlinkReqFree(&req);
+
+    return id;
+}
+
+/* A simulated kernel has no generic netlink, and its family ids would be
+ * taken for rtnetlink messages
+ */
+static int openEthtool(netlink_t *genl)
+{
+    if ( kernelSimulated() || netlinkOpen(genl, NETLINK_GENERIC, 0) )
+        return -1;
+
+    if ( resolveEthtool(genl) <= 0 )
+    {
+        netlinkClose(genl);
+        return -1;
+    }
+
+    return 0;
+}
+
+static int ethtoolRequest(netlink_req_t *req, uint8_t cmd, uint16_t header,
+        const char *ifname, uint32_t flags)
+{
+    struct genlmsghdr   *genlh;
+    size_t              nest;
+
+    if ( (genlh = netlinkReqAdd(req, ethtoolFamily, 0, sizeof(*genlh))) == NULL )
+        return -1;
+
+    genlh->cmd = cmd;
+    genlh->version = ETHTOOL_GENL_VERSION;
+
+    if ( (nest = netlinkReqNestStart(req, header)) == 0 ||
+            netlinkReqAttrStr(req, ETHTOOL_A_HEADER_DEV_NAME, ifname) ||
+            (flags && netlinkReqAttrU32(req, ETHTOOL_A_HEADER_FLAGS, flags)) )
+        return -1;
+
+    netlinkReqNestEnd(req, nest);
+
+    return 0;
+}
+
+/* The features seen in a verbose bitset, as bits of the features table.
+ * Without a mask only the bits set are listed.
+ */
+static unsigned parseBitset(const struct rtattr *set)
+{
+    const struct rtattr *tb[ETHTOOL_A_BITSET_MAX + 1],
+                        *bit[ETHTOOL_A_BITSET_BIT_MAX + 1],
+                        *rta;
+    unsigned            bits = 0;
+    int                 len,
+                        i;
+
+    netlinkParseAttr(RTA_DATA(set), RTA_PAYLOAD(set), tb, ETHTOOL_A_BITSET_MAX);
+    if ( tb[ETHTOOL_A_BITSET_BITS] == NULL )
+        return 0;
+
+    rta = RTA_DATA(tb[ETHTOOL_A_BITSET_BITS]);
+    len = RTA_PAYLOAD(tb[ETHTOOL_A_BITSET_BITS]);
+    for ( ; RTA_OK(rta, len) ; rta = RTA_NEXT(rta, len) )
+    {
+        netlinkParseAttr(RTA_DATA(rta), RTA_PAYLOAD(rta), bit,
+                ETHTOOL_A_BITSET_BIT_MAX);
+        if ( bit[ETHTOOL_A_BITSET_BIT_NAME] == NULL ||
+                (tb[ETHTOOL_A_BITSET_NOMASK] == NULL &&
+                 bit[ETHTOOL_A_BITSET_BIT_VALUE] == NULL) )
+            continue;
+
+        for ( i = 0 ; features[i].name ; i++ )
+        {
+            if ( !strcmp(features[i].name, RTA_DATA(bit[ETHTOOL_A_BITSET_BIT_NAME])) )
+                bits |= 1U << i;
+        }
+    }
+
+    return bits;
+}
+
+typedef struct profile_state
+{
+    const char      *ifname;
+    link_profile_t  *profile;
+    unsigned        changeable;
+    unsigned        active;
+    int             hasFeatures;
+} profile_state_t;
+
+static int linkReply(const struct nlmsghdr *nlh, void *user)
+{
+    profile_state_t         *state = user;
+    const struct ifinfomsg  *ifi = NLMSG_DATA(nlh);
+    const struct rtattr     *tb[IFLA_MAX + 1];
+
+    if ( nlh->nlmsg_type != RTM_NEWLINK )
+        return 0;
+
+    netlinkParseAttr(IFLA_RTA(ifi), IFLA_PAYLOAD(nlh), tb, IFLA_MAX);
+
+    if ( tb[IFLA_MTU] )
+        state->profile->mtu = netlinkAttrU32(tb[IFLA_MTU]);
+
+    if ( tb[IFLA_TXQLEN] )
+        state->profile->txqlen = netlinkAttrU32(tb[IFLA_TXQLEN]);
+
+    return 0;
+}
+
+static int ethtoolReply(const struct nlmsghdr *nlh, void *user)
+{
+    profile_state_t         *state = user;
+    const struct genlmsghdr *genlh = NLMSG_DATA(nlh);
+    const struct rtattr     *tb[ETHTOOL_A_RINGS_MAX + 1],
+                            *ft[ETHTOOL_A_FEATURES_MAX + 1],
+                            *attrs;
+    int                     len,
+                            i;
+
+    if ( nlh->nlmsg_type != ethtoolFamily )
+        return 0;
+
+    attrs = (const struct rtattr *) ((const char *) genlh + GENL_HDRLEN);
+    len = NLMSG_PAYLOAD(nlh, GENL_HDRLEN);
+
+    switch ( genlh->cmd )
+    {
+        case ETHTOOL_MSG_FEATURES_GET_REPLY:
+        netlinkParseAttr(attrs, len, ft, ETHTOOL_A_FEATURES_MAX);
+        if ( ft[ETHTOOL_A_FEATURES_HW] == NULL || ft[ETHTOOL_A_FEATURES_ACTIVE] == NULL )
+            break;
+
+        state->changeable = parseBitset(ft[ETHTOOL_A_FEATURES_HW]);
+        state->active = parseBitset(ft[ETHTOOL_A_FEATURES_ACTIVE]);
+        state->hasFeatures = 1;
+
+        /* Every offload is told by its first feature
+         */
+        for ( i = NBOFFLOADS ; i-- > 0 ; )
+            *offloadField(state->profile, i) = PROFILE_OFF;
+        for ( i = 0 ; features[i].name ; i++ )
+        {
+            if ( (i == 0 || features[i - 1].offload != features[i].offload) &&
+                    (state->active & (1U << i)) )
+                *offloadField(state->profile, features[i].offload) = PROFILE_ON;
+        }
+        break;
+
+        case ETHTOOL_MSG_RINGS_GET_REPLY:
+        netlinkParseAttr(attrs, len, tb, ETHTOOL_A_RINGS_MAX);
+        if ( tb[ETHTOOL_A_RINGS_RX] && tb[ETHTOOL_A_RINGS_RX_MAX] &&
+                netlinkAttrU32(tb[ETHTOOL_A_RINGS_RX_MAX]) )
+            state->profile->rx = netlinkAttrU32(tb[ETHTOOL_A_RINGS_RX]);
+        if ( tb[ETHTOOL_A_RINGS_TX] && tb[ETHTOOL_A_RINGS_TX_MAX] &&
+                netlinkAttrU32(tb[ETHTOOL_A_RINGS_TX_MAX]) )
+            state->profile->tx = netlinkAttrU32(tb[ETHTOOL_A_RINGS_TX]);
+        break;
+
+        default:
+        break;
+    }
+
+    return 0;
+}
+
+/* The link and ethtool requests go in one batch each, a device without
+ * features or rings just answers with an error
+ */
+static int loadProfile(const char *ifname, link_profile_t *profile,
+        profile_state_t *state)
+{
+    netlink_t           nl,
+                        genl;
+    netlink_req_t       req = { 0 };
+    struct ifinfomsg    *ifi;
+    int                 ret = -1;
+
+    memset(state, 0, sizeof(*state));
+    state->ifname = ifname;
+    state->profile = profile;
+    profileReset(profile);
+
+    if ( netlinkOpen(&nl, NETLINK_ROUTE, 0) )
+        return -1;
+
+    if ( (ifi = netlinkReqAdd(&req, RTM_GETLINK, 0, sizeof(*ifi))) == NULL )
+        goto out;
+
+    ifi->ifi_family = AF_UNSPEC;
+
+    if ( netlinkReqAttrStr(&req, IFLA_IFNAME, ifname) ||
+            netlinkReqAttrU32(&req, IFLA_EXT_MASK, RTEXT_FILTER_SKIP_STATS) ||
+            netlinkTransact(&nl, &req, &linkReply, state) ||
+            profile->mtu == PROFILE_UNSET )
+        goto out;
+
+    ret = 0;
+
+    if ( openEthtool(&genl) )
+        goto out;
+
+    netlinkReqReset(&req);
+    if ( ethtoolRequest(&req, ETHTOOL_MSG_FEATURES_GET, ETHTOOL_A_FEATURES_HEADER,
+                ifname, 0) == 0 &&
+            ethtoolRequest(&req, ETHTOOL_MSG_RINGS_GET, ETHTOOL_A_RINGS_HEADER,
+                ifname, 0) == 0 )
+        netlinkTransact(&genl, &req, &ethtoolReply, state);
+
+    netlinkClose(&genl);
+
+out:
+    netlinkReqFree(&req);
+    netlinkClose(&nl);
+
+    return ret;
+}
+
+int getInterfaceProfile(const char *ifname, link_profile_t *profile)
+{
+    profile_state_t state;
+
+    if ( ifname == NULL || profile == NULL )
+        return -1;
+
+    return loadProfile(ifname, profile, &state);
+}
+
+static int refusedReply(const struct nlmsghdr *nlh, void *user)
+{
+    const struct nlmsgerr   *err = NLMSG_DATA(nlh);
+
+    if ( nlh->nlmsg_type == NLMSG_ERROR && err->error )
+        fprintf(stderr, "%s: %s\n", (const char *) user, strerror(-err->error));
+
+    return 0;
+}
+
+static int setFeatures(netlink_req_t *req, const profile_state_t *state,
+        const link_profile_t *profile)
+{
+    size_t  wanted,
+            bits,
+            bit;
+    int     i,
+            value,
+            refused = 0;
+
+    if ( (wanted = netlinkReqNestStart(req, ETHTOOL_A_FEATURES_WANTED)) == 0 ||
+            (bits = netlinkReqNestStart(req, ETHTOOL_A_BITSET_BITS)) == 0 )
+        return -1;
+
+    /* Listed features are the mask, the ones without a value are cleared
+     */
+    for ( i = 0 ; i < NBOFFLOADS ; i++ )
+    {
+        int found = 0,
+            j;
+
+        if ( (value = *offloadField((link_profile_t *) profile, i)) == PROFILE_UNSET ||
+                value == *offloadField(state->profile, i) )
+            continue;
+
+        for ( j = 0 ; features[j].name ; j++ )
+        {
+            if ( features[j].offload != i || !(state->changeable & (1U << j)) )
+                continue;
+
+            if ( (bit = netlinkReqNestStart(req, ETHTOOL_A_BITSET_BITS_BIT)) == 0 ||
+                    netlinkReqAttrStr(req, ETHTOOL_A_BITSET_BIT_NAME, features[j].name) ||
+                    (value && netlinkReqAttr(req, ETHTOOL_A_BITSET_BIT_VALUE, NULL, 0)) )
+                return -1;
+
+            netlinkReqNestEnd(req, bit);
+            found++;
+        }
+
+        if ( !found )
+        {
+            fprintf(stderr, "%s: %s cannot be changed\n", state->ifname,
+                    offloadNames[i]);
+            refused++;
+        }
+    }
+
+    netlinkReqNestEnd(req, bits);
+    netlinkReqNestEnd(req, wanted);
+
+    return refused;
+}
+
+int setInterfaceProfile(const char *ifname, const link_profile_t *profile)
+{
+    link_profile_t      current;
+    profile_state_t     state;
+    netlink_t           nl;
+    netlink_req_t       req = { 0 };
+    struct ifinfomsg    *ifi;
+    struct genlmsghdr   *genlh;
+    size_t              nest;
+    int                 ret,
+                        refused = 0;
+
+    if ( ifname == NULL || profile == NULL ||
+            loadProfile(ifname, &current, &state) )
+        return -1;
+
+    if ( (profile->mtu != PROFILE_UNSET && profile->mtu != current.mtu) ||
+            (profile->txqlen != PROFILE_UNSET && profile->txqlen != current.txqlen) )
+    {
+        if ( netlinkOpen(&nl, NETLINK_ROUTE, 0) )
+            return -1;
+
+        if ( (ifi = netlinkReqAdd(&req, RTM_NEWLINK, 0, sizeof(*ifi))) != NULL )
+            ifi->ifi_family = AF_UNSPEC;
+
+        if ( ifi == NULL ||
+                netlinkReqAttrStr(&req, IFLA_IFNAME, ifname) ||
+                (profile->mtu != PROFILE_UNSET &&
+                 netlinkReqAttrU32(&req, IFLA_MTU, profile->mtu)) ||
+                (profile->txqlen != PROFILE_UNSET &&
+                 netlinkReqAttrU32(&req, IFLA_TXQLEN, profile->txqlen)) )
+            ret = -1;
+        else
+            ret = netlinkTransact(&nl, &req, &refusedReply, (void *) ifname);
+
+        netlinkClose(&nl);
+        if ( ret < 0 )
+            goto out;
+        refused += ret;
+    }
+
+    netlinkReqReset(&req);
+
+    if ( (profile->gro != PROFILE_UNSET && profile->gro != current.gro) ||
+            (profile->gso != PROFILE_UNSET && profile->gso != current.gso) ||
+            (profile->tso != PROFILE_UNSET && profile->tso != current.tso) )
+    {
+        if ( !state.hasFeatures )
+        {
+            fprintf(stderr, "%s: no offload to change\n", ifname);
+            refused++;
+        }
+        else if ( ethtoolRequest(&req, ETHTOOL_MSG_FEATURES_SET,
+                    ETHTOOL_A_FEATURES_HEADER, ifname, ETHTOOL_FLAG_OMIT_REPLY) ||
+                (ret = setFeatures(&req, &state, profile)) < 0 )
+        {
+            ret = -1;
+            goto out;
+        }
+        else
+            refused += ret;
+    }
+
+    if ( (profile->rx != PROFILE_UNSET && profile->rx != current.rx) ||
+            (profile->tx != PROFILE_UNSET && profile->tx != current.tx) )
+    {
+        if ( (genlh = netlinkReqAdd(&req, ethtoolFamily, 0, sizeof(*genlh))) == NULL )
+        {
+            ret = -1;
+            goto out;
+        }
+
+        genlh->cmd = ETHTOOL_MSG_RINGS_SET;
+        genlh->version = ETHTOOL_GENL_VERSION;
+
+        if ( (nest = netlinkReqNestStart(&req, ETHTOOL_A_RINGS_HEADER)) == 0 ||
+                netlinkReqAttrStr(&req, ETHTOOL_A_HEADER_DEV_NAME, ifname) ||
+                (profile->rx != PROFILE_UNSET &&
+                 netlinkReqAttrU32(&req, ETHTOOL_A_RINGS_RX, profile->rx)) ||
+                (profile->tx != PROFILE_UNSET &&
+                 netlinkReqAttrU32(&req, ETHTOOL_A_RINGS_TX, profile->tx)) )
+        {
+            ret = -1;
+            goto out;
+        }
+        netlinkReqNestEnd(&req, nest);
+    }
+
+    ret = 0;
+    if ( req.count )
+    {
+        if ( ethtoolFamily <= 0 || openEthtool(&nl) )
+        {
+            fprintf(stderr, "%s: no ethtool netlink\n", ifname);
+            refused += req.count;
+        }
+        else
+        {
+            ret = netlinkTransact(&nl, &req, &refusedReply, (void *) ifname);
+            netlinkClose(&nl);
+
+            if ( ret > 0 )
+                refused += ret;
+        }
+    }
+
+out:
+    netlinkReqFree(&req);
+
+    return ret < 0 ? -1 : refused;
+}
+
+int saveInterfaceProfile(const char *ifname, const link_profile_t *profile)
+{
+    link_profile_t  current;
+    char            value[256];
+    int             ret;
+
+    if ( (ret = setInterfaceProfile(ifname, profile)) < 0 )
+        return -1;
+
+    /* What the interface ended with is recorded
+     */
+    if ( getInterfaceProfile(ifname, &current) ||
+            profileFormat(&current, value, sizeof(value)) ||
+            setInterfaceOption(ifname, PROFILE_OPTION, value) )
+        return -1;
+
+    return ret;
+}
+
+static int restoreOne(const char *ifname, const char *value, void *user)
+{
+    link_profile_t  profile;
+    int             *failed = user,
+                    ret;
+
+    if ( profileParse(value, &profile) ||
+            (ret = setInterfaceProfile(ifname, &profile)) < 0 )
+    {
+        fprintf(stderr, "%s: cannot restore the profile\n", ifname);
+        (*failed)++;
+    }
+    else
+        *failed += ret;
+
+    return 0;
+}
+
+int restoreProfiles(void)
+{
+    int failed = 0;
+
+    if ( foreachInterfaceOption(PROFILE_OPTION, &restoreOne, &failed) )
+        return -1;
+
+    return failed;
+}
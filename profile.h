@@ -0,0 +1,67 @@
+#ifndef __PROFILE_H__
+#define __PROFILE_H__
+
+#include "netconfig.h"
+#include "network.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/* Option of the interfaces stanzas keeping the profile of an interface
+ */
+#define PROFILE_OPTION      "profile"
+
+#define PROFILE_UNSET       -1
+
+/* Link settings bearing on the throughput : the MTU, the length of the
+ * transmit queue, the GRO, GSO and TSO offloads (0 or 1) and the sizes of
+ * the receive and transmit rings. A field left PROFILE_UNSET is unknown,
+ * or not to be changed.
+ * Written "[mtu <n>] [txqueuelen <n>] [gro|gso|tso on|off] [rx|tx <n>]".
+ */
+typedef struct link_profile
+{
+    int mtu;
+    int txqlen;
+    int gro;
+    int gso;
+    int tso;
+    int rx;
+    int tx;
+} link_profile_t;
+
+NETCONFIG_API
+int profileParse(const char *str, link_profile_t *profile);
+
+NETCONFIG_API
+int profileFormat(const link_profile_t *profile, char *dest, size_t len);
+
+/* The offloads and rings come from the ethtool netlink family, they are
+ * left unset when the device or the kernel does not have them
+ */
+NETCONFIG_API
+int getInterfaceProfile(const char *ifname, link_profile_t *profile);
+
+/* Only the fields that differ are sent : one RTM_NEWLINK for the MTU and
+ * the queue length, one ethtool batch for the offloads and the rings.
+ * Returns the number of settings refused or -1 on error.
+ */
+NETCONFIG_API
+int setInterfaceProfile(const char *ifname, const link_profile_t *profile);
+
+/* Applies the profile then records it in the stanza of the interface
+ */
+NETCONFIG_API
+int saveInterfaceProfile(const char *ifname, const link_profile_t *profile);
+
+/* Applies the profiles recorded in the interfaces file
+ */
+NETCONFIG_API
+int restoreProfiles(void);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __PROFILE_H__ */
@@ -0,0 +1,659 @@
+#include "qdisc.h"
+#include "netlink.h"
+#include "kernel.h"
+
+/* See man (8) tc, tc-fq, tc-fq_codel and tc-mq
+ */
+
+#include <linux/pkt_sched.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <errno.h>
+
+#define QDISC_ON            1
+#define QDISC_OFF           0
+
+#define OPTIONS_MAX         (TCA_FQ_MAX > TCA_FQ_CODEL_MAX ? TCA_FQ_MAX : TCA_FQ_CODEL_MAX)
+
+#define FIELD(name)         offsetof(qdisc_t, name)
+#define PARAM(qdisc, i)     ((int *) ((char *) (qdisc) + params[i].field))
+
+/* The parameters of each kind and their attribute in TCA_OPTIONS, a switch
+ * is written on or off
+ */
+static const struct
+{
+    const char  *kind;
+    const char  *name;
+    size_t      field;
+    uint16_t    attr;
+    int         isSwitch;
+} params [] =
+{
+    {"fq",          "limit",        FIELD(limit),       TCA_FQ_PLIMIT,          0},
+    {"fq",          "flow_limit",   FIELD(flowLimit),   TCA_FQ_FLOW_PLIMIT,     0},
+    {"fq",          "quantum",      FIELD(quantum),     TCA_FQ_QUANTUM,         0},
+    {"fq",          "maxrate",      FIELD(maxrate),     TCA_FQ_FLOW_MAX_RATE,   0},
+    {"fq",          "pacing",       FIELD(pacing),      TCA_FQ_RATE_ENABLE,     1},
+    {"fq_codel",    "limit",        FIELD(limit),       TCA_FQ_CODEL_LIMIT,     0},
+    {"fq_codel",    "flows",        FIELD(flows),       TCA_FQ_CODEL_FLOWS,     0},
+    {"fq_codel",    "quantum",      FIELD(quantum),     TCA_FQ_CODEL_QUANTUM,   0},
+    {"fq_codel",    "target",       FIELD(target),      TCA_FQ_CODEL_TARGET,    0},
+    {"fq_codel",    "interval",     FIELD(interval),    TCA_FQ_CODEL_INTERVAL,  0},
+    {"fq_codel",    "ecn",          FIELD(ecn),         TCA_FQ_CODEL_ECN,       1},
+    {NULL,          NULL,           0,                  0,                      0},
+};
+
+typedef struct qdisc_walk
+{
+    qdisc_callback_t    cb;
+    void                *user;
+} qdisc_walk_t;
+
+/* The root qdisc of an interface and the children of an mq root, which
+ * are all expected to be alike
+ */
+typedef struct qdisc_state
+{
+    int         ifindex;
+    int         nbTx;
+    uint32_t    handle;
+    qdisc_t     *root;
+    qdisc_t     child;
+    int         nbChildren;
+    int         mixed;
+} qdisc_state_t;
+
+/* The roots of a dump, the state of the last one gathering its children
+ */
+typedef struct qdisc_roots
+{
+    qdisc_info_t    *roots;
+    size_t          nb;
+    size_t          size;
+    qdisc_state_t   state;
+} qdisc_roots_t;
+
+static void qdiscReset(qdisc_t *qdisc)
+{
+    int i;
+
+    memset(qdisc, 0, sizeof(*qdisc));
+    for ( i = 0 ; params[i].name ; i++ )
+        *PARAM(qdisc, i) = QDISC_UNSET;
+}
+
+/* The kind the parameters belong to
+ */
+static const char *paramKind(const qdisc_t *qdisc)
+{
+    return strcmp(qdisc->kind, "mq") ? qdisc->kind : qdisc->child;
+}
+
+int qdiscParse(const char *str, qdisc_t *qdisc)
+{
+    char        word[16],
+                value[16];
+    const char  *kind;
+    int         len,
+                i,
+                *field;
+
+    if ( str == NULL || qdisc == NULL )
+        return -1;
+
+    qdiscReset(qdisc);
+
+    if ( sscanf(str, " %15s%n", qdisc->kind, &len) != 1 )
+    {
+        fprintf(stderr, "Invalid qdisc %s\n", str);
+        return -1;
+    }
+    str += len;
+
+    if ( !strcmp(qdisc->kind, "mq") &&
+            sscanf(str, " %15s%n", qdisc->child, &len) == 1 )
+        str += len;
+
+    kind = paramKind(qdisc);
+
+    while ( sscanf(str, " %15s %15s%n", word, value, &len) == 2 )
+    {
+        for ( i = 0 ; params[i].name ; i++ )
+        {
+            if ( !strcmp(params[i].kind, kind) && !strcmp(params[i].name, word) )
+                break;
+        }
+
+        if ( params[i].name == NULL )
+            break;
+
+        field = PARAM(qdisc, i);
+        if ( params[i].isSwitch && !strcmp(value, "on") )
+            *field = QDISC_ON;
+        else if ( params[i].isSwitch && !strcmp(value, "off") )
+            *field = QDISC_OFF;
+        else if ( params[i].isSwitch || (*field = atoi(value)) <= 0 )
+            break;
+
+        str += len;
+    }
+
+    if ( sscanf(str, " %15s", word) == 1 )
+    {
+        fprintf(stderr, "Invalid qdisc at %s\n", str);
+        return -1;
+    }
+
+    return 0;
+}
+
+int qdiscFormat(const qdisc_t *qdisc, char *dest, size_t len)
+{
+    const char  *kind;
+    size_t      off = 0;
+    int         i,
+                value;
+
+    if ( qdisc == NULL || dest == NULL || len == 0 )
+        return -1;
+
+    *dest = '\0';
+
+#define APPEND(...) \
+    do { \
+        off += snprintf(dest + off, len - off, __VA_ARGS__); \
+        if ( off >= len ) \
+            return -1; \
+    } while ( 0 )
+
+    APPEND("%s", qdisc->kind);
+    if ( *qdisc->child )
+        APPEND(" %s", qdisc->child);
+
+    kind = paramKind(qdisc);
+    for ( i = 0 ; params[i].name ; i++ )
+    {
+        if ( strcmp(params[i].kind, kind) ||
+                (value = *PARAM(qdisc, i)) == QDISC_UNSET )
+            continue;
+
+        if ( params[i].isSwitch )
+            APPEND(" %s %s", params[i].name, value ? "on" : "off");
+        else
+            APPEND(" %s %d", params[i].name, value);
+    }
+
+#undef APPEND
+
+    return 0;
+}
+
+static int parseQdisc(const struct nlmsghdr *nlh, qdisc_info_t *info)
+{
+    const struct tcmsg  *tcm = NLMSG_DATA(nlh);
+    const struct rtattr *tb[TCA_MAX + 1],
+                        *opts[OPTIONS_MAX + 1];
+    int                 i;
+
+    if ( nlh->nlmsg_type != RTM_NEWQDISC ||
+            nlh->nlmsg_len < NLMSG_LENGTH(sizeof(*tcm)) )
+        return -1;
+
+    netlinkParseAttr(TCA_RTA(tcm), TCA_PAYLOAD(nlh), tb, TCA_MAX);
+    if ( tb[TCA_KIND] == NULL )
+        return -1;
+
+    *info->name = '\0';
+    info->ifindex = tcm->tcm_ifindex;
+    info->handle = tcm->tcm_handle;
+    info->parent = tcm->tcm_parent;
+    qdiscReset(&info->qdisc);
+    strncpy(info->qdisc.kind, RTA_DATA(tb[TCA_KIND]), QDISC_KINDLEN - 1);
+
+    if ( tb[TCA_OPTIONS] == NULL )
+        return 0;
+
+    netlinkParseAttr(RTA_DATA(tb[TCA_OPTIONS]), RTA_PAYLOAD(tb[TCA_OPTIONS]),
+            opts, OPTIONS_MAX);
+
+    /* An unlimited maxrate is ~0, that is QDISC_UNSET
+     */
+    for ( i = 0 ; params[i].name ; i++ )
+    {
+        if ( !strcmp(params[i].kind, info->qdisc.kind) && opts[params[i].attr] &&
+                RTA_PAYLOAD(opts[params[i].attr]) >= sizeof(uint32_t) )
+            *PARAM(&info->qdisc, i) = netlinkAttrU32(opts[params[i].attr]);
+    }
+
+    return 0;
+}
+
+static int walkReply(const struct nlmsghdr *nlh, void *user)
+{
+    qdisc_walk_t    *walk = user;
+    qdisc_info_t    info;
+
+    if ( parseQdisc(nlh, &info) )
+        return 0;
+
+    kernelIndexToName(info.ifindex, info.name);
+
+    return walk->cb(&info, walk->user);
+}
+
+int foreachQdisc(qdisc_callback_t cb, void *user)
+{
+    qdisc_walk_t    walk = { cb, user };
+    netlink_t       nl;
+    netlink_req_t   req = { 0 };
+    struct tcmsg    *tcm;
+    int             ret = -1;
+
+    if ( cb == NULL )
+        return -1;
+
+    if ( netlinkOpen(&nl, NETLINK_ROUTE, 0) )
+        return -1;
+
+    if ( (tcm = netlinkReqAdd(&req, RTM_GETQDISC, NLM_F_DUMP, sizeof(*tcm))) )
+    {
+        tcm->tcm_family = AF_UNSPEC;
+        ret = netlinkTransact(&nl, &req, &walkReply, &walk);
+    }
+
+    netlinkReqFree(&req);
+    netlinkClose(&nl);
+
+    return ret;
+}
+
+/* The kernel dumps the root of an interface before the others
+ */
+static void stateAdd(qdisc_state_t *state, const qdisc_info_t *info)
+{
+    if ( info->parent == TC_H_ROOT )
+    {
+        *state->root = info->qdisc;
+        state->handle = info->handle;
+    }
+    else if ( !strcmp(state->root->kind, "mq") &&
+            TC_H_MAJ(info->parent) == TC_H_MAJ(state->handle) )
+    {
+        if ( state->nbChildren++ == 0 )
+            state->child = info->qdisc;
+        else if ( memcmp(&state->child, &info->qdisc, sizeof(info->qdisc)) )
+            state->mixed = 1;
+    }
+}
+
+/* mq is shown with the kind and the parameters of its children
+ */
+static void stateFold(qdisc_state_t *state)
+{
+    qdisc_t child;
+
+    if ( state->nbChildren == 0 )
+        return;
+
+    child = state->child;
+    memcpy(child.child, child.kind, sizeof(child.child));
+    memcpy(child.kind, state->root->kind, sizeof(child.kind));
+    *state->root = child;
+}
+
+static int stateReply(const struct nlmsghdr *nlh, void *user)
+{
+    qdisc_state_t           *state = user;
+    const struct ifinfomsg  *ifi = NLMSG_DATA(nlh);
+    const struct rtattr     *tb[IFLA_MAX + 1];
+    qdisc_info_t            info;
+
+    if ( nlh->nlmsg_type == RTM_NEWLINK )
+    {
+        netlinkParseAttr(IFLA_RTA(ifi), IFLA_PAYLOAD(nlh), tb, IFLA_MAX);
+        if ( ifi->ifi_index == state->ifindex && tb[IFLA_NUM_TX_QUEUES] )
+            state->nbTx = netlinkAttrU32(tb[IFLA_NUM_TX_QUEUES]);
+        return 0;
+    }
+
+    if ( parseQdisc(nlh, &info) == 0 && info.ifindex == state->ifindex )
+        stateAdd(state, &info);
+
+    return 0;
+}
+
+/* The link, for its number of transmit queues, and the qdiscs are asked
+ * in one batch
+ */
+static int loadQdisc(const char *ifname, qdisc_t *qdisc, qdisc_state_t *state)
+{
+    netlink_t           nl;
+    netlink_req_t       req = { 0 };
+    struct ifinfomsg    *ifi;
+    struct tcmsg        *tcm;
+    int                 ret = -1;
+
+    memset(state, 0, sizeof(*state));
+    state->root = qdisc;
+    state->nbTx = 1;
+    qdiscReset(qdisc);
+
+    if ( (state->ifindex = kernelNameToIndex(ifname)) == 0 )
+    {
+        perror(ifname);
+        return -1;
+    }
+
+    if ( netlinkOpen(&nl, NETLINK_ROUTE, 0) )
+        return -1;
+
+    if ( (ifi = netlinkReqAdd(&req, RTM_GETLINK, 0, sizeof(*ifi))) == NULL )
+        goto out;
+    ifi->ifi_family = AF_UNSPEC;
+    ifi->ifi_index = state->ifindex;
+
+    if ( netlinkReqAttrU32(&req, IFLA_EXT_MASK, RTEXT_FILTER_SKIP_STATS) ||
+            (tcm = netlinkReqAdd(&req, RTM_GETQDISC, NLM_F_DUMP, sizeof(*tcm))) == NULL )
+        goto out;
+    tcm->tcm_family = AF_UNSPEC;
+    tcm->tcm_ifindex = state->ifindex;
+
+    if ( netlinkTransact(&nl, &req, &stateReply, state) )
+        goto out;
+
+    stateFold(state);
+    ret = 0;
+
+out:
+    netlinkReqFree(&req);
+    netlinkClose(&nl);
+
+    return ret;
+}
+
+int getInterfaceQdisc(const char *ifname, qdisc_t *qdisc)
+{
+    qdisc_state_t   state;
+
+    if ( ifname == NULL || qdisc == NULL )
+        return -1;
+
+    return loadQdisc(ifname, qdisc, &state);
+}
+
+static int rootsReply(const struct nlmsghdr *nlh, void *user)
+{
+    qdisc_roots_t   *roots = user;
+    qdisc_info_t    info,
+                    *grown;
+
+    if ( parseQdisc(nlh, &info) )
+        return 0;
+
+    /* The children follow the root of their interface
+     */
+    if ( info.parent != TC_H_ROOT )
+    {
+        if ( roots->nb && info.ifindex == roots->state.ifindex )
+            stateAdd(&roots->state, &info);
+        return 0;
+    }
+
+    if ( roots->nb )
+        stateFold(&roots->state);
+
+    if ( roots->nb == roots->size )
+    {
+        size_t  size = roots->size ? roots->size * 2 : 64;
+
+        if ( (grown = realloc(roots->roots, size * sizeof(*grown))) == NULL )
+            return -1;
+
+        roots->roots = grown;
+        roots->size = size;
+    }
+
+    roots->roots[roots->nb] = info;
+    memset(&roots->state, 0, sizeof(roots->state));
+    roots->state.ifindex = info.ifindex;
+    roots->state.root = &roots->roots[roots->nb++].qdisc;
+    stateAdd(&roots->state, &info);
+
+    return 0;
+}
+
+static int compareRoot(const void *a, const void *b)
+{
+    return ((const qdisc_info_t *) a)->ifindex - ((const qdisc_info_t *) b)->ifindex;
+}
+
+int getRootQdiscs(qdisc_info_t **roots, size_t *nb)
+{
+    qdisc_roots_t   walk;
+    netlink_t       nl;
+    netlink_req_t   req = { 0 };
+    struct tcmsg    *tcm;
+    size_t          i;
+    int             ret = -1;
+
+    if ( roots == NULL || nb == NULL )
+        return -1;
+
+    if ( netlinkOpen(&nl, NETLINK_ROUTE, 0) )
+        return -1;
+
+    memset(&walk, 0, sizeof(walk));
+    if ( (tcm = netlinkReqAdd(&req, RTM_GETQDISC, NLM_F_DUMP, sizeof(*tcm))) )
+    {
+        tcm->tcm_family = AF_UNSPEC;
+        ret = netlinkTransact(&nl, &req, &rootsReply, &walk) ? -1 : 0;
+    }
+
+    netlinkReqFree(&req);
+    netlinkClose(&nl);
+
+    if ( ret )
+    {
+        free(walk.roots);
+        return -1;
+    }
+
+    if ( walk.nb )
+        stateFold(&walk.state);
+
+    for ( i = 0 ; i < walk.nb ; i++ )
+        kernelIndexToName(walk.roots[i].ifindex, walk.roots[i].name);
+
+    qsort(walk.roots, walk.nb, sizeof(*walk.roots), &compareRoot);
+
+    *roots = walk.roots;
+    *nb = walk.nb;
+
+    return 0;
+}
+
+const qdisc_info_t *findRootQdisc(const qdisc_info_t *roots, size_t nb,
+        const char *ifname)
+{
+    qdisc_info_t    key;
+
+    if ( roots == NULL || ifname == NULL ||
+            (key.ifindex = kernelNameToIndex(ifname)) == 0 )
+        return NULL;
+
+    return bsearch(&key, roots, nb, sizeof(key), &compareRoot);
+}
+
+static int qdiscMatch(const qdisc_state_t *state, const qdisc_t *qdisc)
+{
+    const qdisc_t   *current = state->root;
+    int             i;
+
+    if ( strcmp(current->kind, qdisc->kind) )
+        return 0;
+
+    if ( *qdisc->child && (strcmp(current->child, qdisc->child) ||
+                state->mixed || state->nbChildren != state->nbTx) )
+        return 0;
+
+    for ( i = 0 ; params[i].name ; i++ )
+    {
+        if ( !strcmp(params[i].kind, paramKind(qdisc)) &&
+                *PARAM(qdisc, i) != QDISC_UNSET &&
+                *PARAM(qdisc, i) != *PARAM(current, i) )
+            return 0;
+    }
+
+    return 1;
+}
+
+/* A qdisc is created, or changed when the parent already has one of the
+ * same kind. Only the parameters set are sent.
+ */
+static int addQdisc(netlink_req_t *req, int ifindex, uint32_t parent,
+        uint32_t handle, const char *kind, const qdisc_t *qdisc)
+{
+    struct tcmsg    *tcm;
+    size_t          nest = 0;
+    int             i;
+
+    if ( (tcm = netlinkReqAdd(req, RTM_NEWQDISC, NLM_F_CREATE | NLM_F_REPLACE,
+                    sizeof(*tcm))) == NULL )
+        return -1;
+
+    tcm->tcm_family = AF_UNSPEC;
+    tcm->tcm_ifindex = ifindex;
+    tcm->tcm_parent = parent;
+    tcm->tcm_handle = handle;
+
+    if ( netlinkReqAttrStr(req, TCA_KIND, kind) )
+        return -1;
+
+    for ( i = 0 ; qdisc && params[i].name ; i++ )
+    {
+        if ( strcmp(params[i].kind, kind) || *PARAM(qdisc, i) == QDISC_UNSET )
+            continue;
+
+        if ( (nest == 0 && (nest = netlinkReqNestStart(req, TCA_OPTIONS)) == 0) ||
+                netlinkReqAttrU32(req, params[i].attr, *PARAM(qdisc, i)) )
+            return -1;
+    }
+
+    if ( nest )
+        netlinkReqNestEnd(req, nest);
+
+    return 0;
+}
+
+static int refusedReply(const struct nlmsghdr *nlh, void *user)
+{
+    const struct nlmsgerr   *err = NLMSG_DATA(nlh);
+
+    if ( nlh->nlmsg_type == NLMSG_ERROR && err->error )
+        fprintf(stderr, "%s: %s\n", (const char *) user, strerror(-err->error));
+
+    return 0;
+}
+
+int setInterfaceQdisc(const char *ifname, const qdisc_t *qdisc)
+{
+    qdisc_state_t   state;
+    qdisc_t         current;
+    netlink_t       nl;
+    netlink_req_t   req = { 0 };
+    uint32_t        handle;
+    int             i,
+                    ret;
+
+    if ( ifname == NULL || qdisc == NULL || *qdisc->kind == '\0' )
+        return -1;
+
+    if ( loadQdisc(ifname, &current, &state) )
+        return -1;
+
+    if ( qdiscMatch(&state, qdisc) )
+        return 0;
+
+    if ( strcmp(qdisc->kind, "mq") )
+        ret = addQdisc(&req, state.ifindex, TC_H_ROOT, 0, qdisc->kind, qdisc);
+    else
+    {
+        /* The children hang from the classes 1 to n of mq, one per transmit
+         * queue. An mq root in place is kept.
+         */
+        handle = state.handle;
+        ret = 0;
+        if ( strcmp(current.kind, "mq") )
+        {
+            handle = TC_H_MAKE(1 << 16, 0);
+            ret = addQdisc(&req, state.ifindex, TC_H_ROOT, handle, "mq", NULL);
+        }
+
+        for ( i = 0 ; ret == 0 && *qdisc->child && i < state.nbTx ; i++ )
+            ret = addQdisc(&req, state.ifindex, TC_H_MAKE(handle, i + 1), 0,
+                    qdisc->child, qdisc);
+    }
+
+    if ( ret == 0 && req.count )
+    {
+        if ( netlinkOpen(&nl, NETLINK_ROUTE, 0) )
+            ret = -1;
+        else
+        {
+            ret = netlinkTransact(&nl, &req, &refusedReply, (void *) ifname);
+            netlinkClose(&nl);
+        }
+    }
+
+    netlinkReqFree(&req);
+
+    return ret;
+}
+
+int saveInterfaceQdisc(const char *ifname, const qdisc_t *qdisc)
+{
+    char    value[256];
+    int     ret;
+
+    if ( qdiscFormat(qdisc, value, sizeof(value)) )
+        return -1;
+
+    /* A qdisc the kernel refused is not recorded, restoring it would fail
+     * the same way
+     */
+    if ( (ret = setInterfaceQdisc(ifname, qdisc)) != 0 )
+        return ret;
+
+    return setInterfaceOption(ifname, QDISC_OPTION, value) ? -1 : 0;
+}
+
+static int restoreOne(const char *ifname, const char *value, void *user)
+{
+    qdisc_t qdisc;
+    int     *failed = user,
+            ret;
+
+    if ( qdiscParse(value, &qdisc) ||
+            (ret = setInterfaceQdisc(ifname, &qdisc)) < 0 )
+    {
+        fprintf(stderr, "%s: cannot restore the qdisc\n", ifname);
+        (*failed)++;
+    }
+    else
+        *failed += ret;
+
+    return 0;
+}
+
+int restoreQdiscs(void)
+{
+    int failed = 0;
+
+    if ( foreachInterfaceOption(QDISC_OPTION, &restoreOne, &failed) )
+        return -1;
+
+    return failed;
+}
@@ -0,0 +1,110 @@
+#ifndef __QDISC_H__
+#define __QDISC_H__
+
+#include "netconfig.h"
+#include "network.h"
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/* Option of the interfaces stanzas keeping the root qdisc of an interface
+ */
+#define QDISC_OPTION        "qdisc"
+
+#define QDISC_UNSET         -1
+#define QDISC_KINDLEN       16
+
+/* A queueing discipline and its main parameters, QDISC_UNSET when unknown
+ * or left to the kernel :
+ *  fq          limit, flow_limit, quantum, maxrate (bytes/s), pacing on|off
+ *  fq_codel    limit, flows, quantum, target, interval (us), ecn on|off
+ * An mq root has one child per transmit queue, all of the child kind and
+ * with the parameters. Any other kind is taken without parameters.
+ * Written "<kind> [<child kind>] [<parameter> <value>]...", for example
+ * "mq fq_codel target 5000 ecn on".
+ */
+typedef struct qdisc
+{
+    char    kind[QDISC_KINDLEN];
+    char    child[QDISC_KINDLEN];
+    int     limit;
+    int     flowLimit;
+    int     flows;
+    int     quantum;
+    int     maxrate;
+    int     pacing;
+    int     target;
+    int     interval;
+    int     ecn;
+} qdisc_t;
+
+/* One qdisc of a dump, the handles are major:minor in 16 bits each. child
+ * is always empty.
+ */
+typedef struct qdisc_info
+{
+    char        name[IFNAMSIZ];
+    int         ifindex;
+    uint32_t    handle;
+    uint32_t    parent;
+    qdisc_t     qdisc;
+} qdisc_info_t;
+
+typedef int (*qdisc_callback_t)(const qdisc_info_t *info, void *user);
+
+NETCONFIG_API
+int qdiscParse(const char *str, qdisc_t *qdisc);
+
+NETCONFIG_API
+int qdiscFormat(const qdisc_t *qdisc, char *dest, size_t len);
+
+/* Calls cb for every qdisc of every interface, from one RTM_GETQDISC dump.
+ * A non-zero return of cb stops the walk and is returned.
+ */
+NETCONFIG_API
+int foreachQdisc(qdisc_callback_t cb, void *user);
+
+/* The root qdisc, and for mq the kind and parameters of its children. An
+ * empty kind is an interface without qdisc.
+ */
+NETCONFIG_API
+int getInterfaceQdisc(const char *ifname, qdisc_t *qdisc);
+
+/* The root qdisc of every interface, as getInterfaceQdisc() gives it, from
+ * one RTM_GETQDISC dump. The table is sorted by ifindex, to be freed.
+ */
+NETCONFIG_API
+int getRootQdiscs(qdisc_info_t **roots, size_t *nb);
+
+/* NULL for an interface without qdisc
+ */
+NETCONFIG_API
+const qdisc_info_t *findRootQdisc(const qdisc_info_t *roots, size_t nb,
+        const char *ifname);
+
+/* Nothing is sent when the qdisc already matches, else one batch of
+ * RTM_NEWQDISC replaces the root qdisc, or the children of mq. Returns the
+ * number of messages refused or -1 on error.
+ */
+NETCONFIG_API
+int setInterfaceQdisc(const char *ifname, const qdisc_t *qdisc);
+
+/* Applies the qdisc then records it in the stanza of the interface, only
+ * when none of its messages was refused
+ */
+NETCONFIG_API
+int saveInterfaceQdisc(const char *ifname, const qdisc_t *qdisc);
+
+/* Applies the qdiscs recorded in the interfaces file
+ */
+NETCONFIG_API
+int restoreQdiscs(void);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __QDISC_H__ */
@@ -0,0 +1,525 @@
+#include "snapshot.h"
+#include "dhcp.h"
+#include "lease.h"
+#include "inventory.h"
+#include "netlink.h"
+#include "kernel.h"
+
+/* The snapshot keeps the records of the last display along with a
+ * fingerprint of the kernel state each of them was built from.
+ * The links, their addresses and the default routes of the main and VRF
+ * tables are enough to tell which records are still valid, only the
+ * stale fields are queried again.
+ */
+
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define SNAPSHOT_MAGIC      0x4e43534e
+#define SNAPSHOT_VERSION    1
+
+#define HASH_INIT           0xcbf29ce484222325ULL
+
+typedef struct snapshot_header
+{
+    uint32_t    magic;
+    uint32_t    version;
+    uint32_t    count;
+    uint32_t    entrySize;
+    uint64_t    resolv;
+    uint64_t    leases;
+} snapshot_header_t;
+
+typedef struct snapshot_entry
+{
+    int32_t             ifindex;
+    uint32_t            flags;
+    uint64_t            link;
+    uint64_t            addr;
+    uint64_t            route;
+    interface_info_t    info;
+} snapshot_entry_t;
+
+typedef struct snapshot_scan
+{
+    snapshot_entry_t    *entries;
+    size_t              nb;
+    size_t              size;
+    uint32_t            *tables;
+    size_t              nbTables;
+    size_t              sizeTables;
+} snapshot_scan_t;
+
+static uint64_t hash(uint64_t h, const void *data, size_t len)
+{
+    const unsigned char *p = data;
+
+    /* FNV-1a
+     */
+    while ( len-- )
+    {
+        h ^= *p++;
+        h *= 0x100000001b3ULL;
+    }
+
+    return h;
+}
+
+static uint64_t fileStamp(const char *path)
+{
+    struct stat st;
+    uint64_t    h = HASH_INIT;
+
+    if ( stat(path, &st) < 0 )
+        return 0;
+
+    h = hash(h, &st.st_ino, sizeof(st.st_ino));
+    h = hash(h, &st.st_size, sizeof(st.st_size));
+    h = hash(h, &st.st_mtim, sizeof(st.st_mtim));
+
+    return h;
+}
+
+static int compareEntry(const void *a, const void *b)
+{
+    const snapshot_entry_t  *ea = a,
+                            *eb = b;
+
+    return (ea->ifindex > eb->ifindex) - (ea->ifindex < eb->ifindex);
+}
+
+static snapshot_entry_t *findEntry(snapshot_entry_t *entries, size_t nb,
+        int ifindex)
+{
+    snapshot_entry_t    key;
+
+    key.ifindex = ifindex;
+
+    return bsearch(&key, entries, nb, sizeof(*entries), &compareEntry);
+}
+
+static int addTable(snapshot_scan_t *scan, uint32_t table)
+{
+    uint32_t    *tables;
+    size_t      i;
+
+    for ( i = 0 ; i < scan->nbTables ; i++ )
+    {
+        if ( scan->tables[i] == table )
+            return 0;
+    }
+
+    if ( scan->nbTables == scan->sizeTables )
+    {
+        size_t  size = scan->sizeTables ? scan->sizeTables * 2 : 8;
+
+        if ( (tables = realloc(scan->tables, size * sizeof(*tables))) == NULL )
+            return -1;
+
+        scan->tables = tables;
+        scan->sizeTables = size;
+    }
+
+    scan->tables[scan->nbTables++] = table;
+
+    return 0;
+}
+
+static int scanLink(const struct nlmsghdr *nlh, void *user)
+{
+    snapshot_scan_t         *scan = user;
+    const struct ifinfomsg  *ifi;
+    const struct rtattr     *tb[IFLA_MAX + 1];
+    snapshot_entry_t        *e;
+    uint32_t                table;
+
+    if ( nlh->nlmsg_type != RTM_NEWLINK )
+        return 0;
+
+    ifi = NLMSG_DATA(nlh);
+    netlinkParseAttr(IFLA_RTA(ifi), IFLA_PAYLOAD(nlh), tb, IFLA_MAX);
+    if ( tb[IFLA_IFNAME] == NULL )
+        return 0;
+
+    if ( scan->nb == scan->size )
+    {
+        size_t  size = scan->size ? scan->size * 2 : 64;
+
+        if ( (e = realloc(scan->entries, size * sizeof(*e))) == NULL )
+            return -1;
+
+        scan->entries = e;
+        scan->size = size;
+    }
+
+    e = &scan->entries[scan->nb++];
+    memset(e, 0, sizeof(*e));
+    e->ifindex = ifi->ifi_index;
+    e->flags = ifi->ifi_flags;
+    snprintf(e->info.name, sizeof(e->info.name), "%s",
+            (const char *) RTA_DATA(tb[IFLA_IFNAME]));
+
+    e->link = hash(HASH_INIT, &e->flags, sizeof(e->flags));
+    e->link = hash(e->link, e->info.name, strlen(e->info.name));
+    if ( tb[IFLA_ADDRESS] )
+        e->link = hash(e->link, RTA_DATA(tb[IFLA_ADDRESS]),
+                RTA_PAYLOAD(tb[IFLA_ADDRESS]));
+
+    /* The VRF master chooses the table of the gateway
+     */
+    if ( tb[IFLA_MASTER] )
+        e->route = hash(HASH_INIT, RTA_DATA(tb[IFLA_MASTER]),
+                RTA_PAYLOAD(tb[IFLA_MASTER]));
+
+    /* The default routes of its table are watched along with the main ones
+     */
+    if ( tb[IFLA_LINKINFO] &&
+            (table = inventoryVrfTable(tb[IFLA_LINKINFO])) != 0 )
+        return addTable(scan, table);
+
+    return 0;
+}
+
+static int scanAddr(const struct nlmsghdr *nlh, void *user)
+{
+    snapshot_scan_t         *scan = user;
+    const struct ifaddrmsg  *ifa;
+    const struct rtattr     *tb[IFA_MAX + 1];
+    snapshot_entry_t        *e;
+    uint64_t                h;
+    int                     i;
+
+    if ( nlh->nlmsg_type != RTM_NEWADDR )
+        return 0;
+
+    ifa = NLMSG_DATA(nlh);
+    if ( ifa->ifa_family != AF_INET ||
+            (e = findEntry(scan->entries, scan->nb, ifa->ifa_index)) == NULL )
+        return 0;
+
+    netlinkParseAttr(IFA_RTA(ifa), IFA_PAYLOAD(nlh), tb, IFA_MAX);
+
+    h = hash(HASH_INIT, &ifa->ifa_prefixlen, sizeof(ifa->ifa_prefixlen));
+    for ( i = IFA_ADDRESS ; i <= IFA_BROADCAST ; i++ )
+    {
+        if ( tb[i] )
+            h = hash(h, RTA_DATA(tb[i]), RTA_PAYLOAD(tb[i]));
+    }
+
+    /* The dump order of the addresses does not matter
+     */
+    e->addr += h;
+
+    return 0;
+}
+
+static int scanRoute(const struct nlmsghdr *nlh, void *user)
+{
+    snapshot_scan_t     *scan = user;
+    const struct rtmsg  *rtm;
+    const struct rtattr *tb[RTA_MAX + 1];
+    snapshot_entry_t    *e;
+
+    if ( nlh->nlmsg_type != RTM_NEWROUTE )
+        return 0;
+
+    rtm = NLMSG_DATA(nlh);
+    if ( rtm->rtm_family != AF_INET || rtm->rtm_dst_len != 0 )
+        return 0;
+
+    netlinkParseAttr(RTM_RTA(rtm), RTM_PAYLOAD(nlh), tb, RTA_MAX);
+    if ( tb[RTA_OIF] == NULL ||
+            (e = findEntry(scan->entries, scan->nb, netlinkAttrU32(tb[RTA_OIF]))) == NULL )
+        return 0;
+
+    /* Default routes of the watched tables, one of them is the gateway
+     */
+    e->route = hash(e->route ? e->route : HASH_INIT, "r", 1);
+    if ( tb[RTA_TABLE] )
+        e->route = hash(e->route, RTA_DATA(tb[RTA_TABLE]),
+                RTA_PAYLOAD(tb[RTA_TABLE]));
+    else
+        e->route = hash(e->route, &rtm->rtm_table, sizeof(rtm->rtm_table));
+
+    if ( tb[RTA_PRIORITY] )
+        e->route = hash(e->route, RTA_DATA(tb[RTA_PRIORITY]),
+                RTA_PAYLOAD(tb[RTA_PRIORITY]));
+    if ( tb[RTA_GATEWAY] )
+        e->route = hash(e->route, RTA_DATA(tb[RTA_GATEWAY]),
+                RTA_PAYLOAD(tb[RTA_GATEWAY]));
+
+    return 0;
+}
+
+static int scanState(const struct nlmsghdr *nlh, void *user)
+{
+    if ( nlh->nlmsg_type == RTM_NEWADDR )
+        return scanAddr(nlh, user);
+
+    return scanRoute(nlh, user);
+}
+
+static int scanKernel(snapshot_scan_t *scan)
+{
+    netlink_t           nl;
+    netlink_req_t       req = { 0 };
+    struct ifinfomsg    *ifi;
+    struct ifaddrmsg    *ifa;
+    struct rtmsg        *rtm;
+    size_t              i;
+    int                 ret = -1;
+
+    if ( netlinkOpen(&nl, NETLINK_ROUTE, 0) )
+        return -1;
+
+    /* The route dumps are filtered by table, a full table of routes
+     * learned from peers costs nothing to the validation
+     */
+    netlinkStrict(&nl);
+
+    if ( addTable(scan, RT_TABLE_MAIN) ||
+            (ifi = netlinkReqAdd(&req, RTM_GETLINK, NLM_F_DUMP, sizeof(*ifi))) == NULL ||
+            netlinkReqAttrU32(&req, IFLA_EXT_MASK, RTEXT_FILTER_SKIP_STATS) ||
+            netlinkTransact(&nl, &req, &scanLink, scan) )
+        goto out;
+
+    qsort(scan->entries, scan->nb, sizeof(*scan->entries), &compareEntry);
+
+    /* The addresses and the routes of each table come in the same batch.
+     * The policy rules are not dumped, a gateway a rule alone moves to
+     * another table is seen on the next change of its link or addresses.
+     */
+    netlinkReqReset(&req);
+    if ( (ifa = netlinkReqAdd(&req, RTM_GETADDR, NLM_F_DUMP, sizeof(*ifa))) == NULL )
+        goto out;
+    ifa->ifa_family = AF_INET;
+
+    for ( i = 0 ; i < scan->nbTables ; i++ )
+    {
+        if ( (rtm = netlinkReqAdd(&req, RTM_GETROUTE, NLM_F_DUMP, sizeof(*rtm))) == NULL )
+            goto out;
+        rtm->rtm_family = AF_INET;
+        rtm->rtm_table = scan->tables[i] < 256 ? scan->tables[i] : RT_TABLE_UNSPEC;
+
+        if ( netlinkReqAttrU32(&req, RTA_TABLE, scan->tables[i]) )
+            goto out;
+    }
+
+    if ( netlinkTransact(&nl, &req, &scanState, scan) )
+        goto out;
+
+    ret = 0;
+
+out:
+    netlinkReqFree(&req);
+    netlinkClose(&nl);
+
+    return ret;
+}
+
+static const snapshot_header_t *mapSnapshot(const char *path, size_t *len)
+{
+    const snapshot_header_t *hdr;
+    struct stat             st;
+    int                     fd;
+
+    if ( (fd = open(path, O_RDONLY | O_CLOEXEC)) < 0 )
+        return NULL;
+
+    if ( fstat(fd, &st) < 0 || st.st_size < (off_t) sizeof(*hdr) )
+    {
+        close(fd);
+        return NULL;
+    }
+
+    hdr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if ( hdr == MAP_FAILED )
+        return NULL;
+
+    *len = st.st_size;
+    if ( hdr->magic != SNAPSHOT_MAGIC || hdr->version != SNAPSHOT_VERSION ||
+            hdr->entrySize != sizeof(snapshot_entry_t) ||
+            *len != sizeof(*hdr) + (size_t) hdr->count * sizeof(snapshot_entry_t) )
+    {
+        munmap((void *) hdr, *len);
+        return NULL;
+    }
+
+    return hdr;
+}
+
+static int writeSnapshot(const char *path, const snapshot_header_t *hdr,
+        const snapshot_entry_t *entries)
+{
+    char    tmp[PATH_MAX];
+    size_t  len = (size_t) hdr->count * sizeof(*entries);
+    int     fd,
+            ret = -1;
+
+    /* A name of its own next to the target, two displays writing at the
+     * same time each rename a whole file
+     */
+    if ( snprintf(tmp, sizeof(tmp), "%s.XXXXXX", path) >= (int) sizeof(tmp) ||
+            (fd = mkstemp(tmp)) < 0 )
+        return -1;
+
+    if ( fchmod(fd, 0644) == 0 &&
+            write(fd, hdr, sizeof(*hdr)) == sizeof(*hdr) &&
+            write(fd, entries, len) == (ssize_t) len )
+        ret = 0;
+
+    close(fd);
+
+    if ( ret == 0 && (ret = rename(tmp, path)) )
+        perror("rename");
+
+    if ( ret )
+        unlink(tmp);
+
+    return ret;
+}
+
+static void refreshEntry(snapshot_entry_t *e, const snapshot_entry_t *old,
+        int leasesChanged)
+{
+    struct ifreq    ifr;
+
+    memset(&ifr, 0, sizeof(ifr));
+    memcpy(ifr.ifr_name, e->info.name, IFNAMSIZ);
+
+    if ( old == NULL )
+    {
+        getInterfaceInfo(&ifr, &e->info);
+        return;
+    }
+
+    e->info = old->info;
+
+    if ( old->link != e->link || old->addr != e->addr )
+    {
+        e->info.plugged = isInterfacePlugged(&ifr) > 0;
+
+        if ( getMacAddress(&ifr, e->info.mac, sizeof(e->info.mac)) )
+            *e->info.mac = '\0';
+
+        if ( getIpAddress(&ifr, e->info.ip, sizeof(e->info.ip)) )
+            *e->info.ip = '\0';
+
+        if ( getIpMask(&ifr, e->info.mask, sizeof(e->info.mask)) )
+            *e->info.mask = '\0';
+
+        if ( getIpBroadcast(&ifr, e->info.bcast, sizeof(e->info.bcast)) )
+            *e->info.bcast = '\0';
+    }
+
+    /* The gateway is only looked for on an UP and RUNNING interface
+     */
+    if ( old->route != e->route || old->flags != e->flags )
+    {
+        if ( getIpGateway(&ifr, e->info.gw, sizeof(e->info.gw)) )
+            *e->info.gw = '\0';
+    }
+
+    if ( leasesChanged )
+        e->info.dynamic = isInterfaceDynamic(e->info.name) ? 1 : 0;
+}
+
+/* Walk all the interfaces like a display would, serving the records from
+ * the snapshot at path when the kernel state did not change since it was
+ * written. The snapshot is rewritten only when something was refreshed.
+ */
+int foreachInterfaceCached(const char *path, interface_info_callback_t cb,
+        void *user)
+{
+    const snapshot_header_t *old = NULL;
+    const snapshot_entry_t  *oldEntries = NULL,
+                            *o;
+    snapshot_header_t       hdr;
+    snapshot_scan_t         scan = { 0 };
+    char                    ns[INET6_ADDRSTRLEN] = "";
+    size_t                  oldLen = 0,
+                            i;
+    int                     nsChanged,
+                            leasesChanged,
+                            dirty,
+                            ret = 0;
+
+    if ( path == NULL )
+        path = SNAPSHOT;
+
+    if ( scanKernel(&scan) )
+    {
+        free(scan.entries);
+        free(scan.tables);
+        return -1;
+    }
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = SNAPSHOT_MAGIC;
+    hdr.version = SNAPSHOT_VERSION;
+    hdr.count = scan.nb;
+    hdr.entrySize = sizeof(snapshot_entry_t);
+    hdr.resolv = fileStamp(RESOLV_CONF);
+    hdr.leases = fileStamp(DHCLIENT_LEASES);
+
+    /* A simulated kernel has no snapshot on disk
+     */
+    if ( !kernelSimulated() && (old = mapSnapshot(path, &oldLen)) != NULL )
+        oldEntries = (const snapshot_entry_t *) (old + 1);
+
+    nsChanged = old == NULL || old->resolv != hdr.resolv;
+    leasesChanged = old == NULL || old->leases != hdr.leases;
+    dirty = old == NULL || nsChanged || leasesChanged || old->count != hdr.count;
+
+    if ( nsChanged && getDomainNameServer(ns, sizeof(ns)) )
+        *ns = '\0';
+
+    for ( i = 0 ; i < scan.nb ; i++ )
+    {
+        snapshot_entry_t    *e = &scan.entries[i];
+
+        o = oldEntries ? findEntry((snapshot_entry_t *) oldEntries,
+                old->count, e->ifindex) : NULL;
+
+        /* A renamed interface is a new one
+         */
+        if ( o && strncmp(o->info.name, e->info.name, IFNAMSIZ) )
+            o = NULL;
+
+        if ( o && o->link == e->link && o->addr == e->addr &&
+                o->route == e->route && o->flags == e->flags &&
+                !leasesChanged && !nsChanged )
+        {
+            e->info = o->info;
+            continue;
+        }
+
+        dirty++;
+        refreshEntry(e, o, leasesChanged);
+        if ( nsChanged )
+            memcpy(e->info.ns, ns, sizeof(e->info.ns));
+    }
+
+    if ( old )
+        munmap((void *) old, oldLen);
+
+    if ( dirty && !kernelSimulated() )
+        writeSnapshot(path, &hdr, scan.entries);
+
+    for ( i = 0 ; cb && i < scan.nb ; i++ )
+    {
+        if ( (ret = cb(&scan.entries[i].info, user)) )
+            break;
+    }
+
+    free(scan.entries);
+    free(scan.tables);
+
+    return ret;
+}
@@ -0,0 +1,21 @@
+#ifndef __SNAPSHOT_H__
+#define __SNAPSHOT_H__
+
+#include "netconfig.h"
+#include "network.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#define SNAPSHOT    "/run/netconfig.snapshot"
+
+NETCONFIG_API
+int foreachInterfaceCached(const char *path, interface_info_callback_t cb,
+        void *user);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __SNAPSHOT_H__ */
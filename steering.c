@@ -0,0 +1,637 @@
+/* cpu_set_t and its macros
+ */
+#define _GNU_SOURCE
+
+#include "steering.h"
+#include "kernel.h"
+
+/* See Documentation/networking/scaling.rst of the kernel
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <sched.h>
+
+#define SYSNET          "/sys/class/net"
+#define SYSNODE         "/sys/devices/system/node"
+#define CPU_ONLINE      "/sys/devices/system/cpu/online"
+#define SOCK_FLOWS      "/proc/sys/net/core/rps_sock_flow_entries"
+
+/* Bitmaps are 32 bits words in hexadecimal, most significant first
+ */
+#define MASK_WORDS      (CPU_SETSIZE / 32)
+#define MASKLEN         (MASK_WORDS * 9 + 1)
+
+#define IRQ_MAX         1024
+
+static int readLine(const char *path, char *dest, size_t len)
+{
+    FILE    *file;
+    char    *p;
+
+    if ( (file = kernelOpen(path, "r")) == NULL )
+        return -1;
+
+    if ( fgets(dest, len, file) == NULL )
+    {
+        fclose(file);
+        return -1;
+    }
+
+    fclose(file);
+
+    if ( (p = strchr(dest, '\n')) )
+        *p = '\0';
+
+    return 0;
+}
+
+/* A single write(), at fclose()
+ */
+static int writeLine(const char *path, const char *str)
+{
+    FILE    *file;
+    int     ret;
+
+    if ( (file = kernelOpen(path, "w")) == NULL )
+    {
+        perror(path);
+        return -1;
+    }
+
+    ret = fprintf(file, "%s\n", str) < 0;
+    if ( fclose(file) || ret )
+    {
+        perror(path);
+        return -1;
+    }
+
+    return 0;
+}
+
+static int parseCpuList(const char *str, cpu_set_t *set)
+{
+    char            *end;
+    unsigned long   first,
+                    last;
+
+    CPU_ZERO(set);
+
+    while ( *str && !isspace((unsigned char) *str) )
+    {
+        first = last = strtoul(str, &end, 10);
+        if ( end == str )
+            return -1;
+
+        if ( *end == '-' )
+        {
+            str = end + 1;
+            last = strtoul(str, &end, 10);
+            if ( end == str || last < first )
+                return -1;
+        }
+
+        if ( last >= CPU_SETSIZE )
+            return -1;
+
+        for ( ; first <= last ; first++ )
+            CPU_SET(first, set);
+
+        if ( *end == ',' )
+            end++;
+        str = end;
+    }
+
+    return 0;
+}
+
+static void formatCpuList(const cpu_set_t *set, char *dest, size_t len)
+{
+    size_t  off = 0;
+    int     cpu,
+            last;
+
+    *dest = '\0';
+    for ( cpu = 0 ; cpu < CPU_SETSIZE && off < len ; cpu = last + 1 )
+    {
+        if ( !CPU_ISSET(cpu, set) )
+        {
+            last = cpu;
+            continue;
+        }
+
+        for ( last = cpu ; last + 1 < CPU_SETSIZE && CPU_ISSET(last + 1, set) ; last++ )
+            ;
+
+        if ( last == cpu )
+            off += snprintf(dest + off, len - off, "%s%d", off ? "," : "", cpu);
+        else
+            off += snprintf(dest + off, len - off, "%s%d-%d", off ? "," : "",
+                    cpu, last);
+    }
+}
+
+static int parseCpuMask(const char *str, cpu_set_t *set)
+{
+    const char  *p;
+    int         bit = 0,
+                digit,
+                i;
+
+    CPU_ZERO(set);
+
+    /* From the least significant digit, the words are padded
+     */
+    for ( p = str + strlen(str) ; p > str ; )
+    {
+        if ( *--p == ',' )
+            continue;
+
+        if ( !isxdigit((unsigned char) *p) )
+            return -1;
+
+        digit = isdigit((unsigned char) *p) ? *p - '0' : tolower(*p) - 'a' + 10;
+        for ( i = 0 ; i < 4 ; i++, bit++ )
+        {
+            if ( (digit & (1 << i)) && bit < CPU_SETSIZE )
+                CPU_SET(bit, set);
+        }
+    }
+
+    return 0;
+}
+
+static void formatCpuMask(const cpu_set_t *set, char *dest, size_t len)
+{
+    uint32_t    word;
+    size_t      off = 0;
+    int         i,
+                cpu;
+
+    for ( i = MASK_WORDS - 1 ; i > 0 ; i-- )
+    {
+        for ( cpu = i * 32 ; cpu < (i + 1) * 32 && !CPU_ISSET(cpu, set) ; cpu++ )
+            ;
+        if ( cpu < (i + 1) * 32 )
+            break;
+    }
+
+    for ( ; i >= 0 && off < len ; i-- )
+    {
+        for ( word = 0, cpu = 0 ; cpu < 32 ; cpu++ )
+        {
+            if ( CPU_ISSET(i * 32 + cpu, set) )
+                word |= 1U << cpu;
+        }
+
+        off += snprintf(dest + off, len - off, off ? ",%08x" : "%x", word);
+    }
+}
+
+int steeringParse(const char *str, steering_policy_t *policy)
+{
+    cpu_set_t   set;
+    char        word[16];
+    int         len;
+
+    if ( str == NULL || policy == NULL )
+        return -1;
+
+    memset(policy, 0, sizeof(*policy));
+
+    while ( sscanf(str, " %15s%n", word, &len) == 1 )
+    {
+        str += len;
+
+        if ( !strcmp(word, "spread") )
+            policy->type = STEERING_SPREAD;
+        else if ( !strcmp(word, "pack") )
+            policy->type = STEERING_PACK;
+        else if ( !strcmp(word, "cpus") &&
+                sscanf(str, " %255s%n", policy->cpus, &len) == 1 &&
+                parseCpuList(policy->cpus, &set) == 0 && CPU_COUNT(&set) )
+        {
+            policy->type = STEERING_EXPLICIT;
+            str += len;
+        }
+        else if ( !strcmp(word, "rfs") &&
+                sscanf(str, " %u%n", &policy->rfs, &len) == 1 )
+            str += len;
+        else
+        {
+            fprintf(stderr, "Invalid steering %s\n", word);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+int steeringFormat(const steering_policy_t *policy, char *dest, size_t len)
+{
+    int ret;
+
+    if ( policy == NULL || dest == NULL )
+        return -1;
+
+    switch ( policy->type )
+    {
+        case STEERING_SPREAD:
+        ret = snprintf(dest, len, "spread");
+        break;
+
+        case STEERING_PACK:
+        ret = snprintf(dest, len, "pack");
+        break;
+
+        case STEERING_EXPLICIT:
+        ret = snprintf(dest, len, "cpus %s", policy->cpus);
+        break;
+
+        default:
+        return -1;
+    }
+
+    if ( policy->rfs && ret >= 0 && (size_t) ret < len )
+        ret += snprintf(dest + ret, len - ret, " rfs %u", policy->rfs);
+
+    return ret < 0 || (size_t) ret >= len ? -1 : 0;
+}
+
+/* What a device offers : its queues, counted from their sysfs
+ * directories, its MSI interrupts and its NUMA node
+ */
+typedef struct steering_dev
+{
+    int     numa;
+    int     nbRx;
+    int     nbTx;
+    int     nbIrqs;
+    int     irqs[IRQ_MAX];
+} steering_dev_t;
+
+static int countQueues(const char *ifname, const char *kind, const char *file)
+{
+#define BUFFLEN     128
+    char    path[BUFFLEN],
+            buff[BUFFLEN];
+    int     nb;
+
+    for ( nb = 0 ; ; nb++ )
+    {
+        snprintf(path, sizeof(path), SYSNET "/%s/queues/%s-%d/%s", ifname,
+                kind, nb, file);
+        if ( readLine(path, buff, sizeof(buff)) )
+            return nb;
+    }
+#undef BUFFLEN
+}
+
+static int compareIrq(const void *a, const void *b)
+{
+    return *(const int *) a - *(const int *) b;
+}
+
+static void listIrqs(const char *ifname, steering_dev_t *dev)
+{
+#define BUFFLEN     128
+    char            path[BUFFLEN];
+    struct dirent   *de;
+    DIR             *dir;
+
+    dev->nbIrqs = 0;
+
+    /* Only PCI devices have some, and they are not simulated
+     */
+    snprintf(path, sizeof(path), SYSNET "/%s/device/msi_irqs", ifname);
+    if ( kernelSimulated() || (dir = opendir(path)) == NULL )
+        return;
+
+    while ( (de = readdir(dir)) && dev->nbIrqs < IRQ_MAX )
+    {
+        if ( isdigit((unsigned char) de->d_name[0]) )
+            dev->irqs[dev->nbIrqs++] = atoi(de->d_name);
+    }
+
+    closedir(dir);
+
+    qsort(dev->irqs, dev->nbIrqs, sizeof(int), &compareIrq);
+#undef BUFFLEN
+}
+
+static int loadDevice(const char *ifname, steering_dev_t *dev)
+{
+#define BUFFLEN     128
+    char    path[BUFFLEN],
+            buff[BUFFLEN];
+
+    if ( ifname == NULL || strlen(ifname) >= IFNAMSIZ || strchr(ifname, '/') )
+        return -1;
+
+    snprintf(path, sizeof(path), SYSNET "/%s/device/numa_node", ifname);
+    dev->numa = readLine(path, buff, sizeof(buff)) ? -1 : atoi(buff);
+
+    dev->nbRx = countQueues(ifname, "rx", "rps_cpus");
+    dev->nbTx = countQueues(ifname, "tx", "tx_timeout");
+    listIrqs(ifname, dev);
+
+    return 0;
+#undef BUFFLEN
+}
+
+/* Union of the masks read from a series of files
+ */
+static void readMasks(const char *format, const char *ifname, const int *ids,
+        int nb, char *dest, size_t len)
+{
+#define BUFFLEN     128
+    char        path[BUFFLEN],
+                mask[MASKLEN];
+    cpu_set_t   all,
+                set;
+    int         i;
+
+    CPU_ZERO(&all);
+    for ( i = 0 ; i < nb ; i++ )
+    {
+        if ( ifname )
+            snprintf(path, sizeof(path), format, ifname, i);
+        else
+            snprintf(path, sizeof(path), format, ids[i]);
+
+        if ( readLine(path, mask, sizeof(mask)) == 0 &&
+                parseCpuMask(mask, &set) == 0 )
+            CPU_OR(&all, &all, &set);
+    }
+
+    formatCpuList(&all, dest, len);
+#undef BUFFLEN
+}
+
+int getInterfaceSteering(const char *ifname, steering_info_t *info)
+{
+#define BUFFLEN     128
+    steering_dev_t  *dev;
+    char            path[BUFFLEN],
+                    buff[BUFFLEN];
+    int             i;
+
+    if ( info == NULL || (dev = malloc(sizeof(*dev))) == NULL )
+        return -1;
+
+    if ( loadDevice(ifname, dev) )
+    {
+        free(dev);
+        return -1;
+    }
+
+    memset(info, 0, sizeof(*info));
+    snprintf(info->name, sizeof(info->name), "%s", ifname);
+    info->numa = dev->numa;
+    info->nbRx = dev->nbRx;
+    info->nbTx = dev->nbTx;
+    info->nbIrqs = dev->nbIrqs;
+
+    readMasks(SYSNET "/%s/queues/rx-%d/rps_cpus", ifname, NULL, dev->nbRx,
+            info->rps, sizeof(info->rps));
+    readMasks(SYSNET "/%s/queues/tx-%d/xps_cpus", ifname, NULL, dev->nbTx,
+            info->xps, sizeof(info->xps));
+    readMasks("/proc/irq/%d/smp_affinity", NULL, dev->irqs, dev->nbIrqs,
+            info->irq, sizeof(info->irq));
+
+    for ( i = 0 ; i < dev->nbRx ; i++ )
+    {
+        snprintf(path, sizeof(path), SYSNET "/%s/queues/rx-%d/rps_flow_cnt",
+                ifname, i);
+        if ( readLine(path, buff, sizeof(buff)) == 0 )
+            info->flows += strtoul(buff, NULL, 10);
+    }
+
+    free(dev);
+
+    return 0;
+#undef BUFFLEN
+}
+
+/* The CPUs of the policy, in order
+ */
+static int policyCpus(const steering_policy_t *policy, int numa, int *cpus)
+{
+#define BUFFLEN     1024
+    char        path[BUFFLEN],
+                buff[BUFFLEN];
+    cpu_set_t   set;
+    int         cpu,
+                n;
+
+    if ( policy->type == STEERING_EXPLICIT )
+    {
+        if ( parseCpuList(policy->cpus, &set) )
+            return -1;
+    }
+    else
+    {
+        snprintf(path, sizeof(path), SYSNODE "/node%d/cpulist", numa);
+        if ( (numa < 0 || readLine(path, buff, sizeof(buff))) &&
+                readLine(CPU_ONLINE, buff, sizeof(buff)) )
+            return -1;
+
+        if ( parseCpuList(buff, &set) )
+            return -1;
+    }
+
+    for ( cpu = n = 0 ; cpu < CPU_SETSIZE ; cpu++ )
+    {
+        if ( CPU_ISSET(cpu, &set) )
+            cpus[n++] = cpu;
+    }
+
+    return n;
+#undef BUFFLEN
+}
+
+/* Contiguous shares of the CPUs when they outnumber the queues, one CPU
+ * per queue otherwise
+ */
+static void placeQueue(const steering_policy_t *policy, const int *cpus,
+        int nbCpus, int q, int nb, cpu_set_t *set)
+{
+    int i;
+
+    CPU_ZERO(set);
+
+    if ( policy->type == STEERING_PACK || nb >= nbCpus )
+    {
+        CPU_SET(cpus[q % nbCpus], set);
+        return;
+    }
+
+    for ( i = q * nbCpus / nb ; i < (q + 1) * nbCpus / nb ; i++ )
+        CPU_SET(cpus[i], set);
+}
+
+static int updateFile(const char *path, const char *value)
+{
+#define BUFFLEN     MASKLEN
+    char        buff[BUFFLEN];
+    cpu_set_t   old,
+                new;
+
+    /* A file that cannot be read is a feature missing from the kernel,
+     * the masks are compared as sets as the kernel pads them with zeroes
+     */
+    if ( readLine(path, buff, sizeof(buff)) ||
+            strcmp(buff, value) == 0 ||
+            (parseCpuMask(buff, &old) == 0 && parseCpuMask(value, &new) == 0 &&
+             CPU_EQUAL(&old, &new)) )
+        return 0;
+
+    return writeLine(path, value) ? 1 : 0;
+#undef BUFFLEN
+}
+
+static int placeQueues(const steering_policy_t *policy, const int *cpus,
+        int nbCpus, const char *format, const char *ifname, const int *ids,
+        int nb)
+{
+#define BUFFLEN     128
+    char        path[BUFFLEN],
+                mask[MASKLEN];
+    cpu_set_t   set;
+    int         i,
+                ret = 0;
+
+    for ( i = 0 ; i < nb ; i++ )
+    {
+        if ( ifname )
+            snprintf(path, sizeof(path), format, ifname, i);
+        else
+            snprintf(path, sizeof(path), format, ids[i]);
+
+        placeQueue(policy, cpus, nbCpus, i, nb, &set);
+        formatCpuMask(&set, mask, sizeof(mask));
+        ret += updateFile(path, mask);
+    }
+
+    return ret;
+#undef BUFFLEN
+}
+
+/* The global table of RFS must hold the flows of every interface, it is
+ * only ever grown
+ */
+static int placeFlows(const char *ifname, unsigned flows, int nbRx)
+{
+#define BUFFLEN     128
+    char        path[BUFFLEN],
+                buff[BUFFLEN];
+    unsigned    entries = 0;
+    int         i,
+                ret = 0;
+
+    if ( flows == 0 || nbRx == 0 )
+        return 0;
+
+    if ( readLine(SOCK_FLOWS, buff, sizeof(buff)) == 0 )
+        entries = strtoul(buff, NULL, 10);
+
+    if ( entries < flows )
+    {
+        snprintf(buff, sizeof(buff), "%u", flows);
+        ret += writeLine(SOCK_FLOWS, buff) ? 1 : 0;
+    }
+
+    snprintf(buff, sizeof(buff), "%u", (flows + nbRx - 1) / nbRx);
+    for ( i = 0 ; i < nbRx ; i++ )
+    {
+        snprintf(path, sizeof(path), SYSNET "/%s/queues/rx-%d/rps_flow_cnt",
+                ifname, i);
+        ret += updateFile(path, buff);
+    }
+
+    return ret;
+#undef BUFFLEN
+}
+
+int setInterfaceSteering(const char *ifname, const steering_policy_t *policy)
+{
+    steering_dev_t  *dev;
+    int             *cpus = NULL,
+                    nbCpus,
+                    ret = -1;
+
+    if ( policy == NULL || (dev = malloc(sizeof(*dev))) == NULL )
+        return -1;
+
+    if ( loadDevice(ifname, dev) ||
+            (cpus = malloc(CPU_SETSIZE * sizeof(int))) == NULL )
+        goto out;
+
+    if ( (nbCpus = policyCpus(policy, dev->numa, cpus)) <= 0 )
+    {
+        fprintf(stderr, "%s: no CPU to steer to\n", ifname);
+        goto out;
+    }
+
+    ret = placeQueues(policy, cpus, nbCpus, SYSNET "/%s/queues/rx-%d/rps_cpus",
+            ifname, NULL, dev->nbRx);
+    ret += placeQueues(policy, cpus, nbCpus, SYSNET "/%s/queues/tx-%d/xps_cpus",
+            ifname, NULL, dev->nbTx);
+    ret += placeQueues(policy, cpus, nbCpus, "/proc/irq/%d/smp_affinity",
+            NULL, dev->irqs, dev->nbIrqs);
+    ret += placeFlows(ifname, policy->rfs, dev->nbRx);
+
+out:
+    free(cpus);
+    free(dev);
+
+    return ret;
+}
+
+int saveInterfaceSteering(const char *ifname, const steering_policy_t *policy)
+{
+    char    value[STEERING_CPULEN + 32];
+    int     ret;
+
+    if ( steeringFormat(policy, value, sizeof(value)) )
+        return -1;
+
+    if ( (ret = setInterfaceSteering(ifname, policy)) < 0 )
+        return -1;
+
+    if ( setInterfaceOption(ifname, STEERING_OPTION, value) )
+        return -1;
+
+    return ret;
+}
+
+static int restoreOne(const char *ifname, const char *value, void *user)
+{
+    steering_policy_t   policy;
+    int                 *failed = user,
+                        ret;
+
+    if ( steeringParse(value, &policy) ||
+            (ret = setInterfaceSteering(ifname, &policy)) < 0 )
+    {
+        fprintf(stderr, "%s: cannot restore the steering\n", ifname);
+        (*failed)++;
+    }
+    else
+        *failed += ret;
+
+    return 0;
+}
+
+int restoreSteering(void)
+{
+    int failed = 0;
+
+    if ( foreachInterfaceOption(STEERING_OPTION, &restoreOne, &failed) )
+        return -1;
+
+    return failed;
+}
@@ -0,0 +1,85 @@
+#ifndef __STEERING_H__
+#define __STEERING_H__
+
+#include "netconfig.h"
+#include "network.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/* Option of the interfaces stanzas keeping the policy of an interface
+ */
+#define STEERING_OPTION     "steering"
+
+#define STEERING_CPULEN     256
+
+enum
+{
+    STEERING_SPREAD = 0,
+    STEERING_PACK,
+    STEERING_EXPLICIT,
+};
+
+/* The CPUs are the ones of the NUMA node of the device, all the online
+ * ones when it has none, or the cpus list (e.g. 0-3,8) of an explicit
+ * policy. Queue q of n gets a contiguous share of them with spread, one
+ * of the first ones, q modulo their number, with pack. The same goes for
+ * the receive (RPS) and transmit (XPS) queues and the interrupts of the
+ * device. rfs, when not 0, is the number of flows of the interface for
+ * RFS, shared between its receive queues.
+ * Written "spread|pack|cpus <list> [rfs <flows>]".
+ */
+typedef struct steering_policy
+{
+    int         type;
+    char        cpus[STEERING_CPULEN];
+    unsigned    rfs;
+} steering_policy_t;
+
+/* Unions of the masks of the queues and interrupts, as CPU lists. numa is
+ * -1 when unknown.
+ */
+typedef struct steering_info
+{
+    char        name[IFNAMSIZ];
+    int         numa;
+    int         nbRx;
+    int         nbTx;
+    int         nbIrqs;
+    unsigned    flows;
+    char        rps[STEERING_CPULEN];
+    char        xps[STEERING_CPULEN];
+    char        irq[STEERING_CPULEN];
+} steering_info_t;
+
+NETCONFIG_API
+int steeringParse(const char *str, steering_policy_t *policy);
+
+NETCONFIG_API
+int steeringFormat(const steering_policy_t *policy, char *dest, size_t len);
+
+NETCONFIG_API
+int getInterfaceSteering(const char *ifname, steering_info_t *info);
+
+/* Every mask file is written once, and only when it changes. Returns the
+ * number of files that could not be written or -1 on error.
+ */
+NETCONFIG_API
+int setInterfaceSteering(const char *ifname, const steering_policy_t *policy);
+
+/* Applies the policy then records it in the stanza of the interface
+ */
+NETCONFIG_API
+int saveInterfaceSteering(const char *ifname, const steering_policy_t *policy);
+
+/* Applies the policies recorded in the interfaces file
+ */
+NETCONFIG_API
+int restoreSteering(void);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __STEERING_H__ */
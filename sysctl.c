@@ -0,0 +1,508 @@
+#include "sysctl.h"
+#include "kernel.h"
+
+/* See man (5) sysctl.conf and Documentation/admin-guide/sysctl of the
+ * kernel
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define PROCSYS         "/proc/sys"
+#define SYSCTL_TMP      SYSCTL_CONF ".tmp"
+
+/* The directory of the last key stays open, the keys of a directory
+ * following each other. fd is -1 for a directory that cannot be opened,
+ * error telling why.
+ */
+typedef struct sysctl_dir
+{
+    int     root;
+    int     fd;
+    int     error;
+    char    path[SYSCTL_KEYLEN];
+} sysctl_dir_t;
+
+static int entryPath(sysctl_entry_t *entry)
+{
+    char    *p;
+
+    while ( *entry->key == '.' || *entry->key == '/' )
+        memmove(entry->key, entry->key + 1, strlen(entry->key));
+
+    if ( *entry->key == '\0' || strstr(entry->key, "..") )
+        return -1;
+
+    strcpy(entry->path, entry->key);
+    if ( strchr(entry->path, '/') == NULL )
+    {
+        for ( p = entry->path ; (p = strchr(p, '.')) ; p++ )
+            *p = '/';
+    }
+
+    entry->leaf = (p = strrchr(entry->path, '/')) ? p - entry->path + 1 : 0;
+
+    return 0;
+}
+
+/* By directory then by name
+ */
+static int entryCompare(const sysctl_entry_t *a, const sysctl_entry_t *b)
+{
+    size_t  len = a->leaf < b->leaf ? a->leaf : b->leaf;
+    int     ret;
+
+    if ( (ret = strncmp(a->path, b->path, len ? len - 1 : 0)) )
+        return ret;
+
+    if ( a->leaf != b->leaf )
+        return a->leaf < b->leaf ? -1 : 1;
+
+    return strcmp(a->path + a->leaf, b->path + b->leaf);
+}
+
+int sysctlProfileSet(sysctl_profile_t *profile, const char *key,
+        const char *value)
+{
+    sysctl_entry_t  entry,
+                    *entries;
+    size_t          first = 0,
+                    last,
+                    middle;
+    int             ret = 1;
+
+    if ( profile == NULL || key == NULL || value == NULL ||
+            strlen(key) >= SYSCTL_KEYLEN || strlen(value) >= SYSCTL_VALUELEN )
+        return -1;
+
+    memset(&entry, 0, sizeof(entry));
+    if ( *key == '-' )
+    {
+        entry.ignore = 1;
+        for ( key++ ; isspace((unsigned char) *key) ; key++ )
+            ;
+    }
+    strcpy(entry.key, key);
+    strcpy(entry.value, value);
+    if ( entryPath(&entry) )
+        return -1;
+
+    /* Kept sorted, a key given again replaces the value
+     */
+    for ( last = profile->nb ; first < last ; )
+    {
+        middle = (first + last) / 2;
+        if ( (ret = entryCompare(&entry, &profile->entries[middle])) == 0 )
+            break;
+        else if ( ret < 0 )
+            last = middle;
+        else
+            first = middle + 1;
+    }
+
+    if ( ret == 0 )
+    {
+        profile->entries[middle] = entry;
+        return 0;
+    }
+
+    if ( profile->nb == profile->size )
+    {
+        size_t  size = profile->size ? profile->size * 2 : 64;
+
+        if ( (entries = realloc(profile->entries, size * sizeof(*entries))) == NULL )
+            return -1;
+
+        profile->entries = entries;
+        profile->size = size;
+    }
+
+    memmove(profile->entries + first + 1, profile->entries + first,
+            (profile->nb - first) * sizeof(*profile->entries));
+    profile->entries[first] = entry;
+    profile->nb++;
+
+    return 0;
+}
+
+static char *trim(char *str)
+{
+    char    *end;
+
+    while ( isspace((unsigned char) *str) )
+        str++;
+
+    for ( end = str + strlen(str) ; end > str && isspace((unsigned char) end[-1]) ; end-- )
+        ;
+    *end = '\0';
+
+    return str;
+}
+
+int sysctlProfileLoad(const char *path, sysctl_profile_t *profile)
+{
+#define BUFFLEN     (SYSCTL_KEYLEN + SYSCTL_VALUELEN + 16)
+    char    buff[BUFFLEN],
+            *key,
+            *value;
+    FILE    *file;
+    int     line = 0,
+            ret = 0;
+
+    if ( path == NULL || profile == NULL )
+        return -1;
+
+    memset(profile, 0, sizeof(*profile));
+
+    if ( (file = kernelOpen(path, "r")) == NULL )
+    {
+        perror(path);
+        return -1;
+    }
+
+    while ( ret == 0 && fgets(buff, sizeof(buff), file) )
+    {
+        line++;
+
+        key = trim(buff);
+        if ( *key == '\0' || *key == '#' || *key == ';' )
+            continue;
+
+        if ( (value = strchr(key, '=')) == NULL )
+        {
+            fprintf(stderr, "%s:%d: no value\n", path, line);
+            ret = -1;
+            break;
+        }
+
+        *value++ = '\0';
+        if ( sysctlProfileSet(profile, trim(key), trim(value)) )
+        {
+            fprintf(stderr, "%s:%d: invalid key or value\n", path, line);
+            ret = -1;
+        }
+    }
+
+    fclose(file);
+
+    if ( ret )
+        sysctlProfileFree(profile);
+
+    return ret;
+#undef BUFFLEN
+}
+
+void sysctlProfileFree(sysctl_profile_t *profile)
+{
+    if ( profile == NULL )
+        return;
+
+    free(profile->entries);
+    memset(profile, 0, sizeof(*profile));
+}
+
+/* Word by word, "4096 131072" is "4096\t131072\n"
+ */
+static int sameValue(const char *a, const char *b)
+{
+    for ( ;; )
+    {
+        while ( isspace((unsigned char) *a) )
+            a++;
+        while ( isspace((unsigned char) *b) )
+            b++;
+
+        if ( *a == '\0' || *b == '\0' )
+            return *a == *b;
+
+        for ( ; *a && !isspace((unsigned char) *a) ; a++, b++ )
+        {
+            if ( *a != *b )
+                return 0;
+        }
+
+        if ( *b && !isspace((unsigned char) *b) )
+            return 0;
+    }
+}
+
+static int readFd(int fd, char *dest, size_t len)
+{
+    ssize_t n;
+
+    if ( (n = pread(fd, dest, len - 1, 0)) < 0 )
+        return -1;
+
+    dest[n] = '\0';
+
+    return 0;
+}
+
+/* A read-only key is opened for reading, it only fails if it differs
+ */
+static int openEntry(sysctl_dir_t *dir, const sysctl_entry_t *entry,
+        int *readOnly)
+{
+    int     fd;
+
+    if ( strlen(dir->path) + 1 != entry->leaf ||
+            strncmp(dir->path, entry->path, entry->leaf - 1) )
+    {
+        if ( dir->fd >= 0 )
+            close(dir->fd);
+
+        snprintf(dir->path, sizeof(dir->path), "%.*s",
+                entry->leaf ? (int) entry->leaf - 1 : 1,
+                entry->leaf ? entry->path : ".");
+        dir->fd = openat(dir->root, dir->path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        dir->error = errno;
+    }
+
+    if ( dir->fd < 0 )
+    {
+        errno = dir->error;
+        return -1;
+    }
+
+    *readOnly = 0;
+    if ( (fd = openat(dir->fd, entry->path + entry->leaf, O_RDWR | O_CLOEXEC)) < 0 &&
+            errno == EACCES )
+    {
+        *readOnly = 1;
+        fd = openat(dir->fd, entry->path + entry->leaf, O_RDONLY | O_CLOEXEC);
+    }
+
+    return fd;
+}
+
+/* A key missing or denied is skipped when its failures are ignored
+ */
+static int ignoreEntry(const sysctl_entry_t *entry, int error)
+{
+    return entry->ignore && (error == ENOENT || error == EACCES);
+}
+
+/* Returns 0 when the value was there, 1 when written, 2 when skipped or -1
+ */
+static int applyEntry(sysctl_dir_t *dir, const sysctl_entry_t *entry)
+{
+#define BUFFLEN     (SYSCTL_VALUELEN + 16)
+    char    buff[BUFFLEN];
+    size_t  len = strlen(entry->value);
+    int     fd,
+            readOnly,
+            ret = -1;
+
+    if ( (fd = openEntry(dir, entry, &readOnly)) < 0 )
+    {
+        if ( ignoreEntry(entry, errno) )
+            return 2;
+        perror(entry->key);
+        return -1;
+    }
+
+    if ( readFd(fd, buff, sizeof(buff)) )
+        perror(entry->key);
+    else if ( sameValue(buff, entry->value) )
+        ret = 0;
+    else if ( readOnly && ignoreEntry(entry, EACCES) )
+        ret = 2;
+    else if ( readOnly )
+        fprintf(stderr, "%s: read-only\n", entry->key);
+    else if ( pwrite(fd, entry->value, len, 0) != (ssize_t) len )
+        perror(entry->key);
+    else if ( readFd(fd, buff, sizeof(buff)) )
+        perror(entry->key);
+    else if ( !sameValue(buff, entry->value) )
+    {
+        buff[strcspn(buff, "\n")] = '\0';
+        fprintf(stderr, "%s: wrote %s, reads %s\n", entry->key, entry->value, buff);
+    }
+    else
+        ret = 1;
+
+    close(fd);
+
+    return ret;
+#undef BUFFLEN
+}
+
+static int readFile(const char *path, char *dest, size_t len)
+{
+    FILE    *file;
+    int     ret;
+
+    if ( (file = kernelOpen(path, "r")) == NULL )
+        return -1;
+
+    *dest = '\0';
+    ret = fgets(dest, len, file) == NULL && ferror(file);
+    fclose(file);
+
+    return ret ? -1 : 0;
+}
+
+/* The same through the files of the backend, for the simulation
+ */
+static int applyFile(const sysctl_entry_t *entry)
+{
+#define BUFFLEN     (SYSCTL_VALUELEN + 16)
+    char    path[sizeof(PROCSYS) + SYSCTL_KEYLEN],
+            buff[BUFFLEN];
+    FILE    *file;
+    int     ret;
+
+    snprintf(path, sizeof(path), PROCSYS "/%s", entry->path);
+
+    if ( readFile(path, buff, sizeof(buff)) )
+    {
+        if ( ignoreEntry(entry, errno) )
+            return 2;
+        perror(entry->key);
+        return -1;
+    }
+
+    if ( sameValue(buff, entry->value) )
+        return 0;
+
+    if ( (file = kernelOpen(path, "w")) == NULL )
+    {
+        if ( ignoreEntry(entry, errno) )
+            return 2;
+        perror(entry->key);
+        return -1;
+    }
+
+    ret = fprintf(file, "%s\n", entry->value) < 0;
+    if ( fclose(file) || ret || readFile(path, buff, sizeof(buff)) )
+    {
+        perror(entry->key);
+        return -1;
+    }
+
+    if ( !sameValue(buff, entry->value) )
+    {
+        buff[strcspn(buff, "\n")] = '\0';
+        fprintf(stderr, "%s: wrote %s, reads %s\n", entry->key, entry->value, buff);
+        return -1;
+    }
+
+    return 1;
+#undef BUFFLEN
+}
+
+int applySysctlProfile(const sysctl_profile_t *profile, sysctl_stats_t *stats)
+{
+    sysctl_stats_t  local;
+    sysctl_dir_t    dir = { -1, -1, 0, "" };
+    size_t          i;
+    int             simulated = kernelSimulated();
+
+    if ( profile == NULL )
+        return -1;
+
+    if ( stats == NULL )
+        stats = &local;
+    memset(stats, 0, sizeof(*stats));
+
+    if ( !simulated &&
+            (dir.root = open(PROCSYS, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0 )
+    {
+        perror(PROCSYS);
+        return -1;
+    }
+
+    for ( i = 0 ; i < profile->nb ; i++ )
+    {
+        switch ( simulated ? applyFile(&profile->entries[i]) :
+                applyEntry(&dir, &profile->entries[i]) )
+        {
+            case 0:
+            stats->same++;
+            break;
+
+            case 1:
+            stats->changed++;
+            break;
+
+            case 2:
+            stats->ignored++;
+            break;
+
+            default:
+            stats->failed++;
+            break;
+        }
+    }
+
+    if ( dir.fd >= 0 )
+        close(dir.fd);
+    if ( dir.root >= 0 )
+        close(dir.root);
+
+    return stats->failed;
+}
+
+int saveSysctlProfile(const sysctl_profile_t *profile)
+{
+    FILE    *file;
+    size_t  i;
+    int     ret;
+
+    if ( profile == NULL )
+        return -1;
+
+    if ( (file = kernelOpen(SYSCTL_TMP, "w")) == NULL )
+    {
+        perror(SYSCTL_TMP);
+        return -1;
+    }
+
+    for ( i = 0 ; i < profile->nb ; i++ )
+        fprintf(file, "%s%s = %s\n", profile->entries[i].ignore ? "-" : "",
+                profile->entries[i].key, profile->entries[i].value);
+
+    ret = ferror(file);
+    if ( fclose(file) || ret )
+    {
+        perror(SYSCTL_TMP);
+        return -1;
+    }
+
+    if ( kernelRename(SYSCTL_TMP, SYSCTL_CONF) )
+    {
+        perror("rename");
+        return -1;
+    }
+
+    return 0;
+}
+
+int restoreSysctl(sysctl_stats_t *stats)
+{
+    sysctl_profile_t    profile;
+    FILE                *file;
+    int                 ret;
+
+    if ( stats )
+        memset(stats, 0, sizeof(*stats));
+
+    /* Nothing saved, nothing to do
+     */
+    if ( (file = kernelOpen(SYSCTL_CONF, "r")) == NULL )
+        return 0;
+    fclose(file);
+
+    if ( sysctlProfileLoad(SYSCTL_CONF, &profile) )
+        return -1;
+
+    ret = applySysctlProfile(&profile, stats);
+    sysctlProfileFree(&profile);
+
+    return ret;
+}
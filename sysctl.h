@@ -0,0 +1,85 @@
+#ifndef __SYSCTL_H__
+#define __SYSCTL_H__
+
+#include "netconfig.h"
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/* Profile kept with the interfaces file
+ */
+#define SYSCTL_CONF         "/mnt/boot/conf/sysctl.conf"
+
+#define SYSCTL_KEYLEN       128
+#define SYSCTL_VALUELEN     256
+
+/* key is written as in sysctl.conf, net.core.somaxconn, or as a path under
+ * /proc/sys when it holds a '/', net/ipv4/conf/eth0.100/rp_filter. A
+ * leading - sets ignore : as for sysctl(8), a key missing or denied is
+ * then skipped rather than failed.
+ */
+typedef struct sysctl_entry
+{
+    char    key[SYSCTL_KEYLEN];
+    char    value[SYSCTL_VALUELEN];
+    char    path[SYSCTL_KEYLEN];
+    size_t  leaf;
+    int     ignore;
+} sysctl_entry_t;
+
+/* The entries are sorted by directory, a key given twice keeps its last
+ * value
+ */
+typedef struct sysctl_profile
+{
+    sysctl_entry_t  *entries;
+    size_t          nb;
+    size_t          size;
+} sysctl_profile_t;
+
+typedef struct sysctl_stats
+{
+    unsigned    same;
+    unsigned    changed;
+    unsigned    failed;
+    unsigned    ignored;
+} sysctl_stats_t;
+
+/* Reads "key = value" lines, # and ; start comments as in sysctl.conf
+ */
+NETCONFIG_API
+int sysctlProfileLoad(const char *path, sysctl_profile_t *profile);
+
+NETCONFIG_API
+int sysctlProfileSet(sysctl_profile_t *profile, const char *key,
+        const char *value);
+
+NETCONFIG_API
+void sysctlProfileFree(sysctl_profile_t *profile);
+
+/* One pass over /proc/sys : the directories are opened once, a value is
+ * written only when it differs, then read back. Values are compared word
+ * by word, whatever the blanks. Returns the number of keys that failed or
+ * -1 on error, stats may be NULL.
+ */
+NETCONFIG_API
+int applySysctlProfile(const sysctl_profile_t *profile, sysctl_stats_t *stats);
+
+/* Writes the profile to SYSCTL_CONF
+ */
+NETCONFIG_API
+int saveSysctlProfile(const sysctl_profile_t *profile);
+
+/* Applies SYSCTL_CONF, if any
+ */
+NETCONFIG_API
+int restoreSysctl(sysctl_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __SYSCTL_H__ */
@@ -0,0 +1,69 @@
+#!/bin/sh
+#
+# Probes the gateways of 500 veth pairs at once. The peers answer ARP
+# from a responder namespace : every gateway must be reachable, and the
+# whole run must end within one timeout. Needs root, runs in a network
+# namespace of its own.
+#
+#   tests/probe.sh [<save>]
+#
+
+NB=500
+TIMEOUT=2000
+
+if [ "$(id -u)" != 0 ] ; then
+    echo "skip probe.sh: needs root"
+    exit 0
+fi
+
+SAVE=$(realpath "${1:-./save}")
+
+if [ -z "$PROBE_NETNS" ] ; then
+    PROBE_NETNS=1 exec unshare -n "$0" "$SAVE"
+fi
+
+DIR=$(mktemp -d)
+unshare -n sleep 600 &
+RESPONDER=$!
+
+trap 'kill $RESPONDER ; rm -rf "$DIR"' EXIT
+
+# One /30 per pair, the responder end is the gateway
+i=1
+while [ $i -le $NB ] ; do
+    net=10.$((i / 64)).$((i % 64 * 4))
+    echo "add veth:a$i:b$i:$RESPONDER" >> "$DIR/links"
+    echo "addr add $net.1/30 dev a$i" >> "$DIR/local"
+    echo "link set a$i up" >> "$DIR/local"
+    echo "route add default via $net.2 dev a$i metric $i" >> "$DIR/local"
+    echo "addr add $net.2/30 dev b$i" >> "$DIR/responder"
+    echo "link set b$i up" >> "$DIR/responder"
+    i=$((i + 1))
+done
+
+# The responder is ready once out of our namespace
+while [ "$(readlink /proc/$RESPONDER/ns/net)" = "$(readlink /proc/self/ns/net)" ] ; do
+    sleep 0.01
+done
+
+if ! "$SAVE" --link-file "$DIR/links" > /dev/null ||
+        ! ip -batch "$DIR/local" ||
+        ! nsenter -t $RESPONDER -n ip -batch "$DIR/responder" ||
+        ! "$SAVE" --up $(sed 's/.*veth:\([^:]*\):.*/\1/' "$DIR/links") > /dev/null ; then
+    echo "FAIL probe.sh: setup"
+    exit 1
+fi
+
+start=$(date +%s%N)
+"$SAVE" --probe -c -a --timeout $TIMEOUT > "$DIR/csv"
+ms=$(( ($(date +%s%N) - start) / 1000000 ))
+
+# reach is the last but one column
+reached=$(awk -F, '$1 ~ /^a[0-9]+$/ && $(NF - 1) == 1' "$DIR/csv" | wc -l)
+
+if [ "$reached" -ne $NB ] || [ $ms -ge $TIMEOUT ] ; then
+    echo "FAIL probe.sh: $reached of $NB gateways reached in $ms ms"
+    exit 1
+fi
+
+echo "ok   probe.sh: $NB gateways reached in $ms ms"
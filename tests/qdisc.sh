@@ -0,0 +1,104 @@
+#!/bin/sh
+#
+# Sets, saves and restores root qdiscs on a dummy link and on a veth with
+# four transmit queues. fq and fq_codel are used when the kernel has them,
+# pfifo and bfifo else. Needs root, runs in network and mount namespaces
+# of its own with the interfaces file on a tmpfs.
+#
+#   tests/qdisc.sh [<save>]
+#
+
+if [ "$(id -u)" != 0 ] ; then
+    echo "skip qdisc.sh: needs root"
+    exit 0
+fi
+
+SAVE=$(realpath "${1:-./save}")
+
+if [ -z "$QDISC_NETNS" ] ; then
+    QDISC_NETNS=1 exec unshare -n -m "$0" "$SAVE"
+fi
+
+FAILED=0
+
+mount -t tmpfs none /mnt && mkdir -p /mnt/boot/conf || exit 1
+
+ip link add v0 numtxqueues 4 type veth peer name p0 numtxqueues 4 &&
+    ip link set v0 up && ip link set p0 up || exit 1
+
+LINKS=v0
+if "$SAVE" --link-add dummy:d0 > /dev/null 2>&1 && ip link set d0 up ; then
+    LINKS="d0 v0"
+else
+    echo "note qdisc.sh: no dummy driver, veth only"
+fi
+
+if tc qdisc replace dev p0 root fq > /dev/null 2>&1 ; then
+    ROOT="fq maxrate 125000 pacing on"
+else
+    ROOT="pfifo"
+fi
+
+if tc qdisc replace dev p0 root fq_codel > /dev/null 2>&1 ; then
+    MQ="mq fq_codel target 5000 ecn on"
+else
+    MQ="mq bfifo"
+fi
+
+# <what> <command>...
+check()
+{
+    what=$1
+    shift
+
+    if "$@" ; then
+        echo "ok   qdisc.sh: $what"
+    else
+        echo "FAIL qdisc.sh: $what"
+        FAILED=$((FAILED + 1))
+    fi
+}
+
+# <interface> <qdisc> : the interfaces file records it as set, the CSV shows
+# the kernel's dump of it, which holds every parameter of the kind
+shown()
+{
+    csv=$("$SAVE" -c --qdisc "$1" 2> /dev/null | sed -n '2s/.*,"\(.*\)"$/\1/p')
+
+    sed -n "/^iface $1 /,/^auto\|^iface/p" /mnt/boot/conf/interfaces |
+        grep -qx "	qdisc $2" || return 1
+
+    set -- $2
+    case "$1" in mq) kind="$1 $2" ; shift ;; *) kind=$1 ;; esac
+    shift
+    case "$csv " in "$kind "*) ;; *) return 1 ;; esac
+
+    while [ $# -ge 2 ] ; do
+        case "$csv " in *" $1 $2 "*) ;; *) return 1 ;; esac
+        shift 2
+    done
+}
+
+# <interface> <kind> <n> : n children of the mq root
+children()
+{
+    [ "$(tc qdisc show dev "$1" | grep -c "^qdisc $2 .* parent ")" -eq "$3" ]
+}
+
+for link in $LINKS ; do
+    check "$link $ROOT" "$SAVE" --qdisc-set "$ROOT" $link
+    check "$link shows $ROOT" shown $link "$ROOT"
+done
+
+check "v0 $MQ" "$SAVE" --qdisc-set "$MQ" v0
+check "v0 shows $MQ" shown v0 "$MQ"
+check "v0 has 4 children" children v0 "${MQ#mq }" 4
+
+tc qdisc del dev v0 root
+check "restore" "$SAVE" --qdisc-restore
+check "v0 restored $MQ" shown v0 "$MQ"
+
+check "refused" eval '! "$SAVE" --qdisc-set nosuchqdisc v0 2> /dev/null'
+check "refused not recorded" shown v0 "$MQ"
+
+exit $FAILED
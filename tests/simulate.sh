@@ -0,0 +1,42 @@
+#!/bin/sh
+#
+# Runs save on the in-memory kernel of the seeds of tests/simulate, see
+# fakekernel.h, and compares what it prints with the expected output.
+# Needs no root.
+#
+#   tests/simulate.sh [<save>]
+#
+
+SAVE=${1:-./save}
+DIR=$(dirname "$0")/simulate
+OUT=$(mktemp)
+FAILED=0
+
+trap 'rm -f "$OUT"' EXIT
+
+# <expected> <seed> <arguments>...
+check()
+{
+    expected=$1
+    seed=$2
+    shift 2
+
+    if "$SAVE" --simulate "$DIR/$seed" "$@" > "$OUT" 2> /dev/null &&
+            diff -u "$DIR/$expected" "$OUT" ; then
+        echo "ok   $expected"
+    else
+        echo "FAIL $expected"
+        FAILED=$((FAILED + 1))
+    fi
+}
+
+check csv.out           basic.seed -c -a
+check csv-eth3.out      basic.seed -c eth3
+check save.out          basic.seed -a
+check where.out         basic.seed --where "down and ip in 10.0.0.0/8"
+check where-gw.out      basic.seed --where "gw in 10.0.0.0/8 or name == eth0"
+check routes.out        basic.seed --routes
+check routes-csv.out    basic.seed --routes -c eth3
+check routes-json.out   basic.seed --routes --json
+
+exit $FAILED
@@ -0,0 +1,63 @@
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+/* Static probes of the netconfig provider, for perf or bpftrace on a live
+ * process :
+ *
+ *  bpftrace -e 'usdt:./libnetconfig.so:netconfig:exit
+ *      { printf("%s %s %d\n", str(arg0), str(arg1), arg2); }'
+ *
+ * They are built with `make SDT=1`, which needs sys/sdt.h (systemtap-sdt),
+ * otherwise they are compiled out and their arguments never evaluated.
+ *
+ *  entry(func, ifname)                 a public function of network.h or
+ *  exit(func, ifname, ret)             dhcp.h, ifname may be NULL, ret is
+ *                                      a long even for a pointer
+ *  ioctl_start(request, arg)           arg is the struct ifreq, whose name
+ *  ioctl_done(request, arg, ret)       comes first, of most requests
+ *  netlink_start(bytes, messages)      a batch sent...
+ *  netlink_done(bytes, ret)            ...and the bytes of all its answers
+ *  file_write(ifname, path, bytes)     the interfaces file is rewritten...
+ *  file_rename(ifname, path, ret)      ...then renamed over the old one
+ */
+
+#ifdef HAVE_SDT
+
+#include <sys/sdt.h>
+
+#define TRACE_PROBE2(name, a, b) \
+    DTRACE_PROBE2(netconfig, name, a, b)
+
+#define TRACE_PROBE3(name, a, b, c) \
+    DTRACE_PROBE3(netconfig, name, a, b, c)
+
+/* Keeps the name for the exit probes of the function, so that they
+ * read return TRACE_RETURN(ret)
+ */
+#define TRACE_ENTRY(ifname) \
+    const char *_traceName = (ifname); \
+    TRACE_PROBE2(entry, (const char *) __func__, _traceName)
+
+#define TRACE_EXIT(ret) \
+    TRACE_PROBE3(exit, (const char *) __func__, _traceName, (long) (ret))
+
+#define TRACE_RETURN(ret) \
+    __extension__ ({ \
+        __typeof__(ret) _traceRet = (ret); \
+        TRACE_EXIT(_traceRet); \
+        _traceRet; \
+    })
+
+#else
+
+#define TRACE_PROBE2(name, a, b)        do { } while ( 0 )
+#define TRACE_PROBE3(name, a, b, c)     do { } while ( 0 )
+#define TRACE_ENTRY(ifname)             do { } while ( 0 )
+#define TRACE_EXIT(ret)                 do { } while ( 0 )
+#define TRACE_RETURN(ret)               (ret)
+
+#endif /* HAVE_SDT */
+
+#define TRACE_IFR(ifr)      ((ifr) ? (ifr)->ifr_name : NULL)
+
+#endif /* __TRACE_H__ */